@@ -45,4 +45,157 @@
 #define SERIAL_READING_TIMEOUT  500                 
 
 // How long it should take to read all the data/lines [seconds]
-#define MAX_METER_READ_TIME  60                     
+#define MAX_METER_READ_TIME  60
+
+// ADJUSTME: Uncomment to use the built-in timings of known meters (see profiles.cpp) and narrow them down from the observed
+//           response times. Only the timings still at the values above are tuned, one set by a downlink is kept as it is.
+//#define AUTO_TUNE_TIMINGS
+
+
+// ADJUSTME: Uncomment to read the load profile (P.01) in programming mode instead of the normal data readout.
+//           The node then only wakes every LOAD_PROFILE_SLEEP_TIME and uplinks all intervals recorded since the last readout.
+//#define LOAD_PROFILE_READOUT
+
+// How often to fetch the load profile [ms]
+#define LOAD_PROFILE_SLEEP_TIME 7200000
+
+// ADJUSTME: Recording period of the meter's load profile [minutes]
+#define LOAD_PROFILE_INTERVAL 15
+
+// Max number of load profile entries fetched per readout (8 entries with 2 channels still fit into a DR0 uplink)
+#define MAX_LOAD_PROFILE_ENTRIES 8
+
+// LoRaWAN port used for the load profile uplinks
+#define LOAD_PROFILE_APP_PORT 3
+
+// ADJUSTME: OBIS values of the meter's clock, used to find where to start reading the load profile and for the day/night split
+#define OBIS_VALUE_TIME "0.9.1"
+#define OBIS_VALUE_DATE "0.9.2"
+
+// Size of the emulated EEPROM used to persist data across resets [bytes]
+#define EEPROM_SIZE 1024
+
+// Number of readings kept in the flash journal while LoRaWAN is unavailable (16 bytes each)
+#define JOURNAL_RECORDS 48
+
+// Start of the flash journal within the EEPROM
+#define JOURNAL_EEPROM_OFFSET 0
+
+// LoRaWAN port used to send buffered readings in batches
+#define JOURNAL_APP_PORT 5
+
+// Start of the persisted settings within the EEPROM (after the journal)
+#define SETTINGS_EEPROM_OFFSET 832
+
+// LoRaWAN port on which configuration commands are received
+#define SETTINGS_DOWNLINK_PORT 10
+
+// ADJUSTME: Number of meters read by this node. With more than one meter the optical heads share Serial1
+//           through an analog multiplexer (e.g. 74HC4051) and are read one after another.
+#define METER_COUNT 1
+
+// ADJUSTME: Multiplexer select pins, the first pin is the lowest bit of the channel number
+#define MUX_SELECT_PINS { GPIO1, GPIO2, GPIO3 }
+
+// How long the multiplexer needs after switching the channel [ms]
+#define MUX_SETTLE_TIME 5
+
+// LoRaWAN port used for the readings of several meters
+#define MULTI_METER_APP_PORT 6
+
+// How long the optical head is powered before the request is sent after an unanswered request, the warm-up
+// otherwise starts at MIN_HEAD_WARM_UP_TIME and grows by how much later than usual the meter answers [ms]
+#define HEAD_WARM_UP_TIME 50
+#define MIN_HEAD_WARM_UP_TIME 5
+#define MAX_HEAD_WARM_UP_TIME 500
+
+// ADJUSTME: Uncomment to append the average power, peak and day/night energy to the port 2 uplink
+//#define DERIVED_METRICS
+
+// ADJUSTME: Night tariff window of your meter (meter clock, full hours), used to split the consumption into day and night
+#define NIGHT_TARIFF_START 22
+#define NIGHT_TARIFF_END 6
+
+// ADJUSTME: Current draw of the parts of the node, used to estimate the battery life [uA]
+#define SLEEP_CURRENT_UA 20
+#define ACTIVE_CURRENT_UA 12000
+#define HEAD_CURRENT_UA 3000
+#define TX_CURRENT_UA 90000
+#define RX_CURRENT_UA 6000
+
+// ADJUSTME: Capacity of the battery [mAh]
+#define BATTERY_CAPACITY_MAH 1200
+
+// ADJUSTME: Uncomment to adapt the wake interval instead of always sleeping the configured sleep time. It shrinks while the power
+//           keeps changing between readings, grows while it is flat and is stretched if the battery wouldn't last BATTERY_TARGET_LIFE.
+//#define ADAPTIVE_WAKE
+
+// ADJUSTME: How long the battery should last from the first boot (or from when a fresh battery was put in) [days]
+#define BATTERY_TARGET_LIFE 365
+
+// The days of BATTERY_TARGET_LIFE that passed, persisted within the EEPROM (after the settings)
+#define BUDGET_EEPROM_OFFSET 976
+
+// Bounds of the adaptive wake interval and the step it is rounded to (also the grid of the aligned wakes) [ms]
+#define MIN_WAKE_INTERVAL 300000
+#define MAX_WAKE_INTERVAL 3600000
+#define WAKE_INTERVAL_STEP 300000
+
+// Smoothed power change between readings above which the interval shrinks, below which it grows [permille]
+#define VOLATILE_POWER_CHANGE 250
+#define FLAT_POWER_CHANGE 50
+
+// ADJUSTME: Uncomment to wake on the boundaries of the sleep time (e.g. every full quarter hour) instead of sleeping a fixed time.
+//           The wall time comes from the meter clock (OBIS_VALUE_TIME/OBIS_VALUE_DATE) and optionally the network.
+//#define ALIGNED_WAKE
+
+// Wake this long before the boundary, the meter sends its registers a few seconds after the request [s]
+#define ALIGNED_WAKE_LEAD 2
+
+// Upper limit of the node clock drift that is accepted as such, larger differences are clock jumps [ppm]
+#define MAX_CLOCK_DRIFT_PPM 500
+
+// ADJUSTME: Uncomment to ask the network for the time (DeviceTimeReq) while the meter clock isn't available.
+//           Needs a LoRaMac with LoRaWAN 1.0.3 support.
+//#define DEVICE_TIME_REQUEST
+
+// ADJUSTME: Uncomment to have the first boot (and the first wake after a press of the user button) probe the likely
+//           serial settings and store those the meter answers to, together with its manufacturer code.
+//           Otherwise PARITY_SETTING, INITIAL_BAUD_RATE and METER_IDENTIFIER are used as they are.
+//#define SERIAL_DISCOVERY
+
+// ADJUSTME: Uncomment to turn ADR off and have the node pick the data rate and TX power itself from the RSSI/SNR of the
+//           downlinks and acks, and batch readings at the slow data rates. Otherwise they are left to the network (LORAWAN_ADR).
+//#define LINK_ADAPTATION
+
+// Margin over the demodulation floor the chosen data rate and TX power have to keep [dB]
+#define LINK_MARGIN 10
+
+// Share of the confirmed uplinks that should be acknowledged, below it lost uplinks keep widening the margin [permille]
+#define LINK_TARGET_DELIVERY 950
+
+// How often an uplink is sent confirmed to measure the link, even if the uplinks are unconfirmed otherwise [s]
+#define LINK_PROBE_INTERVAL 86400
+
+// Without a measurement for this long the link is unknown again and LINK_FALLBACK_DATA_RATE is used [s]
+#define LINK_STALE_TIME 259200
+#define LINK_FALLBACK_DATA_RATE 0
+
+// Most readings held back for a batch at the slow data rates (sent through the journal, port 5)
+#define LINK_MAX_BATCH 4
+
+// ADJUSTME: Uncomment to have a downlink on DIAGNOSTIC_APP_PORT (0x01) capture the next readout raw, the telegram is then sent
+//           compressed in fragments on the same port in between the readings.
+//#define DIAGNOSTIC_CAPTURE
+
+// The id of the last capture, persisted within the EEPROM (after the battery budget)
+#define DIAGNOSTIC_EEPROM_OFFSET 982
+
+// Raw bytes kept of the captured readout, the rest of a longer telegram is cut off
+#define DIAGNOSTIC_CAPTURE_SIZE 1024
+
+// LoRaWAN port of the capture request (downlink) and the fragments (uplinks)
+#define DIAGNOSTIC_APP_PORT 7
+
+// Sleep between two fragments, a full DR0 uplink needs this long to stay within the 1% duty cycle [ms]
+#define DIAGNOSTIC_FRAGMENT_INTERVAL 300000
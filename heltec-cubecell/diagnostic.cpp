@@ -0,0 +1,125 @@
+#include "diagnostic.h"
+#include "logger.h"
+#include "EEPROM.h"
+
+static size_t const WINDOW_SIZE = 1 << LZSS_OFFSET_BITS;
+static size_t const MAX_MATCH = LZSS_MIN_MATCH + (1 << LZSS_LENGTH_BITS) - 1;
+
+/* Longest symbol: flag, offset and length [bits] */
+static uint8_t const MAX_SYMBOL_BITS = 1 + LZSS_OFFSET_BITS + LZSS_LENGTH_BITS;
+
+static uint16_t crc16(uint8_t const *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t) data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+struct CaptureRecord {
+  uint8_t id;
+  uint8_t check; /* ~id */
+};
+
+void DiagnosticUpload::begin() {
+  CaptureRecord record;
+  EEPROM.get(DIAGNOSTIC_EEPROM_OFFSET, record);
+  if (record.check == (uint8_t) ~record.id) {
+    captureId_ = record.id;
+  }
+}
+
+void DiagnosticUpload::start(size_t len) {
+  length_ = len < sizeof(buffer_) ? len : sizeof(buffer_);
+  position_ = 0;
+  fragment_ = 0;
+  bits_ = 0;
+  bitCount_ = 0;
+  captureId_++;
+  /* a capture is requested by downlink, the commit is rare */
+  CaptureRecord record = { captureId_, (uint8_t) ~captureId_ };
+  EEPROM.put(DIAGNOSTIC_EEPROM_OFFSET, record);
+  EEPROM.commit();
+  pending_ = length_ > 0;
+  logger::info("Diagnostic capture %d: %d bytes", captureId_, length_);
+}
+
+/* Longest match of the bytes at the position within the window, 0 if none is worth it.
+   Brute force, a telegram is compressed once and the window is small */
+size_t DiagnosticUpload::match(size_t &offset) const {
+  size_t longest = 0;
+  size_t limit = length_ - position_ < MAX_MATCH ? length_ - position_ : MAX_MATCH;
+  size_t start = position_ > WINDOW_SIZE ? position_ - WINDOW_SIZE : 0;
+  for (size_t candidate = start; candidate < position_; candidate++) {
+    size_t len = 0;
+    /* may run into the bytes being encoded, the decoder copies byte by byte */
+    while (len < limit && buffer_[candidate + len] == buffer_[position_ + len]) {
+      len++;
+    }
+    if (len > longest) {
+      longest = len;
+      offset = position_ - candidate;
+      if (len == limit) {
+        break;
+      }
+    }
+  }
+  return longest >= LZSS_MIN_MATCH ? longest : 0;
+}
+
+void DiagnosticUpload::put_bits(uint8_t *frame, size_t &size, uint16_t value, uint8_t count) {
+  bits_ = (bits_ << count) | value;
+  bitCount_ += count;
+  while (bitCount_ >= 8) {
+    bitCount_ -= 8;
+    frame[size++] = bits_ >> bitCount_;
+  }
+  bits_ &= (1UL << bitCount_) - 1;
+}
+
+size_t DiagnosticUpload::next_fragment(uint8_t *frame, size_t maxSize) {
+  if (!pending_ || maxSize < DIAGNOSTIC_FRAGMENT_HEADER_SIZE + DIAGNOSTIC_FIRST_HEADER_SIZE + 2) {
+    return 0;
+  }
+  size_t size = 0;
+  frame[size++] = captureId_;
+  frame[size++] = fragment_;
+  if (fragment_ == 0) {
+    uint16_t crc = crc16(buffer_, length_);
+    frame[size++] = length_ >> 8;
+    frame[size++] = length_ & 0xFF;
+    frame[size++] = crc >> 8;
+    frame[size++] = crc & 0xFF;
+  }
+
+  /* a symbol only goes in if it fits together with the pending bits */
+  while (position_ < length_ && size + (bitCount_ + MAX_SYMBOL_BITS + 7) / 8 <= maxSize) {
+    size_t offset = 0;
+    size_t len = match(offset);
+    if (len > 0) {
+      put_bits(frame, size, 0, 1);
+      put_bits(frame, size, offset - 1, LZSS_OFFSET_BITS);
+      put_bits(frame, size, len - LZSS_MIN_MATCH, LZSS_LENGTH_BITS);
+      position_ += len;
+    } else {
+      put_bits(frame, size, 0x100 | buffer_[position_], 9);
+      position_++;
+    }
+  }
+
+  if (position_ == length_) {
+    /* the decoder stops at the raw length, the padding is never read */
+    if (bitCount_ > 0) {
+      frame[size++] = bits_ << (8 - bitCount_);
+      bitCount_ = 0;
+    }
+    frame[1] |= DIAGNOSTIC_LAST_FRAGMENT;
+    pending_ = false;
+  }
+  logger::debug("Diagnostic fragment %d: %d bytes, %d of %d compressed", fragment_, size, position_, length_);
+  fragment_++;
+  return size;
+}
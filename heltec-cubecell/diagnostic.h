@@ -0,0 +1,63 @@
+#ifndef _DIAGNOSTIC_H
+#define _DIAGNOSTIC_H
+
+#include "config.h"
+#include "Arduino.h"
+
+/* LZSS in the style of heatshrink, MSB first: 1 + 8 bit literal, or 0 + 8 bit offset - 1
+   + 4 bit length - 2 of a match within the last 256 bytes */
+uint8_t const LZSS_OFFSET_BITS = 8;
+uint8_t const LZSS_LENGTH_BITS = 4;
+uint8_t const LZSS_MIN_MATCH = 2;
+
+/* Fragment: <capture id> <index | 0x80 on the last one> [<raw length> <crc16>] <bits...>
+   the raw length and CRC-16/CCITT of the telegram only in the first fragment */
+uint8_t const DIAGNOSTIC_FRAGMENT_HEADER_SIZE = 2;
+uint8_t const DIAGNOSTIC_FIRST_HEADER_SIZE = 4;
+uint8_t const DIAGNOSTIC_LAST_FRAGMENT = 0x80;
+
+/* Holds the raw bytes of one readout (see MeterReader::set_capture) and hands them out as
+   compressed fragments. The compressor works on the captured buffer itself, which is its
+   window, and only keeps the position and a few pending bits between the fragments, thus
+   every fragment is compressed when its uplink is due and no second buffer is needed. */
+class DiagnosticUpload {
+  public:
+    /* Loads the id of the last capture before this boot, after EEPROM.begin() */
+    void begin();
+
+    uint8_t *buffer() {
+      return buffer_;
+    }
+
+    size_t capacity() const {
+      return sizeof(buffer_);
+    }
+
+    /* The readout ended, the first len bytes of the buffer are sent from now on. The id of
+       the capture is persisted, thus fragments of captures before a reset aren't mixed up
+       with this one */
+    void start(size_t len);
+
+    /* Whether fragments are left to send */
+    bool pending() const {
+      return pending_;
+    }
+
+    /* Fills the next fragment of at most maxSize bytes, returns its size */
+    size_t next_fragment(uint8_t *frame, size_t maxSize);
+
+  private:
+    size_t match(size_t &offset) const;
+    void put_bits(uint8_t *frame, size_t &size, uint16_t value, uint8_t count);
+
+    uint8_t buffer_[DIAGNOSTIC_CAPTURE_SIZE];
+    size_t length_ = 0;
+    size_t position_ = 0;
+    uint8_t captureId_ = 0;
+    uint8_t fragment_ = 0;
+    uint32_t bits_ = 0;        /* not yet written, the lowest bitCount_ bits */
+    uint8_t bitCount_ = 0;
+    bool pending_ = false;
+};
+
+#endif
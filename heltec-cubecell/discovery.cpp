@@ -0,0 +1,125 @@
+#include "discovery.h"
+#include "logger.h"
+
+/* SML files start with the escape sequence 1B1B1B1B 01010101 */
+static uint8_t const SML_START[] = { 0x1B, 0x1B, 0x1B, 0x1B, 0x01, 0x01, 0x01, 0x01 };
+
+/* Push meters send at least every few seconds [ms] */
+uint16_t const LISTEN_TIME = 3000;
+
+/* The meter waits this long for an acknowledgement before it accepts a new request [ms] */
+uint16_t const REQUEST_SETTLE_TIME = 1500;
+
+/* Most likely first: IEC 62056-21 asks for 300 bps 7E1, some meters use 8N1. Meters that
+   push their data do so at 9600 bps (SML) or 2400 bps (mode D) */
+static SerialCandidate const CANDIDATES[] = {
+  { SERIAL_7E1, 300, true },
+  { SERIAL_8N1, 300, true },
+  { SERIAL_8N1, 9600, false },
+  { SERIAL_7E1, 2400, false },
+  { SERIAL_7E1, 9600, false },
+};
+
+/* /AAAb... in 7 bit ASCII, with the wrong parity the parity bit ends up in bit 7 */
+static bool is_identification(const char *line, size_t len) {
+  if (len < 7 || line[0] != '/') {
+    return false;
+  }
+  for (size_t i = 1; i < 4; i++) {
+    if (!isalpha((uint8_t) line[i])) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < len; i++) {
+    if ((uint8_t) line[i] >= 0x80 || (line[i] < 0x20 && line[i] != '\r' && line[i] != '\n')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static DiscoveryResult probe(HardwareSerial &serial, SerialCandidate const &candidate, uint16_t timeout, char identification[MAX_IDENTIFICATION_LENGTH]) {
+  serial.begin(candidate.baud, candidate.parity);
+  /* whatever arrived with the previous settings */
+  while (serial.available() > 0) {
+    serial.read();
+  }
+  if (candidate.request) {
+    serial.write(START_SEQUENCE);
+    serial.flush();
+  } else {
+    timeout = LISTEN_TIME;
+  }
+
+  unsigned long start = millis();
+  size_t len = 0, smlMatched = 0;
+  bool inIdentification = false;
+  while (millis() - start < timeout) {
+    if (serial.available() == 0) {
+      delay(1);
+      continue;
+    }
+    char c = serial.read();
+    if ((uint8_t) c == SML_START[smlMatched]) {
+      smlMatched++;
+    } else {
+      /* 1B 1B 1B 1B 1B still ends with a complete escape */
+      smlMatched = smlMatched >= 4 && c == 0x1B ? 4 : 0;
+    }
+    if (smlMatched == sizeof(SML_START)) {
+      return SmlMeter;
+    }
+
+    if (c == '/') {
+      inIdentification = true;
+      len = 0;
+    }
+    if (!inIdentification) {
+      continue;
+    }
+    if (len < MAX_IDENTIFICATION_LENGTH - 1) {
+      identification[len++] = c;
+    }
+    if (c == '\n') {
+      identification[len] = 0;
+      if (is_identification(identification, len)) {
+        return IecMeter;
+      }
+      inIdentification = false;
+    }
+  }
+  return NothingFound;
+}
+
+DiscoveryResult discover_serial_parameters(HardwareSerial &serial, MeterConfig &config) {
+  SerialCandidate const configured = { config.parity, config.initialBaudRate, true };
+  size_t const count = sizeof(CANDIDATES) / sizeof(CANDIDATES[0]);
+  char identification[MAX_IDENTIFICATION_LENGTH];
+
+  for (size_t i = 0; i <= count; i++) {
+    SerialCandidate const &candidate = i == 0 ? configured : CANDIDATES[i - 1];
+    if (i > 0 && candidate.request && candidate.parity == configured.parity && candidate.baud == configured.baud) {
+      continue;
+    }
+    logger::info("Probing %d bps, parity setting %d, %s", candidate.baud, (int) candidate.parity, candidate.request ? "request" : "listen");
+    DiscoveryResult result = probe(serial, candidate, config.identificationTimeout, identification);
+    if (result == SmlMeter) {
+      logger::err("SML meter found at %d bps, this reader only supports IEC 62056-21", candidate.baud);
+      return result;
+    }
+    if (result == IecMeter) {
+      config.parity = candidate.parity;
+      config.initialBaudRate = candidate.baud;
+      /* the manufacturer code, the rest of the identification may change with a firmware update */
+      memcpy(config.identifier, identification + 1, 3);
+      config.identifier[3] = 0;
+      logger::info("Meter %s found at %d bps, parity setting %d", config.identifier, candidate.baud, (int) candidate.parity);
+      if (candidate.request) {
+        delay(REQUEST_SETTLE_TIME);
+      }
+      return result;
+    }
+  }
+  logger::warn("No meter found, keeping the configured serial settings");
+  return NothingFound;
+}
@@ -0,0 +1,29 @@
+#ifndef _DISCOVERY_H
+#define _DISCOVERY_H
+
+#include "config.h"
+#include "Arduino.h"
+#include "meter.h"
+
+enum DiscoveryResult
+{
+  NothingFound,
+  IecMeter,   /* answered with an identification, or pushes one */
+  SmlMeter,   /* pushes SML, which this reader doesn't understand */
+};
+
+/* Serial settings tried by the discovery */
+struct SerialCandidate {
+  uint32_t parity;
+  uint16_t baud;
+  bool request;   /* send the start sequence, otherwise only listen for a meter that pushes its data */
+};
+
+/* Finds the serial settings of the connected meter by trying the likely ones one after
+   another: the configured ones, the IEC 62056-21 default of 300 bps 7E1 and 8N1 and the
+   push rates. Blocks for up to a few seconds per candidate, meant for the first boot or
+   a button press only. On success the parity, the initial baud rate and the identifier
+   (manufacturer code) of config are updated. The serial is left in an unknown state. */
+DiscoveryResult discover_serial_parameters(HardwareSerial &serial, MeterConfig &config);
+
+#endif
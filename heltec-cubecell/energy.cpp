@@ -0,0 +1,130 @@
+#include "energy.h"
+#include "logger.h"
+
+uint32_t const CONSUMER_CURRENTS[ENERGY_CONSUMER_COUNT] = {
+  ACTIVE_CURRENT_UA,
+  HEAD_CURRENT_UA,
+  TX_CURRENT_UA,
+  RX_CURRENT_UA,
+};
+
+/* MHDR, FHDR without options, FPort and MIC */
+uint8_t const LORAWAN_OVERHEAD = 13;
+
+/* A receive window stays open for a few symbols if nothing is received */
+uint32_t const RX_WINDOW_SYMBOLS = 8;
+
+/* The MCU wakes for the end of the transmission and for each receive window */
+uint32_t const RADIO_EVENT_MCU_MS = 5;
+
+/* A join request is 23 bytes, the overhead above included */
+uint8_t const JOIN_REQUEST_PAYLOAD = 10;
+uint8_t const JOIN_RX2_SPREADING_FACTOR = 12;
+
+uint32_t const UA_MS_PER_UAH = 3600000;
+
+/* Semtech AN1200.13: explicit header, CRC on, 8 preamble symbols, low data rate optimization from SF11 */
+uint32_t lora_time_on_air(uint8_t spreadingFactor, uint8_t payloadSize) {
+  int32_t sf = spreadingFactor;
+  int32_t lowDataRate = sf >= 11 ? 1 : 0;
+  uint32_t symbolTime = (1UL << sf) * 8;  /* [us] at 125 kHz */
+  int32_t numerator = 8 * (payloadSize + LORAWAN_OVERHEAD) - 4 * sf + 28 + 16;
+  int32_t denominator = 4 * (sf - 2 * lowDataRate);
+  int32_t blocks = numerator > 0 ? (numerator + denominator - 1) / denominator : 0;
+  uint32_t symbols = 8 + blocks * 5;
+  uint32_t preamble = symbolTime * 49 / 4;  /* 12.25 symbols */
+  return (preamble + symbols * symbolTime + 999) / 1000;
+}
+
+/* LoRaMac alternates the data rate of the join requests in EU868, most go out with SF7 */
+static uint8_t join_spreading_factor(uint16_t attempt) {
+  if (attempt % 48 == 0) {
+    return 12;
+  } else if (attempt % 32 == 0) {
+    return 11;
+  } else if (attempt % 24 == 0) {
+    return 10;
+  } else if (attempt % 16 == 0) {
+    return 9;
+  } else if (attempt % 8 == 0) {
+    return 8;
+  }
+  return 7;
+}
+
+static uint32_t rx_window_ms(uint8_t spreadingFactor) {
+  return RX_WINDOW_SYMBOLS * (1UL << spreadingFactor) / 125;
+}
+
+void EnergyAccount::account(EnergyConsumer consumer, uint32_t ms) {
+  activeMillis_[consumer] += ms;
+  charge_[consumer] += (uint64_t) ms * CONSUMER_CURRENTS[consumer];
+}
+
+void EnergyAccount::add(EnergyConsumer consumer, uint32_t ms) {
+  account(consumer, ms);
+  if (consumer == McuActive) {
+    wakes_++;
+  }
+}
+
+void EnergyAccount::add_uplink(uint8_t spreadingFactor, uint8_t payloadSize) {
+  account(RadioTx, lora_time_on_air(spreadingFactor, payloadSize));
+  account(RadioRx, 2 * rx_window_ms(spreadingFactor));
+  account(McuActive, 3 * RADIO_EVENT_MCU_MS);
+}
+
+void EnergyAccount::add_join(uint16_t attempt) {
+  uint8_t spreadingFactor = join_spreading_factor(attempt);
+  account(RadioTx, lora_time_on_air(spreadingFactor, JOIN_REQUEST_PAYLOAD));
+  account(RadioRx, rx_window_ms(spreadingFactor) + rx_window_ms(JOIN_RX2_SPREADING_FACTOR));
+  /* the retry timer wakes it once more */
+  account(McuActive, 4 * RADIO_EVENT_MCU_MS);
+}
+
+uint32_t EnergyAccount::charge(uint32_t elapsedSeconds) const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < ENERGY_CONSUMER_COUNT; i++) {
+    total += charge_[i];
+  }
+  /* the head and the radio only run while the MCU is active */
+  uint64_t active = activeMillis_[McuActive];
+  uint64_t elapsed = (uint64_t) elapsedSeconds * 1000;
+  if (elapsed > active) {
+    total += (elapsed - active) * SLEEP_CURRENT_UA;
+  }
+  return total / UA_MS_PER_UAH;
+}
+
+uint32_t EnergyAccount::charge_per_wake() const {
+  if (wakes_ == 0) {
+    return 0;
+  }
+  uint64_t total = 0;
+  for (size_t i = 0; i < ENERGY_CONSUMER_COUNT; i++) {
+    total += charge_[i];
+  }
+  return total / UA_MS_PER_UAH / wakes_;
+}
+
+uint32_t EnergyAccount::charge_per_day(uint32_t elapsedSeconds) const {
+  if (elapsedSeconds == 0) {
+    return 0;
+  }
+  return (uint64_t) charge(elapsedSeconds) * 86400 / elapsedSeconds;
+}
+
+uint32_t EnergyAccount::battery_life(uint32_t elapsedSeconds) const {
+  uint32_t perDay = charge_per_day(elapsedSeconds);
+  if (perDay == 0) {
+    return 0;
+  }
+  return (uint64_t) BATTERY_CAPACITY_MAH * 1000 / perDay;
+}
+
+void EnergyAccount::report(uint32_t elapsedSeconds) const {
+  logger::info("Energy: %d [uAh] in %d [s], %d [uAh/day], battery life: %d [days]", charge(elapsedSeconds), elapsedSeconds,
+               charge_per_day(elapsedSeconds), battery_life(elapsedSeconds));
+  logger::debug("Active: MCU %d, head %d, TX %d, RX %d [ms]", activeMillis_[McuActive], activeMillis_[OpticalHead],
+                activeMillis_[RadioTx], activeMillis_[RadioRx]);
+}
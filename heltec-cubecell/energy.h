@@ -0,0 +1,56 @@
+#ifndef _ENERGY_H
+#define _ENERGY_H
+
+#include "config.h"
+#include "Arduino.h"
+
+/* Parts of the node whose time in the power hungry state is tracked */
+enum EnergyConsumer
+{
+  McuActive,
+  OpticalHead,
+  RadioTx,
+  RadioRx,
+  ENERGY_CONSUMER_COUNT,
+};
+
+/* Estimates the charge drawn from the battery from the time each part was active and
+   its current draw (config.h), the rest of the time is accounted as sleep. Makes the
+   effect of firmware changes and failure scenarios on the battery life visible in the log. */
+class EnergyAccount {
+  public:
+    void add(EnergyConsumer consumer, uint32_t ms);
+
+    /* Time on air of the uplink plus both receive windows */
+    void add_uplink(uint8_t spreadingFactor, uint8_t payloadSize);
+
+    /* The n-th join request (from 1) and its receive windows */
+    void add_join(uint16_t attempt);
+
+    /* Charge drawn within the elapsed time since boot [uAh] */
+    uint32_t charge(uint32_t elapsedSeconds) const;
+
+    /* Average consumption extrapolated to a day [uAh] */
+    uint32_t charge_per_day(uint32_t elapsedSeconds) const;
+
+    /* Average charge of a wake, without the sleep in between [uAh] */
+    uint32_t charge_per_wake() const;
+
+    /* Expected battery life with BATTERY_CAPACITY [days], 0 if not known yet */
+    uint32_t battery_life(uint32_t elapsedSeconds) const;
+
+    void report(uint32_t elapsedSeconds) const;
+
+  private:
+    /* Radio events wake the MCU as well, but don't count as a wake */
+    void account(EnergyConsumer consumer, uint32_t ms);
+
+    uint32_t activeMillis_[ENERGY_CONSUMER_COUNT] = {};
+    uint64_t charge_[ENERGY_CONSUMER_COUNT] = {};  /* [uA * ms] */
+    uint32_t wakes_ = 0;                           /* the MCU time is added once per wake */
+};
+
+/* Time on air of a LoRaWAN frame with the given application payload at 125 kHz, CR 4/5 [ms] */
+uint32_t lora_time_on_air(uint8_t spreadingFactor, uint8_t payloadSize);
+
+#endif
@@ -0,0 +1,174 @@
+#include "governor.h"
+#include "logger.h"
+#include "EEPROM.h"
+
+uint32_t const SECONDS_PER_DAY = 86400;
+
+/* Low loads jitter by tens of watts, which is no change worth waking for [W] */
+uint32_t const MIN_REFERENCE_POWER = 100;
+
+/* The battery voltage changes by a few mV per day at best, shorter baselines are noise [s] */
+uint32_t const MIN_TREND_BASELINE = SECONDS_PER_DAY;
+
+/* Once the target is (nearly) reached the budget is spread over this many days at least */
+uint32_t const MIN_DAYS_LEFT = 7;
+
+/* A battery that is this much above the voltage of the stored budget was replaced or recharged [mV] */
+uint16_t const NEW_BATTERY_RISE = 100;
+
+/* Days of the budget in flash, `check` tells an erased or foreign record */
+struct BudgetRecord {
+  uint16_t days;
+  uint16_t voltage;
+  uint16_t check;
+};
+
+uint16_t const BUDGET_MAGIC = 0xA5A5;
+
+void WakeGovernor::begin() {
+  BudgetRecord record;
+  EEPROM.get(BUDGET_EEPROM_OFFSET, record);
+  if (record.check == (record.days ^ record.voltage ^ BUDGET_MAGIC)) {
+    bootDays_ = record.days;
+    storedDays_ = record.days;
+    storedVoltage_ = record.voltage;
+    logger::info("Battery budget: %d of %d days passed", bootDays_, BATTERY_TARGET_LIFE);
+  }
+}
+
+/* Writes the days that passed once a day, the budget starts over with a new battery */
+void WakeGovernor::update_budget(uint32_t now, uint16_t voltage) {
+  if (!budgetChecked_) {
+    budgetChecked_ = true;
+    if (storedVoltage_ > 0 && voltage > storedVoltage_ + NEW_BATTERY_RISE) {
+      logger::info("Battery: %d [mV] after %d [mV] before the reset, the budget starts over", voltage, storedVoltage_);
+      bootDays_ = 0;
+      storedDays_ = 0xFFFF;
+    }
+  }
+  uint32_t days = bootDays_ + now / SECONDS_PER_DAY;
+  if (days == storedDays_) {
+    return;
+  }
+  BudgetRecord record = { (uint16_t) days, voltage, (uint16_t) (days ^ voltage ^ BUDGET_MAGIC) };
+  EEPROM.put(BUDGET_EEPROM_OFFSET, record);
+  EEPROM.commit();
+  storedDays_ = days;
+  storedVoltage_ = voltage;
+}
+
+void WakeGovernor::add_reading(uint16_t power) {
+  if (readings_ > 0) {
+    uint32_t reference = ((uint32_t) power + lastPower_) / 2;
+    if (reference < MIN_REFERENCE_POWER) {
+      reference = MIN_REFERENCE_POWER;
+    }
+    uint32_t change = (power > lastPower_ ? power - lastPower_ : lastPower_ - power) * 1000 / reference;
+    if (change > 2000) {
+      change = 2000;
+    }
+    volatility_ = readings_ == 1 ? change : (3 * (uint32_t) volatility_ + change) / 4;
+  }
+  lastPower_ = power;
+  if (readings_ < 2) {
+    readings_++;
+  }
+}
+
+void WakeGovernor::add_battery(uint32_t now, uint16_t voltage) {
+  update_budget(now, voltage);
+  if (anchorVoltage_ == 0 || now < anchorTime_) {
+    anchorTime_ = now;
+    anchorVoltage_ = voltage;
+    intervalSum_ = 0;
+    intervalCount_ = 0;
+    return;
+  }
+  uint32_t elapsed = now - anchorTime_;
+  if (elapsed < MIN_TREND_BASELINE || intervalCount_ == 0) {
+    return;
+  }
+  uint32_t discharge = voltage < anchorVoltage_ ? (uint64_t) (anchorVoltage_ - voltage) * 1000 * SECONDS_PER_DAY / elapsed : 0;
+  dischargeUvPerDay_ = dischargeUvPerDay_ == 0 ? discharge : (3 * (uint64_t) dischargeUvPerDay_ + discharge) / 4;
+
+  /* the discharge rate belongs to the intervals slept since the anchor */
+  uint32_t averageInterval = intervalSum_ / intervalCount_;
+  uint32_t daysLeft = days_left(now);
+  uint32_t lasts = voltage > emptyVoltage_ && dischargeUvPerDay_ > 0 ? (uint64_t) (voltage - emptyVoltage_) * 1000 / dischargeUvPerDay_ : 0;
+  if (dischargeUvPerDay_ == 0 || lasts >= daysLeft) {
+    trendInterval_ = 0;
+  } else {
+    trendInterval_ = lasts > 0 ? (uint64_t) averageInterval * daysLeft / lasts : MAX_WAKE_INTERVAL;
+    logger::info("Battery: %d [uV/day], lasts %d of %d days at the current interval", dischargeUvPerDay_, lasts, daysLeft);
+  }
+  anchorTime_ = now;
+  anchorVoltage_ = voltage;
+  intervalSum_ = 0;
+  intervalCount_ = 0;
+}
+
+uint32_t WakeGovernor::days_left(uint32_t now) const {
+  uint32_t elapsedDays = bootDays_ + now / SECONDS_PER_DAY;
+  return BATTERY_TARGET_LIFE > elapsedDays + MIN_DAYS_LEFT ? BATTERY_TARGET_LIFE - elapsedDays : MIN_DAYS_LEFT;
+}
+
+/* Shortest interval with which the rest of the battery lasts for the rest of the target life [ms] */
+uint32_t WakeGovernor::budget_interval(uint32_t now, uint8_t batteryPct, uint32_t chargePerWake) const {
+  if (chargePerWake == 0) {
+    return 0;
+  }
+  uint32_t daysLeft = days_left(now);
+  uint64_t left = (uint64_t) BATTERY_CAPACITY_MAH * 1000 * batteryPct / 100;  /* [uAh] */
+  uint64_t sleeping = (uint64_t) SLEEP_CURRENT_UA * 24 * daysLeft;
+  if (left <= sleeping) {
+    return MAX_WAKE_INTERVAL;
+  }
+  uint64_t wakes = (left - sleeping) / chargePerWake;
+  if (wakes == 0) {
+    return MAX_WAKE_INTERVAL;
+  }
+  uint64_t interval = (uint64_t) daysLeft * SECONDS_PER_DAY * 1000 / wakes;
+  return interval > MAX_WAKE_INTERVAL ? MAX_WAKE_INTERVAL : interval;
+}
+
+uint32_t WakeGovernor::next_interval(uint32_t base, uint32_t now, uint8_t batteryPct, uint32_t chargePerWake) {
+  /* the configured sleep time may be outside of the bounds, e.g. set by a downlink */
+  uint32_t lower = base < MIN_WAKE_INTERVAL ? base : MIN_WAKE_INTERVAL;
+  uint32_t upper = base > MAX_WAKE_INTERVAL ? base : MAX_WAKE_INTERVAL;
+  if (base != base_) {
+    /* a new sleep time was configured, start from there */
+    base_ = base;
+    interval_ = base;
+  }
+  if (readings_ >= 2) {
+    if (volatility_ >= VOLATILE_POWER_CHANGE) {
+      interval_ -= interval_ / 4;
+    } else if (volatility_ <= FLAT_POWER_CHANGE) {
+      interval_ += interval_ / 4;
+    } else {
+      interval_ = (int64_t) interval_ + ((int64_t) base - interval_) / 4;
+    }
+  }
+  interval_ = interval_ < lower ? lower : interval_ > upper ? upper : interval_;
+
+  uint32_t interval = interval_;
+  uint32_t budget = budget_interval(now, batteryPct, chargePerWake);
+  if (budget > interval) {
+    interval = budget;
+  }
+  if (trendInterval_ > interval) {
+    interval = trendInterval_;
+  }
+  if (interval > upper) {
+    interval = upper;
+  }
+  /* whole steps, thus the aligned wakes stay on a regular grid */
+  if (interval >= WAKE_INTERVAL_STEP) {
+    interval = (interval + WAKE_INTERVAL_STEP / 2) / WAKE_INTERVAL_STEP * WAKE_INTERVAL_STEP;
+  }
+  intervalSum_ += interval;
+  intervalCount_++;
+  logger::debug("Wake interval: %d [s], volatility %d [permille], budget %d [s], trend %d [s]", interval / 1000, volatility_,
+                budget / 1000, trendInterval_ / 1000);
+  return interval;
+}
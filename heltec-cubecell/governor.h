@@ -0,0 +1,64 @@
+#ifndef _GOVERNOR_H
+#define _GOVERNOR_H
+
+#include "config.h"
+#include "Arduino.h"
+
+/* Picks the next wake interval from the configured sleep time: shorter while the power
+   keeps changing between readings, longer while it is flat. Independently of the readings
+   the interval never gets shorter than the battery affords to last BATTERY_TARGET_LIFE,
+   judged by the charge of the past wakes (energy model) and by the trend of the battery
+   voltage. Only integer arithmetic.
+   The days of the target life that passed are kept in flash, a reset doesn't restart them. */
+class WakeGovernor {
+  public:
+    explicit WakeGovernor(uint16_t emptyVoltage): emptyVoltage_(emptyVoltage) {
+    }
+
+    /* Loads the days of the budget that passed before this boot, after EEPROM.begin() */
+    void begin();
+
+    /* Feed every successful reading [W] */
+    void add_reading(uint16_t power);
+
+    /* Feed the battery voltage of every wake. now: [s] since boot */
+    void add_battery(uint32_t now, uint16_t voltage);
+
+    /* The interval until the next wake [ms]. base: configured sleep time [ms], chargePerWake:
+       average charge of a wake [uAh] or 0 if not known yet */
+    uint32_t next_interval(uint32_t base, uint32_t now, uint8_t batteryPct, uint32_t chargePerWake);
+
+    /* Smoothed relative power change between readings [permille] */
+    uint16_t volatility() const {
+      return volatility_;
+    }
+
+  private:
+    uint32_t budget_interval(uint32_t now, uint8_t batteryPct, uint32_t chargePerWake) const;
+    uint32_t days_left(uint32_t now) const;
+    void update_budget(uint32_t now, uint16_t voltage);
+
+    uint16_t emptyVoltage_;
+
+    uint8_t readings_ = 0;
+    uint16_t lastPower_ = 0;
+    uint16_t volatility_ = 0;
+    uint32_t base_ = 0;
+    uint32_t interval_ = 0;          /* following the volatility [ms] */
+
+    /* battery voltage trend, measured over a day at least */
+    uint32_t anchorTime_ = 0;
+    uint16_t anchorVoltage_ = 0;
+    uint64_t intervalSum_ = 0;       /* of the intervals since the anchor [ms] */
+    uint32_t intervalCount_ = 0;
+    uint32_t dischargeUvPerDay_ = 0; /* 0 = unknown or not discharging */
+    uint32_t trendInterval_ = 0;     /* shortest interval that lasts the target by the trend [ms], 0 = no limit */
+
+    /* budget of BATTERY_TARGET_LIFE, persisted at BUDGET_EEPROM_OFFSET */
+    uint16_t bootDays_ = 0;          /* days that passed before this boot */
+    uint16_t storedDays_ = 0xFFFF;   /* as in flash, 0xFFFF = nothing stored */
+    uint16_t storedVoltage_ = 0;     /* battery voltage when they were stored [mV], 0 = unknown */
+    bool budgetChecked_ = false;     /* the battery was compared with the stored voltage */
+};
+
+#endif
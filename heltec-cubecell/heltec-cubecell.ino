@@ -2,8 +2,27 @@
 #include "Arduino.h"
 #include "math.h"
 #include "meter.h"
+#include "scheduler.h"
+#include "power.h"
+#include "metrics.h"
+#include "retry.h"
+#include "energy.h"
+#include "governor.h"
+#include "linkquality.h"
+#include "diagnostic.h"
+#include "timebase.h"
+#include "discovery.h"
 #include "logger.h"
+#include "journal.h"
+#include "settings.h"
+#include "EEPROM.h"
 #include "credentials.h"
+#ifdef DEVICE_TIME_REQUEST
+#include "systime.h"
+#endif
+#ifdef LINK_ADAPTATION
+#include "sx126x.h"
+#endif
 
 #define INT_GPIO USER_KEY
 
@@ -13,25 +32,111 @@
 //  1200000  ->  20 min
 //  1800000  ->  30 min
 //  3600000  ->  60 min
+#ifdef LOAD_PROFILE_READOUT
+uint32_t sleepTime = LOAD_PROFILE_SLEEP_TIME;
+#else
 uint32_t sleepTime = 1200000;
+#endif
+
+/* POWER para */
+static PowerSequencer powerSequencer;
+static EnergyAccount energy;
+unsigned long awakeSince = 0;   // start of the current readout cycle [ms], 0 = sleeping
+bool joining = false;            // the library repeats the join request on its own until it is accepted
+uint32_t joinStartedAt = 0;      // [s]
+uint16_t joinAttempts = 0;       // join requests accounted so far
+#define JOIN_RETRY_SECONDS 36    // the receive windows close after 6 s, the next request follows 30 s later
 
 /* BATTERY params */
 #define MAXBATT 3400
 #define MINBATT 3280
 
+/* WAKE para */
+uint32_t wakeInterval = sleepTime;                      // sleep time of the current cycle, set by the governor [ms]
+#ifdef ADAPTIVE_WAKE
+static WakeGovernor governor(MINBATT);
+#endif
+
+#ifdef LINK_ADAPTATION
+/* LINK para */
+static LinkTracker linkTracker;
+#endif
+
 /* METER para */
-static MeterReader reader(Serial1);
+#if defined(LOAD_PROFILE_READOUT) && METER_COUNT > 1
+#error "The load profile readout supports a single meter only"
+#endif
+static MeterReader readers[METER_COUNT];
+static MeterReader &reader = readers[0];
+static MeterScheduler scheduler;
+const uint8_t MULTI_METER_FRAME_HEADER_SIZE = 3;
+const uint8_t MULTI_METER_FRAME_RECORD_SIZE = 8;
+char obisPower[SETTINGS_OBIS_LENGTH];
+char obisEnergy[SETTINGS_OBIS_LENGTH];
+enum MeterRegister
+{
+  PowerRegister,
+  EnergyRegister,
+};
+/* Pushed by the reader while it reads, committed once the readout ended with Ok */
+struct MeterRegisters {
+  int32_t power, stagedPower;     // [W]
+  int32_t energy, stagedEnergy;   // [Wh]
+  bool powerStaged, energyStaged;
+};
+MeterRegisters meterRegisters[METER_COUNT];
 double power = 0;
 double totalkWh = 0;
 unsigned int uptimeCount = 0;
 uint8_t batteryPct = 0;
 uint16_t batteryVoltage = 0;
 
+#ifdef DERIVED_METRICS
+/* METRICS para */
+static MetricsTracker metrics;
+#endif
+
+#ifdef LOAD_PROFILE_READOUT
+/* LOAD PROFILE para */
+uint32_t loadProfileFrom = 0;   // timestamp of the next entry to fetch, 0 until the meter clock was read [minutes since 2000-01-01]
+#endif
+
+#ifdef SERIAL_DISCOVERY
+/* DISCOVERY para */
+#if METER_COUNT > 1
+#error "The serial discovery supports a single meter only"
+#endif
+volatile bool discoveryRequested = false;              // set on boot until the meter was found once, and by the user button
+#endif
+
+#ifdef DIAGNOSTIC_CAPTURE
+/* DIAGNOSTIC para */
+static DiagnosticUpload diagnostic;
+const uint8_t DIAGNOSTIC_CAPTURE_REQUEST = 0x01;
+volatile bool diagnosticRequested = false;             // set by a downlink, the next readout is captured
+bool diagnosticCapturing = false;
+bool fragmentWakeScheduled = false, fragmentSent = false;
+uint32_t nextReadingAt = 0;                            // the fragments go out in between, the readings keep their time [s]
+#endif
+
+/* JOURNAL para */
+static Journal journal;
+const uint8_t JOURNAL_FRAME_HEADER_SIZE = 3;
+const uint8_t JOURNAL_FRAME_RECORD_SIZE = 8;
+uint32_t clockSeconds = 0;                             // seconds since boot, keeps counting during sleep
+TimerTime_t lastClockTime = 0;
+
+/* TIME para */
+TimeBaseState timeBaseState;
+static TimeBase timeBase(timeBaseState);
+#ifdef DEVICE_TIME_REQUEST
+const uint32_t UNIX_TIME_2000 = 946684800;
+bool deviceTimeUpdated = false;                         // a DeviceTimeAns arrived since the last sync
+#endif
 
 /* RETRY para */
-const unsigned int INITIAL_RETRY_SLEEP_TIME = 5000;     // start retry time [ms]
-float retrySleepTime = INITIAL_RETRY_SLEEP_TIME;        // Every time there's an error, this sleep time is multiplied by the multiplier faktor, up to the maximum, the normal sleepTime. [seconds]
-const float BACKOFF_MULTIPLIER = 1.5;                   // 5    7.5   11.25   16.8    23.3    37.9    56.9    85.42     128
+RetryState retryState;                                  // see retry.cpp for the policies per error class
+static RetryScheduler retryScheduler(retryState);
 
 /* LOGGER para */
 #define DEFAULT_LOG_LEVEL Info // DEBUG: set the Debug for more logging statements
@@ -52,7 +157,11 @@ uint32_t appTxDutyCycle = sleepTime;
 bool overTheAirActivation = LORAWAN_NETMODE;
 
 /*ADR enable*/
+#ifdef LINK_ADAPTATION
+bool loraWanAdr = false;        // the node picks the data rate and TX power itself
+#else
 bool loraWanAdr = LORAWAN_ADR;
+#endif
 
 /* set LORAWAN_Net_Reserve ON, the node could save the network info to flash, when node reset not need to join again */
 bool keepNet = LORAWAN_NET_RESERVE;
@@ -108,19 +217,19 @@ uint8_t confirmedNbTrials = 8;
 //+DefaultSet=1             to reset parameter to Default setting
 //AT+LogLevel=debug         set log level to none|debug|info|warn|error
 //AT+SleepTime=600          set sleep time in seconds
+//AT+Energy=1               print the estimated consumption and battery life
 bool checkUserAt(char * cmd, char * content) {
   if (strcmp(cmd, "LogLevel") == 0) {
-    for (size_t i = 0; i < sizeof(content); i++) {
+    for (size_t i = 0; content[i] != 0; i++) {
       content[i] = tolower(content[i]);
     }
-    const std::string logLevel = std::string(content);
-    if (logLevel.find("none") != std::string::npos) {
+    if (strstr(content, "none") != NULL) {
       logger::set_level(logger::None);
-    } else if (logLevel.find("debug") != std::string::npos) {
+    } else if (strstr(content, "debug") != NULL) {
       logger::set_level(logger::Debug);
-    } else if (logLevel.find("info") != std::string::npos) {
+    } else if (strstr(content, "info") != NULL) {
       logger::set_level(logger::Info);
-    } else if (logLevel.find("warn") != std::string::npos) {
+    } else if (strstr(content, "warn") != NULL) {
       logger::set_level(logger::Warning);
     } else {
       logger::set_level(logger::Error);
@@ -131,6 +240,9 @@ bool checkUserAt(char * cmd, char * content) {
     sleepTime = (uint32_t) (atoi(content) * 1000);
     logger::info("Sleep Time changed to: %d", sleepTime);
     return true;
+  } else if (strcmp(cmd, "Energy") == 0) {
+    energy.report(nowSeconds());
+    return true;
   }
   return false;
 }
@@ -145,14 +257,116 @@ void downLinkDataHandle(McpsIndication_t *mcpsIndication)
     Serial.printf("%02X", mcpsIndication->Buffer[i]);
   }
   Serial.println();
+#ifdef LINK_ADAPTATION
+  // an ack that carries data was measured by downLinkAckHandle already
+  if (!mcpsIndication->AckReceived) {
+    linkTracker.add_downlink(nowSeconds(), mcpsIndication->Rssi, (int8_t) mcpsIndication->Snr);
+  }
+#endif
+
+  if (mcpsIndication->Port == 4 && mcpsIndication->BufferSize == 2) {
+    // legacy sleep time downlink, same as the SetSleepTime settings command
+    uint8_t command[] = { SetSleepTime, 2, mcpsIndication->Buffer[0], mcpsIndication->Buffer[1] };
+    settings::handle_downlink(command, sizeof(command));
+  } else if (mcpsIndication->Port == SETTINGS_DOWNLINK_PORT) {
+    settings::handle_downlink(mcpsIndication->Buffer, mcpsIndication->BufferSize);
+#ifdef DIAGNOSTIC_CAPTURE
+  } else if (mcpsIndication->Port == DIAGNOSTIC_APP_PORT && mcpsIndication->BufferSize >= 1 &&
+             mcpsIndication->Buffer[0] == DIAGNOSTIC_CAPTURE_REQUEST) {
+    logger::info("Diagnostic capture requested");
+    diagnosticRequested = true;
+#endif
+  }
+}
+
+void applySettings() {
+  Settings const &current = settings::current();
+  for (size_t i = 0; i < METER_COUNT; i++) {
+    readers[i].unsubscribe(obisPower);
+    readers[i].unsubscribe(obisEnergy);
+    readers[i].subscribe(current.obisPower, PowerRegister);
+    readers[i].subscribe(current.obisEnergy, EnergyRegister);
+    readers[i].configure(current.meter);
+  }
+  strcpy(obisPower, current.obisPower);
+  strcpy(obisEnergy, current.obisEnergy);
+  sleepTime = current.sleepTime;
+  isTxConfirmed = (current.payloadOptions & ConfirmedUplinks) != 0;
+  logger::debug("Settings: sleepTime=%d, identifier=%s, obis=%s/%s", sleepTime, current.meter.identifier, obisPower, obisEnergy);
+}
+
+
+/* The RTC timer keeps running during sleep but wraps after ~49 days, thus accumulate the elapsed seconds */
+uint32_t nowSeconds() {
+  TimerTime_t elapsed = TimerGetCurrentTime() - lastClockTime;
+  clockSeconds += elapsed / 1000;
+  lastClockTime += elapsed - elapsed % 1000;
+  return clockSeconds;
+}
+
+/* The join requests the library sent since the join started, it doesn't tell about the failed ones */
+void accountJoinAttempts() {
+  uint16_t attempts = (nowSeconds() - joinStartedAt) / JOIN_RETRY_SECONDS + 1;
+  while (joinAttempts < attempts) {
+    energy.add_join(++joinAttempts);
+  }
+}
+
+/* EU868 like regions: DR0 = SF12 ... DR5 = SF7 */
+uint8_t currentSpreadingFactor() {
+  MibRequestConfirm_t mib;
+  mib.Type = MIB_CHANNELS_DATARATE;
+  LoRaMacMibGetRequestConfirm(&mib);
+  int8_t dataRate = mib.Param.ChannelsDatarate;
+  return dataRate >= 0 && dataRate <= 5 ? 12 - dataRate : 7;
+}
 
-  if (mcpsIndication->Port == 4) {
-    int newSleepTime = mcpsIndication->Buffer[1] | (mcpsIndication->Buffer[0] << 8);
-    sleepTime  = newSleepTime * 1000;
-    logger::info("Changed Sleep Time to: %d", sleepTime);
+void sendFrame() {
+#ifdef DEVICE_TIME_REQUEST
+  if (timeBase.source() != MeterClock) {
+    requestDeviceTime();
   }
+#endif
+#ifdef LINK_ADAPTATION
+  linkTracker.add_uplink(nowSeconds(), isTxConfirmed);
+#endif
+  energy.add_uplink(currentSpreadingFactor(), appDataSize);
+  LoRaWAN.send();
+}
+
+/* Called by the LoRaWAN stack when a confirmed uplink was acknowledged */
+void downLinkAckHandle() {
+  logger::debug("Uplink acknowledged");
+  journal.acknowledge();
+#ifdef LINK_ADAPTATION
+  // the ack is the last packet the radio received
+  PacketStatus_t packet;
+  SX126xGetPacketStatus(&packet);
+  linkTracker.add_downlink(nowSeconds(), packet.Params.LoRa.RssiPkt, packet.Params.LoRa.SnrPkt);
+  linkTracker.add_ack();
+#endif
 }
 
+#ifdef LINK_ADAPTATION
+/* Sets the data rate and TX power the tracker chose for the uplink of this cycle, and confirms
+   the uplink if the link should be measured. Before the frame is prepared, it has to fit */
+LinkChoice applyLinkChoice() {
+  uint32_t now = nowSeconds();
+  LinkChoice choice = linkTracker.choose(now);
+  isTxConfirmed = (settings::current().payloadOptions & ConfirmedUplinks) != 0 || linkTracker.probe_due(now);
+  LoRaWAN.setDataRateForNoADR(choice.dataRate);
+  MibRequestConfirm_t mib;
+  mib.Type = MIB_CHANNELS_DATARATE;
+  mib.Param.ChannelsDatarate = choice.dataRate;
+  LoRaMacMibSetRequestConfirm(&mib);
+  mib.Type = MIB_CHANNELS_TX_POWER;
+  mib.Param.ChannelsTxPower = choice.txPower;
+  LoRaMacMibSetRequestConfirm(&mib);
+  logger::debug("Link: DR%d, TX power %d, batch %d, delivery %d [permille]%s", choice.dataRate, choice.txPower, choice.batch,
+                linkTracker.delivery(), isTxConfirmed ? ", confirmed" : "");
+  return choice;
+}
+#endif
 
 void updateBatteryData() {
   batteryVoltage = getBatteryVoltage();
@@ -164,22 +378,167 @@ void updateBatteryData() {
   }
   logger::debug("Battery-Voltage: %d", batteryVoltage);
   logger::debug("Battery-Percent: %d", batteryPct);
+#ifdef ADAPTIVE_WAKE
+  governor.add_battery(nowSeconds(), batteryVoltage);
+#endif
+
+}
+
+/* Called by the reader for every power and energy value as soon as its line was read */
+void onRegister(void *context, uint8_t id, FixedPoint const &value) {
+  MeterRegisters &registers = *(MeterRegisters *)context;
+  logger::debug("Register %d: %d / 10^%d", id, value.mantissa, value.decimals);
+  if (id == PowerRegister) {
+    registers.stagedPower = fixed_point_scaled(value, 3);   // kW -> W
+    registers.powerStaged = true;
+  } else if (id == EnergyRegister) {
+    registers.stagedEnergy = fixed_point_scaled(value, 3);  // kWh -> Wh
+    registers.energyStaged = true;
+  }
+}
+
+/* The values of a readout that failed (e.g. checksum) are dropped */
+void onSessionEnd(void *context, bool ok) {
+  MeterRegisters &registers = *(MeterRegisters *)context;
+  if (ok && registers.powerStaged) {
+    registers.power = registers.stagedPower;
+  }
+  if (ok && registers.energyStaged) {
+    registers.energy = registers.stagedEnergy;
+  }
+  registers.powerStaged = false;
+  registers.energyStaged = false;
+}
 
+/* Interval until the next readout after a successful cycle [ms] */
+uint32_t nextWakeInterval() {
+#ifdef ADAPTIVE_WAKE
+  wakeInterval = governor.next_interval(sleepTime, nowSeconds(), batteryPct, energy.charge_per_wake());
+#else
+  wakeInterval = sleepTime;
+#endif
+  return wakeInterval;
 }
 
 void updateMeterData() {
-  std::map<std::string, std::string> mymap = reader.values();
-  for (std::map<std::string, std::string>::iterator it = mymap.begin(); it != mymap.end(); ++it) {
-    const std::string key = it->first;
-    const char *value = it->second.c_str();
-    logger::debug("Result: %s \t %s", key.c_str(), value);
-    if (key.compare(OBIS_VALUE_POWER) == 0) {
-      power = atof(value) * 1000;
-    } else if (key.compare(OBIS_VALUE_TOTAL_ENERGY) == 0) {
-      totalkWh = atof(value);
+  power = meterRegisters[0].power;
+  totalkWh = meterRegisters[0].energy / 1000.0;
+}
+
+#ifdef ALIGNED_WAKE
+/* Sync the time base with the meter clock of the normal readout */
+void syncMeterClock() {
+  uint32_t wall = meter_clock_seconds(reader.values().value(OBIS_VALUE_DATE), reader.values().value(OBIS_VALUE_TIME));
+  if (wall == 0) {
+    logger::debug("Meter clock not available");
+    return;
+  }
+  timeBase.sync(wall, nowSeconds(), MeterClock);
+}
+
+/* Sleep until shortly before the next boundary of the wake interval, e.g. the next full quarter hour [ms] */
+uint32_t alignedSleepTime() {
+  uint32_t interval = wakeInterval / 1000;
+#ifdef ADAPTIVE_WAKE
+  /* the governor's intervals are whole steps, on the grid of the step they stay on the billing periods */
+  uint32_t step = WAKE_INTERVAL_STEP / 1000;
+  if (interval >= step) {
+    return timeBase.seconds_until_boundary(nowSeconds(), step, ALIGNED_WAKE_LEAD, interval - step / 2) * 1000;
+  }
+#endif
+  return timeBase.seconds_until_boundary(nowSeconds(), interval, ALIGNED_WAKE_LEAD, interval / 4) * 1000;
+}
+#endif
+
+#ifdef DEVICE_TIME_REQUEST
+/* Piggybacks a DeviceTimeReq on the next uplink */
+void requestDeviceTime() {
+  MlmeReq_t mlmeReq;
+  mlmeReq.Type = MLME_DEVICE_TIME;
+  LoRaMacMlmeRequest(&mlmeReq);
+}
+
+/* Called by the LoRaWAN app of the core when the MLME_DEVICE_TIME request is confirmed */
+void dev_time_updated() {
+  deviceTimeUpdated = true;
+}
+
+/* The MAC sets the system time when the DeviceTimeAns arrives, between answers it runs on the node clock */
+void syncNetworkTime() {
+  if (!deviceTimeUpdated) {
+    return;
+  }
+  deviceTimeUpdated = false;
+  SysTime_t sysTime = SysTimeGet();
+  if (sysTime.Seconds < UNIX_TIME_2000) {
+    return;
+  }
+  timeBase.sync(sysTime.Seconds - UNIX_TIME_2000, nowSeconds(), NetworkTime);
+}
+#endif
+
+#ifdef DERIVED_METRICS
+/* Minute of the day of the meter clock, -1 if not available */
+int meterMinuteOfDay() {
+  return meter_minute_of_day(reader.values().value(OBIS_VALUE_TIME));
+}
+#endif
+
+#ifdef LOAD_PROFILE_READOUT
+void updateLoadProfileStart() {
+  uint32_t now = meter_clock_seconds(reader.values().value(OBIS_VALUE_DATE), reader.values().value(OBIS_VALUE_TIME)) / 60;
+  if (now == 0) {
+    logger::warn("Meter clock not available, cannot start the load profile readout");
+    return;
+  }
+  if (now > MAX_LOAD_PROFILE_ENTRIES * LOAD_PROFILE_INTERVAL) {
+    loadProfileFrom = now - MAX_LOAD_PROFILE_ENTRIES * LOAD_PROFILE_INTERVAL;
+    logger::info("Load profile readout starts at: %d", loadProfileFrom);
+  }
+}
+
+/* Returns false if no new entries were read */
+static bool prepareLoadProfileTxFrame() {
+  LoadProfile const &profile = reader.load_profile();
+  if (profile.size() == 0) {
+    logger::info("No new load profile entries");
+    return false;
+  }
+  uint8_t channels = profile.channels() < MAX_LOAD_PROFILE_CHANNELS ? profile.channels() : MAX_LOAD_PROFILE_CHANNELS;
+  uint32_t timestamp = profile.entry(0).timestamp;
+
+  // TIMESTAMP OF THE FIRST ENTRY (minutes since 2000-01-01)
+  appData[0] = timestamp >> 24;
+  appData[1] = timestamp >> 16;
+  appData[2] = timestamp >> 8;
+  appData[3] = timestamp & 0xFF;
+
+  appData[4] = profile.interval();
+  appData[5] = channels;
+  appData[7] = batteryPct;
+
+  // ENTRIES (Wh per interval and channel), stop at the first gap so the entries stay contiguous
+  uint8_t count = 0;
+  appDataSize = 8;
+  for (size_t i = 0; i < profile.size(); i++) {
+    LoadProfileEntry const &entry = profile.entry(i);
+    if (entry.timestamp != timestamp + count * profile.interval()) {
+      break;
     }
+    for (uint8_t channel = 0; channel < channels; channel++) {
+      appData[appDataSize++] = entry.values[channel] >> 8;
+      appData[appDataSize++] = entry.values[channel] & 0xFF;
+    }
+    count++;
   }
+  appData[6] = count;
+
+  loadProfileFrom = timestamp + count * profile.interval();
+  logger::debug("Load profile entries: %d, next readout starts at: %d", count, loadProfileFrom);
+  appPort = LOAD_PROFILE_APP_PORT;
+  return true;
 }
+#endif
 
 static void prepareTxFrame( uint8_t port )
 {
@@ -190,7 +549,7 @@ static void prepareTxFrame( uint8_t port )
     for example, if use REGION_CN470,
     the max value for different DR can be found in MaxPayloadOfDatarateCN470 refer to DataratesCN470 and BandwidthsCN470 in "RegionCN470.h".
   */
-  appDataSize = 10;
+  appDataSize = settings::current().payloadOptions & CompactPayload ? 7 : 10;
 
   // POWER (KW)
   uint16_t power_lora = power;
@@ -212,27 +571,194 @@ static void prepareTxFrame( uint8_t port )
 
   // COUNTER
   appData[9] = (uint8_t)uptimeCount;
+
+#ifdef DERIVED_METRICS
+  if (appDataSize == 10 && metrics.valid()) {
+    DerivedMetrics const &derived = metrics.metrics();
+    // AVERAGE AND PEAK POWER (W)
+    appData[10] = derived.averagePower >> 8;
+    appData[11] = derived.averagePower & 0xFF;
+    appData[12] = derived.peakPower >> 8;
+    appData[13] = derived.peakPower & 0xFF;
+    // INTERVAL (MIN)
+    appData[14] = derived.intervalMinutes >> 8;
+    appData[15] = derived.intervalMinutes & 0xFF;
+    // DAY AND NIGHT ENERGY (WH)
+    appData[16] = derived.dayEnergy >> 24;
+    appData[17] = derived.dayEnergy >> 16;
+    appData[18] = derived.dayEnergy >> 8;
+    appData[19] = derived.dayEnergy & 0xFF;
+    appData[20] = derived.nightEnergy >> 24;
+    appData[21] = derived.nightEnergy >> 16;
+    appData[22] = derived.nightEnergy >> 8;
+    appData[23] = derived.nightEnergy & 0xFF;
+    appDataSize = 24;
+  }
+#endif
 }
 
+/* What fits into one uplink at the current data rate */
+static uint8_t maxPayloadSize() {
+  uint8_t maxPayload = LORAWAN_APP_DATA_MAX_SIZE;
+  LoRaMacTxInfo_t txInfo;
+  if (LoRaMacQueryTxPossible(0, &txInfo) == LORAMAC_STATUS_OK && txInfo.MaxPossiblePayload < maxPayload) {
+    maxPayload = txInfo.MaxPossiblePayload;
+  }
+  return maxPayload;
+}
+
+/* Sends the oldest buffered readings, as many as fit into one uplink at the current data rate */
+static void prepareJournalTxFrame() {
+  uint8_t maxPayload = maxPayloadSize();
+  uint32_t now = nowSeconds();
+  uint32_t lastSequence = 0;
+  uint8_t count = 0;
+  appDataSize = JOURNAL_FRAME_HEADER_SIZE;
+  for (size_t i = 0; i < journal.pending() && appDataSize + JOURNAL_FRAME_RECORD_SIZE <= maxPayload; i++) {
+    JournalRecord record;
+    if (!journal.read(i, record)) {
+      continue;
+    }
+    // AGE (minutes, FFFF = unknown)
+    uint32_t age = journal.from_previous_boot(record) ? 0xFFFF : (now - record.timestamp) / 60;
+    if (age > 0xFFFF) {
+      age = 0xFFFF;
+    }
+    appData[appDataSize++] = age >> 8;
+    appData[appDataSize++] = age & 0xFF;
+    // POWER (W)
+    appData[appDataSize++] = record.power >> 8;
+    appData[appDataSize++] = record.power & 0xFF;
+    // ENERGY (KWH)
+    appData[appDataSize++] = record.totalkWh >> 24;
+    appData[appDataSize++] = record.totalkWh >> 16;
+    appData[appDataSize++] = record.totalkWh >> 8;
+    appData[appDataSize++] = record.totalkWh & 0xFF;
+    lastSequence = record.sequence;
+    count++;
+  }
+  appData[0] = count;
+  appData[1] = batteryPct;
+  appData[2] = (uint8_t)uptimeCount;
+
+  journal.mark_in_flight(lastSequence);
+  appPort = JOURNAL_APP_PORT;
+  logger::info("Sending %d of %d buffered readings", count, journal.pending());
+}
+
+/* One record per meter, failed readouts are sent with their status and zero values */
+static void prepareMultiMeterTxFrame() {
+  appData[0] = scheduler.size();
+  appData[1] = batteryPct;
+  appData[2] = (uint8_t)uptimeCount;
+  appDataSize = MULTI_METER_FRAME_HEADER_SIZE;
+  for (size_t i = 0; i < scheduler.size(); i++) {
+    MeterReader &meter = scheduler.reader(i);
+    int32_t meterPower = 0;
+    int32_t meterEnergy = 0;
+    if (meter.status() == Ok) {
+      meterPower = meterRegisters[i].power;
+      meterEnergy = meterRegisters[i].energy;
+    }
+    // INDEX AND STATUS
+    appData[appDataSize++] = i;
+    appData[appDataSize++] = meter.status();
+    // POWER (W)
+    uint16_t power_lora = meterPower;
+    appData[appDataSize++] = power_lora >> 8;
+    appData[appDataSize++] = power_lora & 0xFF;
+    // ENERGY (KWH)
+    uint32_t totalkWh_lora = meterEnergy / 10;
+    appData[appDataSize++] = totalkWh_lora >> 24;
+    appData[appDataSize++] = totalkWh_lora >> 16;
+    appData[appDataSize++] = totalkWh_lora >> 8;
+    appData[appDataSize++] = totalkWh_lora & 0xFF;
+  }
+  appPort = MULTI_METER_APP_PORT;
+}
+
+#ifdef DIAGNOSTIC_CAPTURE
+/* Hands the raw bytes of the readout that just ended to the upload */
+void finishDiagnosticCapture() {
+  if (!diagnosticCapturing) {
+    return;
+  }
+  diagnosticCapturing = false;
+  diagnostic.start(reader.captured());
+  reader.set_capture(NULL, 0);
+}
+
+/* A wake scheduled for a fragment only sends the fragment, returns false on the wakes of the readings */
+bool sendDiagnosticFragment() {
+  if (!fragmentWakeScheduled) {
+    return false;
+  }
+  fragmentWakeScheduled = false;
+  appDataSize = diagnostic.next_fragment(appData, maxPayloadSize());
+  if (appDataSize == 0) {
+    return false;
+  }
+  appPort = DIAGNOSTIC_APP_PORT;
+  // never wait for an ack of a fragment, nor mistake it for the ack of buffered readings
+  bool confirmed = isTxConfirmed;
+  isTxConfirmed = false;
+  sendFrame();
+  isTxConfirmed = confirmed;
+  fragmentSent = true;
+  return true;
+}
+
+/* While fragments are left the sleep until the next reading is split into fragment wakes,
+   the readings keep their schedule [ms] */
+uint32_t diagnosticSleepTime(uint32_t sleep) {
+  uint32_t now = nowSeconds();
+  if (fragmentSent) {
+    fragmentSent = false;
+    sleep = nextReadingAt > now ? (nextReadingAt - now) * 1000 : 1000;
+  } else {
+    nextReadingAt = now + sleep / 1000;
+  }
+  // the wake after the fragment has to keep the duty cycle as well
+  fragmentWakeScheduled = diagnostic.pending() && sleep >= 2 * DIAGNOSTIC_FRAGMENT_INTERVAL;
+  return fragmentWakeScheduled ? DIAGNOSTIC_FRAGMENT_INTERVAL : sleep;
+}
+#endif
+
 void onWakeUp() {
   delay(10);
   if (digitalRead(INT_GPIO) == 0) {
     Serial.println("Woke up by GPIO");
-    // resetRetryTime();
+#ifdef SERIAL_DISCOVERY
+    // probe the serial settings again with the next readout, e.g. after the meter was replaced
+    discoveryRequested = true;
+#endif
+    // retryScheduler.succeeded();
     // deviceState = DEVICE_STATE_SEND; // DEBUGME: After the button is pressed direclty read data from the smart-meter
   }
 }
 
-int determineRetryTime() {
-  retrySleepTime *= BACKOFF_MULTIPLIER;
-  if (retrySleepTime > sleepTime) {
-    retrySleepTime = sleepTime;
+#ifdef SERIAL_DISCOVERY
+/* Probes the serial settings of the meter, the optical head has to be powered */
+void discoverSerialParameters() {
+  MeterConfig meter = settings::current().meter;
+  if (discover_serial_parameters(Serial1, meter) == IecMeter) {
+    settings::store_discovered(meter);
   }
-  return retrySleepTime;
+  // sets up the serial again before the readout
+  applySettings();
 }
+#endif
 
-void resetRetryTime() {
-  retrySleepTime = INITIAL_RETRY_SLEEP_TIME;
+void startReading() {
+#ifdef LOAD_PROFILE_READOUT
+  if (loadProfileFrom != 0) {
+    reader.start_load_profile_reading(loadProfileFrom);
+  } else {
+    reader.start_reading();
+  }
+#else
+  scheduler.start_reading();
+#endif
 }
 
 void setup() {
@@ -244,13 +770,44 @@ void setup() {
   Serial1.begin(INITIAL_BAUD_RATE, PARITY_SETTING);
   Serial1.setTimeout(10);
 
-  pinMode(Vext, OUTPUT);
+  powerSequencer.begin();
   pinMode(INT_GPIO, INPUT);
 
   attachInterrupt(INT_GPIO, onWakeUp, FALLING);
 
-  reader.start_monitoring(OBIS_VALUE_POWER);
-  reader.start_monitoring(OBIS_VALUE_TOTAL_ENERGY);
+#if METER_COUNT > 1
+  const uint8_t muxPins[] = MUX_SELECT_PINS;
+  scheduler.set_mux_pins(muxPins, sizeof(muxPins));
+  for (size_t i = 0; i < METER_COUNT; i++) {
+    scheduler.add(readers[i], i);
+  }
+#else
+  scheduler.add(reader);
+#endif
+
+  for (size_t i = 0; i < METER_COUNT; i++) {
+    readers[i].set_listener({ onRegister, onSessionEnd, &meterRegisters[i] });
+  }
+
+  EEPROM.begin(EEPROM_SIZE);
+  journal.begin();
+  settings::begin(sleepTime);
+  applySettings();
+#ifdef ADAPTIVE_WAKE
+  governor.begin();
+#endif
+#ifdef DIAGNOSTIC_CAPTURE
+  diagnostic.begin();
+#endif
+#ifdef SERIAL_DISCOVERY
+  discoveryRequested = !settings::current().serialDiscovered;
+#endif
+#if defined(LOAD_PROFILE_READOUT) || defined(DERIVED_METRICS) || defined(ALIGNED_WAKE)
+  reader.start_monitoring(OBIS_VALUE_TIME);
+#endif
+#if defined(LOAD_PROFILE_READOUT) || defined(ALIGNED_WAKE)
+  reader.start_monitoring(OBIS_VALUE_DATE);
+#endif
 
 #if(AT_SUPPORT)
   enableAt();
@@ -260,6 +817,7 @@ void setup() {
 
   LoRaWAN.ifskipjoin();
   logger::info("Setup done");
+  energy.add(McuActive, millis());
 }
 
 void loop() {
@@ -276,14 +834,43 @@ void loop() {
       }
     case DEVICE_STATE_JOIN:
       {
+        joining = true;
+        joinStartedAt = nowSeconds();
+        joinAttempts = 0;
+        accountJoinAttempts();
         LoRaWAN.join();
         break;
       }
     case DEVICE_STATE_SEND:
       {
-        Status readerState = reader.status();
-        reader.loop();
+        if (joining) {
+          accountJoinAttempts();
+          joining = false;
+        }
+        Status readerState = scheduler.status();
+        scheduler.loop();
         if (readerState == Ready) {
+          awakeSince = millis();
+          // the acknowledgement of the last uplink would have arrived by now
+          journal.flush();
+#ifdef DIAGNOSTIC_CAPTURE
+          if (sendDiagnosticFragment()) {
+            deviceState = DEVICE_STATE_CYCLE;
+            break;
+          }
+#endif
+          // the head warms up while the battery is measured
+          powerSequencer.head_on();
+          if (settings::apply_pending()) {
+            applySettings();
+#ifdef SERIAL_DISCOVERY
+            // e.g. reset to the defaults by a downlink
+            discoveryRequested = discoveryRequested || !settings::current().serialDiscovered;
+#endif
+          }
+#ifdef DEVICE_TIME_REQUEST
+          syncNetworkTime();
+#endif
           uptimeCount ++;
           updateBatteryData();
           // cubecell cannot format float/double values (%f) -> thus let's cast to int
@@ -292,42 +879,152 @@ void loop() {
           logger::debug("Energy:          %d [kWh]", (int)(totalkWh));
           logger::debug("Power:           %d [w]", (int)(power));
           logger::debug("sleepTime:       %d [s]", (int)(sleepTime / 1000.0));
-          logger::debug("retrySleepTime:  %d [s]", (int)(retrySleepTime / 1000.0 ));
+          logger::debug("retryFailures:   %d", retryScheduler.failures());
           logger::debug("appTxDutyCycle:  %d [s]", (int)(appTxDutyCycle / 1000.0));
-          digitalWrite(Vext, LOW);
-          delay(50); // TODO is this needed?
-          reader.start_reading();
+          powerSequencer.wait_for_head();
+#ifdef SERIAL_DISCOVERY
+          if (discoveryRequested) {
+            discoveryRequested = false;
+            discoverSerialParameters();
+          }
+#endif
+#ifdef DIAGNOSTIC_CAPTURE
+          // a new capture would overwrite the telegram of the upload in progress
+          if (diagnosticRequested && !diagnostic.pending()) {
+            diagnosticRequested = false;
+            diagnosticCapturing = true;
+            reader.set_capture(diagnostic.buffer(), diagnostic.capacity());
+          }
+#endif
+          startReading();
         } else if (readerState == Ok) {
           logger::debug("Reader OK");
+#ifdef DIAGNOSTIC_CAPTURE
+          finishDiagnosticCapture();
+#endif
+          powerSequencer.head_off();
+          powerSequencer.learn(reader.first_response_latency());
+#ifdef LINK_ADAPTATION
+          LinkChoice linkChoice = applyLinkChoice();
+#endif
+#if METER_COUNT > 1
+#ifdef ALIGNED_WAKE
+          syncMeterClock();
+#endif
+          prepareMultiMeterTxFrame();
+          scheduler.acknowledge();
+          sendFrame();
+          retryScheduler.succeeded();
+          appTxDutyCycle = nextWakeInterval();
+          deviceState = DEVICE_STATE_CYCLE;
+          break;
+#endif
+#ifdef LOAD_PROFILE_READOUT
+          if (reader.mode() == LoadProfileReadout) {
+            if (prepareLoadProfileTxFrame()) {
+              sendFrame();
+            }
+            reader.acknowledge();
+            retryScheduler.succeeded();
+            appTxDutyCycle = nextWakeInterval();
+            deviceState = DEVICE_STATE_CYCLE;
+            break;
+          }
+          updateLoadProfileStart();
+#endif
           updateMeterData();
+#ifdef ALIGNED_WAKE
+          syncMeterClock();
+#endif
+#ifdef ADAPTIVE_WAKE
+          governor.add_reading((uint16_t)power);
+#endif
+#ifdef DERIVED_METRICS
+          metrics.update(nowSeconds(), (uint32_t)(totalkWh * 1000 + 0.5), (uint16_t)power, meterMinuteOfDay());
+#endif
           reader.acknowledge();
-          prepareTxFrame( appPort );
-          LoRaWAN.send();
-          resetRetryTime();
-          appTxDutyCycle = sleepTime;
+          journal.append(nowSeconds(), (uint32_t)(totalkWh * 100), (uint16_t)power, batteryPct);
+#ifdef LINK_ADAPTATION
+          if (journal.pending() < linkChoice.batch) {
+            // a slow data rate, the reading goes out with the next ones in a journal frame
+            logger::info("Holding %d of %d readings for a batch", journal.pending(), linkChoice.batch);
+            retryScheduler.succeeded();
+            appTxDutyCycle = nextWakeInterval();
+            deviceState = DEVICE_STATE_CYCLE;
+            break;
+          }
+#endif
+          if (journal.pending() > 1) {
+            prepareJournalTxFrame();
+          } else {
+            appPort = 2;
+            prepareTxFrame( appPort );
+            JournalRecord record;
+            if (journal.read(0, record)) {
+              journal.mark_in_flight(record.sequence);
+            }
+          }
+          sendFrame();
+          if (!isTxConfirmed) {
+            // without confirmed uplinks there is no way to know if the data arrived
+            journal.acknowledge();
+          }
+          retryScheduler.succeeded();
+          appTxDutyCycle = nextWakeInterval();
           deviceState = DEVICE_STATE_CYCLE;
         } else if (readerState != Busy) {
           logger::err("Reader Error with Status: %d", readerState);
-          reader.acknowledge();
-          appTxDutyCycle = determineRetryTime();
+#ifdef DIAGNOSTIC_CAPTURE
+          // the telegrams of failing readouts are the interesting ones
+          finishDiagnosticCapture();
+#endif
+          powerSequencer.learn(reader.first_response_latency());
+          scheduler.acknowledge();
+          RetryClass retryClass = retry_class_for(readerState);
+          if (retryScheduler.retry_now(retryClass)) {
+            // the head is still powered
+            startReading();
+            break;
+          }
+          powerSequencer.head_off();
+          appTxDutyCycle = retryScheduler.next_delay(retryClass, wakeInterval);
           deviceState = DEVICE_STATE_CYCLE;
         }
         break;
       }
     case DEVICE_STATE_CYCLE:
       {
-        digitalWrite(Vext, HIGH);
+        powerSequencer.head_off();
         // Schedule next packet transmission
         txDutyCycleTime = appTxDutyCycle + randr( 0, APP_TX_DUTYCYCLE_RND );
+#ifdef ALIGNED_WAKE
+        if (appTxDutyCycle == wakeInterval && timeBase.valid()) {
+          // no random offset, the readings have to be on the boundaries
+          txDutyCycleTime = alignedSleepTime();
+        }
+#endif
+#ifdef DIAGNOSTIC_CAPTURE
+        txDutyCycleTime = diagnosticSleepTime(txDutyCycleTime);
+#endif
         LoRaWAN.cycle(txDutyCycleTime);
         deviceState = DEVICE_STATE_SLEEP;
-        logger::debug("Go to sleep for: %d ms", appTxDutyCycle);
+        logger::debug("Go to sleep for: %d ms", txDutyCycleTime);
         delay(50);
+        // the delay above is awake time as well
+        if (awakeSince != 0) {
+          energy.add(McuActive, millis() - awakeSince);
+          energy.add(OpticalHead, powerSequencer.take_on_time());
+          energy.report(nowSeconds());
+          awakeSince = 0;
+        }
         break;
       }
     case DEVICE_STATE_SLEEP:
       {
         LoRaWAN.sleep();
+        if (joining) {
+          accountJoinAttempts();
+        }
         break;
       }
     default:
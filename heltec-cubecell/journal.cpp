@@ -0,0 +1,121 @@
+#include "journal.h"
+#include "logger.h"
+#include "EEPROM.h"
+
+size_t const JOURNAL_MARKERS = 8;
+size_t const MARKER_EEPROM_OFFSET = JOURNAL_EEPROM_OFFSET + JOURNAL_RECORDS * sizeof(JournalRecord);
+
+struct JournalMarker {
+  uint32_t tail;
+  uint32_t check; /* ~tail */
+};
+
+static uint8_t crc8(uint8_t const *data, size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint8_t record_crc(JournalRecord const &record) {
+  return crc8((uint8_t const *) &record, offsetof(JournalRecord, crc));
+}
+
+static size_t record_address(uint32_t sequence) {
+  return JOURNAL_EEPROM_OFFSET + (sequence % JOURNAL_RECORDS) * sizeof(JournalRecord);
+}
+
+static bool is_valid(JournalRecord const &record) {
+  return record.sequence != 0 && record.sequence != 0xFFFFFFFF && record.crc == record_crc(record);
+}
+
+void Journal::begin() {
+  uint32_t last = 0;
+  for (size_t slot = 0; slot < JOURNAL_RECORDS; slot++) {
+    JournalRecord record;
+    EEPROM.get(JOURNAL_EEPROM_OFFSET + slot * sizeof(JournalRecord), record);
+    if (is_valid(record) && record.sequence > last) {
+      last = record.sequence;
+    }
+  }
+  head_ = last + 1;
+
+  uint32_t tail = 0;
+  for (size_t slot = 0; slot < JOURNAL_MARKERS; slot++) {
+    JournalMarker marker;
+    EEPROM.get(MARKER_EEPROM_OFFSET + slot * sizeof(JournalMarker), marker);
+    if (marker.check == ~marker.tail && marker.tail != 0xFFFFFFFF && marker.tail >= tail) {
+      tail = marker.tail;
+      markerSlot_ = slot;
+    }
+  }
+  tail_ = tail < 1 ? 1 : tail;
+  if (tail_ > head_) {
+    tail_ = head_;
+  }
+  if (head_ - tail_ > JOURNAL_RECORDS) {
+    tail_ = head_ - JOURNAL_RECORDS;
+  }
+  bootSequence_ = head_;
+  flashPending_ = pending() > 0;
+  logger::debug("Journal restored with %d pending readings", pending());
+}
+
+void Journal::append(uint32_t timestamp, uint32_t totalkWh, uint16_t power, uint8_t batteryPct) {
+  JournalRecord record;
+  memset(&record, 0, sizeof(record));
+  record.sequence = head_;
+  record.timestamp = timestamp;
+  record.totalkWh = totalkWh;
+  record.power = power;
+  record.batteryPct = batteryPct;
+  record.crc = record_crc(record);
+
+  EEPROM.put(record_address(head_), record);
+  dirty_ = true;
+
+  head_++;
+  /* The oldest reading was overwritten if the ring is full */
+  if (head_ - tail_ > JOURNAL_RECORDS) {
+    tail_ = head_ - JOURNAL_RECORDS;
+  }
+}
+
+bool Journal::read(size_t index, JournalRecord &record) const {
+  if (index >= pending()) {
+    return false;
+  }
+  uint32_t sequence = tail_ + index;
+  EEPROM.get(record_address(sequence), record);
+  return is_valid(record) && record.sequence == sequence;
+}
+
+void Journal::acknowledge() {
+  if (inFlight_ < tail_) {
+    return;
+  }
+  tail_ = inFlight_ + 1 < head_ ? inFlight_ + 1 : head_;
+  inFlight_ = 0;
+
+  JournalMarker marker;
+  marker.tail = tail_;
+  marker.check = ~tail_;
+  markerSlot_ = (markerSlot_ + 1) % JOURNAL_MARKERS;
+  EEPROM.put(MARKER_EEPROM_OFFSET + markerSlot_ * sizeof(JournalMarker), marker);
+  dirty_ = true;
+}
+
+void Journal::flush() {
+  bool unacknowledged = inFlight_ != 0 && inFlight_ >= tail_;
+  if (!dirty_ || !(unacknowledged || flashPending_)) {
+    return;
+  }
+  EEPROM.commit();
+  dirty_ = false;
+  flashPending_ = pending() > 0;
+  logger::debug("Journal committed with %d pending readings", pending());
+}
@@ -0,0 +1,66 @@
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include "config.h"
+#include "Arduino.h"
+
+struct JournalRecord {
+  uint32_t sequence;   /* 0 and 0xFFFFFFFF are never used, so erased or empty slots are invalid */
+  uint32_t timestamp;  /* seconds since boot when the reading was taken */
+  uint32_t totalkWh;   /* 1/100 kWh */
+  uint16_t power;      /* W */
+  uint8_t batteryPct;
+  uint8_t crc;
+};
+
+/* Append-only ring of readings in the emulated EEPROM. Head and tail are never stored
+   in a fixed cell: the head is recovered from the highest valid sequence number and
+   the tail from a small ring of markers. A record only counts once its CRC matches,
+   so a write cut short by a power failure is simply ignored.
+   This is no wear levelling: the CubeCell EEPROM emulation rewrites all of its flash
+   on every commit. Hence records and markers are only written to the RAM copy (which
+   is retained during sleep) and committed by flush() when an uplink went out without
+   being acknowledged, i.e. during an outage, and once more when the backlog is gone.
+   While every reading is delivered right away the flash is not written at all, a reset
+   then only loses the reading of the current cycle and readings held for a batch. */
+class Journal {
+  public:
+    /* Restores head and tail from flash, call once after a cold boot (after EEPROM.begin) */
+    void begin();
+
+    void append(uint32_t timestamp, uint32_t totalkWh, uint16_t power, uint8_t batteryPct);
+
+    /* Number of readings not delivered yet */
+    size_t pending() const {
+      return head_ - tail_;
+    }
+
+    /* Reads the pending record at the given position (0 = oldest) */
+    bool read(size_t index, JournalRecord &record) const;
+
+    /* Whether the record was taken before the last reset, its timestamp is meaningless then */
+    bool from_previous_boot(JournalRecord const &record) const {
+      return record.sequence < bootSequence_;
+    }
+
+    /* Remember that all records up to (and including) the given sequence were sent */
+    void mark_in_flight(uint32_t sequence) {
+      inFlight_ = sequence;
+    }
+
+    /* The records in flight were delivered and can be dropped */
+    void acknowledge();
+
+    /* Commits to flash if records were sent but not acknowledged, or if the flash still
+       lists records as pending that were delivered since. Call once the acknowledgement
+       of the last uplink is due, e.g. at the start of the next cycle */
+    void flush();
+
+  private:
+    uint32_t head_ = 1, tail_ = 1, inFlight_ = 0, bootSequence_ = 1;
+    uint8_t markerSlot_ = 0;
+    bool dirty_ = false;         /* the RAM copy differs from flash */
+    bool flashPending_ = false;  /* flash has pending records as of the last commit */
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "linkquality.h"
+#include "logger.h"
+
+/* Demodulation floor of LoRa at 125 kHz, DR0 (SF12): SNR -20 dB or -137 dBm, every faster
+   data rate needs about 2.5 dB more [dB/4] */
+static int16_t const FLOOR_SNR = -20 * 4;
+static int16_t const FLOOR_RSSI = -137 * 4;
+static int16_t const FLOOR_STEP = 10;
+
+/* The gateway transmits with more power than the node, a downlink overrates the uplink [dB] */
+static int16_t const DOWNLINK_ADVANTAGE = 6;
+
+/* EU868: TX power 0 (16 dBm EIRP) ... 7 (2 dBm EIRP), 2 dB each */
+static uint8_t const MAX_TX_POWER_INDEX = 7;
+static int16_t const TX_POWER_STEP = 2 * 4;
+
+/* Largest extra margin after lost uplinks [dB] */
+static uint8_t const MAX_BOOST = 15;
+
+void LinkTracker::add_downlink(uint32_t now, int16_t rssi, int8_t snr) {
+  /* Above the noise floor the SNR saturates, the RSSI still tells the margin there */
+  int16_t margin = snr > 0 ? rssi * 4 - FLOOR_RSSI : snr * 4 - FLOOR_SNR;
+  margin -= DOWNLINK_ADVANTAGE * 4;
+  margin_ = samples_ == 0 || !known(now) ? margin : (3 * (int32_t) margin_ + margin) / 4;
+  if (samples_ < 255) {
+    samples_++;
+  }
+  lastSample_ = now;
+  logger::debug("Link: rssi %d [dBm], snr %d [dB], margin %d [dB/4] at DR0", rssi, snr, margin_);
+}
+
+void LinkTracker::add_uplink(uint32_t now, bool confirmed) {
+  if (awaitingAck_) {
+    delivery_ = 7 * (uint32_t) delivery_ / 8;
+    boost_ = boost_ + 3 > MAX_BOOST ? MAX_BOOST : boost_ + 3;
+    logger::info("Link: uplink lost, delivery %d [permille], margin +%d [dB]", delivery_, boost_);
+  }
+  awaitingAck_ = confirmed;
+  if (confirmed) {
+    lastProbe_ = now;
+  }
+}
+
+void LinkTracker::add_ack() {
+  if (!awaitingAck_) {
+    return;
+  }
+  awaitingAck_ = false;
+  delivery_ = (7 * (uint32_t) delivery_ + 1000) / 8;
+  if (boost_ > 0 && delivery_ >= LINK_TARGET_DELIVERY) {
+    boost_--;
+  }
+}
+
+bool LinkTracker::known(uint32_t now) const {
+  return samples_ > 0 && now - lastSample_ <= LINK_STALE_TIME;
+}
+
+bool LinkTracker::probe_due(uint32_t now) const {
+  if (!known(now)) {
+    /* measure soon, until then the fallback data rate is used */
+    return lastProbe_ == 0 || now - lastProbe_ >= LINK_PROBE_INTERVAL / 4;
+  }
+  return now - lastProbe_ >= LINK_PROBE_INTERVAL;
+}
+
+LinkChoice LinkTracker::choose(uint32_t now) const {
+  LinkChoice choice = { LINK_FALLBACK_DATA_RATE, 0, 1 };
+  if (!known(now)) {
+    return choice;
+  }
+  int16_t spare = margin_ - (LINK_MARGIN + boost_) * 4;
+  if (spare < 0) {
+    /* even DR0 at max power is short of the margin, the best there is */
+    choice.dataRate = 0;
+  } else {
+    choice.dataRate = spare / FLOOR_STEP >= LINK_DATA_RATES - 1 ? LINK_DATA_RATES - 1 : spare / FLOOR_STEP;
+    spare -= choice.dataRate * FLOOR_STEP;
+    choice.txPower = spare / TX_POWER_STEP >= MAX_TX_POWER_INDEX ? MAX_TX_POWER_INDEX : spare / TX_POWER_STEP;
+  }
+  choice.batch = choice.dataRate >= 3 ? 1 : 4 - choice.dataRate;
+  if (choice.batch > LINK_MAX_BATCH) {
+    choice.batch = LINK_MAX_BATCH;
+  }
+  return choice;
+}
@@ -0,0 +1,60 @@
+#ifndef _LINKQUALITY_H
+#define _LINKQUALITY_H
+
+#include "config.h"
+#include "Arduino.h"
+
+/* EU868 like regions: DR0 = SF12 ... DR5 = SF7 */
+uint8_t const LINK_DATA_RATES = 6;
+
+struct LinkChoice {
+  uint8_t dataRate;
+  uint8_t txPower;   /* index of the region, 0 = max EIRP, every step 2 dB less */
+  uint8_t batch;     /* readings per uplink */
+};
+
+/* Keeps a smoothed margin of the downlinks (acks and application downlinks) and the delivery
+   of the confirmed uplinks, and picks the data rate and TX power from them: the fastest data
+   rate whose margin over the demodulation floor reaches LINK_MARGIN, then as little power as
+   keeps that margin. Airtime halves with every data rate step while the radio current drops
+   far less per power step, thus this order gives the lowest charge per delivered byte. Lost
+   uplinks widen the margin, delivered ones narrow it again while the delivery ratio is above
+   LINK_TARGET_DELIVERY. At the slow data rates the preamble and header dominate an uplink,
+   there the readings are batched. Integer arithmetic only. */
+class LinkTracker {
+  public:
+    /* Feed every received downlink. rssi: [dBm], snr: [dB] */
+    void add_downlink(uint32_t now, int16_t rssi, int8_t snr);
+
+    /* Feed every uplink before it is sent, a confirmed one that wasn't acknowledged until the
+       next counts as lost */
+    void add_uplink(uint32_t now, bool confirmed);
+
+    /* The last confirmed uplink was acknowledged */
+    void add_ack();
+
+    /* What to use for the next uplink, the defaults while the link isn't known */
+    LinkChoice choose(uint32_t now) const;
+
+    /* Whether the next uplink should be confirmed to measure the link, even if the
+       uplinks are unconfirmed otherwise */
+    bool probe_due(uint32_t now) const;
+
+    /* Smoothed delivery ratio of the confirmed uplinks [permille] */
+    uint16_t delivery() const {
+      return delivery_;
+    }
+
+  private:
+    bool known(uint32_t now) const;
+
+    int16_t margin_ = 0;        /* smoothed margin at DR0 and max power [dB/4] */
+    uint8_t samples_ = 0;
+    uint32_t lastSample_ = 0;   /* [s] */
+    uint32_t lastProbe_ = 0;    /* [s] */
+    uint16_t delivery_ = 1000;  /* [permille] */
+    uint8_t boost_ = 0;         /* extra margin after lost uplinks [dB] */
+    bool awaitingAck_ = false;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "loadprofile.h"
+#include "logger.h"
+#include "noheap.h"
+
+/* P.01(sYYMMDDhhmmss)(status)(interval)(channels)(id-1)(unit-1)...(id-n)(unit-n) */
+size_t const HEADER_FIELDS = 4;
+size_t const MAX_FIELD_LENGTH = 16;
+
+/* days between 1970-01-01 and 2000-01-01 */
+int32_t const EPOCH_2000_DAYS = 10957;
+
+static int32_t days_from_civil(int year, int month, int day) {
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  int32_t yoe = year - era * 400;
+  int32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(int32_t days, int &year, int &month, int &day) {
+  days += 719468;
+  int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int32_t doe = days - era * 146097;
+  int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int32_t mp = (5 * doy + 2) / 153;
+  day = doy - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = yoe + era * 400 + (month <= 2);
+}
+
+static int two_digits(const char *chars) {
+  if (!isdigit((uint8_t) chars[0]) || !isdigit((uint8_t) chars[1])) {
+    return -1;
+  }
+  return (chars[0] - '0') * 10 + (chars[1] - '0');
+}
+
+/* Parses a decimal value like "0.012" or "1.5*kWh" into thousandths of its unit */
+static uint16_t parse_thousandths(const char *value) {
+  uint32_t result = 0;
+  int decimals = -1;
+  for (const char *c = value; *c != 0 && decimals < 3; c++) {
+    if (*c == '.' || *c == ',') {
+      decimals = 0;
+    } else if (isdigit((uint8_t) *c)) {
+      result = result * 10 + (*c - '0');
+      if (decimals >= 0) {
+        decimals++;
+      }
+      if (result > 0xFFFFFF) {
+        break;
+      }
+    } else {
+      break;
+    }
+  }
+  for (int i = decimals < 0 ? 0 : decimals; i < 3; i++) {
+    result *= 10;
+  }
+  return result > 0xFFFF ? 0xFFFF : result;
+}
+
+uint32_t load_profile_minutes(int year, int month, int day, int hour, int minute) {
+  int32_t days = days_from_civil(year, month, day) - EPOCH_2000_DAYS;
+  if (days < 0) {
+    return 0;
+  }
+  return (uint32_t) days * 1440 + hour * 60 + minute;
+}
+
+uint32_t parse_load_profile_timestamp(const char *zst) {
+  if (strlen(zst) < LOAD_PROFILE_TIMESTAMP_LENGTH - 1) {
+    return 0;
+  }
+  /* skip the season flag */
+  int year = two_digits(zst + 1);
+  int month = two_digits(zst + 3);
+  int day = two_digits(zst + 5);
+  int hour = two_digits(zst + 7);
+  int minute = two_digits(zst + 9);
+  if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+    return 0;
+  }
+  return load_profile_minutes(2000 + year, month, day, hour, minute);
+}
+
+void format_load_profile_timestamp(uint32_t minutes, char season, char out[LOAD_PROFILE_TIMESTAMP_LENGTH]) {
+  int year, month, day;
+  civil_from_days(minutes / 1440 + EPOCH_2000_DAYS, year, month, day);
+  snprintf(out, LOAD_PROFILE_TIMESTAMP_LENGTH, "%c%02d%02d%02d%02d%02d", season, year % 100, month, day,
+           (int) (minutes % 1440) / 60, (int) (minutes % 60));
+}
+
+void LoadProfile::clear() {
+  count_ = 0;
+  channels_ = 0;
+  channel_ = 0;
+}
+
+bool LoadProfile::parse_line(const char *line) {
+  bool header = strncmp(line, "P.01", 4) == 0;
+  size_t field = 0;
+  char token[MAX_FIELD_LENGTH];
+  const char *cursor = line;
+  const char *open;
+
+  while (!full() && (open = strchr(cursor, '(')) != NULL) {
+    const char *close = strchr(open, ')');
+    if (close == NULL) {
+      logger::warn("unterminated load profile field");
+      break;
+    }
+    size_t len = close - open - 1;
+    if (len >= MAX_FIELD_LENGTH) {
+      len = MAX_FIELD_LENGTH - 1;
+    }
+    memcpy(token, open + 1, len);
+    token[len] = 0;
+    cursor = close + 1;
+
+    if (header && field < HEADER_FIELDS + 2 * channels_) {
+      if (field == 0) {
+        uint32_t timestamp = parse_load_profile_timestamp(token);
+        if (timestamp != 0) {
+          nextTimestamp_ = timestamp;
+          season_ = token[0];
+        }
+      } else if (field == 1) {
+        status_ = strtoul(token, NULL, 16);
+      } else if (field == 2) {
+        interval_ = atoi(token);
+      } else if (field == 3) {
+        channels_ = atoi(token);
+        channel_ = 0;
+      }
+      /* channel ids and units are not needed */
+    } else {
+      add_value(token);
+    }
+    field++;
+  }
+  return !full();
+}
+
+void LoadProfile::add_value(const char *value) {
+  if (channels_ == 0) {
+    /* values before the first header can't be assigned to a timestamp */
+    return;
+  }
+  LoadProfileEntry &entry = entries_[count_];
+  if (channel_ == 0) {
+    memset(&entry, 0, sizeof(entry));
+    entry.timestamp = nextTimestamp_;
+    entry.status = status_;
+  }
+  if (channel_ < MAX_LOAD_PROFILE_CHANNELS) {
+    entry.values[channel_] = parse_thousandths(value);
+  }
+  if (++channel_ >= channels_) {
+    channel_ = 0;
+    count_++;
+    nextTimestamp_ += interval_;
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef _LOADPROFILE_H
+#define _LOADPROFILE_H
+
+#include "config.h"
+#include "Arduino.h"
+
+size_t const MAX_LOAD_PROFILE_CHANNELS = 2;
+size_t const LOAD_PROFILE_TIMESTAMP_LENGTH = 11 + 1; /* sYYMMDDhhmm */
+
+struct LoadProfileEntry {
+  uint32_t timestamp;                          /* minutes since 2000-01-01 00:00 (meter time) */
+  uint8_t status;
+  uint16_t values[MAX_LOAD_PROFILE_CHANNELS];  /* thousandths of the channel unit, e.g. Wh for kWh */
+};
+
+/* Collects the interval records of a P.01 response line by line, so the
+   whole telegram never has to be buffered */
+class LoadProfile {
+  public:
+    void clear();
+
+    /* Feed one line of the P.01 response (without STX and CR/LF).
+       Returns false once no more entries can be stored */
+    bool parse_line(const char *line);
+
+    bool full() const {
+      return count_ >= MAX_LOAD_PROFILE_ENTRIES;
+    }
+
+    size_t size() const {
+      return count_;
+    }
+
+    LoadProfileEntry const &entry(size_t index) const {
+      return entries_[index];
+    }
+
+    uint8_t interval() const {
+      return interval_;
+    }
+
+    uint8_t channels() const {
+      return channels_;
+    }
+
+    /* Season flag of the last header, needed to request entries by timestamp */
+    char season() const {
+      return season_;
+    }
+
+  private:
+    void add_value(const char *value);
+
+    LoadProfileEntry entries_[MAX_LOAD_PROFILE_ENTRIES];
+    size_t count_ = 0;
+    uint32_t nextTimestamp_ = 0;
+    uint8_t interval_ = LOAD_PROFILE_INTERVAL, channels_ = 0, status_ = 0, channel_ = 0;
+    char season_ = '0';
+};
+
+/* Converts a calendar date/time into minutes since 2000-01-01 00:00 */
+uint32_t load_profile_minutes(int year, int month, int day, int hour, int minute);
+
+/* Parses a P.01 timestamp in the form sYYMMDDhhmm[ss], returns 0 if malformed */
+uint32_t parse_load_profile_timestamp(const char *zst);
+
+/* Formats minutes since 2000-01-01 as sYYMMDDhhmm (s = season flag) */
+void format_load_profile_timestamp(uint32_t minutes, char season, char out[LOAD_PROFILE_TIMESTAMP_LENGTH]);
+
+#endif
@@ -1,6 +1,8 @@
 #include "meter.h"
 #include "logger.h"
+#include "noheap.h"
 
+#define SOH '\x01'
 #define STX '\x02'
 #define ETX '\x03'
 
@@ -32,64 +34,108 @@ static BaudSwitchParameters baud_char_to_params(char identification) {
     return {false, 0};                                     /* no acknowledgement, don't switch baud */
 }
 
-static bool is_valid_object_value(std::string value) {
-  for (size_t i = 0; i < value.size(); ++i)
+static bool is_valid_object_value(const char *value) {
+  for (const char *c = value; *c != 0; ++c)
   {
-    if (!strchr(OBJECT_VALUE_ALLOWED_CHARS, value[i]))
+    if (!strchr(OBJECT_VALUE_ALLOWED_CHARS, *c))
       return false;
   }
   return true;
 }
 
-static void postprocess_value(std::string &value) {
+static void postprocess_value(char *value) {
 #ifdef STRIP_UNIT
-  size_t unit_sep_pos = value.find_last_of(UNIT_SEPARATOR);
-  if (unit_sep_pos != std::string::npos)
-    value.erase(unit_sep_pos, std::string::npos);
+  char *unit_sep = strrchr(value, UNIT_SEPARATOR);
+  if (unit_sep != NULL)
+    *unit_sep = 0;
 #endif
 }
 
+MeterConfig default_meter_config() {
+  MeterConfig config;
+  memset(&config, 0, sizeof(config));
+#ifdef METER_IDENTIFIER
+  const char *identifier = METER_IDENTIFIER;
+  if (identifier != NULL) {
+    strncpy(config.identifier, identifier, MAX_METER_IDENTIFIER_LENGTH - 1);
+  }
+#endif
+#ifdef MODE_OVERRIDE
+  config.modeOverride = MODE_OVERRIDE;
+#endif
+  config.baudrateChangeDelay = BAUDRATE_CHANGE_DELAY;
+  config.identificationTimeout = SERIAL_IDENTIFICATION_READING_TIMEOUT;
+  config.readingTimeout = SERIAL_READING_TIMEOUT;
+  config.maxReadTime = MAX_METER_READ_TIME;
+  config.parity = PARITY_SETTING;
+  config.initialBaudRate = INITIAL_BAUD_RATE;
+  return config;
+}
+
 void MeterReader::start_reading() {
+  begin_reading(DataReadout);
+}
+
+void MeterReader::start_load_profile_reading(uint32_t from) {
+  begin_reading(LoadProfileReadout);
+  if (status_ == Busy) {
+    profileFrom_ = from;
+    loadProfile_.clear();
+  }
+}
+
+void MeterReader::begin_reading(ReadoutMode mode) {
   /* Don't allow starting a read when one is already in progress */
   if (status_ == Busy) {
     return;
   }
+  mode_ = mode;
   startTime_ = millis();
-  Serial1.updateBaudRate(INITIAL_BAUD_RATE);
-
-
-  // Hack: Sometimes it seems as there is already some data in the rx buffer thus let's clear it.
-  // THE Elster AS 3000 has sometimes a weird behaviour where the data is being send in an endless loop.
-  // The only way to stop the loop is by manually pressing the meter's menu button many times to navigate through all the obis values till you reach END (ETX).
-  // Thus I also added a timeout check here
-  logger::debug("Clear serial buffer");
-  while (Serial1.read() >= 0) {
-    logger::debug(".");
-    if (startTime_ + (2 * 1000) < millis()) {
-      change_status(TimeoutError);
-      return;
-    }
-    delay(20);
+  firstResponseLatency_ = 0;
+  memset(&statistics_, 0, sizeof(statistics_));
+  captured_ = 0;
+  baud_ = config_.initialBaudRate;
+  if (parity_ != activeParity_) {
+    /* the configuration changed the parity, e.g. after the discovery */
+    serial_.begin(baud_, parity_);
+    activeParity_ = parity_;
+  } else {
+    serial_.updateBaudRate(baud_);
   }
 
+
   status_ = Busy;
-  step_ = Started;
-  startTime_ = millis();
+  /* Data before our request means the meter is already sending, see read_unsolicited() */
+  if (serial_.available() > 0) {
+    logger::debug("Unsolicited data in the serial buffer");
+    serial_.setTimeout(reading_timeout());
+    unsolicitedLines_ = 0;
+    step_ = Unsolicited;
+  } else {
+    step_ = Started;
+  }
 }
 
 void MeterReader::send_request() {
   logger::debug("Step -> send_request");
   logger::debug(START_SEQUENCE);
-  Serial1.write(START_SEQUENCE);
-  Serial1.flush();
+  serial_.write(START_SEQUENCE);
+  serial_.flush();
+  requestTime_ = millis();
   step_ = RequestSent;
 }
 
 void MeterReader::read_identification() {
   logger::debug("Step -> read_identification");
-  Serial1.setTimeout(SERIAL_IDENTIFICATION_READING_TIMEOUT);
+  serial_.setTimeout(identification_timeout());
+  while (serial_.available() == 0 && millis() - requestTime_ < identification_timeout()) {
+    delay(1);
+  }
+  firstResponseLatency_ = serial_.available() > 0 ? millis() - requestTime_ : 0;
   static char identification[MAX_IDENTIFICATION_LENGTH];
-  size_t len = Serial1.readBytesUntil('\n', identification, MAX_IDENTIFICATION_LENGTH);
+  size_t len = serial_.readBytesUntil('\n', identification, MAX_IDENTIFICATION_LENGTH - 1);
+  identification[len] = 0;
+  capture(identification, len, true);
   logger::debug("identification=%s", identification);
   if (len < 6) {
     logger::err("ident too short (%u chars)\n", len);
@@ -97,110 +143,276 @@ void MeterReader::read_identification() {
     return;
   }
 
-  std::string idView = std::string(identification);
-  lastReadChars_ = idView;
-  
-#ifdef METER_IDENTIFIER
-  if (strlen(METER_IDENTIFIER) != 0 && idView.find(METER_IDENTIFIER) == std::string::npos) {
+  strcpy(lastReadChars_, identification);
+
+  if (strlen(config_.identifier) != 0 && strstr(identification, config_.identifier) == NULL) {
     logger::err("identification not matched: %s", identification);
     change_status(IdentificationError_Id_Mismatch);
     return;
   }
-#endif
 
-  /* Remove \r and null terminate */
-  identification[len - 1] = 0;
+  /* Remove \r, a cut off identification doesn't end with one */
+  if (identification[len - 1] == '\r') {
+    identification[len - 1] = 0;
+  }
+
+  baud_char_ = config_.modeOverride != 0 ? config_.modeOverride : identification[4];
 
-#ifndef MODE_OVERRIDE
-  baud_char_ = identification[4];
-#else
-  baud_char_ = MODE_OVERRIDE;
+#ifdef AUTO_TUNE_TIMINGS
+  MeterProfile const *profile = find_meter_profile(identification);
+  if (profile != tuner_.profile()) {
+    tuner_.reset(profile);
+  }
+  tuner_.observe_first_response(firstResponseLatency_);
 #endif
 
   step_ = IdentificationRead;
-  delay(BAUDRATE_CHANGE_DELAY);
+  delay(baudrate_change_delay());
 }
 
 void MeterReader::switch_baud() {
   logger::debug("Step -> switch_baud");
   BaudSwitchParameters params = baud_char_to_params(baud_char_);
   if (params.send_acknowledgement) {
-    Serial1.printf(ACK "0%c0\r\n", baud_char_);
-    Serial1.flush();
+    /* mode control character: 0 = data readout, 1 = programming mode */
+    serial_.printf(ACK "0%c%c\r\n", baud_char_, mode_ == LoadProfileReadout ? '1' : '0');
+    serial_.flush();
+  } else if (mode_ == LoadProfileReadout) {
+    logger::err("programming mode requires a mode C meter");
+    change_status(ProtocolError);
+    return;
   }
   delay(50); // TODO is this needed?
 
   if (params.new_baud) {
     logger::debug("switching to %d bps", params.new_baud);
-    Serial1.updateBaudRate(params.new_baud);
+    serial_.updateBaudRate(params.new_baud);
+    baud_ = params.new_baud;
   } else {
-    Serial1.updateBaudRate(INITIAL_BAUD_RATE);
+    serial_.updateBaudRate(config_.initialBaudRate);
   }
-  Serial1.setTimeout(SERIAL_READING_TIMEOUT);
-  step_ = InData;
+  serial_.setTimeout(reading_timeout());
+  step_ = mode_ == LoadProfileReadout ? ProgrammingMode : InData;
   /* Start with checksum=STX to avoid having to avoid xoring it */
   checksum_ = STX;
 }
 
 void MeterReader::read_line() {
   static char line[MAX_LINE_LENGTH];
-  size_t len = Serial1.readBytesUntil('\n', line, MAX_LINE_LENGTH);
+  unsigned long lineStart = millis();
+  size_t len = serial_.readBytesUntil('\n', line, MAX_LINE_LENGTH);
   if (len == MAX_LINE_LENGTH) {
-    logger::warn("probably truncated a line, expect a checksum error");
+    skip_long_line(line, len);
     return;
   } else if (len < 2) {
     /* A valid line will never be shorter than this */
     logger::warn("read short line or timed out");
     return;
   }
+
+  /* Whatever exceeds the transfer time of the line (10 bits per char) was spent waiting for the meter */
+  unsigned long elapsed = millis() - lineStart;
+  unsigned long transfer = (len + 1) * 10000UL / baud_;
+  tuner_.observe_line_gap(elapsed > transfer ? elapsed - transfer : 0);
+
+  process_line(line, len);
+}
+
+void MeterReader::add_to_checksum(const char *chars, size_t len) {
   for (size_t i = 0; i < len; ++i) {
-    checksum_ ^= line[i];
+    checksum_ ^= chars[i];
+  }
+}
+
+/* readBytesUntil drops the line feed, lineEnd puts it back */
+void MeterReader::capture(const char *chars, size_t len, bool lineEnd) {
+  if (capture_ == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < len && captured_ < captureSize_; i++) {
+    capture_[captured_++] = chars[i];
+  }
+  if (lineEnd && captured_ < captureSize_) {
+    capture_[captured_++] = '\n';
   }
+}
+
+/* The value of a line that doesn't fit into the buffer is lost, but its characters
+   still count for the checksum. Read up to the line feed, so the rest of the line
+   isn't mistaken for a line of its own */
+void MeterReader::skip_long_line(char *line, size_t len) {
+  logger::warn("line longer than %d chars, skipping it", MAX_LINE_LENGTH);
+  statistics_.truncatedLines++;
+  do {
+    add_to_checksum(line, len);
+    capture(line, len, false);
+    statistics_.bytes += len;
+  } while (len == MAX_LINE_LENGTH && (len = serial_.readBytesUntil('\n', line, MAX_LINE_LENGTH)) > 0);
+  checksum_ ^= '\n';
+  capture(NULL, 0, true);
+  statistics_.bytes++;
+  statistics_.lines++;
+}
+
+void MeterReader::process_line(char *line, size_t len) {
+  add_to_checksum(line, len);
+  capture(line, len, true);
   /* readBytesUntil doesn't include the terminator, so take it into account separately */
   checksum_ ^= '\n';
+  statistics_.lines++;
+  statistics_.bytes += len + 1;
 
-  line[len - 1] = 0; /* Cut off \r before logging the line */
+  /* Cut off \r before logging the line, len < MAX_LINE_LENGTH keeps the terminator in the buffer */
+  if (line[len - 1] == '\r') {
+    len--;
+  }
+  line[len] = 0;
 
   logger::debug("line -> %s", line);
 
-  if (line[len - 2] == '!') {
+  if (len > 0 && line[len - 1] == '!') {
     /* End of data, ETX and checksum will follow */
     logger::debug("ETX");
     step_ = AfterData;
   } else {
-    std::string lineView = std::string(line);
-    if (lineView[0] == STX) {
-      /* The first data line starts with an STX, remove it */
-      lineView.erase(0, 1);
-    }
-    int openParen = lineView.find_first_of('(');
-    int closeParen = lineView.find_last_of(')');
-    if (openParen != std::string::npos && closeParen != std::string::npos) {
-      std::string obis = lineView.substr(0, openParen);
-      std::string measuredValue = lineView.substr(openParen + 1, closeParen - (openParen + 1));
-      handle_object(obis, measuredValue);
-    } else {
-      logger::warn("improper data line format");
+    parse_data_line(line);
+  }
+}
+
+void MeterReader::parse_data_line(const char *line) {
+  if (line[0] == STX) {
+    /* The first data line starts with an STX, skip it */
+    line++;
+  }
+  const char *openParen = strchr(line, '(');
+  const char *closeParen = strrchr(line, ')');
+  if (openParen == NULL || closeParen == NULL || closeParen < openParen) {
+    logger::warn("improper data line format");
+    statistics_.malformedLines++;
+    return;
+  }
+  if (openParen == line) {
+    /* continuation of the previous object, e.g. further load profile values */
+    return;
+  }
+  ObisCode code;
+  if (!parse_obis_code(line, openParen - line, code)) {
+    logger::warn("malformed obis code");
+    statistics_.malformedLines++;
+    return;
+  }
+  if (!values_.monitors(code) && !subscribed(code)) {
+    return;
+  }
+  char measuredValue[MAX_VALUE_LENGTH];
+  size_t valueLen = closeParen - openParen - 1;
+  if (valueLen >= sizeof(measuredValue)) {
+    logger::warn("value too long");
+    statistics_.malformedLines++;
+    return;
+  }
+  memcpy(measuredValue, openParen + 1, valueLen);
+  measuredValue[valueLen] = 0;
+  handle_object(code, line, openParen - line, measuredValue);
+}
+
+/* FNV-1a, only used to recognize a line when it comes around again */
+static uint32_t line_hash(const char *line, size_t len) {
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ (uint8_t) line[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+/* The meter was already sending when the readout started. The Elster AS3000 sometimes
+   repeats its telegram in an endless loop, and only pressing its menu button through
+   all values stops it. Instead of waiting for silence, use the telegram it is sending:
+   once an STX shows up the rest is read like a normal readout (including the checksum),
+   if the stream has no STX the values are taken as soon as the first line comes around again. */
+void MeterReader::read_unsolicited() {
+  static char line[MAX_LINE_LENGTH];
+  size_t len = serial_.readBytesUntil('\n', line, MAX_LINE_LENGTH - 1);
+  if (len == 0) {
+    /* Silence, the buffer only held some leftovers. Continue with a normal readout */
+    logger::debug("no unsolicited data anymore");
+    step_ = Started;
+    return;
+  }
+
+  char *stx = (char *) memchr(line, STX, len);
+  if (stx != NULL && len - (stx - line) >= 2) {
+    logger::info("found the start of the repeated telegram");
+    checksum_ = STX;
+    step_ = InData;
+    process_line(stx, len - (stx - line));
+    return;
+  }
+
+  if (len == MAX_LINE_LENGTH - 1 && unsolicitedLines_ > 0) {
+    /* No line feeds at all, most likely sent at a different baud rate */
+    logger::warn("unsolicited data doesn't look like a telegram");
+    change_status(TimeoutError);
+    return;
+  }
+
+  uint32_t hash = line_hash(line, len);
+  if (unsolicitedLines_ == 1) {
+    /* The first line was most likely cut off, the second one is the reference */
+    firstLineHash_ = hash;
+  } else if (unsolicitedLines_ > 1 && hash == firstLineHash_) {
+    logger::info("telegram repeats after %d lines, using its values", unsolicitedLines_ - 1);
+    change_status(Ok);
+    return;
+  }
+
+  if (++unsolicitedLines_ > MAX_TELEGRAM_LINES) {
+    logger::warn("unsolicited data doesn't look like a telegram");
+    change_status(TimeoutError);
+    return;
+  }
+
+  if (unsolicitedLines_ > 1 && len >= 2 && line[len - 2] != '!') {
+    line[len - 1] = 0;
+    parse_data_line(line);
+  }
+}
+
+void MeterReader::handle_object(ObisCode const &code, const char *obis, size_t obisLen, char *value) {
+  postprocess_value(value);
+  if (!is_valid_object_value(value)) {
+    return;
+  }
+  logger::debug(" -> found valid obis entry: %.*s", (int) obisLen, obis);
+  if (listener_.onRegister != NULL) {
+    FixedPoint fixedPoint;
+    for (size_t i = 0; i < subscriptionCount_; i++) {
+      if (obis_matches(subscriptions_[i].pattern, code) && parse_fixed_point(value, fixedPoint)) {
+        listener_.onRegister(listener_.context, subscriptions_[i].id, fixedPoint);
+      }
     }
   }
+  if (values_.monitors(code) && !values_.store(code, obis, obisLen, value)) {
+    logger::warn("no room for the value of %.*s", (int) obisLen, obis);
+  }
 }
 
-void MeterReader::handle_object(std::string obisNr, std::string obisValue) {
-  std::map<std::string, std::string>::iterator entry = values_.find(obisNr);
-  if (entry != values_.end()) {
-    postprocess_value(obisValue);
-    if (is_valid_object_value(obisValue)) {
-      logger::debug(" -> found valid obis entry: %s", obisNr.c_str());
-      entry->second = obisValue;
+bool MeterReader::subscribed(ObisCode const &code) const {
+  for (size_t i = 0; i < subscriptionCount_; i++) {
+    if (obis_matches(subscriptions_[i].pattern, code)) {
+      return true;
     }
   }
+  return false;
 }
 
 void MeterReader::verify_checksum() {
 #ifndef SKIP_CHECKSUM_CHECK
   /* Expecting ETX and then the checksum */
   uint8_t etx_bcc[2];
-  if (Serial1.readBytes(etx_bcc, 2) != 2 || etx_bcc[0] != ETX) {
+  size_t len = serial_.readBytes(etx_bcc, 2);
+  capture((const char *) etx_bcc, len, false);
+  if (len != 2 || etx_bcc[0] != ETX) {
     logger::warn("failed to read checksum");
     change_status(ProtocolError);
     return;
@@ -216,7 +428,132 @@ void MeterReader::verify_checksum() {
   return;
 }
 
+void MeterReader::read_programming_prompt() {
+  logger::debug("Step -> read_programming_prompt");
+  /* The meter answers with SOH P0 STX (password seed) ETX BCC */
+  static char prompt[MAX_LINE_LENGTH];
+  uint8_t bcc;
+  size_t len = serial_.readBytesUntil(ETX, prompt, MAX_LINE_LENGTH);
+  if (len < 3 || prompt[0] != SOH || prompt[1] != 'P' || serial_.readBytes(&bcc, 1) != 1) {
+    logger::warn("meter did not enter programming mode");
+    change_status(ProtocolError);
+    return;
+  }
+  send_profile_request();
+}
+
+void MeterReader::send_profile_request() {
+  logger::debug("Step -> send_profile_request");
+  char request[5 + LOAD_PROFILE_TIMESTAMP_LENGTH + 2];
+  if (profileFrom_ != 0) {
+    char from[LOAD_PROFILE_TIMESTAMP_LENGTH];
+    format_load_profile_timestamp(profileFrom_, loadProfile_.season(), from);
+    snprintf(request, sizeof(request), "P.01(%s;)", from);
+  } else {
+    snprintf(request, sizeof(request), "P.01(;)");
+  }
+  logger::debug("request -> %s", request);
+  send_command("R5", request);
+  step_ = InProfile;
+  checksum_ = STX;
+}
+
+void MeterReader::read_profile_line() {
+  static char line[MAX_LINE_LENGTH];
+  size_t len = serial_.readBytesUntil('\n', line, MAX_LINE_LENGTH - 1);
+  if (len == 0) {
+    /* Entries read so far are complete on their own, the next readout continues after them */
+    logger::warn("load profile readout timed out after %u entries", loadProfile_.size());
+    send_command("B0", NULL);
+    change_status(loadProfile_.size() > 0 ? Ok : ProtocolError);
+    return;
+  }
+
+  char *etx = (char *) memchr(line, ETX, len);
+  size_t dataLen = etx != NULL ? etx - line + 1 : len;
+  add_to_checksum(line, dataLen);
+  statistics_.lines++;
+  statistics_.bytes += len + 1;
+  int bcc = -1;
+  if (etx == NULL) {
+    /* readBytesUntil doesn't include the terminator, so take it into account separately */
+    checksum_ ^= '\n';
+  } else if (dataLen < len) {
+    bcc = (uint8_t) line[dataLen];
+  } else {
+    bcc = serial_.read();
+  }
+
+  len = etx != NULL ? etx - line : len;
+  if (len > 0 && line[len - 1] == '\r') {
+    len--;
+  }
+  line[len] = 0;
+  char *content = line[0] == STX ? line + 1 : line;
+  logger::debug("profile -> %s", content);
+
+  if (strstr(content, "(ERROR)") != NULL) {
+    logger::info("no load profile entries available");
+    send_command("B0", NULL);
+    change_status(Ok);
+    return;
+  }
+
+  if (!loadProfile_.parse_line(content)) {
+    /* Buffer full, the remaining entries are fetched by the next readout */
+    logger::debug("load profile buffer full");
+    send_command("B0", NULL);
+    change_status(Ok);
+    return;
+  }
+
+  if (etx != NULL) {
+    send_command("B0", NULL);
+#ifndef SKIP_CHECKSUM_CHECK
+    if (bcc != (uint8_t) checksum_) {
+      logger::warn("checksum mismatch: %02x != %02x", (uint8_t) checksum_, bcc);
+      change_status(ChecksumError);
+      return;
+    }
+#endif
+    change_status(Ok);
+  }
+}
+
+/* Sends SOH command [STX data] ETX BCC, the BCC covers everything after SOH */
+void MeterReader::send_command(char const *command, char const *data) {
+  uint8_t bcc = 0;
+  serial_.write(SOH);
+  for (char const *c = command; *c != 0; c++) {
+    bcc ^= *c;
+  }
+  serial_.write(command);
+  if (data != NULL) {
+    bcc ^= STX;
+    serial_.write(STX);
+    for (char const *c = data; *c != 0; c++) {
+      bcc ^= *c;
+    }
+    serial_.write(data);
+  }
+  bcc ^= ETX;
+  serial_.write(ETX);
+  serial_.write(bcc);
+  serial_.flush();
+}
+
 void MeterReader::change_status(Status to) {
+  if (status_ == Busy && to != Busy) {
+    bool afterBaudSwitch = step_ == InData || step_ == AfterData || step_ == ProgrammingMode || step_ == InProfile;
+    tuner_.finish(to == Ok, afterBaudSwitch);
+    statistics_.duration = millis() - startTime_;
+    logger::info("Readout: %d lines (%d truncated, %d malformed), %d bytes in %d ms", statistics_.lines, statistics_.truncatedLines,
+                 statistics_.malformedLines, statistics_.bytes, statistics_.duration);
+    if (listener_.onSessionEnd != NULL) {
+      listener_.onSessionEnd(listener_.context, to == Ok);
+    }
+  }
+
   if (to == ProtocolError || to == IdentificationError || to == IdentificationError_Id_Mismatch || to == TimeoutError)
     ++errors_;
   else if (to == ChecksumError)
@@ -227,23 +564,90 @@ void MeterReader::change_status(Status to) {
   status_ = to;
 }
 
-bool MeterReader::start_monitoring(std::string obis) {
+#ifdef AUTO_TUNE_TIMINGS
+/* The tuned timings of the meter's profile replace the ones still at their config.h value once
+   the meter is known, a timing set by a downlink is kept */
+static bool tunable(ProtocolTuner const &tuner, uint16_t value, uint16_t configured) {
+  return tuner.profile() != NULL && value == configured;
+}
+#endif
+
+uint16_t MeterReader::identification_timeout() const {
+#ifdef AUTO_TUNE_TIMINGS
+  if (tunable(tuner_, config_.identificationTimeout, SERIAL_IDENTIFICATION_READING_TIMEOUT)) {
+    return tuner_.identification_timeout();
+  }
+#endif
+  return config_.identificationTimeout;
+}
+
+uint16_t MeterReader::baudrate_change_delay() const {
+#ifdef AUTO_TUNE_TIMINGS
+  if (tunable(tuner_, config_.baudrateChangeDelay, BAUDRATE_CHANGE_DELAY)) {
+    return tuner_.baudrate_change_delay();
+  }
+#endif
+  return config_.baudrateChangeDelay;
+}
+
+uint16_t MeterReader::reading_timeout() const {
+#ifdef AUTO_TUNE_TIMINGS
+  if (tunable(tuner_, config_.readingTimeout, SERIAL_READING_TIMEOUT)) {
+    return tuner_.reading_timeout();
+  }
+#endif
+  return config_.readingTimeout;
+}
+
+uint16_t MeterReader::max_read_time() const {
+#ifdef AUTO_TUNE_TIMINGS
+  if (tunable(tuner_, config_.maxReadTime, MAX_METER_READ_TIME)) {
+    return tuner_.profile()->maxReadTime;
+  }
+#endif
+  return config_.maxReadTime;
+}
+
+bool MeterReader::start_monitoring(const char *obis) {
   /* Don't allow adding a new monitored object in the middle of a readout */
   if (status_ == Busy) {
     return false;
   }
 
-  values_.insert(std::pair<std::string, std::string>(obis, "") );
+  return values_.add(obis);
+}
+
+bool MeterReader::subscribe(const char *pattern, uint8_t id) {
+  ObisCode code;
+  if (status_ == Busy || subscriptionCount_ >= MAX_SUBSCRIPTIONS || !parse_obis_code(pattern, code)) {
+    return false;
+  }
+  subscriptions_[subscriptionCount_++] = {code, id};
   return true;
 }
 
-bool MeterReader::stop_monitoring(std::string obis) {
+bool MeterReader::unsubscribe(const char *pattern) {
+  ObisCode code;
+  if (status_ == Busy || !parse_obis_code(pattern, code)) {
+    return false;
+  }
+  for (size_t i = 0; i < subscriptionCount_; i++) {
+    if (subscriptions_[i].pattern.value == code.value && subscriptions_[i].pattern.mask == code.mask) {
+      /* keep the table dense */
+      subscriptions_[i] = subscriptions_[--subscriptionCount_];
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MeterReader::stop_monitoring(const char *obis) {
   /* Don't allow removing a monitored object in the middle of a readout */
   if (status_ == Busy) {
     return false;
   }
 
-  return values_.erase(obis) == 1;
+  return values_.remove(obis);
 }
 
 void MeterReader::loop() {
@@ -251,7 +655,7 @@ void MeterReader::loop() {
     return;
   }
 
-  if (startTime_ + (MAX_METER_READ_TIME * 1000) < millis()) {
+  if (startTime_ + (max_read_time() * 1000UL) < millis()) {
     change_status(TimeoutError);
     return;
   }
@@ -271,8 +675,17 @@ void MeterReader::loop() {
     case InData:
       read_line();
       break;
+    case Unsolicited:
+      read_unsolicited();
+      break;
     case AfterData:
       verify_checksum();
       break;
+    case ProgrammingMode:
+      read_programming_prompt();
+      break;
+    case InProfile:
+      read_profile_line();
+      break;
   }
 }
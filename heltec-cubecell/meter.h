@@ -1,13 +1,21 @@
+#ifndef _METER_H
+#define _METER_H
+
 #include "config.h"
-#include <map>
-#include <string>
 #include "Arduino.h"
 #include <HardwareSerial.h>
+#include "loadprofile.h"
+#include "profiles.h"
+#include "obisvalues.h"
 
-size_t const MAX_OBIS_CODE_LENGTH = 16;
 size_t const MAX_IDENTIFICATION_LENGTH = 5 + 16 + 1; /* /AAAbi...i\r */
-size_t const MAX_VALUE_LENGTH = 32 + 1 + 16 + 1;   /* value: 32, *, unit: 16 */
+/* Every parser works on a single line of at most this many chars and only scans it linearly,
+   thus the work per received char is bounded whatever the meter (or a disturbed line) sends */
 size_t const MAX_LINE_LENGTH = 78;
+size_t const MAX_TELEGRAM_LINES = 64;
+size_t const MAX_METER_IDENTIFIER_LENGTH = 7 + 1;
+size_t const MAX_SUBSCRIPTIONS = 4;
+uint32_t const UNKNOWN_PARITY = 0xFFFFFFFF;  /* forces the serial to be set up again */
 
 /* An additional layer of protection against bit flips: the values of all exported
    objects are checked, and if they contain any characters other than these, the
@@ -36,25 +44,102 @@ enum Step
   IdentificationRead,
   InData,
   AfterData,
+  ProgrammingMode,
+  InProfile,
+  Unsolicited,
+};
+
+/* Protocol settings that can be changed at runtime, the defaults come from config.h */
+struct MeterConfig
+{
+  char identifier[MAX_METER_IDENTIFIER_LENGTH];  /* empty = accept any meter */
+  char modeOverride;                             /* 0 = automatic mode selection */
+  uint16_t baudrateChangeDelay;                  /* [ms] */
+  uint16_t identificationTimeout;                /* [ms] */
+  uint16_t readingTimeout;                       /* [ms] */
+  uint16_t maxReadTime;                          /* [s] */
+  uint32_t parity;                               /* e.g. SERIAL_7E1, found by the discovery or PARITY_SETTING */
+  uint16_t initialBaudRate;                      /* [bps] */
+};
+
+/* What the last readout went through, to compare firmware versions and meters */
+struct ReadoutStatistics {
+  uint16_t lines;
+  uint16_t truncatedLines;   /* longer than MAX_LINE_LENGTH, skipped */
+  uint16_t malformedLines;   /* not in the form obis(value) */
+  uint32_t bytes;
+  uint32_t duration;         /* [ms] */
+};
+
+/* Called for a subscribed register as soon as its line was read and its value passed the
+   character check, thus before the checksum of the telegram is known. id: as subscribed */
+typedef void (*RegisterCallback)(void *context, uint8_t id, FixedPoint const &value);
+
+/* Called when a readout ends. ok: the values passed since the start can be used (commit),
+   otherwise they have to be dropped (rollback) */
+typedef void (*SessionCallback)(void *context, bool ok);
+
+struct ReaderListener {
+  RegisterCallback onRegister;
+  SessionCallback onSessionEnd;
+  void *context;
+};
+
+/* The compile time settings from config.h */
+MeterConfig default_meter_config();
+
+enum ReadoutMode
+{
+  DataReadout,
+  LoadProfileReadout,
 };
 
 class MeterReader {
   public:
-    MeterReader(HardwareSerial &serial): serial_(serial)
+    MeterReader(HardwareSerial &serial = Serial1): serial_(serial)
     {
     }
     //MeterReader(MeterReader const &) = delete;
     //MeterReader(MeterReader &&) = delete;
-    /* Start monitoring an object. Returns true if monitoring was just started
-       for the specified object, false otherwise */
-    bool start_monitoring(std::string obis);
+    /* Start monitoring an object, e.g. "1.8.0" or "1-0:1.8.0*255", or all objects matching
+       a pattern like "1.8.*". Returns true if monitoring was just started, false otherwise */
+    bool start_monitoring(const char *obis);
 
     /* Stop monitoring an object. Returns true if monitoring was just stopped
        for the specified object, false otherwise */
-    bool stop_monitoring(std::string obis);
+    bool stop_monitoring(const char *obis);
+
+    /* Have the values of the objects matching the pattern pushed to the listener as they are
+       read, with the given id. They aren't kept in values(). Returns false if the pattern is
+       malformed or there is no room for another subscription */
+    bool subscribe(const char *pattern, uint8_t id);
+
+    bool unsubscribe(const char *pattern);
+
+    void set_listener(ReaderListener const &listener) {
+      listener_ = listener;
+    }
+
+    /* Replace the protocol settings, ignored while a readout is in progress */
+    void configure(MeterConfig const &config) {
+      if (status_ != Busy) {
+        config_ = config;
+        parity_ = config.parity;
+        /* the serial may have been used with other settings, e.g. by the discovery */
+        activeParity_ = UNKNOWN_PARITY;
+      }
+    }
+
+    MeterConfig const &config() const {
+      return config_;
+    }
 
     void start_reading();
 
+    /* Read the load profile (P.01) in programming mode, starting at the given
+       timestamp (minutes since 2000-01-01, 0 = let the meter decide) */
+    void start_load_profile_reading(uint32_t from);
+
     /* Must be called frequently to advance the reading process */
     void loop();
 
@@ -62,6 +147,10 @@ class MeterReader {
       return status_;
     }
 
+    ReadoutMode mode() const {
+      return mode_;
+    }
+
     /* Call this after status() returns Ok or an error to reset it to Ready */
     void acknowledge()
     {
@@ -71,11 +160,23 @@ class MeterReader {
       }
     }
 
-    std::string lastReadChars()
+    const char *lastReadChars() const
     {
       return lastReadChars_;
     }
 
+    /* Copy the raw bytes of the readouts (identification, data lines, ETX and BCC) into the
+       buffer until it is full, NULL stops. captured() starts from 0 with every readout */
+    void set_capture(uint8_t *buffer, size_t size) {
+      capture_ = buffer;
+      captureSize_ = size;
+      captured_ = 0;
+    }
+
+    size_t captured() const {
+      return captured_;
+    }
+
     size_t errors() const {
       return errors_;
     }
@@ -88,25 +189,75 @@ class MeterReader {
       return successes_;
     }
 
-    std::map<std::string, std::string> const &values() const {
+    ObisValues const &values() const {
       return values_;
     }
 
+    LoadProfile const &load_profile() const {
+      return loadProfile_;
+    }
+
+    ReadoutStatistics const &statistics() const {
+      return statistics_;
+    }
+
+    /* Time from the request until the meter started to answer in the last readout, 0 = no answer [ms] */
+    unsigned long first_response_latency() const {
+      return firstResponseLatency_;
+    }
+
   private:
+    void begin_reading(ReadoutMode mode);
     void send_request();
     void read_identification();
     void switch_baud();
     void read_line();
-    void handle_object(std::string obis, std::string valuex);
+    void process_line(char *line, size_t len);
+    void skip_long_line(char *line, size_t len);
+    void add_to_checksum(const char *chars, size_t len);
+    void capture(const char *chars, size_t len, bool lineEnd);
+    void parse_data_line(const char *line);
+    void read_unsolicited();
+    bool subscribed(ObisCode const &code) const;
+    void handle_object(ObisCode const &code, const char *obis, size_t obisLen, char *value);
     void verify_checksum();
+    void read_programming_prompt();
+    void send_profile_request();
+    void read_profile_line();
+    void send_command(char const *command, char const *data);
     void change_status(Status to);
+    uint16_t identification_timeout() const;
+    uint16_t baudrate_change_delay() const;
+    uint16_t reading_timeout() const;
+    uint16_t max_read_time() const;
 
     HardwareSerial &serial_;
     Step step_;
     Status status_ = Ready;
     unsigned int baud_char_, checksum_;
-    std::map<std::string, std::string> values_;
+    ObisValues values_;
+    struct Subscription {
+      ObisCode pattern;
+      uint8_t id;
+    };
+    Subscription subscriptions_[MAX_SUBSCRIPTIONS];
+    size_t subscriptionCount_ = 0;
+    ReaderListener listener_ = {};
     size_t errors_ = 0, checksum_errors_ = 0, successes_ = 0;
     unsigned long startTime_;
-    std::string lastReadChars_;
+    char lastReadChars_[MAX_IDENTIFICATION_LENGTH] = "";
+    ReadoutMode mode_ = DataReadout;
+    uint32_t profileFrom_ = 0;
+    LoadProfile loadProfile_;
+    MeterConfig config_ = default_meter_config();
+    ProtocolTuner tuner_;
+    uint32_t baud_ = INITIAL_BAUD_RATE, parity_ = PARITY_SETTING, activeParity_ = UNKNOWN_PARITY;
+    unsigned long requestTime_, firstResponseLatency_ = 0;
+    size_t unsolicitedLines_ = 0;
+    uint32_t firstLineHash_ = 0;
+    ReadoutStatistics statistics_ = {};
+    uint8_t *capture_ = NULL;
+    size_t captureSize_ = 0, captured_ = 0;
 };
+
+#endif
@@ -0,0 +1,82 @@
+#include "metrics.h"
+#include "logger.h"
+
+uint32_t const MINUTES_PER_DAY = 1440;
+
+/* Shorter intervals give too coarse averages with meters showing 0.1 kWh */
+uint32_t const MIN_INTERVAL_SECONDS = 60;
+
+/* Above this the Wh * 3600 product would overflow, such a jump is a misread anyway */
+uint32_t const MAX_ENERGY_DELTA = 0xFFFFFFFF / 3600;
+
+bool is_night_tariff(int minuteOfDay) {
+  int start = NIGHT_TARIFF_START * 60;
+  int end = NIGHT_TARIFF_END * 60;
+  if (start <= end) {
+    return minuteOfDay >= start && minuteOfDay < end;
+  }
+  return minuteOfDay >= start || minuteOfDay < end;
+}
+
+static uint16_t clamp16(uint32_t value) {
+  return value > 0xFFFF ? 0xFFFF : value;
+}
+
+bool MetricsTracker::update(uint32_t now, uint32_t energy, uint16_t power, int minuteOfDay) {
+  if (!hasLast_ || energy < lastEnergy_ || energy - lastEnergy_ > MAX_ENERGY_DELTA || now < lastTime_) {
+    /* first reading, meter replaced or misread: start over from this reading */
+    hasLast_ = true;
+    valid_ = false;
+    lastTime_ = now;
+    lastEnergy_ = energy;
+    lastPower_ = power;
+    return false;
+  }
+  uint32_t elapsed = now - lastTime_;
+  if (elapsed < MIN_INTERVAL_SECONDS) {
+    /* keep the older reading as reference */
+    return false;
+  }
+  uint32_t delta = energy - lastEnergy_;
+  uint32_t average = delta * 3600 / elapsed;
+  uint32_t peak = average;
+  if (power > peak) {
+    peak = power;
+  }
+  if (lastPower_ > peak) {
+    peak = lastPower_;
+  }
+  metrics_.averagePower = clamp16(average);
+  metrics_.peakPower = clamp16(peak);
+  metrics_.intervalMinutes = clamp16(elapsed / 60);
+  add_to_buckets(delta, elapsed / 60, minuteOfDay);
+
+  lastTime_ = now;
+  lastEnergy_ = energy;
+  lastPower_ = power;
+  valid_ = true;
+  logger::debug("Average power: %d [W], peak: %d [W], interval: %d [min]", metrics_.averagePower, metrics_.peakPower, metrics_.intervalMinutes);
+  return true;
+}
+
+/* Splits the consumption of the interval at the tariff boundary, assuming a constant load in between */
+void MetricsTracker::add_to_buckets(uint32_t delta, uint32_t minutes, int minuteOfDay) {
+  if (minuteOfDay < 0) {
+    metrics_.dayEnergy += delta;
+    return;
+  }
+  if (minutes >= MINUTES_PER_DAY) {
+    minutes = MINUTES_PER_DAY - 1;
+  }
+  int startMinute = (minuteOfDay + MINUTES_PER_DAY - minutes) % MINUTES_PER_DAY;
+  bool nightAtEnd = is_night_tariff(minuteOfDay);
+  if (minutes == 0 || is_night_tariff(startMinute) == nightAtEnd) {
+    (nightAtEnd ? metrics_.nightEnergy : metrics_.dayEnergy) += delta;
+    return;
+  }
+  int boundary = (nightAtEnd ? NIGHT_TARIFF_START : NIGHT_TARIFF_END) * 60;
+  uint32_t sinceBoundary = (minuteOfDay + MINUTES_PER_DAY - boundary) % MINUTES_PER_DAY;
+  uint32_t afterBoundary = sinceBoundary >= minutes ? delta : delta * sinceBoundary / minutes;
+  (nightAtEnd ? metrics_.nightEnergy : metrics_.dayEnergy) += afterBoundary;
+  (nightAtEnd ? metrics_.dayEnergy : metrics_.nightEnergy) += delta - afterBoundary;
+}
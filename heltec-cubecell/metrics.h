@@ -0,0 +1,45 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include "config.h"
+#include "Arduino.h"
+
+struct DerivedMetrics {
+  uint16_t averagePower;     /* [W] from the energy consumed since the previous reading */
+  uint16_t peakPower;        /* [W] lower bound of the peak within the interval */
+  uint16_t intervalMinutes;  /* length of the interval the values above refer to */
+  uint32_t dayEnergy;        /* [Wh] consumed outside of the night tariff since boot */
+  uint32_t nightEnergy;      /* [Wh] consumed within the night tariff since boot */
+};
+
+/* Derives metrics from consecutive readings without extra meter reads. Only integer
+   arithmetic. */
+class MetricsTracker {
+  public:
+    /* Feed a successful reading. now: [s] since boot, energy: meter reading [Wh],
+       power: instantaneous power [W], minuteOfDay: meter clock or -1 if unknown.
+       Returns true if the metrics were updated */
+    bool update(uint32_t now, uint32_t energy, uint16_t power, int minuteOfDay);
+
+    /* False until two consecutive readings were fed */
+    bool valid() const {
+      return valid_;
+    }
+
+    DerivedMetrics const &metrics() const {
+      return metrics_;
+    }
+
+  private:
+    void add_to_buckets(uint32_t delta, uint32_t minutes, int minuteOfDay);
+
+    bool hasLast_ = false, valid_ = false;
+    uint32_t lastTime_ = 0, lastEnergy_ = 0;
+    uint16_t lastPower_ = 0;
+    DerivedMetrics metrics_ = {};
+};
+
+/* Whether the given minute of the day (0-1439) falls into the night tariff */
+bool is_night_tariff(int minuteOfDay);
+
+#endif
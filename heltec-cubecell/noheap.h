@@ -0,0 +1,10 @@
+#ifndef _NOHEAP_H
+#define _NOHEAP_H
+
+/* Include as the last header of the modules on the readout path: using the heap
+   there fails the build. Over weeks of uptime heap fragmentation is a real risk
+   with the little RAM of the CubeCell, thus the reader only uses tables of fixed size.
+   tools/memory_report.py --heap-free checks the object files for operator new as well. */
+#pragma GCC poison malloc calloc realloc free strdup
+
+#endif
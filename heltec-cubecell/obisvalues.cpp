@@ -0,0 +1,216 @@
+#include "obisvalues.h"
+#include "noheap.h"
+
+/* Groups of an OBIS code, A is stored in the highest byte */
+enum ObisGroup
+{
+  GroupA,
+  GroupB,
+  GroupC,
+  GroupD,
+  GroupE,
+  GroupF,
+};
+
+static void set_group(ObisCode &code, int group, uint8_t value) {
+  int shift = (GroupF - group) * 8;
+  code.value |= (uint64_t) value << shift;
+  code.mask |= (uint64_t) 0xFF << shift;
+}
+
+/* Letters used instead of a number in group C, e.g. C.1.0 (meter serial number) or F.F (error register) */
+static int letter_value(char c) {
+  switch (c) {
+    case 'C': return 96;
+    case 'F': return 97;
+    case 'L': return 98;
+    case 'P': return 99;
+    default: return -1;
+  }
+}
+
+bool parse_obis_code(const char *text, size_t len, ObisCode &code) {
+  code.value = 0;
+  code.mask = 0;
+  if (len == 0) {
+    return false;
+  }
+  const char *end = text + len;
+  const char *colon = (const char *) memchr(text, ':', len);
+  int group = GroupC;
+  if (colon != NULL) {
+    group = memchr(text, '-', colon - text) != NULL ? GroupA : GroupB;
+  }
+
+  const char *c = text;
+  while (true) {
+    if (*c == '*') {
+      /* wildcard, the group stays out of the mask */
+      c++;
+    } else if (isdigit((uint8_t) *c)) {
+      unsigned int value = 0;
+      while (c < end && isdigit((uint8_t) *c)) {
+        value = value * 10 + (*c++ - '0');
+        if (value > 255) {
+          return false;
+        }
+      }
+      set_group(code, group, value);
+    } else if (letter_value(*c) >= 0) {
+      set_group(code, group, letter_value(*c++));
+    } else {
+      return false;
+    }
+    if (c == end) {
+      if (group < GroupF) {
+        /* without F the code is the current value, not one of the billing periods */
+        set_group(code, GroupF, 255);
+      }
+      return true;
+    }
+
+    char separator = *c++;
+    if (c == end) {
+      return false;
+    }
+    if (separator == '-' && group == GroupA) {
+      group = GroupB;
+    } else if (separator == ':' && group == GroupB) {
+      group = GroupC;
+    } else if (separator == '.' && group >= GroupC && group < GroupE) {
+      group++;
+    } else if ((separator == '*' || separator == '&') && group >= GroupC && group < GroupF) {
+      group = GroupF;
+    } else {
+      return false;
+    }
+  }
+}
+
+bool parse_fixed_point(const char *text, FixedPoint &value) {
+  int64_t mantissa = 0;
+  int decimals = -1;
+  bool negative = *text == '-';
+  bool digits = false;
+  if (negative) {
+    text++;
+  }
+  for (; *text != 0 && *text != '*'; text++) {
+    if (isdigit((uint8_t) *text)) {
+      mantissa = mantissa * 10 + (*text - '0');
+      digits = true;
+      if (decimals >= 0) {
+        decimals++;
+      }
+      if (mantissa > INT32_MAX) {
+        return false;
+      }
+    } else if ((*text == '.' || *text == ',') && decimals < 0) {
+      decimals = 0;
+    } else {
+      return false;
+    }
+  }
+  if (!digits) {
+    return false;
+  }
+  value.mantissa = negative ? -mantissa : mantissa;
+  value.decimals = decimals > 0 ? decimals : 0;
+  return true;
+}
+
+int32_t fixed_point_scaled(FixedPoint const &value, uint8_t decimals) {
+  int64_t scaled = value.mantissa;
+  for (uint8_t i = value.decimals; i < decimals; i++) {
+    scaled *= 10;
+  }
+  for (uint8_t i = decimals; i < value.decimals; i++) {
+    scaled /= 10;
+  }
+  return scaled > INT32_MAX ? INT32_MAX : scaled < INT32_MIN ? INT32_MIN : scaled;
+}
+
+bool ObisValues::add(const char *pattern) {
+  ObisCode code;
+  if (patternCount_ >= MAX_OBIS_PATTERNS || !parse_obis_code(pattern, code)) {
+    return false;
+  }
+  for (size_t i = 0; i < patternCount_; i++) {
+    if (patterns_[i].value == code.value && patterns_[i].mask == code.mask) {
+      return false;
+    }
+  }
+  patterns_[patternCount_++] = code;
+  return true;
+}
+
+bool ObisValues::remove(const char *pattern) {
+  ObisCode code;
+  if (!parse_obis_code(pattern, code)) {
+    return false;
+  }
+  size_t i = 0;
+  while (i < patternCount_ && (patterns_[i].value != code.value || patterns_[i].mask != code.mask)) {
+    i++;
+  }
+  if (i == patternCount_) {
+    return false;
+  }
+  /* keep the tables dense */
+  patterns_[i] = patterns_[--patternCount_];
+  i = 0;
+  while (i < count_) {
+    if (monitors(entries_[i].code)) {
+      i++;
+    } else {
+      entries_[i] = entries_[--count_];
+    }
+  }
+  return true;
+}
+
+bool ObisValues::monitors(ObisCode const &code) const {
+  for (size_t i = 0; i < patternCount_; i++) {
+    if (obis_matches(patterns_[i], code)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ObisValues::store(ObisCode const &code, const char *obis, size_t obisLen, const char *value) {
+  ObisValue *entry = NULL;
+  for (size_t i = 0; i < count_ && entry == NULL; i++) {
+    if (entries_[i].code.value == code.value && entries_[i].code.mask == code.mask) {
+      entry = &entries_[i];
+    }
+  }
+  if (entry == NULL) {
+    if (count_ >= MAX_OBIS_VALUES) {
+      return false;
+    }
+    entry = &entries_[count_++];
+    entry->code = code;
+    if (obisLen >= MAX_OBIS_CODE_LENGTH) {
+      obisLen = MAX_OBIS_CODE_LENGTH - 1;
+    }
+    memcpy(entry->obis, obis, obisLen);
+    entry->obis[obisLen] = 0;
+  }
+  strncpy(entry->value, value, MAX_VALUE_LENGTH - 1);
+  entry->value[MAX_VALUE_LENGTH - 1] = 0;
+  return true;
+}
+
+const char *ObisValues::value(const char *pattern) const {
+  ObisCode code;
+  if (!parse_obis_code(pattern, code)) {
+    return NULL;
+  }
+  for (size_t i = 0; i < count_; i++) {
+    if (obis_matches(code, entries_[i].code)) {
+      return entries_[i].value;
+    }
+  }
+  return NULL;
+}
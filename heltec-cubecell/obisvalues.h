@@ -0,0 +1,87 @@
+#ifndef _OBISVALUES_H
+#define _OBISVALUES_H
+
+#include "Arduino.h"
+
+size_t const MAX_OBIS_CODE_LENGTH = 16;
+size_t const MAX_VALUE_LENGTH = 32 + 1 + 16 + 1;   /* value: 32, *, unit: 16 */
+size_t const MAX_OBIS_PATTERNS = 6;
+size_t const MAX_OBIS_VALUES = 8;
+
+/* An OBIS code A-B:C.D.E*F packed into one integer, a byte per group (A in the highest).
+   Groups that are missing or '*' are left out of the mask and match anything, thus
+   "1.8.0" matches "1-0:1.8.0*255" and "1.8.*" all tariff registers. A missing F is 255
+   (the current value), thus "1.8.0" doesn't match the billing period "1.8.0*01", but
+   "1.8.0**" matches all of them */
+struct ObisCode {
+  uint64_t value;
+  uint64_t mask;
+};
+
+/* Parses the first `len` chars of text, e.g. "1-0:1.8.0*255", "1.8.0", "1.8.*" or "C.1.0"
+   (letters C, F, L and P stand for 96 - 99). Returns false if malformed */
+bool parse_obis_code(const char *text, size_t len, ObisCode &code);
+
+inline bool parse_obis_code(const char *text, ObisCode &code) {
+  return parse_obis_code(text, strlen(text), code);
+}
+
+/* Groups that are present in both codes must be equal */
+inline bool obis_matches(ObisCode const &pattern, ObisCode const &code) {
+  return ((pattern.value ^ code.value) & pattern.mask & code.mask) == 0;
+}
+
+/* A register value as integer: mantissa * 10^-decimals, e.g. "012345.678" = {12345678, 3} */
+struct FixedPoint {
+  int32_t mantissa;
+  uint8_t decimals;
+};
+
+/* Parses a decimal value up to the unit ('*'), '.' or ',' separate the decimals.
+   Returns false if there are no digits, other characters or too many digits */
+bool parse_fixed_point(const char *text, FixedPoint &value);
+
+/* The value with the given number of decimals, e.g. kW with 3 decimals = W. Cut, not rounded */
+int32_t fixed_point_scaled(FixedPoint const &value, uint8_t decimals);
+
+struct ObisValue {
+  ObisCode code;
+  char obis[MAX_OBIS_CODE_LENGTH];   /* as sent by the meter */
+  char value[MAX_VALUE_LENGTH];
+};
+
+/* The monitored patterns and the last values of the objects matching them in tables of
+   fixed size, thus the readout never touches the heap */
+class ObisValues {
+  public:
+    /* Returns false if the pattern is malformed, already monitored or the table is full */
+    bool add(const char *pattern);
+
+    /* Also drops the values no other pattern matches */
+    bool remove(const char *pattern);
+
+    /* Whether the object is monitored, cheap enough to filter every line */
+    bool monitors(ObisCode const &code) const;
+
+    /* Stores the value of a monitored object, returns false if there is no room for another object */
+    bool store(ObisCode const &code, const char *obis, size_t obisLen, const char *value);
+
+    /* The value of the first object matching the pattern, NULL if none was read */
+    const char *value(const char *pattern) const;
+
+    size_t size() const {
+      return count_;
+    }
+
+    ObisValue const &operator[](size_t index) const {
+      return entries_[index];
+    }
+
+  private:
+    ObisCode patterns_[MAX_OBIS_PATTERNS];
+    size_t patternCount_ = 0;
+    ObisValue entries_[MAX_OBIS_VALUES];
+    size_t count_ = 0;
+};
+
+#endif
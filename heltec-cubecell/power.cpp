@@ -0,0 +1,77 @@
+#include "power.h"
+#include "logger.h"
+
+/* Latencies within this much of the reaction time are jitter of the meter, and added to the
+   measured settling time of the head [ms] */
+uint16_t const WARM_UP_MARGIN = 10;
+
+void PowerSequencer::begin() {
+  pinMode(Vext, OUTPUT);
+  head_off();
+}
+
+void PowerSequencer::head_on() {
+  if (headPowered_) {
+    return;
+  }
+  digitalWrite(Vext, LOW);
+  headOnTime_ = millis();
+  headPowered_ = true;
+}
+
+void PowerSequencer::head_off() {
+  digitalWrite(Vext, HIGH);
+  if (headPowered_) {
+    onTime_ += millis() - headOnTime_;
+  }
+  headPowered_ = false;
+}
+
+uint32_t PowerSequencer::take_on_time() {
+  uint32_t onTime = onTime_;
+  onTime_ = 0;
+  return onTime;
+}
+
+void PowerSequencer::wait_for_head() {
+  unsigned long elapsed = millis() - headOnTime_;
+  if (headPowered_ && elapsed < warmUp_) {
+    delay(warmUp_ - elapsed);
+  }
+}
+
+void PowerSequencer::learn(unsigned long latency) {
+  if (latency == 0) {
+    /* nothing to measure: the request didn't reach the meter or the meter was busy */
+    if (warmUp_ < lastGood_) {
+      floor_ = warmUp_;
+      warmUp_ = lastGood_;
+    } else {
+      floor_ = 0;
+      warmUp_ = warmUp_ * 2 > HEAD_WARM_UP_TIME ? warmUp_ * 2 : HEAD_WARM_UP_TIME;
+      warmUp_ = warmUp_ < MAX_HEAD_WARM_UP_TIME ? warmUp_ : MAX_HEAD_WARM_UP_TIME;
+    }
+    logger::debug("Head warm-up: %d ms", warmUp_);
+    return;
+  }
+  if (reaction_ == 0 || latency < reaction_) {
+    reaction_ = latency < 0xFFFF ? latency : 0xFFFF;
+  }
+  if (latency > (unsigned long) reaction_ + WARM_UP_MARGIN) {
+    /* the answer waited for the head, it has to be on that much longer before the request */
+    unsigned long warmUp = warmUp_ + (latency - reaction_) + WARM_UP_MARGIN;
+    measured_ = warmUp < MAX_HEAD_WARM_UP_TIME ? warmUp : MAX_HEAD_WARM_UP_TIME;
+    warmUp_ = measured_;
+    lastGood_ = measured_;
+    floor_ = 0;
+  } else {
+    lastGood_ = warmUp_;
+    /* in time after unanswered requests: back towards the measured warm-up, but not to one the
+       meter didn't answer with */
+    uint16_t next = warmUp_ - warmUp_ / 4 > measured_ ? warmUp_ - warmUp_ / 4 : measured_;
+    if (next > floor_) {
+      warmUp_ = next;
+    }
+  }
+  logger::debug("Head warm-up: %d ms (latency %d ms)", warmUp_, (int) latency);
+}
@@ -0,0 +1,48 @@
+#ifndef _POWER_H
+#define _POWER_H
+
+#include "config.h"
+#include "Arduino.h"
+
+/* Owns the Vext rail that powers the optical head(s). The head is only powered for
+   the readout window, work done right after switching it on (e.g. measuring the
+   battery) counts towards its warm-up time. The warm-up starts at MIN_HEAD_WARM_UP_TIME
+   and is set from the first-response latency: the meter answers after its reaction time
+   at the earliest, an answer that comes later than that waited for the head to settle. */
+class PowerSequencer {
+  public:
+    void begin();
+
+    void head_on();
+
+    void head_off();
+
+    bool head_powered() const {
+      return headPowered_;
+    }
+
+    /* Blocks for the rest of the warm-up time */
+    void wait_for_head();
+
+    /* Feed the first-response latency of a readout, 0 if the meter didn't answer [ms] */
+    void learn(unsigned long latency);
+
+    uint16_t head_warm_up() const {
+      return warmUp_;
+    }
+
+    /* How long the head was powered since the last call [ms] */
+    uint32_t take_on_time();
+
+  private:
+    bool headPowered_ = false;
+    unsigned long headOnTime_ = 0;
+    uint32_t onTime_ = 0;
+    uint16_t warmUp_ = MIN_HEAD_WARM_UP_TIME;
+    uint16_t measured_ = MIN_HEAD_WARM_UP_TIME;  /* warm-up the latencies asked for */
+    uint16_t reaction_ = 0;                      /* shortest latency seen, the reaction time of the meter */
+    uint16_t lastGood_ = MIN_HEAD_WARM_UP_TIME;  /* last warm-up the meter answered with */
+    uint16_t floor_ = 0;                         /* longest warm-up the meter didn't answer with */
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "profiles.h"
+#include "logger.h"
+#include "noheap.h"
+
+/* Known-safe values, verified on real meters or taken from their manuals */
+MeterProfile const METER_PROFILES[] = {
+  /* Elster / Honeywell AS1440, AS3000: slow baud rate switch */
+  { "ELS", 500, 1500, 500, 60 },
+  /* Landis+Gyr */
+  { "LGZ", 300, 1500, 300, 30 },
+  /* Iskraemeco */
+  { "ISK", 300, 1500, 300, 30 },
+  /* EMH */
+  { "EMH", 200, 1000, 300, 30 },
+  /* Hager */
+  { "HAG", 300, 1500, 300, 30 },
+};
+
+uint16_t const MIN_TUNED_TIMEOUT = 100;    /* [ms] */
+uint16_t const TIMEOUT_MARGIN = 100;       /* [ms] added to twice the observed time */
+uint16_t const DELAY_STEP = 50;            /* [ms] */
+uint16_t const DELAY_LOCK_READOUTS = 24;   /* after the first failure, doubles with every further one */
+uint16_t const MAX_DELAY_LOCK_READOUTS = 768;
+
+MeterProfile const *find_meter_profile(const char *identification) {
+  if (identification[0] != '/') {
+    return NULL;
+  }
+  for (size_t i = 0; i < sizeof(METER_PROFILES) / sizeof(METER_PROFILES[0]); i++) {
+    /* the parity bit ends up in bit 7 if the serial is set up with the wrong parity */
+    bool matches = true;
+    for (size_t c = 0; c < 3 && matches; c++) {
+      matches = (identification[1 + c] & 0x7F) == METER_PROFILES[i].manufacturer[c];
+    }
+    if (matches) {
+      return &METER_PROFILES[i];
+    }
+  }
+  return NULL;
+}
+
+static uint16_t tuned_timeout(unsigned long observed, uint16_t limit) {
+  unsigned long timeout = observed * 2 + TIMEOUT_MARGIN;
+  if (timeout < MIN_TUNED_TIMEOUT) {
+    timeout = MIN_TUNED_TIMEOUT;
+  }
+  return timeout < limit ? timeout : limit;
+}
+
+void ProtocolTuner::reset(MeterProfile const *profile) {
+  profile_ = profile;
+  delayLock_ = 0;
+  delayLockLength_ = 0;
+  if (profile != NULL) {
+    baudrateChangeDelay_ = profile->baudrateChangeDelay;
+    identificationTimeout_ = profile->identificationTimeout;
+    readingTimeout_ = profile->readingTimeout;
+    logger::info("Using the timings of the %s profile", profile->manufacturer);
+  }
+}
+
+void ProtocolTuner::observe_first_response(unsigned long latency) {
+  firstResponse_ = latency;
+}
+
+void ProtocolTuner::observe_line_gap(unsigned long gap) {
+  if (gap > lineGap_) {
+    lineGap_ = gap;
+  }
+}
+
+void ProtocolTuner::finish(bool ok, bool afterBaudSwitch) {
+  if (profile_ == NULL) {
+    return;
+  }
+  if (ok) {
+    /* Smooth towards the observed times, the profile values are the upper bound */
+    identificationTimeout_ = (identificationTimeout_ * 3 + tuned_timeout(firstResponse_, profile_->identificationTimeout)) / 4;
+    readingTimeout_ = (readingTimeout_ * 3 + tuned_timeout(lineGap_, profile_->readingTimeout)) / 4;
+    if (delayLock_ > 0) {
+      delayLock_--;
+    } else if (baudrateChangeDelay_ >= DELAY_STEP) {
+      baudrateChangeDelay_ -= DELAY_STEP;
+    }
+  } else if (afterBaudSwitch) {
+    /* Too aggressive, go back to a value that worked and keep it for a while, the meter
+       or the light conditions may change */
+    baudrateChangeDelay_ += 2 * DELAY_STEP;
+    if (baudrateChangeDelay_ > profile_->baudrateChangeDelay) {
+      baudrateChangeDelay_ = profile_->baudrateChangeDelay;
+    }
+    delayLockLength_ = delayLockLength_ == 0 ? DELAY_LOCK_READOUTS : delayLockLength_ * 2;
+    if (delayLockLength_ > MAX_DELAY_LOCK_READOUTS) {
+      delayLockLength_ = MAX_DELAY_LOCK_READOUTS;
+    }
+    delayLock_ = delayLockLength_;
+    readingTimeout_ = profile_->readingTimeout;
+  } else {
+    identificationTimeout_ = profile_->identificationTimeout;
+  }
+  logger::debug("Tuned timings: delay=%d ident=%d reading=%d", baudrateChangeDelay_, identificationTimeout_, readingTimeout_);
+  firstResponse_ = 0;
+  lineGap_ = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef _PROFILES_H
+#define _PROFILES_H
+
+#include "config.h"
+#include "Arduino.h"
+
+/* Known-safe protocol timings of a meter family, keyed on the manufacturer
+   code of the identification (/AAAb...). Only the timings, whether the checksum is checked
+   is up to SKIP_CHECKSUM_CHECK */
+struct MeterProfile
+{
+  char manufacturer[4];
+  uint16_t baudrateChangeDelay;    /* [ms] */
+  uint16_t identificationTimeout;  /* [ms] */
+  uint16_t readingTimeout;         /* [ms] */
+  uint16_t maxReadTime;            /* [s] */
+};
+
+/* Returns the profile matching the identification or NULL if the meter is unknown */
+MeterProfile const *find_meter_profile(const char *identification);
+
+/* Narrows the timings of a profile down to what the connected meter actually needs.
+   Timeouts follow the observed response times with a safety margin, the baud rate
+   change delay is shortened step by step as long as readouts succeed and backed off
+   as soon as one fails after the switch. It is then kept for a number of successful
+   readouts, which doubles with every further failure, before it is shortened again. */
+class ProtocolTuner
+{
+  public:
+    /* Start over with the timings of the given profile */
+    void reset(MeterProfile const *profile);
+
+    MeterProfile const *profile() const {
+      return profile_;
+    }
+
+    uint16_t baudrate_change_delay() const {
+      return baudrateChangeDelay_;
+    }
+
+    uint16_t identification_timeout() const {
+      return identificationTimeout_;
+    }
+
+    uint16_t reading_timeout() const {
+      return readingTimeout_;
+    }
+
+    /* Time from the request until the first byte of the identification [ms] */
+    void observe_first_response(unsigned long latency);
+
+    /* Longest pause between two data lines [ms] */
+    void observe_line_gap(unsigned long gap);
+
+    /* Must be called once per readout, afterBaudSwitch tells if a failure happened after the baud rate was changed */
+    void finish(bool ok, bool afterBaudSwitch);
+
+  private:
+    MeterProfile const *profile_ = NULL;
+    uint16_t baudrateChangeDelay_ = 0, identificationTimeout_ = 0, readingTimeout_ = 0;
+    unsigned long firstResponse_ = 0, lineGap_ = 0;
+    uint16_t delayLock_ = 0;        /* successful readouts until the delay is shortened again */
+    uint16_t delayLockLength_ = 0;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "retry.h"
+#include "logger.h"
+
+/* Jitter keeps nodes that failed together (e.g. gateway outage) from retrying in lockstep [%] */
+long const RETRY_JITTER = 10;
+
+RetryPolicy const RETRY_POLICIES[RETRY_CLASS_COUNT] = {
+  /* MeterNoise   */ { 2, 30, 200, 600, 6 },
+  /* MeterSilent  */ { 1, 10, 150, 900, 8 },
+  /* MeterBusy    */ { 0, 120, 200, 1800, 5 },
+  /* WrongMeter   */ { 0, 0, 100, 0, 1 },
+  /* RadioFailure */ { 0, 30, 200, 1800, 6 },
+};
+
+RetryClass retry_class_for(Status status) {
+  switch (status) {
+    case ChecksumError:
+    case ProtocolError:
+      return MeterNoise;
+    case IdentificationError:
+      return MeterSilent;
+    case IdentificationError_Id_Mismatch:
+      return WrongMeter;
+    case TimeoutError:
+    default:
+      return MeterBusy;
+  }
+}
+
+RetryPolicy const &retry_policy(RetryClass retryClass) {
+  return RETRY_POLICIES[retryClass];
+}
+
+void RetryScheduler::succeeded() {
+  state_.failures = 0;
+  state_.sessionRetries = 0;
+  state_.delay = 0;
+}
+
+bool RetryScheduler::retry_now(RetryClass retryClass) {
+  if (state_.sessionRetries >= retry_policy(retryClass).immediateRetries) {
+    return false;
+  }
+  state_.sessionRetries++;
+  logger::info("Retrying right away (%d/%d)", state_.sessionRetries, retry_policy(retryClass).immediateRetries);
+  return true;
+}
+
+uint32_t RetryScheduler::next_delay(RetryClass retryClass, uint32_t normalDelay) {
+  RetryPolicy const &policy = retry_policy(retryClass);
+  uint32_t normal = normalDelay / 1000;
+  state_.sessionRetries = 0;
+
+  if (state_.lastClass != retryClass || state_.failures == 0) {
+    /* another kind of failure starts over */
+    state_.lastClass = retryClass;
+    state_.failures = 0;
+    state_.delay = policy.initialDelay;
+  } else {
+    state_.delay = state_.delay * policy.growth / 100;
+  }
+  if (state_.failures < 0xFF) {
+    state_.failures++;
+  }
+
+  if (state_.delay == 0 || state_.failures > policy.budget) {
+    /* budget used up, stop spending energy on early attempts: the normal interval, also if
+       it is longer than maxDelay */
+    logger::info("Failure %d of class %d, retry with the next reading", state_.failures, retryClass);
+    return normalDelay;
+  }
+  uint32_t delay = state_.delay;
+  if (policy.maxDelay != 0 && delay > policy.maxDelay) {
+    delay = policy.maxDelay;
+  }
+  if (delay > normal) {
+    delay = normal;
+  }
+  long jitter = (long) delay * 10 * random(-RETRY_JITTER, RETRY_JITTER + 1);
+  delay = delay * 1000 + jitter;
+  logger::info("Failure %d of class %d, retry in %d [s]", state_.failures, retryClass, (int) (delay / 1000));
+  return delay;
+}
@@ -0,0 +1,61 @@
+#ifndef _RETRY_H
+#define _RETRY_H
+
+#include "Arduino.h"
+#include "meter.h"
+
+/* Failures that are retried alike */
+enum RetryClass
+{
+  MeterNoise,    /* checksum or protocol error, most likely light or a bit flip */
+  MeterSilent,   /* no or too short identification, head not ready or misaligned */
+  MeterBusy,     /* timeout, the meter is busy or sending in a loop */
+  WrongMeter,    /* identification doesn't match, retrying soon won't change it */
+  RadioFailure,  /* join or uplink failed */
+  RETRY_CLASS_COUNT,
+};
+
+struct RetryPolicy {
+  uint8_t immediateRetries;  /* retries within the same wake before going to sleep */
+  uint16_t initialDelay;     /* [s], 0 = normal interval */
+  uint16_t growth;           /* delay increase per consecutive failure [%] */
+  uint16_t maxDelay;         /* [s] */
+  uint8_t budget;            /* consecutive failures before falling back to the normal interval */
+};
+
+struct RetryState {
+  uint8_t lastClass;
+  uint8_t failures;
+  uint8_t sessionRetries;
+  uint32_t delay;  /* [s] */
+};
+
+RetryClass retry_class_for(Status status);
+
+RetryPolicy const &retry_policy(RetryClass retryClass);
+
+class RetryScheduler {
+  public:
+    explicit RetryScheduler(RetryState &state): state_(state)
+    {
+    }
+
+    /* Forget all failures after a successful cycle */
+    void succeeded();
+
+    /* Whether the failure is worth another attempt right away, within the same wake */
+    bool retry_now(RetryClass retryClass);
+
+    /* How long to sleep after a failure [ms], never longer than the normal interval and the
+       normal interval once the budget of the class is used up */
+    uint32_t next_delay(RetryClass retryClass, uint32_t normalDelay);
+
+    uint8_t failures() const {
+      return state_.failures;
+    }
+
+  private:
+    RetryState &state_;
+};
+
+#endif
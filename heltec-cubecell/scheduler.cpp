@@ -0,0 +1,97 @@
+#include "scheduler.h"
+#include "logger.h"
+#include "noheap.h"
+
+bool MeterScheduler::add(MeterReader &reader) {
+  if (count_ >= MAX_METERS) {
+    return false;
+  }
+  slots_[count_++] = { &reader, -1 };
+  return true;
+}
+
+bool MeterScheduler::add(MeterReader &reader, uint8_t muxChannel) {
+  if (count_ >= MAX_METERS || muxChannel >= (1 << MAX_MUX_PINS)) {
+    return false;
+  }
+  slots_[count_++] = { &reader, (int8_t) muxChannel };
+  return true;
+}
+
+void MeterScheduler::set_mux_pins(uint8_t const *pins, size_t count) {
+  muxPinCount_ = count < MAX_MUX_PINS ? count : MAX_MUX_PINS;
+  for (size_t i = 0; i < muxPinCount_; i++) {
+    muxPins_[i] = pins[i];
+    pinMode(pins[i], OUTPUT);
+  }
+}
+
+void MeterScheduler::select_channel(uint8_t channel) {
+  for (size_t i = 0; i < muxPinCount_; i++) {
+    digitalWrite(muxPins_[i], (channel >> i) & 1 ? HIGH : LOW);
+  }
+  delay(MUX_SETTLE_TIME);
+}
+
+void MeterScheduler::start_reading() {
+  current_ = -1;
+  start_next();
+}
+
+void MeterScheduler::start_next() {
+  current_++;
+  if (current_ >= (int) count_) {
+    return;
+  }
+  if (slots_[current_].muxChannel >= 0) {
+    logger::debug("Reading meter %d on channel %d", current_, slots_[current_].muxChannel);
+    select_channel(slots_[current_].muxChannel);
+  }
+  slots_[current_].reader->start_reading();
+}
+
+void MeterScheduler::loop() {
+  if (current_ < 0 || current_ >= (int) count_) {
+    /* no round in progress, a reader may have been started on its own (load profile) */
+    for (size_t i = 0; i < count_; i++) {
+      slots_[i].reader->loop();
+    }
+    return;
+  }
+  slots_[current_].reader->loop();
+  if (slots_[current_].reader->status() != Busy) {
+    start_next();
+  }
+}
+
+Status MeterScheduler::status() const {
+  if (current_ >= 0 && current_ < (int) count_) {
+    return Busy;
+  }
+  bool anyOk = false;
+  bool allReady = true;
+  Status error = Ready;
+  for (size_t i = 0; i < count_; i++) {
+    Status status = slots_[i].reader->status();
+    if (status == Busy) {
+      return Busy;
+    }
+    anyOk = anyOk || status == Ok;
+    if (status != Ready) {
+      allReady = false;
+      if (error == Ready && status != Ok) {
+        error = status;
+      }
+    }
+  }
+  if (anyOk) {
+    return Ok;
+  }
+  return allReady ? Ready : error;
+}
+
+void MeterScheduler::acknowledge() {
+  for (size_t i = 0; i < count_; i++) {
+    slots_[i].reader->acknowledge();
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "meter.h"
+
+size_t const MAX_METERS = 8;
+size_t const MAX_MUX_PINS = 3;
+
+/* Drives several readers through one readout round, one after another. A reader waits
+   for whole lines (readBytesUntil blocks until the line or the timeout), so readers on
+   ports of their own couldn't overlap their waits anyway, and a meter answering while
+   another reader blocks could overrun its serial buffer. Readers behind a multiplexer
+   get their channel selected first. The scheduler reports the same status as a single
+   reader: Busy until every reader is done, Ok if at least one readout succeeded. */
+class MeterScheduler {
+  public:
+    /* Add a reader that has a serial port on its own */
+    bool add(MeterReader &reader);
+
+    /* Add a reader whose optical head is selected with the given multiplexer channel */
+    bool add(MeterReader &reader, uint8_t muxChannel);
+
+    void set_mux_pins(uint8_t const *pins, size_t count);
+
+    void start_reading();
+
+    /* Must be called frequently to advance the reading process */
+    void loop();
+
+    Status status() const;
+
+    /* Acknowledges the results of all readers */
+    void acknowledge();
+
+    size_t size() const {
+      return count_;
+    }
+
+    MeterReader &reader(size_t index) {
+      return *slots_[index].reader;
+    }
+
+  private:
+    struct Slot {
+      MeterReader *reader;
+      int8_t muxChannel;  /* -1 = own serial port */
+    };
+
+    void start_next();
+    void select_channel(uint8_t channel);
+
+    Slot slots_[MAX_METERS];
+    size_t count_ = 0;
+    uint8_t muxPins_[MAX_MUX_PINS];
+    size_t muxPinCount_ = 0;
+    int current_ = -1;  /* slot read right now */
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include "settings.h"
+#include "obisvalues.h"
+#include "logger.h"
+#include "EEPROM.h"
+
+/* The active settings are followed by a slot for the pending ones, a downlink only
+   ever writes the pending slot. A power failure while activating them just repeats
+   the activation on the next boot. */
+size_t const ACTIVE_EEPROM_OFFSET = SETTINGS_EEPROM_OFFSET;
+size_t const PENDING_EEPROM_OFFSET = SETTINGS_EEPROM_OFFSET + sizeof(Settings);
+
+namespace settings
+{
+
+Settings active;
+Settings defaults;
+
+static uint16_t crc16(uint8_t const *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t) data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t settings_crc(Settings const &s) {
+  return crc16((uint8_t const *) &s, offsetof(Settings, crc));
+}
+
+static bool load(size_t address, Settings &s) {
+  EEPROM.get(address, s);
+  return s.version == SETTINGS_VERSION && s.crc == settings_crc(s);
+}
+
+static void store(size_t address, Settings &s) {
+  s.version = SETTINGS_VERSION;
+  s.crc = settings_crc(s);
+  EEPROM.put(address, s);
+  EEPROM.commit();
+}
+
+static void invalidate(size_t address) {
+  EEPROM.write(address, 0);
+  EEPROM.commit();
+}
+
+static bool copy_string(char *target, size_t size, uint8_t const *value, uint8_t len, bool allowEmpty) {
+  if (len >= size || (len == 0 && !allowEmpty)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < len; i++) {
+    if (value[i] < 0x20 || value[i] > 0x7E) {
+      return false;
+    }
+  }
+  memcpy(target, value, len);
+  target[len] = 0;
+  return true;
+}
+
+/* Malformed codes would match any object */
+static bool copy_obis(char *target, size_t size, uint8_t const *value, uint8_t len) {
+  ObisCode code;
+  return parse_obis_code((const char *) value, len, code) && copy_string(target, size, value, len, false);
+}
+
+static bool in_range(uint16_t value, uint16_t min, uint16_t max) {
+  return value >= min && value <= max;
+}
+
+static bool apply_command(Settings &s, uint8_t command, uint8_t const *value, uint8_t len) {
+  uint16_t number = len == 2 ? (value[0] << 8) | value[1] : 0;
+  switch (command) {
+    case SetSleepTime:
+      if (len != 2 || !in_range(number, 60, 43200)) {
+        return false;
+      }
+      s.sleepTime = number * 1000UL;
+      return true;
+    case SetMeterIdentifier:
+      return copy_string(s.meter.identifier, sizeof(s.meter.identifier), value, len, true);
+    case SetObisPower:
+      return copy_obis(s.obisPower, sizeof(s.obisPower), value, len);
+    case SetObisEnergy:
+      return copy_obis(s.obisEnergy, sizeof(s.obisEnergy), value, len);
+    case SetModeOverride:
+      if (len != 1 || (value[0] != 0 && (value[0] < '0' || value[0] > '6'))) {
+        return false;
+      }
+      s.meter.modeOverride = value[0];
+      return true;
+    case SetBaudrateChangeDelay:
+      if (len != 2 || !in_range(number, 0, 5000)) {
+        return false;
+      }
+      s.meter.baudrateChangeDelay = number;
+      return true;
+    case SetIdentificationTimeout:
+      if (len != 2 || !in_range(number, 100, 10000)) {
+        return false;
+      }
+      s.meter.identificationTimeout = number;
+      return true;
+    case SetReadingTimeout:
+      if (len != 2 || !in_range(number, 50, 10000)) {
+        return false;
+      }
+      s.meter.readingTimeout = number;
+      return true;
+    case SetMaxReadTime:
+      if (len != 2 || !in_range(number, 5, 300)) {
+        return false;
+      }
+      s.meter.maxReadTime = number;
+      return true;
+    case SetPayloadOptions:
+      if (len != 1) {
+        return false;
+      }
+      s.payloadOptions = value[0];
+      return true;
+    case ResetSettings:
+      if (len != 0) {
+        return false;
+      }
+      s = defaults;
+      return true;
+    default:
+      return false;
+  }
+}
+
+void begin(uint32_t defaultSleepTime) {
+  memset(&defaults, 0, sizeof(defaults));
+  defaults.version = SETTINGS_VERSION;
+  defaults.meter = default_meter_config();
+  strncpy(defaults.obisPower, OBIS_VALUE_POWER, SETTINGS_OBIS_LENGTH - 1);
+  strncpy(defaults.obisEnergy, OBIS_VALUE_TOTAL_ENERGY, SETTINGS_OBIS_LENGTH - 1);
+  defaults.sleepTime = defaultSleepTime;
+  defaults.payloadOptions = LORAWAN_UPLINKMODE ? ConfirmedUplinks : 0;
+
+  if (!load(ACTIVE_EEPROM_OFFSET, active)) {
+    logger::info("No stored settings, using the defaults");
+    active = defaults;
+  }
+  apply_pending();
+}
+
+Settings const &current() {
+  return active;
+}
+
+bool handle_downlink(uint8_t const *data, size_t len) {
+  /* Commands build on settings that are still pending */
+  Settings pending;
+  if (!load(PENDING_EEPROM_OFFSET, pending)) {
+    pending = active;
+  }
+
+  size_t pos = 0;
+  while (pos + 2 <= len) {
+    uint8_t command = data[pos];
+    uint8_t valueLen = data[pos + 1];
+    if (pos + 2 + valueLen > len || !apply_command(pending, command, data + pos + 2, valueLen)) {
+      logger::warn("Invalid settings command %02X, downlink ignored", command);
+      return false;
+    }
+    pos += 2 + valueLen;
+  }
+  if (pos != len || len == 0) {
+    logger::warn("Malformed settings downlink ignored");
+    return false;
+  }
+
+  store(PENDING_EEPROM_OFFSET, pending);
+  logger::info("Settings stored, applied on the next wakeup");
+  return true;
+}
+
+bool apply_pending() {
+  Settings pending;
+  if (!load(PENDING_EEPROM_OFFSET, pending)) {
+    return false;
+  }
+  store(ACTIVE_EEPROM_OFFSET, pending);
+  invalidate(PENDING_EEPROM_OFFSET);
+  active = pending;
+  logger::info("Applied new settings");
+  return true;
+}
+
+void store_discovered(MeterConfig const &meter) {
+  /* A downlink that is still pending was built on the settings from before the discovery,
+     applying it mustn't bring back the old serial settings. An identifier it sets is kept */
+  Settings pending;
+  if (load(PENDING_EEPROM_OFFSET, pending)) {
+    pending.meter.parity = meter.parity;
+    pending.meter.initialBaudRate = meter.initialBaudRate;
+    if (strcmp(pending.meter.identifier, active.meter.identifier) == 0) {
+      strcpy(pending.meter.identifier, meter.identifier);
+    }
+    pending.serialDiscovered = 1;
+    store(PENDING_EEPROM_OFFSET, pending);
+  }
+
+  active.meter.parity = meter.parity;
+  active.meter.initialBaudRate = meter.initialBaudRate;
+  strcpy(active.meter.identifier, meter.identifier);
+  active.serialDiscovered = 1;
+  store(ACTIVE_EEPROM_OFFSET, active);
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef _SETTINGS_H
+#define _SETTINGS_H
+
+#include "config.h"
+#include "meter.h"
+
+uint8_t const SETTINGS_VERSION = 2;
+size_t const SETTINGS_OBIS_LENGTH = MAX_OBIS_CODE_LENGTH;
+
+enum PayloadOption : uint8_t
+{
+  ConfirmedUplinks = 0x01,  /* request an acknowledgement for every uplink */
+  CompactPayload = 0x02,    /* leave out battery voltage and up-counter */
+};
+
+/* Everything that can be changed by a downlink, persisted in flash */
+struct Settings
+{
+  uint8_t version;
+  MeterConfig meter;
+  char obisPower[SETTINGS_OBIS_LENGTH];
+  char obisEnergy[SETTINGS_OBIS_LENGTH];
+  uint32_t sleepTime;       /* [ms] */
+  uint8_t payloadOptions;
+  uint8_t serialDiscovered;  /* the serial settings of the meter were found by the discovery */
+  uint16_t crc;
+};
+
+/* Downlink commands, a downlink contains one or more of: <command> <length> <value...>
+   Multi-byte values are big endian, strings are not null terminated. */
+enum SettingsCommand : uint8_t
+{
+  SetSleepTime = 0x01,              /* uint16 [s] */
+  SetMeterIdentifier = 0x02,        /* string, empty = accept any meter */
+  SetObisPower = 0x03,              /* string */
+  SetObisEnergy = 0x04,             /* string */
+  SetModeOverride = 0x05,           /* '0'..'6', 0 = automatic */
+  SetBaudrateChangeDelay = 0x06,    /* uint16 [ms] */
+  SetIdentificationTimeout = 0x07,  /* uint16 [ms] */
+  SetReadingTimeout = 0x08,         /* uint16 [ms] */
+  SetMaxReadTime = 0x09,            /* uint16 [s] */
+  SetPayloadOptions = 0x0A,         /* uint8, see PayloadOption */
+  ResetSettings = 0xFF,             /* no value, back to the defaults of config.h */
+};
+
+namespace settings
+{
+
+/* Loads the settings from flash, falls back to the defaults if they are missing or corrupt */
+void begin(uint32_t defaultSleepTime);
+
+Settings const &current();
+
+/* Validates the commands of a downlink and stores the result as pending settings.
+   Nothing is changed if any of the commands is invalid. */
+bool handle_downlink(uint8_t const *data, size_t len);
+
+/* Activates the pending settings, meant to be called at the beginning of a wakeup
+   so a readout never runs with half applied settings. Returns true if anything changed. */
+bool apply_pending();
+
+/* Stores the serial settings and the identifier found by the discovery right away, a pending
+   downlink keeps them when it is applied */
+void store_discovered(MeterConfig const &meter);
+
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include "timebase.h"
+#include "loadprofile.h"
+#include "logger.h"
+
+/* The drift is only measured over long periods, the meter clock has a resolution of one second */
+uint32_t const MIN_DRIFT_BASELINE = 6 * 3600;
+uint32_t const MAX_DRIFT_BASELINE = 48 * 3600;
+
+/* A fresh meter clock is preferred over the network time, as the meter defines the billing intervals */
+uint32_t const METER_CLOCK_VALIDITY = 24 * 3600;
+
+bool TimeBase::sync(uint32_t wall, uint32_t node, TimeSource source) {
+  if (wall == 0 || source == NoTimeSource) {
+    return false;
+  }
+  if (source == NetworkTime && state_.source == MeterClock && node - state_.nodeReference < METER_CLOCK_VALIDITY) {
+    return false;
+  }
+  if (source != state_.source) {
+    // meter clock is local time, network time UTC: the drift can only be measured within one source
+    logger::info("Time source: %d", source);
+    state_.wallAnchor = wall;
+    state_.nodeAnchor = node;
+  } else {
+    logger::debug("Clock error since last sync: %d [s]", (int) (wall - now(node)));
+    learn_drift(wall, node);
+  }
+  state_.source = source;
+  state_.wallReference = wall;
+  state_.nodeReference = node;
+  return true;
+}
+
+void TimeBase::learn_drift(uint32_t wall, uint32_t node) {
+  uint32_t nodeElapsed = node - state_.nodeAnchor;
+  int32_t wallElapsed = (int32_t) (wall - state_.wallAnchor);
+  if (nodeElapsed < MIN_DRIFT_BASELINE) {
+    return;
+  }
+  int64_t measured = wallElapsed > 0 ? ((int64_t) nodeElapsed - wallElapsed) * 1000000 / wallElapsed : 0;
+  state_.wallAnchor = wall;
+  state_.nodeAnchor = node;
+  if (wallElapsed <= 0 || nodeElapsed > MAX_DRIFT_BASELINE || measured > MAX_CLOCK_DRIFT_PPM || measured < -MAX_CLOCK_DRIFT_PPM) {
+    // the clock was set or switched to daylight saving time, start over
+    logger::info("Clock jump, drift measurement restarted");
+    return;
+  }
+  if (state_.driftSamples == 0) {
+    state_.driftPpm = measured;
+  } else {
+    state_.driftPpm = (3 * (int64_t) state_.driftPpm + measured) / 4;
+  }
+  if (state_.driftSamples < 255) {
+    state_.driftSamples++;
+  }
+  logger::info("Node clock drift: %d [ppm]", (int) state_.driftPpm);
+}
+
+uint32_t TimeBase::now(uint32_t node) const {
+  if (!valid()) {
+    return 0;
+  }
+  uint32_t elapsed = node - state_.nodeReference;
+  return state_.wallReference + elapsed - (int32_t) ((int64_t) elapsed * state_.driftPpm / 1000000);
+}
+
+uint32_t TimeBase::seconds_until_boundary(uint32_t node, uint32_t interval, uint32_t lead, uint32_t minimum) const {
+  if (!valid() || interval == 0) {
+    return minimum;
+  }
+  uint32_t wall = now(node);
+  uint32_t boundary = (wall + minimum + lead + interval - 1) / interval * interval;
+  uint32_t sleep = boundary - lead - wall;
+  // the node clock has to run this much longer or shorter to cover the wall time
+  return sleep + (int32_t) ((int64_t) sleep * state_.driftPpm / 1000000);
+}
+
+/* Collects up to `count` digits, starting with the last ones if `fromEnd` is set */
+static size_t collect_digits(const char *chars, int digits[], size_t count, bool fromEnd) {
+  size_t found = 0;
+  size_t len = strlen(chars);
+  for (size_t i = 0; i < len && found < count; i++) {
+    char c = chars[fromEnd ? len - 1 - i : i];
+    if (isdigit((uint8_t) c)) {
+      digits[fromEnd ? count - 1 - found : found] = c - '0';
+      found++;
+    }
+  }
+  return found;
+}
+
+uint32_t meter_clock_seconds(const char *date, const char *time) {
+  int d[6], t[6];
+  if (date == NULL || time == NULL) {
+    return 0;
+  }
+  // some meters prefix the date (YYMMDD) with the century or weekday
+  if (collect_digits(date, d, 6, true) < 6) {
+    return 0;
+  }
+  size_t timeDigits = collect_digits(time, t, 6, false);
+  if (timeDigits < 4) {
+    return 0;
+  }
+  if (timeDigits < 6) {
+    t[4] = t[5] = 0;
+  }
+  int month = d[2] * 10 + d[3], day = d[4] * 10 + d[5];
+  int hour = t[0] * 10 + t[1], minute = t[2] * 10 + t[3], second = t[4] * 10 + t[5];
+  if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 59) {
+    return 0;
+  }
+  return load_profile_minutes(2000 + d[0] * 10 + d[1], month, day, hour, minute) * 60 + second;
+}
+
+int meter_minute_of_day(const char *time) {
+  int t[4];
+  if (time == NULL || collect_digits(time, t, 4, false) < 4) {
+    return -1;
+  }
+  int hour = t[0] * 10 + t[1], minute = t[2] * 10 + t[3];
+  return hour < 24 && minute < 60 ? hour * 60 + minute : -1;
+}
@@ -0,0 +1,43 @@
+#include "journal.h"
+
+void Journal::append(uint32_t timestamp, uint32_t energy, uint16_t power)
+{
+  JournalRecord &record = state_.records[state_.head % JOURNAL_RECORDS];
+  record.timestamp = timestamp;
+  record.energy = energy;
+  record.power = power;
+  state_.head++;
+  if (pending() > JOURNAL_RECORDS)
+    state_.tail = state_.head - JOURNAL_RECORDS;
+}
+
+size_t Journal::frame(uint8_t *frame, size_t maxSize, uint32_t now, uint8_t batteryPct, uint8_t upCounter, size_t &count) const
+{
+  size_t size = JOURNAL_FRAME_HEADER_SIZE;
+  count = 0;
+  while (count < pending() && size + JOURNAL_FRAME_RECORD_SIZE <= maxSize)
+  {
+    JournalRecord const &record = state_.records[(state_.tail + count) % JOURNAL_RECORDS];
+    uint32_t age = now >= record.timestamp ? (now - record.timestamp) / 60 : 0xFFFF;
+    if (age > 0xFFFF)
+      age = 0xFFFF;
+    frame[size++] = age >> 8;
+    frame[size++] = age & 0xFF;
+    frame[size++] = record.power >> 8;
+    frame[size++] = record.power & 0xFF;
+    frame[size++] = record.energy >> 24;
+    frame[size++] = record.energy >> 16;
+    frame[size++] = record.energy >> 8;
+    frame[size++] = record.energy & 0xFF;
+    count++;
+  }
+  frame[0] = count;
+  frame[1] = batteryPct;
+  frame[2] = upCounter;
+  return size;
+}
+
+void Journal::drop(size_t count)
+{
+  state_.tail = count < pending() ? state_.tail + count : state_.head;
+}
@@ -0,0 +1,53 @@
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+
+uint8_t const JOURNAL_RECORDS = 32;
+
+/* Port 5 frame, the same as the CubeCell sends: <count> <battery> <up-counter>, per reading
+   <age [min], FFFF = unknown> <power [W]> (2 bytes each) <energy [kWh/100]> (4 bytes) */
+uint8_t const JOURNAL_APP_PORT = 5;
+uint8_t const JOURNAL_FRAME_HEADER_SIZE = 3;
+uint8_t const JOURNAL_FRAME_RECORD_SIZE = 8;
+
+struct JournalRecord
+{
+	uint32_t timestamp; /* system time of the reading, it keeps running during deep sleep [s] */
+	uint32_t energy;	/* [kWh/100] */
+	uint16_t power;		/* [W] */
+};
+
+struct JournalState
+{
+	uint32_t head; /* sequence of the next reading */
+	uint32_t tail; /* sequence of the oldest reading not delivered yet */
+	JournalRecord records[JOURNAL_RECORDS];
+};
+
+/* Readings that haven't reached the network yet, e.g. while the join keeps failing. RTC
+   memory keeps them across deep sleep but not across a reset, unlike the flash journal of
+   the CubeCell. A full ring overwrites the oldest reading. */
+class Journal
+{
+public:
+	explicit Journal(JournalState &state) : state_(state) {}
+
+	void append(uint32_t timestamp, uint32_t energy, uint16_t power);
+
+	/* Number of readings not delivered yet */
+	size_t pending() const { return state_.head - state_.tail; }
+
+	/* Fills a port 5 frame with the oldest pending readings that fit into maxSize bytes,
+	   returns the frame size and the number of readings in it */
+	size_t frame(uint8_t *frame, size_t maxSize, uint32_t now, uint8_t batteryPct, uint8_t upCounter, size_t &count) const;
+
+	/* The oldest count readings were delivered */
+	void drop(size_t count);
+
+private:
+	JournalState &state_;
+};
+
+#endif
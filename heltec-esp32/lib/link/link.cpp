@@ -0,0 +1,84 @@
+#include <Arduino.h>
+#include "link.h"
+
+/* Demodulation floor of LoRa at 125 kHz, DR0 (SF12): SNR -20 dB or -137 dBm, every faster
+   data rate needs about 2.5 dB more [dB/4] */
+int16_t const FLOOR_SNR = -20 * 4;
+int16_t const FLOOR_RSSI = -137 * 4;
+int16_t const FLOOR_STEP = 10;
+
+/* The gateway transmits with more power than the node, a downlink overrates the uplink [dB] */
+int16_t const DOWNLINK_ADVANTAGE = 6;
+
+/* EU868: 16 dBm EIRP down to 2 dBm in steps of 2 dB */
+int8_t const MAX_TX_POWER = 16;
+int8_t const MIN_TX_POWER = 2;
+int16_t const TX_POWER_STEP = 2 * 4;
+
+/* Largest extra margin after lost uplinks [dB] */
+uint8_t const MAX_BOOST = 15;
+
+void LinkTracker::add_downlink(uint32_t now, int16_t rssi, int16_t snr)
+{
+  /* Above the noise floor the SNR saturates, the RSSI still tells the margin there */
+  int16_t margin = snr > 0 ? rssi * 4 - FLOOR_RSSI : snr - FLOOR_SNR;
+  margin -= DOWNLINK_ADVANTAGE * 4;
+  state_.margin = state_.samples == 0 || !known(now) ? margin : (3 * (int32_t)state_.margin + margin) / 4;
+  if (state_.samples < 255)
+    state_.samples++;
+  state_.lastSample = now;
+  Serial.printf("Link: rssi %d dBm, snr %.2f dB, margin %.2f dB at DR0\n", rssi, snr / 4.0, state_.margin / 4.0);
+}
+
+void LinkTracker::add_uplink(uint32_t now, bool confirmed)
+{
+  if (state_.awaitingAck)
+  {
+    state_.delivery = 7 * (uint32_t)state_.delivery / 8;
+    state_.boost = state_.boost + 3 > MAX_BOOST ? MAX_BOOST : state_.boost + 3;
+    Serial.printf("Link: uplink lost, delivery %u permille, margin +%u dB\n", state_.delivery, state_.boost);
+  }
+  state_.awaitingAck = confirmed;
+  if (confirmed)
+    state_.lastProbe = now;
+}
+
+void LinkTracker::add_ack()
+{
+  if (!state_.awaitingAck)
+    return;
+  state_.awaitingAck = false;
+  state_.delivery = (7 * (uint32_t)state_.delivery + 1000) / 8;
+  if (state_.boost > 0 && state_.delivery >= config_.targetDelivery)
+    state_.boost--;
+}
+
+bool LinkTracker::known(uint32_t now) const
+{
+  return state_.samples > 0 && now - state_.lastSample <= config_.staleTime;
+}
+
+bool LinkTracker::probe_due(uint32_t now) const
+{
+  if (!known(now)) /* measure soon, until then the fallback data rate is used */
+    return state_.lastProbe == 0 || now - state_.lastProbe >= config_.probeInterval / 4;
+  return now - state_.lastProbe >= config_.probeInterval;
+}
+
+LinkChoice LinkTracker::choose(uint32_t now) const
+{
+  LinkChoice choice = {config_.fallbackDataRate, MAX_TX_POWER};
+  if (!known(now))
+    return choice;
+  int16_t spare = state_.margin - (config_.margin + state_.boost) * 4;
+  if (spare < 0) /* even DR0 at max power is short of the margin, the best there is */
+  {
+    choice.dataRate = 0;
+    return choice;
+  }
+  choice.dataRate = spare / FLOOR_STEP >= LINK_DATA_RATES - 1 ? LINK_DATA_RATES - 1 : spare / FLOOR_STEP;
+  spare -= choice.dataRate * FLOOR_STEP;
+  int steps = spare / TX_POWER_STEP;
+  choice.txPower = MAX_TX_POWER - 2 * steps < MIN_TX_POWER ? MIN_TX_POWER : MAX_TX_POWER - 2 * steps;
+  return choice;
+}
@@ -0,0 +1,68 @@
+#ifndef _LINK_H
+#define _LINK_H
+
+#include <cstdint>
+
+/* EU868: DR0 = SF12 ... DR5 = SF7 */
+uint8_t const LINK_DATA_RATES = 6;
+
+struct LinkState
+{
+	int16_t margin;		 /* smoothed margin at DR0 and max power [dB/4] */
+	uint8_t samples;
+	uint8_t boost;		 /* extra margin after lost uplinks [dB] */
+	uint16_t delivery;	 /* of the confirmed uplinks [permille] */
+	bool awaitingAck;
+	uint32_t lastSample; /* [s] */
+	uint32_t lastProbe;	 /* [s] */
+};
+
+struct LinkChoice
+{
+	uint8_t dataRate;
+	int8_t txPower; /* [dBm] */
+};
+
+struct LinkConfig
+{
+	uint8_t margin;			  /* the chosen data rate and power have to keep this margin over the floor [dB] */
+	uint16_t targetDelivery;  /* [permille] */
+	uint32_t probeInterval;	  /* how often an uplink is confirmed to measure the link [s] */
+	uint32_t staleTime;		  /* without a measurement for this long the link is unknown again [s] */
+	uint8_t fallbackDataRate; /* while the link is unknown */
+};
+
+/* Keeps a smoothed margin of the downlinks and the delivery of the confirmed uplinks, and picks
+   the fastest data rate whose margin reaches the configured one, then as little TX power as
+   keeps it. Airtime halves with every data rate step while the radio current drops far less
+   per power step, thus this order gives the lowest charge per delivered byte. Lost uplinks
+   widen the margin, delivered ones narrow it again while the delivery ratio is on target. */
+class LinkTracker
+{
+public:
+	LinkTracker(LinkState &state, LinkConfig const &config) : state_(state), config_(config) {}
+
+	/* Feed every received downlink, including acks and MAC only frames. rssi: [dBm], snr: [dB/4] */
+	void add_downlink(uint32_t now, int16_t rssi, int16_t snr);
+
+	/* Feed every uplink before it is sent, a confirmed one that wasn't acknowledged until the next counts as lost */
+	void add_uplink(uint32_t now, bool confirmed);
+
+	/* The last confirmed uplink was acknowledged */
+	void add_ack();
+
+	LinkChoice choose(uint32_t now) const;
+
+	/* Whether the next uplink should be confirmed to measure the link */
+	bool probe_due(uint32_t now) const;
+
+	uint16_t delivery() const { return state_.delivery; }
+
+private:
+	bool known(uint32_t now) const;
+
+	LinkState &state_;
+	LinkConfig const &config_;
+};
+
+#endif
@@ -7,8 +7,9 @@
 /* Set to an unused pin (needed to switch between RX and TX only) */
 #define DUMMY_PIN 23 // CHANGME: set this pin to a unused pin
 
-/* Uncomment to verify the checksum */
-#define SKIP_CHECKSUM_CHECK
+/* Uncomment to skip verifying the checksum. If the checksum fails, values of lines
+   that look intact and pass the plausibility checks are still used */
+//#define SKIP_CHECKSUM_CHECK
 
 /* An additional layer of protection against bit flips: the values of all exported
    objects are checked, and if they contain any characters other than these, the
@@ -17,6 +18,12 @@
    1 byte, it might be worth keeping. */
 char const *const OBJECT_VALUE_ALLOWED_CHARS = "0123456789.,:-";
 
+/* Registers checked for plausible values: the energy register must count up, not
+   faster than the fuse allows, and the power must stay within the fuse limit */
+#define ENERGY_OBIS "1.8.0"
+#define POWER_OBIS "1.7.0"
+#define FUSE_LIMIT_W 43470 // CHANGEME: 3 phases x 63 A x 230 V
+
 /* Uncomment to override automatic mode selection, for example to limit the baud
    rate. Use if you have problems with your optical receiver. */
 //#define MODE_OVERRIDE '5'
\ No newline at end of file
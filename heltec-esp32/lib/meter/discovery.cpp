@@ -0,0 +1,64 @@
+#include <cctype>
+#include "config.h"
+#include "discovery.h"
+
+/* The meter waits this long for an acknowledgement before it accepts a new request [ms] */
+unsigned long const REQUEST_SETTLE_TIME = 1500;
+
+/* /AAAb... in 7 bit ASCII, with the wrong parity or levels the bytes don't come out as such */
+static bool is_identification(const char *line, size_t len)
+{
+  if (len < 7 || line[0] != '/')
+    return false;
+  for (size_t i = 1; i < 4; i++)
+  {
+    if (!isalpha((uint8_t)line[i]))
+      return false;
+  }
+  for (size_t i = 0; i < len; i++)
+  {
+    if ((uint8_t)line[i] >= 0x80 || (line[i] < 0x20 && line[i] != '\r'))
+      return false;
+  }
+  return true;
+}
+
+static bool probe(HardwareSerial &serial, uint8_t rx, uint8_t tx, SerialSettings const &candidate)
+{
+  serial.begin(INITIAL_BAUD_RATE, candidate.config, rx, tx, candidate.inverted);
+  serial.setTimeout(SERIAL_TIMEOUT * 2);
+  /* whatever arrived with the previous settings */
+  while (serial.read() >= 0)
+    ;
+  serial.write("/?!\r\n");
+  serial.flush();
+
+  char identification[MAX_IDENTIFICATION_LENGTH];
+  size_t len = serial.readBytesUntil('\n', identification, MAX_IDENTIFICATION_LENGTH - 1);
+  identification[len] = 0;
+  return is_identification(identification, len);
+}
+
+bool discover_serial_settings(HardwareSerial &serial, uint8_t rx, uint8_t tx, SerialSettings &found)
+{
+  SerialSettings const candidates[] = {
+      {SERIAL_7E1, IRINVERTED},
+      {SERIAL_8N1, IRINVERTED},
+      {SERIAL_7E1, !IRINVERTED},
+      {SERIAL_8N1, !IRINVERTED},
+  };
+  for (SerialSettings const &candidate : candidates)
+  {
+    Serial.printf("Probing %s, %s levels\n", candidate.config == SERIAL_7E1 ? "7E1" : "8N1",
+                  candidate.inverted ? "inverted" : "normal");
+    if (probe(serial, rx, tx, candidate))
+    {
+      Serial.println("Meter found");
+      found = candidate;
+      delay(REQUEST_SETTLE_TIME);
+      return true;
+    }
+  }
+  Serial.println("No meter found, keeping the serial settings");
+  return false;
+}
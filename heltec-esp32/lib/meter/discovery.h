@@ -0,0 +1,14 @@
+#ifndef _DISCOVERY_H
+#define _DISCOVERY_H
+
+#include <HardwareSerial.h>
+#include "meter.h"
+
+/* Finds the frame format and the levels the meter answers to: the configured ones first
+   (SERIAL_7E1, IRINVERTED), then 8N1 and the other level of the optical head, each with a
+   request at the initial baud rate. Blocks for a few seconds per candidate, meant for the
+   first boot and a press of the button. The serial is left in an unknown state.
+   Returns false if no meter answered, found is left as it is then */
+bool discover_serial_settings(HardwareSerial &serial, uint8_t rx, uint8_t tx, SerialSettings &found);
+
+#endif
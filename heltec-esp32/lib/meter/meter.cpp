@@ -2,6 +2,8 @@
 #include <cstdint>
 #include "config.h"
 #include "meter.h"
+#include "discovery.h"
+#include "plausibility.h"
 
 #define STX '\x02'
 #define ETX '\x03'
@@ -54,6 +56,47 @@ static void postprocess_value(std::string &value)
 #endif
 }
 
+bool parse_fixed_point(const char *text, FixedPoint &value)
+{
+  int64_t mantissa = 0;
+  int decimals = -1;
+  bool negative = *text == '-';
+  bool digits = false;
+  if (negative)
+    text++;
+  for (; *text != 0 && *text != UNIT_SEPARATOR; text++)
+  {
+    if (isdigit((unsigned char)*text))
+    {
+      mantissa = mantissa * 10 + (*text - '0');
+      digits = true;
+      if (decimals >= 0)
+        decimals++;
+      if (mantissa > INT32_MAX)
+        return false;
+    }
+    else if ((*text == '.' || *text == ',') && decimals < 0)
+      decimals = 0;
+    else
+      return false;
+  }
+  if (!digits)
+    return false;
+  value.mantissa = negative ? -mantissa : mantissa;
+  value.decimals = decimals > 0 ? decimals : 0;
+  return true;
+}
+
+int32_t fixed_point_scaled(FixedPoint const &value, uint8_t decimals)
+{
+  int64_t scaled = value.mantissa;
+  for (uint8_t i = value.decimals; i < decimals; i++)
+    scaled *= 10;
+  for (uint8_t i = decimals; i < value.decimals; i++)
+    scaled /= 10;
+  return scaled > INT32_MAX ? INT32_MAX : scaled < INT32_MIN ? INT32_MIN : scaled;
+}
+
 enum class MeterReader::Step : uint8_t
 {
   Ready,
@@ -71,6 +114,18 @@ enum class MeterReader::Step : uint8_t
                                                               => status = ProtocolError => status = Ready
 */
 
+SerialSettings default_serial_settings()
+{
+  return {SERIAL_7E1, IRINVERTED};
+}
+
+bool MeterReader::discover_serial_settings()
+{
+  if (status_ == Status::Busy)
+    return false;
+  return ::discover_serial_settings(serial_, rx_, tx_, serialSettings_);
+}
+
 void MeterReader::start_reading()
 {
   /* Don't allow starting a read when one is already in progress */
@@ -80,10 +135,12 @@ void MeterReader::start_reading()
   status_ = Status::Busy;
   step_ = Step::Started;
   startTime_ = millis();
+  pending_.clear();
 
   // prepare serial
+  baud_ = INITIAL_BAUD_RATE;
   serial_.setTimeout(SERIAL_TIMEOUT);
-  serial_.begin(INITIAL_BAUD_RATE, SERIAL_7E1, rx_, tx_, IRINVERTED);
+  serial_.begin(INITIAL_BAUD_RATE, serialSettings_.config, rx_, tx_, serialSettings_.inverted);
 
   // Hack: Sometimes it seems as there is already some data in the rx buffer thus let's clear it.
   // THE Elster AS 3000 has sometimes a weird behaviour where the data is being send in an endless loop.
@@ -115,7 +172,8 @@ void MeterReader::read_identification()
   Serial.println("Step -> read_identification");
   serial_.setTimeout(SERIAL_TIMEOUT * 2); // double the normal timeout at the beginning
   char identification[MAX_IDENTIFICATION_LENGTH];
-  size_t len = serial_.readBytesUntil('\n', identification, MAX_IDENTIFICATION_LENGTH);
+  size_t len = serial_.readBytesUntil('\n', identification, MAX_IDENTIFICATION_LENGTH - 1);
+  identification[len] = 0;
   std::string idView = std::string(identification);
   lastReadChars_ = idView;
   Serial.printf("identification=%s\n", identification);
@@ -132,7 +190,8 @@ void MeterReader::read_identification()
     return change_status(Status::IdentificationError_Id_Mismatch);
   }
 
-  identification[len - 1] = 0; /* Remove \r and null terminate */
+  if (identification[len - 1] == '\r') /* Remove \r, a cut off identification doesn't end with one */
+    identification[len - 1] = 0;
   Serial.printf("identification=%s\n", identification);
 
 #ifndef MODE_OVERRIDE
@@ -160,11 +219,12 @@ void MeterReader::switch_baud()
   if (params.new_baud)
   {
     Serial.printf("switching to %d bps\n", params.new_baud);
-    serial_.begin(params.new_baud, SERIAL_7E1, rx_, DUMMY_PIN, IRINVERTED);
+    baud_ = params.new_baud;
+    serial_.begin(params.new_baud, serialSettings_.config, rx_, DUMMY_PIN, serialSettings_.inverted);
   }
   else
   {
-    serial_.begin(INITIAL_BAUD_RATE, SERIAL_7E1, rx_, DUMMY_PIN, IRINVERTED);
+    serial_.begin(INITIAL_BAUD_RATE, serialSettings_.config, rx_, DUMMY_PIN, serialSettings_.inverted);
   }
 
   step_ = Step::InData;
@@ -178,7 +238,17 @@ void MeterReader::read_line()
   size_t len = serial_.readBytesUntil('\n', line, MAX_LINE_LENGTH);
   if (len == MAX_LINE_LENGTH)
   {
-    Serial.println("probably truncated a line, expect a checksum error");
+    /* The value is lost, but the characters still count for the checksum. Read up to
+       the line feed, so the rest of the line isn't mistaken for a line of its own */
+    Serial.println("line too long, skipping it");
+    ++truncated_lines_;
+    do
+    {
+      for (size_t i = 0; i < len; ++i)
+        checksum_ ^= line[i];
+    } while (len == MAX_LINE_LENGTH && (len = serial_.readBytesUntil('\n', line, MAX_LINE_LENGTH)) > 0);
+    checksum_ ^= '\n';
+    return;
   }
   else if (len < 2) /* A valid line will never be shorter than this */
   {
@@ -193,10 +263,13 @@ void MeterReader::read_line()
   /* readBytesUntil doesn't include the terminator, so take it into account separately */
   checksum_ ^= '\n';
 
-  line[len - 1] = 0; /* Cut off \r before logging the line */
+  /* Cut off \r before logging the line, len < MAX_LINE_LENGTH keeps the terminator in the buffer */
+  if (line[len - 1] == '\r')
+    --len;
+  line[len] = 0;
   Serial.printf("line: %s \n", line);
 
-  if (line[len - 2] == '!') /* End of data, ETX and checksum will follow */
+  if (len > 0 && line[len - 1] == '!') /* End of data, ETX and checksum will follow */
   {
     Serial.printf("ETX\n");
     step_ = Step::AfterData;
@@ -210,11 +283,11 @@ void MeterReader::read_line()
 
     auto openParen = lineView.find_first_of('(');
     auto closeParen = lineView.find_last_of(')');
-    if (openParen != std::string::npos && closeParen != std::string::npos)
+    if (openParen != std::string::npos && closeParen != std::string::npos && closeParen > openParen)
     {
       auto obis = lineView.substr(0, openParen);
       auto value = lineView.substr(openParen + 1, closeParen - (openParen + 1));
-      handle_object(obis, value);
+      handle_object(obis, value, line_integrity(lineView));
     }
     else
     {
@@ -223,17 +296,67 @@ void MeterReader::read_line()
   }
 }
 
-void MeterReader::handle_object(std::string obis, std::string value)
+void MeterReader::handle_object(std::string obis, std::string value, int integrity)
 {
-  auto entry = values_.find(obis);
-  if (entry != values_.end())
+  if (values_.find(obis) == values_.end())
+    return;
+
+  postprocess_value(value);
+  if (!is_valid_object_value(value))
+    return;
+
+  if (!is_plausible(obis, value))
   {
-    postprocess_value(value);
-    if (is_valid_object_value(value))
-    {
-      entry->second = value;
-    }
+    Serial.printf("implausible value: %s=%s\n", obis.c_str(), value.c_str());
+    ++implausible_;
+    return;
   }
+  pending_[obis] = {value, integrity >= MIN_SALVAGE_SCORE};
+}
+
+bool MeterReader::is_plausible(std::string const &obis, std::string const &value) const
+{
+  double number = atof(value.c_str());
+  if (obis.compare(ENERGY_OBIS) == 0)
+    return energy_plausible(number, energyReference_, energyElapsed_);
+  if (obis.compare(POWER_OBIS) == 0)
+    return power_plausible(number);
+  return true;
+}
+
+/* Moves the values of the current readout into values(), returns how many were used */
+size_t MeterReader::commit_values(bool salvageableOnly)
+{
+  size_t count = 0;
+  for (auto const &entry : pending_)
+  {
+    if (salvageableOnly && !entry.second.salvageable)
+      continue;
+    values_[entry.first] = entry.second.value;
+    ++count;
+    auto subscription = subscriptions_.find(entry.first);
+    FixedPoint value;
+    if (listener_.onRegister != NULL && subscription != subscriptions_.end() && parse_fixed_point(entry.second.value.c_str(), value))
+      listener_.onRegister(listener_.context, subscription->second, value);
+  }
+  pending_.clear();
+  return count;
+}
+
+/* The telegram as a whole can't be trusted, but the lines that look intact can */
+void MeterReader::salvage_or_fail(Status failure)
+{
+  size_t count = commit_values(true);
+  if (count == 0)
+    return change_status(failure);
+
+  Serial.printf("salvaged %u values\n", count);
+  ++salvaged_;
+  if (failure == Status::ChecksumError) /* still counted as the failure it was */
+    ++checksum_errors_;
+  else
+    ++errors_;
+  set_status(Status::Ok);
 }
 
 void MeterReader::verify_checksum()
@@ -244,17 +367,18 @@ void MeterReader::verify_checksum()
   if (serial_.readBytes(etx_bcc, 2) != 2 || etx_bcc[0] != ETX)
   {
     Serial.println("failed to read checksum");
-    return change_status(Status::ProtocolError);
+    return salvage_or_fail(Status::ProtocolError);
   }
 
   checksum_ ^= ETX;
   if (checksum_ != etx_bcc[1])
   {
     Serial.printf("checksum mismatch: %02" PRIx8 " != %02" PRIx8, checksum_, etx_bcc[1]);
-    return change_status(Status::ChecksumError);
+    return salvage_or_fail(Status::ChecksumError);
   }
 #endif
 
+  commit_values(false);
   return change_status(Status::Ok); /* Data readout successful */
 }
 
@@ -267,7 +391,16 @@ void MeterReader::change_status(Status to)
   else if (to == Status::Ok)
     ++successes_;
 
+  set_status(to);
+}
+
+/* Leaving Busy ends the session, the listener learns whether the values pushed were used */
+void MeterReader::set_status(Status to)
+{
+  bool ended = status_ == Status::Busy && to != Status::Busy;
   status_ = to;
+  if (ended && listener_.onSessionEnd != NULL)
+    listener_.onSessionEnd(listener_.context, to == Status::Ok);
 }
 
 bool MeterReader::start_monitoring(std::string obis)
@@ -280,6 +413,21 @@ bool MeterReader::start_monitoring(std::string obis)
   return true;
 }
 
+bool MeterReader::subscribe(std::string obis, uint8_t id)
+{
+  if (!start_monitoring(obis))
+    return false;
+  subscriptions_[obis] = id;
+  return true;
+}
+
+bool MeterReader::unsubscribe(std::string obis)
+{
+  if (status_ == Status::Busy || subscriptions_.erase(obis) == 0)
+    return false;
+  return stop_monitoring(obis);
+}
+
 bool MeterReader::stop_monitoring(std::string obis)
 {
   /* Don't allow removing a monitored object in the middle of a readout */
@@ -1,3 +1,6 @@
+#ifndef _METER_H
+#define _METER_H
+
 #include <cstddef>
 #include <cstdint>
 #include <map>
@@ -8,6 +11,8 @@
 size_t const MAX_OBIS_CODE_LENGTH = 16;
 size_t const MAX_IDENTIFICATION_LENGTH = 5 + 16 + 1; /* /AAAbi...i\r */
 size_t const MAX_VALUE_LENGTH = 32 + 1 + 16 + 1;	 /* value: 32, *, unit: 16 */
+/* Every parser works on a single line of at most this many chars and only scans it linearly,
+   thus the work per received char is bounded whatever the meter (or a disturbed line) sends */
 size_t const MAX_LINE_LENGTH = 78;
 uint32_t const INITIAL_BAUD_RATE = 300;
 
@@ -15,6 +20,45 @@ uint32_t const SERIAL_TIMEOUT = 2000; // How long to wait for the meter to send
 
 unsigned long const MAX_METER_READ_TIME = 30; // How long it should take to read all the data/lines [seconds]
 
+/* A register value as integer: mantissa * 10^-decimals, e.g. "012345.678" = {12345678, 3} */
+struct FixedPoint
+{
+	int32_t mantissa;
+	uint8_t decimals;
+};
+
+/* Parses a decimal value up to the unit ('*'), '.' or ',' separate the decimals.
+   Returns false if there are no digits, other characters or too many digits */
+bool parse_fixed_point(const char *text, FixedPoint &value);
+
+/* The value with the given number of decimals, e.g. kW with 3 decimals = W. Cut, not rounded */
+int32_t fixed_point_scaled(FixedPoint const &value, uint8_t decimals);
+
+/* Called for a subscribed register once its value is used: the telegram passed the checksum,
+   or the line was intact enough to be salvaged. id: as subscribed */
+typedef void (*RegisterCallback)(void *context, uint8_t id, FixedPoint const &value);
+
+/* Called when a readout ends, after the values were pushed. ok: the readout succeeded, otherwise
+   no value was pushed */
+typedef void (*SessionCallback)(void *context, bool ok);
+
+/* Frame format and levels of the optical head, see discovery.h */
+struct SerialSettings
+{
+	uint32_t config; /* SERIAL_7E1 or SERIAL_8N1 */
+	bool inverted;	 /* the receiver of the optical head inverts the levels */
+};
+
+/* SERIAL_7E1 and IRINVERTED of config.h */
+SerialSettings default_serial_settings();
+
+struct ReaderListener
+{
+	RegisterCallback onRegister;
+	SessionCallback onSessionEnd;
+	void *context;
+};
+
 class MeterReader
 {
 public:
@@ -32,6 +76,7 @@ public:
 
 	explicit MeterReader(HardwareSerial &serial, uint8_t rx, uint8_t tx, const char *identifierChars) : serial_(serial)
 	{
+		serialSettings_ = default_serial_settings();
 		rx_ = rx;
 		tx_ = tx;
 		identifierChars_ = identifierChars;
@@ -49,6 +94,22 @@ public:
 	 * for the specified object, false otherwise */
 	bool stop_monitoring(std::string obis);
 
+	/* Monitor an object and push its values to the listener with the given id */
+	bool subscribe(std::string obis, uint8_t id);
+
+	bool unsubscribe(std::string obis);
+
+	void set_listener(ReaderListener const &listener) { listener_ = listener; }
+
+	/* Used from the next readout on */
+	void set_serial_settings(SerialSettings const &settings) { serialSettings_ = settings; }
+
+	SerialSettings const &serial_settings() const { return serialSettings_; }
+
+	/* Probes the serial settings (see discovery.h) and keeps the ones the meter answered to.
+	   Returns false if it didn't answer to any or a readout is in progress */
+	bool discover_serial_settings();
+
 	void start_reading();
 
 	/* Must be called frequently to advance the reading process */
@@ -56,6 +117,9 @@ public:
 
 	Status status() const { return status_; }
 
+	/* Baud rate the meter is currently read with */
+	uint32_t baud() const { return baud_; }
+
 	/* Call this after status() returns Ok or an error to reset it to Ready */
 	void acknowledge()
 	{
@@ -76,6 +140,23 @@ public:
 
 	std::map<std::string, std::string> const &values() const { return values_; }
 
+	/* Lines longer than MAX_LINE_LENGTH, their values are skipped */
+	size_t truncated_lines() const { return truncated_lines_; }
+
+	/* Readouts with a failed checksum whose intact values were used nevertheless */
+	size_t salvaged() const { return salvaged_; }
+
+	/* Values that were rejected as implausible */
+	size_t implausible() const { return implausible_; }
+
+	/* The last accepted energy reading [kWh] and the seconds since then, to check
+	   the next readout against. Call before start_reading(), 0 = unknown */
+	void set_energy_reference(double kWh, uint32_t elapsed)
+	{
+		energyReference_ = kWh;
+		energyElapsed_ = elapsed;
+	}
+
 private:
 	enum class Step : uint8_t;
 
@@ -83,19 +164,38 @@ private:
 	void read_identification();
 	void switch_baud();
 	void read_line();
-	void handle_object(std::string obis, std::string value);
+	void handle_object(std::string obis, std::string value, int integrity);
+	bool is_plausible(std::string const &obis, std::string const &value) const;
+	size_t commit_values(bool salvageableOnly);
+	void salvage_or_fail(Status failure);
 
 	void verify_checksum();
 
 	void change_status(Status to);
+	void set_status(Status to);
 
 	HardwareSerial &serial_;
 	Step step_;
 	Status status_ = Status::Ready;
 	uint8_t baud_char_, checksum_, rx_, tx_;
+	SerialSettings serialSettings_;
+	struct PendingValue
+	{
+		std::string value;
+		bool salvageable;
+	};
+
 	std::map<std::string, std::string> values_;
-	size_t errors_ = 0, checksum_errors_ = 0, successes_ = 0;
+	std::map<std::string, uint8_t> subscriptions_;
+	ReaderListener listener_ = {};
+	std::map<std::string, PendingValue> pending_; /* values of the current readout, used once the checksum is known */
+	size_t errors_ = 0, checksum_errors_ = 0, successes_ = 0, salvaged_ = 0, implausible_ = 0, truncated_lines_ = 0;
+	double energyReference_ = 0;
+	uint32_t energyElapsed_ = 0;
+	uint32_t baud_ = INITIAL_BAUD_RATE;
 	unsigned long startTime_;
 	const char *identifierChars_;
 	std::string lastReadChars_;
 };
+
+#endif
@@ -0,0 +1,101 @@
+#include <cctype>
+#include <cstring>
+#include "config.h"
+#include "meter.h"
+#include "plausibility.h"
+
+int line_integrity(std::string const &line)
+{
+  int score = 100;
+
+  size_t open = line.find('(');
+  size_t close = line.find_last_of(')');
+  if (open == std::string::npos || close != line.size() - 1 || open == 0)
+    return 0;
+
+  for (size_t i = 0; i < line.size(); ++i)
+  {
+    /* 7 bit ASCII only, a flipped bit often ends up in the control or upper range */
+    if (line[i] < 0x20 || line[i] > 0x7E)
+      return 0;
+  }
+
+  /* OBIS code: digits, separators and a few letters (C.1.0, F.F, ...) */
+  bool separator = false;
+  for (size_t i = 0; i < open; ++i)
+  {
+    char c = line[i];
+    if (c == '.' || c == ':' || c == '-' || c == '*')
+      separator = true;
+    else if (!isdigit(c) && !strchr("CFLP", c))
+      score -= 50;
+  }
+  if (!separator)
+    score -= 50;
+
+  /* one value group */
+  if (line.find('(', open + 1) != std::string::npos || line.find(')') != close)
+    score -= 25;
+
+  /* value: digits with separators, optionally followed by *unit */
+  size_t unit = line.find('*', open);
+  size_t valueEnd = unit != std::string::npos ? unit : close;
+  int decimals = 0;
+  for (size_t i = open + 1; i < valueEnd; ++i)
+  {
+    char c = line[i];
+    if (c == '.' || c == ',')
+      ++decimals;
+    else if (!isdigit(c) && c != ':' && c != '-')
+      score -= 50;
+  }
+  if (decimals > 1)
+    score -= 50;
+  if (unit != std::string::npos)
+  {
+    for (size_t i = unit + 1; i < close; ++i)
+    {
+      if (!isalpha(line[i]))
+      {
+        score -= 25;
+        break;
+      }
+    }
+  }
+
+  return score < 0 ? 0 : score;
+}
+
+bool energy_plausible(double kWh, double reference, uint32_t elapsed)
+{
+  if (kWh < 0)
+    return false;
+  if (reference <= 0)
+    return true;
+  if (kWh < reference)
+    return false; /* registers never count down */
+  if (elapsed == 0)
+    return true;
+
+  /* the fuse limits the increase, allow for the read time and the resolution of the register */
+  double maxIncrease = FUSE_LIMIT_W / 1000.0 * (elapsed + MAX_METER_READ_TIME) / 3600.0 + 0.01;
+  return kWh - reference <= maxIncrease;
+}
+
+bool power_plausible(double kW)
+{
+  return kW >= 0 && kW * 1000 <= FUSE_LIMIT_W;
+}
+
+bool drop_energy_reference(unsigned &rejectedReadouts, size_t implausible)
+{
+  if (implausible == 0)
+  {
+    rejectedReadouts = 0;
+    return false;
+  }
+  if (++rejectedReadouts < MAX_REJECTED_READOUTS)
+    return false;
+  rejectedReadouts = 0;
+  return true;
+}
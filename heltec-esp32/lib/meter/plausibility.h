@@ -0,0 +1,30 @@
+#ifndef _PLAUSIBILITY_H
+#define _PLAUSIBILITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* Lines with at least this score are trusted even if the checksum of the telegram fails */
+int const MIN_SALVAGE_SCORE = 75;
+
+/* Scores how intact a data line (without STX and CR/LF) looks: 100 = well-formed,
+   each suspicious detail lowers the score, 0 = surely damaged */
+int line_integrity(std::string const &line);
+
+/* Energy registers only count up, and not faster than the fuse allows.
+   reference: last accepted reading [kWh] (0 = unknown), elapsed: seconds since then (0 = unknown) */
+bool energy_plausible(double kWh, double reference, uint32_t elapsed);
+
+/* Power must stay within the fuse limit */
+bool power_plausible(double kW);
+
+/* After this many readouts in a row with implausible values the energy reference is dropped,
+   e.g. the meter was replaced and its register starts lower */
+unsigned const MAX_REJECTED_READOUTS = 3;
+
+/* Counts the readouts in a row with implausible values, returns true once the energy reference
+   has to be dropped. implausible: values rejected in this readout */
+bool drop_energy_reference(unsigned &rejectedReadouts, size_t implausible);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _POWER_H
+#define _POWER_H
+
+#include <cstdint>
+
+/* What the firmware is busy with, each phase has its own CPU clock requirement */
+enum class PowerPhase : uint8_t
+{
+	Idle,		  /* setup, battery measurement */
+	MeterReadout, /* waiting for characters from the optical head */
+	Radio,		  /* LoRa/TTN join and send */
+	Display,	  /* rendering the OLED (software I2C) */
+};
+
+/* Frequencies supported by setCpuFrequencyMhz() with the 40 MHz crystal of the Heltec boards */
+uint32_t const CPU_FREQUENCIES_MHZ[] = {10, 20, 40, 80, 160, 240};
+
+/* CPU cycles needed per received bit: the UART interrupt copies the FIFO and
+   readBytesUntil() polls the buffer, both must easily keep up with one character
+   every 10 bits. Below 80 MHz the APB (and thus the UART) clock follows the CPU clock,
+   the Arduino core recalculates the baud rate divider on every frequency change. */
+uint32_t const CPU_CYCLES_PER_BIT = 2000;
+
+uint32_t const RADIO_CPU_MHZ = 80;	  /* LMIC needs the PLL clock for SPI and its timing */
+uint32_t const DISPLAY_CPU_MHZ = 240; /* bit-banged I2C, finish as fast as possible */
+uint32_t const IDLE_CPU_MHZ = 80;
+
+/* Lowest CPU frequency for the given phase and the baud rate the meter is read with.
+   See host/test/esp32_power.cpp */
+inline uint32_t cpu_mhz_for(PowerPhase phase, uint32_t baud)
+{
+	switch (phase)
+	{
+	case PowerPhase::MeterReadout:
+		for (uint32_t mhz : CPU_FREQUENCIES_MHZ)
+		{
+			if (mhz * 1000000 >= baud * CPU_CYCLES_PER_BIT)
+				return mhz;
+		}
+		return CPU_FREQUENCIES_MHZ[sizeof(CPU_FREQUENCIES_MHZ) / sizeof(CPU_FREQUENCIES_MHZ[0]) - 1];
+	case PowerPhase::Radio:
+		return RADIO_CPU_MHZ;
+	case PowerPhase::Display:
+		return DISPLAY_CPU_MHZ;
+	case PowerPhase::Idle:
+	default:
+		return IDLE_CPU_MHZ;
+	}
+}
+
+#endif
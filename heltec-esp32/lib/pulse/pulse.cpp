@@ -0,0 +1,157 @@
+#include <Arduino.h>
+#include <esp32/ulp.h>
+#include <driver/rtc_io.h>
+#include <esp_sleep.h>
+#include <soc/rtc_cntl_reg.h>
+#include <soc/rtc_io_reg.h>
+#include "pulse.h"
+
+/* Layout of RTC slow memory, in 32 bit words of which the ULP uses the lower 16 bits.
+   The program follows the data, both fit into the 512 bytes the Arduino core reserves */
+enum PulseWord
+{
+  PULSE_COUNT,
+  PULSE_LEVEL,       /* level of the last sample */
+  PULSE_ACTIVE,      /* level of the pin while the LED is on */
+  PULSE_TICKS,       /* sample periods since the last pulse, saturating */
+  PULSE_RING_INDEX,  /* next slot of the ring */
+  PULSE_RING,
+  PULSE_PROGRAM = PULSE_RING + PULSE_RING_SIZE,
+};
+
+enum PulseLabel
+{
+  LABEL_SATURATED,
+  LABEL_PULSE,
+  LABEL_DONE,
+};
+
+void PulseCounter::begin()
+{
+  if (esp_reset_reason() != ESP_RST_DEEPSLEEP)
+  {
+    state_.running = false;
+    state_.pulses = 0;
+  }
+}
+
+bool PulseCounter::start(time_t now)
+{
+  int rtcio = rtc_io_number_get(pin_);
+  if (rtcio < 0 || pulsesPerKwh_ == 0)
+    return false;
+
+  rtc_gpio_init(pin_);
+  rtc_gpio_set_direction(pin_, RTC_GPIO_MODE_INPUT_ONLY);
+  uint32_t level = rtc_gpio_get_level(pin_);
+  for (uint32_t i = 0; i < PULSE_PROGRAM; i++)
+    RTC_SLOW_MEM[i] = 0;
+  RTC_SLOW_MEM[PULSE_LEVEL] = level; /* a lit LED isn't a pulse yet */
+  RTC_SLOW_MEM[PULSE_ACTIVE] = activeLow_ ? 0 : 1;
+  RTC_SLOW_MEM[PULSE_TICKS] = UNKNOWN_PULSE_INTERVAL;
+
+  /* R3 stays 0, thus the offsets of the loads and stores are the word addresses */
+  const ulp_insn_t program[] = {
+      I_MOVI(R3, 0),
+      /* ticks = min(ticks + 1, 0xFFFF) */
+      I_LD(R0, R3, PULSE_TICKS),
+      M_BGE(LABEL_SATURATED, UNKNOWN_PULSE_INTERVAL),
+      I_ADDI(R0, R0, 1),
+      I_ST(R0, R3, PULSE_TICKS),
+      M_LABEL(LABEL_SATURATED),
+      /* sample, done if the level didn't change */
+      I_RD_REG(RTC_GPIO_IN_REG, RTC_GPIO_IN_NEXT_S + rtcio, RTC_GPIO_IN_NEXT_S + rtcio),
+      I_LD(R1, R3, PULSE_LEVEL),
+      I_ST(R0, R3, PULSE_LEVEL),
+      I_SUBR(R2, R0, R1),
+      M_BXZ(LABEL_DONE),
+      /* only the transition to the active level is a pulse */
+      I_LD(R1, R3, PULSE_ACTIVE),
+      I_SUBR(R2, R0, R1),
+      M_BXZ(LABEL_PULSE),
+      M_BX(LABEL_DONE),
+      M_LABEL(LABEL_PULSE),
+      I_LD(R0, R3, PULSE_COUNT),
+      I_ADDI(R0, R0, 1),
+      I_ST(R0, R3, PULSE_COUNT),
+      /* ring[index] = ticks, ticks = 0, index = (index + 1) % size */
+      I_LD(R1, R3, PULSE_RING_INDEX),
+      I_LD(R0, R3, PULSE_TICKS),
+      I_ST(R0, R1, PULSE_RING),
+      I_MOVI(R0, 0),
+      I_ST(R0, R3, PULSE_TICKS),
+      I_ADDI(R1, R1, 1),
+      I_ANDI(R1, R1, PULSE_RING_SIZE - 1),
+      I_ST(R1, R3, PULSE_RING_INDEX),
+      M_LABEL(LABEL_DONE),
+      I_HALT(),
+  };
+  size_t size = sizeof(program) / sizeof(ulp_insn_t);
+  if (ulp_process_macros_and_load(PULSE_PROGRAM, program, &size) != ESP_OK)
+  {
+    rtc_gpio_deinit(pin_);
+    return false;
+  }
+  /* the RTC IOs must stay powered during deep sleep, no wakeup source asks for them */
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+  ulp_set_wakeup_period(0, samplePeriodUs_);
+  if (ulp_run(PULSE_PROGRAM) != ESP_OK)
+  {
+    rtc_gpio_deinit(pin_);
+    return false;
+  }
+  state_.lastCount = 0;
+  state_.lastRead = now;
+  state_.running = true;
+  return true;
+}
+
+void PulseCounter::stop()
+{
+  if (!state_.running)
+    return;
+  /* the program halts after every sample, without the timer it isn't started again */
+  CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+  delayMicroseconds(100);
+  /* start() clears the counter, e.g. after a failed readout the pulses still count */
+  state_.pulses += (uint16_t)(word(PULSE_COUNT) - state_.lastCount);
+  state_.lastCount = word(PULSE_COUNT);
+  rtc_gpio_deinit(pin_);
+  state_.running = false;
+}
+
+uint16_t PulseCounter::word(uint32_t index) const
+{
+  return RTC_SLOW_MEM[index] & 0xFFFF;
+}
+
+PulseReading PulseCounter::read(time_t now)
+{
+  PulseReading reading = {0, 0, 0, 0, 0};
+  if (!state_.running)
+    return reading;
+
+  /* the ULP may count a pulse in between, it is only missing from the intervals */
+  uint16_t count = word(PULSE_COUNT);
+  uint16_t index = word(PULSE_RING_INDEX);
+  uint16_t pulses = count - state_.lastCount;
+  state_.lastCount = count;
+  state_.pulses += pulses;
+  reading.pulses = pulses;
+  if (now > state_.lastRead)
+    reading.seconds = now - state_.lastRead;
+  if (reading.seconds > 0 && pulsesPerKwh_ > 0)
+    reading.averageW = pulses * 3.6e6f / pulsesPerKwh_ / reading.seconds;
+  state_.lastRead = now;
+  if (pulses == 0)
+    return reading;
+
+  reading.lastW = pulse_power_w(word(PULSE_RING + ((index - 1) & (PULSE_RING_SIZE - 1))), samplePeriodUs_, pulsesPerKwh_);
+  for (uint32_t i = 0; i < pulses && i < PULSE_RING_SIZE; i++)
+  {
+    float power = pulse_power_w(word(PULSE_RING + ((index - 1 - i) & (PULSE_RING_SIZE - 1))), samplePeriodUs_, pulsesPerKwh_);
+    if (power > reading.peakW)
+      reading.peakW = power;
+  }
+  return reading;
+}
@@ -0,0 +1,85 @@
+#ifndef _PULSE_H
+#define _PULSE_H
+
+#include <cstdint>
+#include <ctime>
+#include <driver/gpio.h>
+
+/* Uplinks of the wakes that only collect the pulses */
+uint8_t const PULSE_APP_PORT = 8;
+
+/* Inter-pulse intervals kept in RTC slow memory, must be a power of two */
+uint32_t const PULSE_RING_SIZE = 64;
+
+/* Interval of the first pulse after the start and of intervals too long to be counted [ticks] */
+uint16_t const UNKNOWN_PULSE_INTERVAL = 0xFFFF;
+
+struct PulseState
+{
+	bool running;
+	uint16_t lastCount; /* counter of the ULP at the last read */
+	uint32_t pulses;	/* since the energy reference */
+	time_t lastRead;
+};
+
+struct PulseReading
+{
+	uint32_t pulses; /* since the last read */
+	float averageW;	 /* since the last read */
+	float lastW;	 /* of the latest interval, 0 = unknown */
+	float peakW;	 /* of the shortest interval since the last read, 0 = unknown */
+	uint32_t seconds; /* since the last read */
+};
+
+/* Power of one inter-pulse interval [W], 0 if the interval is unknown (see host/test/esp32_pulse.cpp) */
+inline float pulse_power_w(uint16_t ticks, uint32_t samplePeriodUs, uint32_t pulsesPerKwh)
+{
+	if (ticks == 0 || ticks == UNKNOWN_PULSE_INTERVAL || pulsesPerKwh == 0)
+		return 0;
+	/* 3.6e6 J per kWh, the interval in us */
+	return 3.6e12f / ((float)pulsesPerKwh * ticks * samplePeriodUs);
+}
+
+/* Counts the flashes of the test LED (imp/kWh) with the ULP coprocessor, which keeps
+   sampling the pin during deep sleep. Every sample period the ULP program reads the
+   pin, counts the transitions to the active level and stores the interval since the
+   previous pulse (in sample periods) in a ring in RTC slow memory. The main core only
+   collects the counts when it wakes. */
+class PulseCounter
+{
+public:
+	PulseCounter(PulseState &state, gpio_num_t pin, uint32_t pulsesPerKwh, uint32_t samplePeriodUs, bool activeLow)
+		: state_(state), pin_(pin), pulsesPerKwh_(pulsesPerKwh), samplePeriodUs_(samplePeriodUs), activeLow_(activeLow) {}
+
+	/* Call once in setup(): the ULP only keeps running across deep sleep, not across other resets */
+	void begin();
+
+	/* Loads and starts the ULP program, returns false if the pin is no RTC GPIO. The pulses
+	   since the energy reference are kept */
+	bool start(time_t now);
+
+	/* Stops sampling and returns the pin to the digital domain, e.g. for the UART. The pulses
+	   counted so far are added to the energy, the next start() clears the ULP's counter */
+	void stop();
+
+	bool running() const { return state_.running; }
+
+	/* Collects the pulses since the last read */
+	PulseReading read(time_t now);
+
+	/* The energy register was read, count from zero again */
+	void reset_reference() { state_.pulses = 0; }
+
+	double kwh_since_reference() const { return pulsesPerKwh_ > 0 ? (double)state_.pulses / pulsesPerKwh_ : 0; }
+
+private:
+	uint16_t word(uint32_t index) const;
+
+	PulseState &state_;
+	gpio_num_t pin_;
+	uint32_t pulsesPerKwh_;
+	uint32_t samplePeriodUs_;
+	bool activeLow_;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include <Arduino.h>
+#include "retry.h"
+
+/* Jitter keeps nodes that failed together (e.g. gateway outage) from retrying in lockstep [%] */
+long const RETRY_JITTER = 10;
+
+RetryPolicy const RETRY_POLICIES[(size_t)RetryClass::Count] = {
+    /* MeterNoise   */ {2, 30, 200, 600, 6},
+    /* MeterSilent  */ {1, 10, 150, 900, 8},
+    /* MeterBusy    */ {0, 120, 200, 1800, 5},
+    /* WrongMeter   */ {0, 0, 100, 0, 1},
+    /* RadioFailure */ {0, 30, 200, 1800, 6}};
+
+RetryClass retry_class_for(MeterReader::Status status)
+{
+  switch (status)
+  {
+  case MeterReader::Status::ChecksumError:
+  case MeterReader::Status::ProtocolError:
+    return RetryClass::MeterNoise;
+  case MeterReader::Status::IdentificationError:
+    return RetryClass::MeterSilent;
+  case MeterReader::Status::IdentificationError_Id_Mismatch:
+    return RetryClass::WrongMeter;
+  case MeterReader::Status::TimeoutError:
+  default:
+    return RetryClass::MeterBusy;
+  }
+}
+
+RetryPolicy const &retry_policy(RetryClass retryClass)
+{
+  return RETRY_POLICIES[(size_t)retryClass];
+}
+
+void RetryScheduler::succeeded()
+{
+  state_.failures = 0;
+  state_.delay = 0;
+  sessionRetries_ = 0;
+}
+
+bool RetryScheduler::retry_now(RetryClass retryClass)
+{
+  if (sessionRetries_ >= retry_policy(retryClass).immediateRetries)
+    return false;
+
+  ++sessionRetries_;
+  Serial.printf("Retrying right away (%d/%d)\n", sessionRetries_, retry_policy(retryClass).immediateRetries);
+  return true;
+}
+
+uint32_t RetryScheduler::next_delay(RetryClass retryClass, uint32_t normalDelay)
+{
+  RetryPolicy const &policy = retry_policy(retryClass);
+
+  if (state_.lastClass != (uint8_t)retryClass || state_.failures == 0)
+  {
+    /* another kind of failure starts over */
+    state_.lastClass = (uint8_t)retryClass;
+    state_.failures = 0;
+    state_.delay = policy.initialDelay;
+  }
+  else
+    state_.delay = state_.delay * policy.growth / 100;
+
+  if (state_.failures < UINT8_MAX)
+    ++state_.failures;
+
+  if (state_.delay == 0 || state_.failures > policy.budget)
+  {
+    /* budget used up, stop spending energy on early attempts: the normal interval, also if it is longer than maxDelay */
+    Serial.printf("Failure %d of class %d, retry with the next reading\n", state_.failures, (int)retryClass);
+    return normalDelay;
+  }
+  uint32_t delay = state_.delay;
+  if (policy.maxDelay != 0 && delay > policy.maxDelay)
+    delay = policy.maxDelay;
+  if (delay > normalDelay)
+    delay = normalDelay;
+
+  long jitter = (long)delay * random(-RETRY_JITTER, RETRY_JITTER + 1) / 100;
+  delay += jitter;
+  Serial.printf("Failure %d of class %d, retry in %u seconds\n", state_.failures, (int)retryClass, delay);
+  return delay > 0 ? delay : 1;
+}
@@ -0,0 +1,60 @@
+#ifndef _TIMEBASE_H
+#define _TIMEBASE_H
+
+#include <cstdint>
+
+/* Upper limit of the node clock drift that is accepted as such, larger differences are
+   clock jumps. The RTC runs on the internal RC oscillator during deep sleep [ppm] */
+int32_t const MAX_CLOCK_DRIFT_PPM = 20000;
+
+/* Where the wall time comes from */
+enum class TimeSource : uint8_t
+{
+	None,
+	MeterClock, /* 0.9.1/0.9.2 of the meter, local time of the meter */
+};
+
+struct TimeBaseState
+{
+	uint8_t source;
+	uint32_t wallReference; /* wall time of the last sync [s since 2000-01-01] */
+	uint32_t nodeReference; /* node clock at the last sync [s] */
+	uint32_t wallAnchor;	/* start of the current drift measurement, same units */
+	uint32_t nodeAnchor;
+	int32_t driftPpm; /* > 0: the node clock runs fast */
+	uint8_t driftSamples;
+};
+
+/* Keeps the wall time between syncs with the node clock (system time, running during
+   deep sleep) and learns how much the node clock drifts, so the wakes can be put on the
+   interval boundaries the meter and the utility use. */
+class TimeBase
+{
+public:
+	explicit TimeBase(TimeBaseState &state) : state_(state) {}
+
+	/* Returns false if the time was ignored */
+	bool sync(uint32_t wall, uint32_t node, TimeSource source);
+
+	bool valid() const { return state_.source != (uint8_t)TimeSource::None; }
+
+	/* Drift compensated wall time at the given node time, 0 if never synced [s since 2000-01-01] */
+	uint32_t now(uint32_t node) const;
+
+	/* Node seconds to sleep so the wake lands `lead` seconds before the next multiple of
+	   `interval` (wall time), but not earlier than `minimum` seconds from now */
+	uint32_t seconds_until_boundary(uint32_t node, uint32_t interval, uint32_t lead, uint32_t minimum) const;
+
+	int32_t drift_ppm() const { return state_.driftPpm; }
+
+private:
+	void learn_drift(uint32_t wall, uint32_t node);
+
+	TimeBaseState &state_;
+};
+
+/* Meter clock (date YYMMDD, optionally prefixed, and time hh:mm:ss or hhmmss) in seconds since
+   2000-01-01, 0 if malformed */
+uint32_t meter_clock_seconds(const char *date, const char *time);
+
+#endif
@@ -0,0 +1,14 @@
+# PlatformIO extra script: "pio run -t memreport" prints the static RAM/flash usage per module.
+# No --heap-free here: the reader of the ESP32 keeps its values in std::map and std::string
+Import("env")
+
+import os
+
+report = os.path.join("$PROJECT_DIR", "..", "tools", "memory_report.py")
+
+env.AddCustomTarget(
+    name="memreport",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=["$PYTHONEXE %s --prefix xtensa-esp32-elf- $BUILD_DIR" % report],
+    title="Memory Report",
+    description="Static RAM/flash usage per module")
@@ -4,27 +4,37 @@
 #include <U8g2lib.h>
 #include "RunningAverage.h"
 #include <TTN_esp32.h>
+#include <lmic.h>
+#include <rom/crc.h>
 #include "meter.h"
+#include "plausibility.h"
+#include "power.h"
+#include "retry.h"
+#include "timebase.h"
+#include "pulse.h"
+#include "link.h"
+#include "journal.h"
 #include "credentials.h"
 
 #define TRANSISTOR_PIN 17
+#define HEAD_WARM_UP_TIME 50 // how long the optical head is powered before the request is sent [ms]
 
+// RTC_DATA_ATTR: kept in the RTC memory across deep sleep, but not across a reset
 RTC_DATA_ATTR unsigned int uptimeCount = 0;
 
-enum RetryReason
-{
-  NONE,
-  METER_ERROR,
-  TTN_ERROR
-};
-RTC_DATA_ATTR RetryReason lastRetryReason;
-RTC_DATA_ATTR float retrySleepTime;             // Every time there's an error, this delay is doubled, up to a maximum. [seconds]
-const unsigned int INITAL_RETRY_SLEEP_TIME = 1; // start retry time [seconds]
-const float BACKOFF_MULTIPLIER = 1.5;           // 1   2   3   5   7   11    17    25    38    57    86    129   194    291     437
+RTC_DATA_ATTR RetryState retryState;            // see retry.cpp for the policies per error class
+RetryScheduler retryScheduler(retryState);
 const unsigned DEEP_SLEEP_TIME = 600;           // normal deep sleep time [seconds]
 
+RTC_DATA_ATTR TimeBaseState timeBaseState;      // wall time from the meter clock, see timebase.cpp
+TimeBase timeBase(timeBaseState);
+const bool ALIGNED_WAKE = false;                // CHANGEME: true wakes on the boundaries of DEEP_SLEEP_TIME (wall time) instead of sleeping it
+const unsigned ALIGNED_WAKE_LEAD = 2;           // wake this long before the boundary of DEEP_SLEEP_TIME, the meter needs a moment to send its registers [seconds]
+
 char sendingStatus[10];
 double power, totalkWh;
+bool energyValid = false; // 1.8.0 was read in this wake (or extrapolated from the pulses), otherwise totalkWh is no reading
+const uint32_t ENERGY_UNKNOWN = 0xFFFFFFFF; // sent instead of the energy, see ingest
 int batteryPct = 0;
 
 /**********
@@ -33,6 +43,60 @@ int batteryPct = 0;
 const unsigned MAX_SENDING_TIME = 20; // max time to send the message to ttn [seconds]
 TTN_esp32 ttn;
 
+/**********
+ * LORA LINK
+ **********/
+const bool LINK_ADAPTATION = false; // CHANGEME: true turns ADR off and picks the data rate and TX power from the link
+const LinkConfig LINK_CONFIG = {
+    10,     // margin over the demodulation floor [dB]
+    950,    // target delivery ratio of the confirmed uplinks [permille]
+    86400,  // an uplink is confirmed this often to measure the link [seconds]
+    259200, // without a measurement for this long the link is unknown again [seconds]
+    0};     // data rate while the link is unknown
+RTC_DATA_ATTR LinkState linkState = {0, 0, 0, 1000, false, 0, 0}; // only initialized on power-on, see lib/link
+LinkTracker linkTracker(linkState, LINK_CONFIG);
+
+/**********
+ * LORA SESSION
+ **********/
+const uint32_t SESSION_MAGIC = 0x5E551012;
+const unsigned MAX_SEND_FAILURES = 3; // consecutive send failures after which the session is considered dead
+struct LoraSession
+{
+  uint32_t magic;
+  u4_t netId;
+  devaddr_t devAddr;
+  u1_t nwkSKey[16];
+  u1_t appSKey[16];
+  u4_t seqnoUp;
+  u4_t seqnoDn;
+  dr_t dataRate;
+  s1_t txPower;
+  // set by the network in the Join-Accept and by MAC commands, LMIC_setSession() resets them to the defaults
+  u1_t rxDelay;                    // RX1 delay [s]
+  u1_t rx1DrOffset;
+  dr_t dn2Dr;                      // RX2 data rate
+  u4_t dn2Freq;                    // RX2 frequency
+  u4_t channelFreq[MAX_CHANNELS];  // includes the CFList channels
+  u2_t channelDrMap[MAX_CHANNELS];
+  u2_t channelMap;                 // enabled channels
+  uint32_t crc;
+};
+RTC_DATA_ATTR LoraSession loraSession; // survives deep sleep, thus a wakeup doesn't need to join again
+RTC_DATA_ATTR unsigned int sendFailures = 0;
+bool sessionRestored = false;
+
+/**********
+ * JOURNAL
+ **********/
+RTC_DATA_ATTR JournalState journalState; // readings not delivered yet, e.g. while the join fails
+Journal journal(journalState);
+
+/**********
+ * POWER
+ **********/
+PowerPhase powerPhase = PowerPhase::Idle;
+
 /**********
  * OLED
  **********/
@@ -58,57 +122,111 @@ RunningAverage batteryValues(VBATT_SMOOTH);
 /**********
  * OPTICAL METER
  **********/
-const std::map<MeterReader::Status, std::string> METER_STATUS_MAP = {
-    {MeterReader::Status::Ready, "Ready"},
-    {MeterReader::Status::Busy, "Busy"},
-    {MeterReader::Status::Ok, "Ok"},
-    {MeterReader::Status::TimeoutError, "Timeout"},
-    {MeterReader::Status::IdentificationError, "Err-Idn-1"},
-    {MeterReader::Status::IdentificationError_Id_Mismatch, "Err-Idn-2"},
-    {MeterReader::Status::ProtocolError, "Err-Prot"},
-    {MeterReader::Status::ChecksumError, "Timeout"},
-    {MeterReader::Status::TimeoutError, "Err-Chk"}};
+enum MeterRegister
+{
+  PowerRegister,  // 1.7.0 momentane leistung
+  EnergyRegister, // 1.8.0 total kwh
+};
 char const *const EXPORT_OBJECTS[] = {
-    "1.7.0", // momentane leistung
-    "1.8.0"  // total kwh
+    "0.9.1", // uhrzeit
+    "0.9.2"  // datum
+};
+struct MeterRegisters
+{
+  int32_t power;  // [W]
+  int32_t energy; // [Wh]
+  bool hasPower, hasEnergy;
 };
+MeterRegisters meterRegisters; // pushed by the reader while it commits the values of a readout
+RTC_DATA_ATTR double energyReference = 0;                // last accepted energy reading [kWh]
+RTC_DATA_ATTR time_t energyReferenceTime = 0;            // system time keeps running during deep sleep
+RTC_DATA_ATTR unsigned int rejectedReadouts = 0;
 static MeterReader reader(Serial2, 12, 13, "ELS"); // CHANGEME: Adapt RX and TX Pin
 //static MeterReader reader(Serial2, 12, 13, NULL);   // CHANGEME: Use this if you don't know the Identifier of your meter (for example: /ELS5\@V10.04)
+const bool SERIAL_DISCOVERY = false;                   // CHANGEME: true probes the frame format and the levels of the optical head on power-on and when the button woke the node
+RTC_DATA_ATTR SerialSettings serialSettings;           // found by the discovery, the readouts of the following wakes start with them
+RTC_DATA_ATTR bool serialDiscovered = false;
 
-void printRuntime()
+/**********
+ * TEST LED PULSES
+ **********/
+const unsigned PULSES_PER_KWH = 0;            // CHANGEME: imp/kWh printed next to the test LED of the meter, 0 = no pulse counting
+const gpio_num_t PULSE_PIN = GPIO_NUM_12;     // the receiver of the optical head (RX) if it sees the test LED, otherwise a separate phototransistor on an RTC GPIO
+const unsigned PULSE_SAMPLE_PERIOD_US = 2000; // the LED must be lit for at least this long to be seen
+const unsigned FULL_READOUT_INTERVAL = 6;     // while pulses are counted only every n-th wake reads the meter, to re-anchor 1.8.0
+RTC_DATA_ATTR PulseState pulseState;
+RTC_DATA_ATTR unsigned int wakesSinceReadout = 0;
+PulseReading pulseReading;
+bool pulseWake = false; // this wake only collected the pulses, sent on PULSE_APP_PORT
+PulseCounter pulseCounter(pulseState, PULSE_PIN, PULSES_PER_KWH, PULSE_SAMPLE_PERIOD_US, true); // light pulls the receiver low
+
+// Switches the CPU clock to what the phase needs, returns the previous phase
+PowerPhase setPowerPhase(PowerPhase phase)
 {
-  long seconds = millis() / 1000;
-  Serial.print("Runtime: ");
-  Serial.print(seconds);
-  Serial.println(" seconds");
+  PowerPhase previous = powerPhase;
+  powerPhase = phase;
+  uint32_t mhz = cpu_mhz_for(phase, reader.baud());
+  if (getCpuFrequencyMhz() != mhz)
+  {
+    Serial.flush(); // the UART clock changes below 80 MHz, don't garble pending output
+    setCpuFrequencyMhz(mhz);
+  }
+  return previous;
 }
 
-int retryTimeSeconds(RetryReason retryReason)
+// The optical head is only powered for the readout window, or while the test LED pulses are counted
+void headOn()
 {
-  Serial.printf("Last Retry-Reason: %d - Current Retry-Reason: %d\n", lastRetryReason, retryReason);
-  if (lastRetryReason != retryReason)
-    retrySleepTime = INITAL_RETRY_SLEEP_TIME;
+  digitalWrite(TRANSISTOR_PIN, HIGH);
+}
 
-  lastRetryReason = retryReason;
-  retrySleepTime *= BACKOFF_MULTIPLIER;
-  return retrySleepTime;
+void headOff()
+{
+  digitalWrite(TRANSISTOR_PIN, LOW);
 }
 
-void resetRetryTime()
+// Counts the test LED pulses from now on (also during deep sleep), once there is an energy reading to add them to
+void startPulseCounting()
 {
-  lastRetryReason = NONE;
-  retrySleepTime = INITAL_RETRY_SLEEP_TIME;
+  if (PULSES_PER_KWH == 0 || energyReference <= 0 || pulseCounter.running())
+    return;
+  headOn();
+  if (!pulseCounter.start(time(NULL)))
+    Serial.println("Pulse counting not available, the pin is no RTC GPIO");
 }
 
-void goDeepSleep(unsigned int deepSleepTime)
+// Probes the serial settings once per boot, if they weren't found yet or the button woke the node (e.g. a new head)
+void discoverSerialSettings()
 {
-  if (deepSleepTime > DEEP_SLEEP_TIME)
+  static bool probed = false; // a retry of the readout doesn't probe again
+  if (!SERIAL_DISCOVERY || probed || (serialDiscovered && esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_EXT1))
+    return;
+  probed = true;
+  setPowerPhase(PowerPhase::MeterReadout);
+  if (reader.discover_serial_settings())
   {
-    resetRetryTime();
-    Serial.println("Enough retry -> Let's restart");
-    ESP.restart();
+    serialSettings = reader.serial_settings();
+    serialDiscovered = true;
   }
+}
 
+// Whether this wake only collects the pulses, the meter is read on every FULL_READOUT_INTERVAL-th wake and on a button press
+bool pulseOnlyWake()
+{
+  return pulseCounter.running() && energyReference > 0 && wakesSinceReadout + 1 < FULL_READOUT_INTERVAL &&
+         esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
+
+void printRuntime()
+{
+  long seconds = millis() / 1000;
+  Serial.print("Runtime: ");
+  Serial.print(seconds);
+  Serial.println(" seconds");
+}
+
+void goDeepSleep(unsigned int deepSleepTime)
+{
   Serial.printf("Go DeepSleep for %d seconds\n", deepSleepTime);
   printRuntime();
   u8g2.sleepOn();
@@ -118,7 +236,15 @@ void goDeepSleep(unsigned int deepSleepTime)
   Serial.end();
   Serial2.end();
   digitalWrite(Vext, HIGH);          // Turn off Vext
-  digitalWrite(TRANSISTOR_PIN, LOW); // turn of transistor
+  startPulseCounting();
+  if (pulseCounter.running())
+  {
+    // the head stays powered for the ULP, the pad keeps its level during deep sleep
+    gpio_hold_en((gpio_num_t)TRANSISTOR_PIN);
+    gpio_deep_sleep_hold_en();
+  }
+  else
+    digitalWrite(TRANSISTOR_PIN, LOW); // turn of transistor
   pinMode(5, INPUT);
   pinMode(14, INPUT);
   pinMode(15, INPUT);
@@ -147,10 +273,8 @@ void blink(int times)
 
 uint16_t readBatteryVoltageSample()
 {
-  // Poll the proper ADC for VBatt on Heltec Lora 32 with GPIO21 toggled
+  // Poll the proper ADC for VBatt on Heltec Lora 32, GPIO21 (Vext) must be low, see batteryUpdate()
   uint16_t reading = 666;
-  digitalWrite(Vext, LOW);   // ESP32 Lora v2.1 reads on GPIO37 when GPIO21 is low
-  delay(ADC_READ_STABILIZE); // let GPIO stabilize
 #if (defined(HELTEC_V2_1))
   pinMode(ADC1_GPIO37_CHANNEL, OPEN_DRAIN); // ADC GPIO37
   reading = adc1_get_raw(ADC1_GPIO37_CHANNEL);
@@ -167,17 +291,33 @@ uint16_t readBatteryVoltageSample()
   return voltage;
 }
 
-std::string meterStatus()
+const char *meterStatus()
 {
-  MeterReader::Status status = reader.status();
-  auto it = METER_STATUS_MAP.find(status);
-  if (it == METER_STATUS_MAP.end())
-    return "Unknw";
-  return it->second;
+  switch (reader.status())
+  {
+  case MeterReader::Status::Ready:
+    return "Ready";
+  case MeterReader::Status::Busy:
+    return "Busy";
+  case MeterReader::Status::Ok:
+    return "Ok";
+  case MeterReader::Status::TimeoutError:
+    return "Timeout";
+  case MeterReader::Status::IdentificationError:
+    return "Err-Idn-1";
+  case MeterReader::Status::IdentificationError_Id_Mismatch:
+    return "Err-Idn-2";
+  case MeterReader::Status::ProtocolError:
+    return "Err-Prot";
+  case MeterReader::Status::ChecksumError:
+    return "Err-Chk";
+  }
+  return "Unknw";
 }
 
 void displayUpdate()
 {
+  PowerPhase previousPhase = setPowerPhase(PowerPhase::Display);
   u8g2.clearBuffer();
   u8g2.setFont(u8g2_font_amstrad_cpc_extended_8f);
 
@@ -197,7 +337,7 @@ void displayUpdate()
 
   u8g2.setCursor(3, 46);
   u8g2.print("State:");
-  u8g2.printf("%9s", meterStatus().c_str());
+  u8g2.printf("%9s", meterStatus());
 
   std::string lastReadChars = reader.lastReadChars();
   if (lastReadChars.size() > 0)
@@ -220,10 +360,13 @@ void displayUpdate()
   }
 
   u8g2.sendBuffer();
+  setPowerPhase(previousPhase);
 }
 
 void batteryUpdate()
 {
+  digitalWrite(Vext, LOW);   // ESP32 Lora v2.1 reads on GPIO37 when GPIO21 is low
+  delay(ADC_READ_STABILIZE); // let GPIO stabilize, once for all samples
   for (int x = 0; x <= VBATT_SMOOTH; x++)
   {
     auto value = readBatteryVoltageSample();
@@ -240,20 +383,97 @@ void batteryUpdate()
 #endif
 }
 
+// Syncs the time base with the meter clock, the system time itself is left as it is
+void syncMeterClock()
+{
+  auto const &values = reader.values();
+  auto time = values.find("0.9.1");
+  auto date = values.find("0.9.2");
+  if (time == values.end() || date == values.end())
+    return;
+  timeBase.sync(meter_clock_seconds(date->second.c_str(), time->second.c_str()), ::time(NULL), TimeSource::MeterClock);
+}
+
+// Sleeps until shortly before the next boundary of DEEP_SLEEP_TIME (wall time), e.g. the next full 10 minutes
+unsigned alignedSleepTime()
+{
+  if (!ALIGNED_WAKE || !timeBase.valid())
+    return DEEP_SLEEP_TIME;
+  return timeBase.seconds_until_boundary(time(NULL), DEEP_SLEEP_TIME, ALIGNED_WAKE_LEAD, DEEP_SLEEP_TIME / 4);
+}
+
+// Called by the reader for every power and energy value it uses
+void onRegister(void *context, uint8_t id, FixedPoint const &value)
+{
+  MeterRegisters &registers = *(MeterRegisters *)context;
+  Serial.printf("Register %u: %d / 10^%u\n", id, value.mantissa, value.decimals);
+  if (id == PowerRegister)
+  {
+    registers.power = fixed_point_scaled(value, 3); // kW -> W
+    registers.hasPower = true;
+  }
+  else if (id == EnergyRegister)
+  {
+    registers.energy = fixed_point_scaled(value, 3); // kWh -> Wh
+    registers.hasEnergy = true;
+  }
+}
+
+// The values of the readout become the current ones, a failed readout pushes none
+void onSessionEnd(void *context, bool ok)
+{
+  MeterRegisters &registers = *(MeterRegisters *)context;
+  if (ok && registers.hasPower)
+    power = registers.power;
+  if (ok && registers.hasEnergy)
+    totalkWh = registers.energy / 1000.0;
+  energyValid = ok && registers.hasEnergy;
+  registers.hasPower = false;
+  registers.hasEnergy = false;
+}
+
 void updateMeterData()
 {
-  for (auto const &entry : reader.values())
+  if (!energyValid)
+    Serial.println("No energy register in this readout, the energy is sent as unknown");
+  else if (totalkWh > 0)
   {
-    auto value = entry.second.c_str();
-    Serial.printf("Result: %s \t %s \n", entry.first.c_str(), value);
-    if (entry.first.compare("1.7.0") == 0)
-      power = atof(value) * 1000;
-    if (entry.first.compare("1.8.0") == 0)
-      totalkWh = atof(value);
+    energyReference = totalkWh;
+    energyReferenceTime = time(NULL);
+    pulseCounter.reset_reference();
+    wakesSinceReadout = 0;
   }
+  if (drop_energy_reference(rejectedReadouts, reader.implausible()))
+  {
+    Serial.println("Values keep being implausible -> drop the energy reference");
+    energyReference = 0;
+  }
+  displayUpdate();
+}
+
+// Power and energy from the pulses counted since the last wake, the energy is added to the last reading of 1.8.0
+void updatePulseData()
+{
+  pulseReading = pulseCounter.read(time(NULL));
+  pulseWake = true;
+  power = pulseReading.averageW;
+  totalkWh = energyReference + pulseCounter.kwh_since_reference();
+  energyValid = true;
+  wakesSinceReadout++;
+  Serial.printf("Pulses: %u in %u s, average %.0f W, last %.0f W, peak %.0f W\n", pulseReading.pulses, pulseReading.seconds,
+                pulseReading.averageW, pulseReading.lastW, pulseReading.peakW);
   displayUpdate();
 }
 
+void setEnergyReference()
+{
+  time_t now = time(NULL);
+  if (energyReference > 0 && now >= energyReferenceTime)
+    reader.set_energy_reference(energyReference, now - energyReferenceTime);
+  else
+    reader.set_energy_reference(energyReference, 0);
+}
+
 void onMessage(const uint8_t *payload, size_t size, int rssi)
 {
   Serial.println("-- MESSAGE");
@@ -267,6 +487,58 @@ void onMessage(const uint8_t *payload, size_t size, int rssi)
   Serial.println();
 }
 
+uint32_t sessionCrc()
+{
+  return crc32_le(0, (const uint8_t *)&loraSession, offsetof(LoraSession, crc));
+}
+
+void saveSession()
+{
+  LMIC_getSessionKeys(&loraSession.netId, &loraSession.devAddr, loraSession.nwkSKey, loraSession.appSKey);
+  loraSession.seqnoUp = LMIC.seqnoUp;
+  loraSession.seqnoDn = LMIC.seqnoDn;
+  loraSession.dataRate = LMIC.datarate;
+  loraSession.txPower = LMIC.adrTxPow;
+  loraSession.rxDelay = LMIC.rxDelay;
+  loraSession.rx1DrOffset = LMIC.rx1DrOffset;
+  loraSession.dn2Dr = LMIC.dn2Dr;
+  loraSession.dn2Freq = LMIC.dn2Freq;
+  memcpy(loraSession.channelFreq, LMIC.channelFreq, sizeof(loraSession.channelFreq));
+  memcpy(loraSession.channelDrMap, LMIC.channelDrMap, sizeof(loraSession.channelDrMap));
+  loraSession.channelMap = LMIC.channelMap;
+  loraSession.magic = SESSION_MAGIC;
+  loraSession.crc = sessionCrc();
+}
+
+void invalidateSession()
+{
+  Serial.println("Invalidate TTN Session");
+  loraSession.magic = 0;
+  sendFailures = 0;
+  ttn.deleteSession();
+}
+
+bool restoreSession()
+{
+  if (loraSession.magic != SESSION_MAGIC || loraSession.crc != sessionCrc() || loraSession.devAddr == 0)
+    return false;
+
+  LMIC_setSession(loraSession.netId, loraSession.devAddr, loraSession.nwkSKey, loraSession.appSKey);
+  LMIC.seqnoUp = loraSession.seqnoUp;
+  LMIC.seqnoDn = loraSession.seqnoDn;
+  LMIC.rxDelay = loraSession.rxDelay;
+  LMIC.rx1DrOffset = loraSession.rx1DrOffset;
+  LMIC.dn2Dr = loraSession.dn2Dr;
+  LMIC.dn2Freq = loraSession.dn2Freq;
+  memcpy(LMIC.channelFreq, loraSession.channelFreq, sizeof(loraSession.channelFreq));
+  memcpy(LMIC.channelDrMap, loraSession.channelDrMap, sizeof(loraSession.channelDrMap));
+  LMIC.channelMap = loraSession.channelMap;
+  LMIC_setDrTxpow(loraSession.dataRate, loraSession.txPower);
+  LMIC_setLinkCheckMode(1);
+  Serial.printf("Restored TTN Session (DevAddr: %08X, FCnt: %u)\n", loraSession.devAddr, loraSession.seqnoUp);
+  return true;
+}
+
 void waitForTransactions()
 {
   auto waitTime = ttn.waitForPendingTransactions();
@@ -274,31 +546,109 @@ void waitForTransactions()
   Serial.println("Waiting took " + String(waitTime) + "ms");
 }
 
-bool sendBytes()
+// Sets the data rate and TX power the tracker chose, returns whether the uplink should be confirmed to measure the link
+bool applyLinkChoice(uint32_t now)
 {
-  waitForTransactions();
-  uint8_t LORA_DATA[8];
+  if (!LINK_ADAPTATION)
+    return false;
+  LinkChoice choice = linkTracker.choose(now);
+  bool probe = linkTracker.probe_due(now);
+  LMIC_setAdrMode(0);
+  LMIC_setDrTxpow(choice.dataRate, choice.txPower);
+  Serial.printf("Link: DR%u, %d dBm, delivery %u permille%s\n", choice.dataRate, choice.txPower, linkTracker.delivery(), probe ? ", confirmed" : "");
+  return probe;
+}
 
-  uint16_t power_lora = power;
-  LORA_DATA[0] = power_lora >> 8;
-  LORA_DATA[1] = power_lora & 0xFF;
+// The RSSI and SNR of whatever came back in the receive windows: acks, MAC commands, application downlinks
+void updateLinkQuality(uint32_t now)
+{
+  if (!(LMIC.txrxFlags & (TXRX_DNW1 | TXRX_DNW2)))
+    return;
+  linkTracker.add_downlink(now, LMIC.rssi - RSSI_OFF, LMIC.snr);
+  if (LMIC.txrxFlags & TXRX_ACK)
+    linkTracker.add_ack();
+}
 
-  uint32_t totalkWh_lora = totalkWh * 100;
-  LORA_DATA[2] = totalkWh_lora >> 24;
-  LORA_DATA[3] = totalkWh_lora >> 16;
-  LORA_DATA[4] = totalkWh_lora >> 8;
-  LORA_DATA[5] = totalkWh_lora & 0xFF;
+// EU868 limit of the application payload at the current data rate (DR0-2: 51, DR3: 115, DR4-5: 222 bytes)
+size_t maxPayloadSize()
+{
+  if (LMIC.datarate <= 2)
+    return 51;
+  return LMIC.datarate == 3 ? 115 : 222;
+}
 
-  uint8_t battery_lora = batteryPct;
-  LORA_DATA[6] = battery_lora;
+// Keeps the reading until an uplink carried it
+void journalReading()
+{
+  journal.append(time(NULL), energyValid ? (uint32_t)(totalkWh * 100) : ENERGY_UNKNOWN, power);
+}
 
-  uint8_t uptimeCount_lora = uptimeCount;
-  LORA_DATA[7] = uptimeCount_lora;
+bool sendBytes()
+{
+  waitForTransactions();
+  uint32_t now = time(NULL);
+  bool confirmed = applyLinkChoice(now);
+  uint8_t LORA_DATA[222];
+  size_t size = 8;
+  uint8_t port = 2;
+  size_t readings = 1;
+
+  if (journal.pending() > 1)
+  {
+    // older readings didn't get through, send them oldest first together with this one
+    size = journal.frame(LORA_DATA, maxPayloadSize(), now, batteryPct, uptimeCount, readings);
+    port = JOURNAL_APP_PORT;
+    Serial.printf("Sending %u of %u buffered readings\n", readings, journal.pending());
+  }
+  else
+  {
+    uint16_t power_lora = power;
+    LORA_DATA[0] = power_lora >> 8;
+    LORA_DATA[1] = power_lora & 0xFF;
+
+    uint32_t totalkWh_lora = energyValid ? (uint32_t)(totalkWh * 100) : ENERGY_UNKNOWN;
+    LORA_DATA[2] = totalkWh_lora >> 24;
+    LORA_DATA[3] = totalkWh_lora >> 16;
+    LORA_DATA[4] = totalkWh_lora >> 8;
+    LORA_DATA[5] = totalkWh_lora & 0xFF;
+
+    uint8_t battery_lora = batteryPct;
+    LORA_DATA[6] = battery_lora;
+
+    uint8_t uptimeCount_lora = uptimeCount;
+    LORA_DATA[7] = uptimeCount_lora;
+
+    if (pulseWake)
+    {
+      // the power of the latest and the shortest inter-pulse interval, the seconds and pulses the average covers
+      uint16_t lastW_lora = pulseReading.lastW;
+      LORA_DATA[8] = lastW_lora >> 8;
+      LORA_DATA[9] = lastW_lora & 0xFF;
+
+      uint16_t peakW_lora = pulseReading.peakW;
+      LORA_DATA[10] = peakW_lora >> 8;
+      LORA_DATA[11] = peakW_lora & 0xFF;
+
+      uint16_t seconds_lora = pulseReading.seconds > 0xFFFF ? 0xFFFF : pulseReading.seconds;
+      LORA_DATA[12] = seconds_lora >> 8;
+      LORA_DATA[13] = seconds_lora & 0xFF;
+
+      uint16_t pulses_lora = pulseReading.pulses > 0xFFFF ? 0xFFFF : pulseReading.pulses;
+      LORA_DATA[14] = pulses_lora >> 8;
+      LORA_DATA[15] = pulses_lora & 0xFF;
+
+      size = 16;
+      port = PULSE_APP_PORT;
+    }
+  }
 
-  if (ttn.sendBytes(LORA_DATA, sizeof(LORA_DATA), 2, false))
+  linkTracker.add_uplink(now, confirmed);
+  if (ttn.sendBytes(LORA_DATA, size, port, confirmed))
   {
     Serial.println("Paket send");
+    journal.drop(readings);
     waitForTransactions();
+    updateLinkQuality(now);
     return true;
   }
   else
@@ -310,6 +660,14 @@ bool sendBytes()
 
 void prepareTTN()
 {
+  setPowerPhase(PowerPhase::Radio);
+  if (sessionRestored)
+  {
+    strncpy(sendingStatus, "Session", sizeof(sendingStatus) - 1);
+    displayUpdate();
+    return;
+  }
+
   ttn.join();
   unsigned long startJoiningTime = millis();
   Serial.print("Joining TTN ");
@@ -329,14 +687,16 @@ void prepareTTN()
     Serial.println("\nJoining failed go back to sleep");
     strncpy(sendingStatus, "Failed", sizeof(sendingStatus) - 1);
     displayUpdate();
-    ttn.deleteSession();
+    invalidateSession();
     delay(100);
-    goDeepSleep(retryTimeSeconds(TTN_ERROR));
+    goDeepSleep(retryScheduler.next_delay(RetryClass::RadioFailure, DEEP_SLEEP_TIME));
     return;
   }
   else
   {
     Serial.println("\njoined!");
+    LMIC_setLinkCheckMode(1);
+    saveSession();
     strncpy(sendingStatus, "Joined", sizeof(sendingStatus) - 1);
     displayUpdate();
   }
@@ -349,14 +709,23 @@ void sendData()
     Serial.println("Send Failed");
     strncpy(sendingStatus, "Failed", sizeof(sendingStatus) - 1);
     displayUpdate();
-    ttn.deleteSession();
+    // a single failure doesn't mean the session is gone, only rejoin if it keeps failing
+    if (++sendFailures >= MAX_SEND_FAILURES)
+      invalidateSession();
+    else
+      saveSession();
     delay(100);
-    goDeepSleep(retryTimeSeconds(TTN_ERROR));
+    goDeepSleep(retryScheduler.next_delay(RetryClass::RadioFailure, DEEP_SLEEP_TIME));
     return;
   }
   Serial.println("SENT!");
   strncpy(sendingStatus, "SENT", sizeof(sendingStatus) - 1);
   displayUpdate();
+  sendFailures = 0;
+  if (LMIC.opmode & OP_LINKDEAD) // no downlink received for the ADR/link-check period
+    invalidateSession();
+  else
+    saveSession();
 }
 
 void setup()
@@ -392,8 +761,18 @@ void setup()
   pinMode(LED_BUILTIN, OUTPUT);
 
   // METER
+  pulseCounter.begin();
   pinMode(TRANSISTOR_PIN, OUTPUT);
-  digitalWrite(TRANSISTOR_PIN, HIGH);
+  if (pulseCounter.running())
+    headOn(); // the ULP keeps counting while awake
+  else
+    headOff();
+  gpio_hold_dis((gpio_num_t)TRANSISTOR_PIN);
+  reader.set_listener({onRegister, onSessionEnd, &meterRegisters});
+  if (serialDiscovered)
+    reader.set_serial_settings(serialSettings);
+  reader.subscribe("1.7.0", PowerRegister);
+  reader.subscribe("1.8.0", EnergyRegister);
   for (char const *obis : EXPORT_OBJECTS)
   {
     reader.start_monitoring(obis);
@@ -401,13 +780,9 @@ void setup()
 
   // LORA INIT
   ttn.begin();
-  if (uptimeCount % 20 == 0) // delete session every x count;
-  {
-    Serial.printf("Delete TTN Session");
-    ttn.deleteSession();
-  }
   ttn.onMessage(onMessage);
   ttn.provision(devEui, appEui, appKey);
+  sessionRestored = restoreSession();
 
   // DISPLAY
   u8g2.begin();
@@ -418,26 +793,63 @@ void loop()
 {
   reader.loop();
   const MeterReader::Status status = reader.status();
-  if (status == MeterReader::Status::Ready)
+  if (status == MeterReader::Status::Busy)
   {
-    reader.start_reading();
+    // follows the baud switch right away, the meter waits at least 200 ms before it sends at the new rate
+    setPowerPhase(PowerPhase::MeterReadout);
+  }
+  else if (status == MeterReader::Status::Ready)
+  {
+    setPowerPhase(PowerPhase::Idle);
+    if (pulseOnlyWake())
+    {
+      batteryUpdate();
+      updatePulseData();
+      journalReading();
+      prepareTTN();
+      sendData();
+      retryScheduler.succeeded();
+      blink(1);
+      goDeepSleep(alignedSleepTime());
+    }
+    pulseCounter.stop(); // the readout needs the pin, the energy register replaces the pulses
+    // the head warms up while the battery is measured
+    unsigned long headOnTime = millis();
+    headOn();
     batteryUpdate();
+    while (millis() - headOnTime < HEAD_WARM_UP_TIME)
+      delay(1);
+    setEnergyReference();
+    discoverSerialSettings();
+    reader.start_reading();
     displayUpdate();
+    setPowerPhase(PowerPhase::MeterReadout);
   }
   else if (status == MeterReader::Status::Ok)
   {
+    headOff();
     updateMeterData();
+    startPulseCounting();
+    syncMeterClock();
+    journalReading();
     prepareTTN();
     sendData();
-    resetRetryTime();
+    retryScheduler.succeeded();
     blink(1);
-    goDeepSleep(DEEP_SLEEP_TIME);
+    goDeepSleep(alignedSleepTime());
   }
   else if (status != MeterReader::Status::Busy) /* Not Ready, Ok or Busy => error */
   {
+    RetryClass retryClass = retry_class_for(status);
+    if (retryScheduler.retry_now(retryClass))
+    {
+      reader.acknowledge(); // read again with the next loop, the head stays powered
+      return;
+    }
+    headOff();
     displayUpdate();
     blink(5);
     delay(2000);
-    goDeepSleep(retryTimeSeconds(METER_ERROR));
+    goDeepSleep(retryScheduler.next_delay(retryClass, DEEP_SLEEP_TIME));
   }
 }
\ No newline at end of file
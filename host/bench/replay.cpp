@@ -0,0 +1,360 @@
+/* Replays the telegrams of the corpus through the MeterReader of the CubeCell, once as fast as
+   the host can parse them and once with the timing of the meter (baud rates, response and
+   switch delays) on a virtual clock. Reports the outcome of every file, the throughput, the
+   heap and stack the reader used and how many bytes waited in the receive buffer.
+
+     build/replay [--save FILE | --compare FILE] [FILE...]
+
+   --save writes the results as CSV, --compare fails (exit code 1) if the outcome, the counts,
+   the allocations or the backlog of a file changed against a saved baseline and shows the
+   throughput next to it. Without files the whole corpus is replayed. */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+#include "meter.h"
+#include "logger.h"
+#include "telegram.h"
+#include "wire.h"
+
+#ifndef CORPUS_DIR
+#define CORPUS_DIR "corpus"
+#endif
+
+static char const *const USAGE =
+  "usage: %s [--save FILE | --compare FILE] [FILE...]\n"
+  "  replays the telegrams (.tlg) and captures (.cap), by default all of " CORPUS_DIR "\n";
+
+static size_t const RX_BUFFER = 256;               /* receive buffer of the CubeCell UART */
+static double const MIN_WALL_TIME = 0.25;          /* [s] of repeated replays per file */
+static size_t const STACK_PAINT = 64 * 1024;
+
+/* --- Heap ---------------------------------------------------------------------------------- */
+
+static bool counting = false;
+static size_t allocations = 0, heapInUse = 0, heapPeak = 0;
+
+/* Every block starts with its size, thus the delete operators know what is given back */
+void *operator new(size_t size) {
+  size_t *block = (size_t *) malloc(sizeof(size_t) * 2 + size);
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  block[0] = size;
+  if (counting) {
+    allocations++;
+    heapInUse += size;
+    heapPeak = std::max(heapPeak, heapInUse);
+  }
+  return block + 2;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *memory) noexcept {
+  if (memory == NULL) {
+    return;
+  }
+  size_t *block = (size_t *) memory - 2;
+  if (counting) {
+    heapInUse -= std::min(heapInUse, block[0]);
+  }
+  free(block);
+}
+
+void operator delete[](void *memory) noexcept {
+  operator delete(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+  operator delete(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+  operator delete(memory);
+}
+
+/* --- Stack --------------------------------------------------------------------------------- */
+
+/* Fills the stack below the caller with a pattern, stack_used() finds how deep the calls in
+   between wrote into it. Both have to be called from the same function */
+__attribute__((noinline)) static void paint_stack() {
+  volatile uint8_t area[STACK_PAINT];
+  for (size_t i = 0; i < STACK_PAINT; i++) {
+    area[i] = 0xA5;
+  }
+}
+
+/* reads what the calls left in the area, on purpose */
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((noinline)) static size_t stack_used() {
+  volatile uint8_t area[STACK_PAINT];
+  size_t untouched = 0;
+  while (untouched < STACK_PAINT && area[untouched] == 0xA5) {
+    untouched++;
+  }
+  return STACK_PAINT - untouched;
+}
+
+/* --- Replay -------------------------------------------------------------------------------- */
+
+static char const *const STATUS_NAMES[] = {
+  "ready", "busy", "ok", "timeout", "identification", "id-mismatch", "protocol", "checksum",
+};
+
+struct Result {
+  std::string file;
+  std::string mode;            /* unlimited or real */
+  std::string outcome;
+  unsigned lines, truncated, malformed, bytes, values;
+  uint32_t digest;             /* of the values read, FNV-1a */
+  size_t allocations, heapPeak;
+  unsigned long durationMs;    /* simulated */
+  size_t maxBacklog;
+  double wallUs;               /* per readout */
+  size_t stack;
+};
+
+static uint32_t fnv1a(uint32_t hash, char const *text) {
+  for (; *text != 0; text++) {
+    hash = (hash ^ (uint8_t) *text) * 16777619u;
+  }
+  return hash;
+}
+
+static double wall_seconds() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* One readout from a fresh reader, the meter answers with the capture */
+static void replay(std::string const &identification, std::string const &data, bool realTime, Result &result) {
+  wire_reset(identification, data, realTime);
+
+  MeterReader reader(Serial1);
+  MeterConfig config = default_meter_config();
+  config.identifier[0] = 0;
+  reader.configure(config);
+  reader.start_monitoring("1.8.*");
+  reader.start_monitoring("2.8.*");
+  reader.start_monitoring("1.7.0");
+  reader.start_monitoring("0.9.1");
+  reader.start_monitoring("0.9.2");
+
+  allocations = heapInUse = heapPeak = 0;
+  counting = true;
+  double start = wall_seconds();
+  reader.start_reading();
+  while (reader.status() == Busy) {
+    reader.loop();
+  }
+  double wall = wall_seconds() - start;
+  counting = false;
+
+  ReadoutStatistics const &stats = reader.statistics();
+  result.outcome = STATUS_NAMES[reader.status()];
+  result.lines = stats.lines;
+  result.truncated = stats.truncatedLines;
+  result.malformed = stats.malformedLines;
+  result.bytes = stats.bytes;
+  result.durationMs = stats.duration;
+  result.values = reader.values().size();
+  result.digest = 2166136261u;
+  for (size_t i = 0; i < reader.values().size(); i++) {
+    result.digest = fnv1a(result.digest, reader.values()[i].obis);
+    result.digest = fnv1a(result.digest, reader.values()[i].value);
+  }
+  result.allocations = allocations;
+  result.heapPeak = heapPeak;
+  result.maxBacklog = wire.maxBacklog;
+  result.wallUs = wall * 1e6;
+}
+
+static Result measure(char const *path, std::string const &identification, std::string const &data, bool realTime) {
+  Result result;
+  char const *slash = strrchr(path, '/');
+  result.file = slash != NULL ? slash + 1 : path;
+  result.mode = realTime ? "real" : "unlimited";
+  /* the first run resolves the library calls, which takes stack of its own */
+  Result again;
+  replay(identification, data, realTime, again);
+  paint_stack();
+  replay(identification, data, realTime, result);
+  result.stack = stack_used();
+  /* the outcome is the same every time, only the time taken is averaged */
+  double total = result.wallUs;
+  size_t runs = 1;
+  while (total < MIN_WALL_TIME * 1e6) {
+    replay(identification, data, realTime, again);
+    total += again.wallUs;
+    runs++;
+  }
+  result.wallUs = total / runs;
+  return result;
+}
+
+static void print(Result const &r) {
+  double perSecond = r.wallUs > 0 ? 1e6 / r.wallUs : 0;
+  if (r.mode == "unlimited") {
+    printf("  %-18s %-14s %5u %5u %5u %6u %6u %6zu %6zu %6zu %10.0f %10.0f %9.1f\n", r.file.c_str(), r.outcome.c_str(),
+           r.lines, r.truncated, r.malformed, r.bytes, r.values, r.allocations, r.heapPeak, r.stack,
+           r.lines * perSecond, r.bytes * perSecond, r.wallUs);
+  } else {
+    double cpu = r.durationMs > 0 ? 100 * r.wallUs / (r.durationMs * 1000.0) : 0;
+    printf("  %-18s %-14s %8lu %7zu%s %9.4f\n", r.file.c_str(), r.outcome.c_str(), r.durationMs, r.maxBacklog,
+           r.maxBacklog > RX_BUFFER ? "!" : " ", cpu);
+  }
+}
+
+static char const *const CSV_HEADER =
+  "file,mode,outcome,lines,truncated,malformed,bytes,values,digest,allocations,heap_peak,duration_ms,max_backlog,wall_us";
+
+static bool save(char const *path, std::vector<Result> const &results) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+  fprintf(file, "%s\n", CSV_HEADER);
+  for (size_t i = 0; i < results.size(); i++) {
+    Result const &r = results[i];
+    fprintf(file, "%s,%s,%s,%u,%u,%u,%u,%u,%08x,%zu,%zu,%lu,%zu,%.1f\n", r.file.c_str(), r.mode.c_str(), r.outcome.c_str(),
+            r.lines, r.truncated, r.malformed, r.bytes, r.values, r.digest, r.allocations, r.heapPeak, r.durationMs,
+            r.maxBacklog, r.wallUs);
+  }
+  fclose(file);
+  return true;
+}
+
+/* Everything but the time taken, which depends on the host */
+static std::string fingerprint(Result const &r) {
+  char text[256];
+  snprintf(text, sizeof(text), "%s,%u,%u,%u,%u,%u,%08x,%zu,%zu,%lu,%zu", r.outcome.c_str(), r.lines, r.truncated,
+           r.malformed, r.bytes, r.values, r.digest, r.allocations, r.heapPeak, r.durationMs, r.maxBacklog);
+  return text;
+}
+
+static bool compare(char const *path, std::vector<Result> const &results) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+  std::vector<Result> baseline;
+  char line[512];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char name[128], mode[16], outcome[32];
+    Result r;
+    if (sscanf(line, "%127[^,],%15[^,],%31[^,],%u,%u,%u,%u,%u,%x,%zu,%zu,%lu,%zu,%lf", name, mode, outcome, &r.lines,
+               &r.truncated, &r.malformed, &r.bytes, &r.values, &r.digest, &r.allocations, &r.heapPeak, &r.durationMs,
+               &r.maxBacklog, &r.wallUs) != 14) {
+      continue;
+    }
+    r.file = name;
+    r.mode = mode;
+    r.outcome = outcome;
+    baseline.push_back(r);
+  }
+  fclose(file);
+
+  bool same = true;
+  printf("\nCompared to %s:\n", path);
+  for (size_t i = 0; i < results.size(); i++) {
+    Result const &r = results[i];
+    Result const *before = NULL;
+    for (size_t j = 0; j < baseline.size(); j++) {
+      if (baseline[j].file == r.file && baseline[j].mode == r.mode) {
+        before = &baseline[j];
+      }
+    }
+    if (before == NULL) {
+      printf("  %-18s %-9s new\n", r.file.c_str(), r.mode.c_str());
+    } else if (fingerprint(*before) != fingerprint(r)) {
+      printf("  %-18s %-9s CHANGED: %s -> %s\n", r.file.c_str(), r.mode.c_str(), fingerprint(*before).c_str(),
+             fingerprint(r).c_str());
+      same = false;
+    } else {
+      printf("  %-18s %-9s same, %.2fx the speed\n", r.file.c_str(), r.mode.c_str(),
+             r.wallUs > 0 ? before->wallUs / r.wallUs : 0);
+    }
+  }
+  return same;
+}
+
+static void corpus_files(std::vector<std::string> &files) {
+  DIR *dir = opendir(CORPUS_DIR);
+  if (dir == NULL) {
+    perror(CORPUS_DIR);
+    return;
+  }
+  for (struct dirent *entry; (entry = readdir(dir)) != NULL;) {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".tlg") == 0 || name.compare(name.size() - 4, 4, ".cap") == 0)) {
+      files.push_back(std::string(CORPUS_DIR) + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(files.begin(), files.end());
+}
+
+int main(int argc, char **argv) {
+  char const *savePath = NULL, *comparePath = NULL;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "--save") == 0 || strcmp(argv[i], "--compare") == 0) && i + 1 < argc) {
+      (argv[i][2] == 's' ? savePath : comparePath) = argv[i + 1];
+      i++;
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, USAGE, argv[0]);
+      return 2;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) {
+    corpus_files(files);
+  }
+  logger::set_level(logger::None);
+
+  std::vector<Result> results;
+  printf("MeterReader: %zu bytes, lines up to %zu chars, receive buffer %zu bytes\n", sizeof(MeterReader), MAX_LINE_LENGTH,
+         RX_BUFFER);
+  printf("\nUnlimited speed:\n  %-18s %-14s %5s %5s %5s %6s %6s %6s %6s %6s %10s %10s %9s\n", "file", "outcome", "lines",
+         "trunc", "malf", "bytes", "values", "allocs", "heap", "stack", "lines/s", "bytes/s", "us/read");
+  for (size_t i = 0; i < files.size(); i++) {
+    std::string identification, data;
+    if (!load_capture(files[i].c_str(), identification, data)) {
+      fprintf(stderr, "%s: can't read it\n", files[i].c_str());
+      return 2;
+    }
+    results.push_back(measure(files[i].c_str(), identification, data, false));
+    print(results.back());
+  }
+  printf("\nBaud rates of the meter (simulated time, cpu = host time per readout time):\n  %-18s %-14s %8s %8s %9s\n",
+         "file", "outcome", "ms", "backlog", "cpu %");
+  for (size_t i = 0; i < files.size(); i++) {
+    std::string identification, data;
+    load_capture(files[i].c_str(), identification, data);
+    results.push_back(measure(files[i].c_str(), identification, data, true));
+    print(results.back());
+  }
+
+  if (savePath != NULL && !save(savePath, results)) {
+    return 2;
+  }
+  if (comparePath != NULL && !compare(comparePath, results)) {
+    return 1;
+  }
+  return 0;
+}
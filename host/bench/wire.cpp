@@ -0,0 +1,230 @@
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include "Arduino.h"
+#include "wire.h"
+
+static char const ACK = 0x06;
+static uint64_t const RESPONSE_DELAY = 200 * MS;   /* the meter answers a request after this */
+static uint64_t const BAUD_SWITCH_TIME = 250 * MS; /* and switches this long after the acknowledgement */
+static uint32_t const INITIAL_BAUD = 300;
+static uint32_t const BAUD_RATES[] = { 300, 600, 1200, 2400, 4800, 9600, 19200 };
+
+/* --- Virtual clock ------------------------------------------------------------------------- */
+
+uint64_t now = 0;
+
+unsigned long millis() {
+  return now / MS;
+}
+
+unsigned long micros() {
+  return now;
+}
+
+void delay(unsigned long ms) {
+  now += ms * MS;
+}
+
+void delayMicroseconds(unsigned int us) {
+  now += us;
+}
+
+/* --- The meter on the other end of the optical head ---------------------------------------- */
+
+Wire wire;
+
+static uint64_t byte_time(uint32_t baud) {
+  return baud > 0 ? 10 * 1000 * MS / baud : 1000 * MS;
+}
+
+static void send(std::string const &bytes, uint32_t baud, uint64_t start) {
+  uint64_t at = start;
+  for (size_t i = 0; i < bytes.size(); i++) {
+    if (wire.realTime) {
+      at += byte_time(baud);
+    }
+    wire.bytes.push_back(bytes[i]);
+    wire.arrival.push_back(at);
+  }
+}
+
+static void message_received(uint64_t at) {
+  char const *message = wire.received;
+  if (message[0] == '/') {
+    uint64_t start = wire.realTime ? at + RESPONSE_DELAY : at;
+    send(wire.identification, INITIAL_BAUD, start);
+    char baudChar = wire.identification.size() > 4 ? wire.identification[4] : '0';
+    if (baudChar < '0' || baudChar > '6') {
+      /* mode A and B: the data follows the identification without acknowledgement */
+      uint32_t baud = baudChar >= 'A' && baudChar <= 'F' ? BAUD_RATES[baudChar - 'A' + 1] : INITIAL_BAUD;
+      uint64_t end = wire.arrival.empty() ? start : wire.arrival.back();
+      send(wire.data, baud, wire.realTime ? end + BAUD_SWITCH_TIME : end);
+    }
+  } else if (message[0] == ACK && wire.receivedLen >= 3 && message[2] >= '0' && message[2] <= '6') {
+    send(wire.data, BAUD_RATES[message[2] - '0'], wire.realTime ? at + BAUD_SWITCH_TIME : at);
+  }
+}
+
+static void transmit(uint8_t byte) {
+  if (wire.realTime) {
+    wire.txIdle = std::max(wire.txIdle, now) + byte_time(wire.readerBaud);
+  }
+  if (wire.receivedLen < sizeof(wire.received) - 1) {
+    wire.received[wire.receivedLen++] = byte;
+    wire.received[wire.receivedLen] = 0;
+  }
+  if (byte == '\n') {
+    message_received(std::max(wire.txIdle, now));
+    wire.receivedLen = 0;
+  }
+}
+
+static size_t backlog() {
+  size_t arrived = std::upper_bound(wire.arrival.begin(), wire.arrival.end(), now) - wire.arrival.begin();
+  size_t waiting = arrived > wire.readPos ? arrived - wire.readPos : 0;
+  wire.maxBacklog = std::max(wire.maxBacklog, waiting);
+  return waiting;
+}
+
+/* Stream::timedRead(): waits up to the timeout for the next byte */
+static int timed_read() {
+  if (wire.readPos < wire.bytes.size() && wire.arrival[wire.readPos] <= now + wire.timeout * MS) {
+    backlog();
+    now = std::max(now, wire.arrival[wire.readPos]);
+    return wire.bytes[wire.readPos++];
+  }
+  now += wire.timeout * MS;
+  return -1;
+}
+void wire_reset(std::string const &identification, std::string const &data, bool realTime) {
+  wire.realTime = realTime;
+  wire.identification = identification;
+  wire.data = data;
+  wire.bytes.clear();
+  wire.arrival.clear();
+  wire.bytes.reserve(identification.size() + data.size());
+  wire.arrival.reserve(identification.size() + data.size());
+  wire.readPos = 0;
+  wire.receivedLen = 0;
+  wire.txIdle = 0;
+  wire.maxBacklog = 0;
+  now = 0;
+}
+
+void wire_send_unsolicited(std::string const &bytes) {
+  send(bytes, INITIAL_BAUD, now);
+}
+
+/* --- Serial: the console is discarded, Serial1 is the optical head ------------------------- */
+
+HardwareSerial Serial(1), Serial1(2), Serial2(3);
+
+static bool head(long uart) {
+  return uart == 2;
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config) {
+  if (head(uart_)) {
+    wire.readerBaud = baud;
+  }
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin, bool invert) {
+  begin(baud, config);
+}
+
+void HardwareSerial::end() {
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud) {
+  begin(baud);
+}
+
+void HardwareSerial::setTimeout(unsigned long timeout) {
+  if (head(uart_)) {
+    wire.timeout = timeout;
+  }
+}
+
+int HardwareSerial::available() {
+  return head(uart_) ? backlog() : 0;
+}
+
+int HardwareSerial::read() {
+  return available() > 0 ? wire.bytes[wire.readPos++] : -1;
+}
+
+int HardwareSerial::peek() {
+  return available() > 0 ? wire.bytes[wire.readPos] : -1;
+}
+
+size_t HardwareSerial::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (head(uart_) && count < length) {
+    int c = timed_read();
+    if (c < 0) {
+      break;
+    }
+    buffer[count++] = c;
+  }
+  return count;
+}
+
+size_t HardwareSerial::readBytes(uint8_t *buffer, size_t length) {
+  return readBytes((char *) buffer, length);
+}
+
+size_t HardwareSerial::readBytesUntil(char terminator, char *buffer, size_t length) {
+  size_t count = 0;
+  while (head(uart_) && count < length) {
+    int c = timed_read();
+    if (c < 0 || c == terminator) {
+      break;
+    }
+    buffer[count++] = c;
+  }
+  return count;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (head(uart_)) {
+    transmit(c);
+  }
+  return 1;
+}
+
+size_t HardwareSerial::write(uint8_t const *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(data[i]);
+  }
+  return size;
+}
+
+size_t HardwareSerial::write(char const *text) {
+  return write((uint8_t const *) text, strlen(text));
+}
+
+void HardwareSerial::flush() {
+  if (head(uart_)) {
+    now = std::max(now, wire.txIdle);
+  }
+}
+
+int HardwareSerial::printf(char const *fmt, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+  write(buffer);
+  return len;
+}
+
+size_t HardwareSerial::print(char const *text) {
+  return write(text);
+}
+
+size_t HardwareSerial::println(char const *text) {
+  return write(text) + write("\r\n");
+}
@@ -0,0 +1,43 @@
+#ifndef _WIRE_H
+#define _WIRE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* The meter on the other end of the optical head for the host tools that run the MeterReader of
+   the CubeCell without the simulator (bench/replay.cpp, fuzz/meter.cpp): a virtual clock, and
+   Serial1 answers the request with a capture. Serial and Serial2 are discarded. */
+
+uint64_t const MS = 1000;
+
+/* What the meter sends, with the time each byte is in the receive buffer. Reserved before a
+   replay, thus the wire itself doesn't allocate while the heap is counted */
+struct Wire {
+  bool realTime;               /* the baud rates and delays of the meter, otherwise as fast as read */
+  std::string identification, data;
+  std::vector<uint8_t> bytes;
+  std::vector<uint64_t> arrival;
+  size_t readPos;
+  char received[64];           /* what the reader sent since the last line feed */
+  size_t receivedLen;
+  uint64_t txIdle;             /* the reader's transmitter is busy until then */
+  uint32_t readerBaud;
+  unsigned long timeout;
+  size_t maxBacklog;
+};
+
+extern Wire wire;
+
+/* Virtual clock [us], millis() and delay() use it */
+extern uint64_t now;
+
+/* Starts a readout over at 0: the meter answers the request with the identification (up to and
+   including the line feed) and the data block after the acknowledgement or right away (mode A/B) */
+void wire_reset(std::string const &identification, std::string const &data, bool realTime);
+
+/* Bytes in the receive buffer before the request, e.g. a telegram the meter repeats on its own */
+void wire_send_unsolicited(std::string const &bytes);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _ARDUINO_H
+#define _ARDUINO_H
+
+/* CubeCell (ASR650x) core of the host simulator */
+
+#include "arduino_core.h"
+
+/* pins the sketch uses, the numbers only have to differ */
+#define Vext 6               /* LOW = the rail of the optical head is powered */
+#define USER_KEY 7
+#define GPIO1 8
+#define GPIO2 9
+#define GPIO3 10
+
+/* [mV], measured through the divider while the MCU is active */
+uint16_t getBatteryVoltage();
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _EEPROM_H
+#define _EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* The emulated EEPROM of the CubeCell core: a RAM copy that commit() writes to flash */
+class EEPROMClass {
+  public:
+    void begin(size_t size);
+
+    uint8_t read(int address) const;
+
+    void write(int address, uint8_t value);
+
+    template <typename T> T &get(int address, T &value) const {
+      memcpy(&value, data_ + address, sizeof(T));
+      return value;
+    }
+
+    template <typename T> T const &put(int address, T const &value) {
+      memcpy(data_ + address, &value, sizeof(T));
+      return value;
+    }
+
+    /* Erases and writes the flash rows, takes the MCU ~20 ms */
+    bool commit();
+
+  private:
+    uint8_t data_[4096];
+    size_t size_ = 0;
+    bool erased_ = false;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef _LORAWAN_APP_H
+#define _LORAWAN_APP_H
+
+/* The part of the Heltec CubeCell LoRaWAN library the sketch uses, on the simulated
+   EU868 network of board.cpp */
+
+#include "Arduino.h"
+
+#define LORAWAN_APP_DATA_MAX_SIZE 242
+#define APP_TX_DUTYCYCLE_RND 1000
+
+enum eDeviceState_LoraWan
+{
+  DEVICE_STATE_INIT,
+  DEVICE_STATE_JOIN,
+  DEVICE_STATE_SEND,
+  DEVICE_STATE_CYCLE,
+  DEVICE_STATE_SLEEP,
+};
+
+typedef enum
+{
+  LORAMAC_REGION_EU868 = 5,
+} LoRaMacRegion_t;
+
+typedef enum
+{
+  CLASS_A,
+  CLASS_B,
+  CLASS_C,
+} DeviceClass_t;
+
+typedef enum
+{
+  LORAMAC_STATUS_OK,
+  LORAMAC_STATUS_BUSY,
+  LORAMAC_STATUS_LENGTH_ERROR = 8,
+} LoRaMacStatus_t;
+
+typedef uint32_t TimerTime_t;
+
+typedef struct {
+  uint8_t McpsIndication;
+  uint8_t Status;
+  uint8_t Multicast;
+  uint8_t Port;
+  uint8_t RxDatarate;
+  uint8_t FramePending;
+  uint8_t *Buffer;
+  uint8_t BufferSize;
+  bool RxData;
+  int16_t Rssi;
+  uint8_t Snr;
+  uint8_t RxSlot;
+  bool AckReceived;
+  uint32_t DownLinkCounter;
+} McpsIndication_t;
+
+typedef enum
+{
+  MIB_NETWORK_JOINED,
+  MIB_CHANNELS_DATARATE,
+  MIB_CHANNELS_TX_POWER,
+} Mib_t;
+
+typedef struct {
+  Mib_t Type;
+  union {
+    bool IsNetworkJoined;
+    int8_t ChannelsDatarate;
+    int8_t ChannelsTxPower;
+  } Param;
+} MibRequestConfirm_t;
+
+typedef struct {
+  uint8_t MaxPossiblePayload;
+  uint8_t CurrentPossiblePayloadSize;
+} LoRaMacTxInfo_t;
+
+typedef enum
+{
+  MLME_JOIN,
+  MLME_LINK_CHECK,
+  MLME_DEVICE_TIME,
+} Mlme_t;
+
+typedef struct {
+  Mlme_t Type;
+} MlmeReq_t;
+
+LoRaMacStatus_t LoRaMacMibGetRequestConfirm(MibRequestConfirm_t *mibGet);
+LoRaMacStatus_t LoRaMacMibSetRequestConfirm(MibRequestConfirm_t *mibSet);
+LoRaMacStatus_t LoRaMacQueryTxPossible(uint8_t size, LoRaMacTxInfo_t *txInfo);
+LoRaMacStatus_t LoRaMacMlmeRequest(MlmeReq_t *mlmeRequest);
+
+/* [ms] since boot, wraps after ~49 days */
+TimerTime_t TimerGetCurrentTime();
+
+int32_t randr(int32_t min, int32_t max);
+
+class LoRaWanClass {
+  public:
+    void init(DeviceClass_t lorawanClass, LoRaMacRegion_t region);
+    void join();
+    void send();
+    void cycle(uint32_t dutyCycle);
+    void sleep();
+    void ifskipjoin();
+    void setDataRateForNoADR(int8_t dataRate);
+};
+
+extern LoRaWanClass LoRaWAN;
+
+extern enum eDeviceState_LoraWan deviceState;
+extern uint8_t appData[LORAWAN_APP_DATA_MAX_SIZE];
+extern uint8_t appDataSize;
+extern uint32_t txDutyCycleTime;
+
+/* defined by the sketch */
+extern uint8_t devEui[], appEui[], appKey[], nwkSKey[], appSKey[];
+extern uint32_t devAddr;
+extern uint16_t userChannelsMask[6];
+extern LoRaMacRegion_t loraWanRegion;
+extern DeviceClass_t loraWanClass;
+extern uint32_t appTxDutyCycle;
+extern bool overTheAirActivation, loraWanAdr, keepNet, isTxConfirmed;
+extern uint8_t appPort, confirmedNbTrials;
+
+void printDevParam();
+void downLinkDataHandle(McpsIndication_t *mcpsIndication);
+void downLinkAckHandle();
+void dev_time_updated();
+
+#endif
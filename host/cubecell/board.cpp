@@ -0,0 +1,388 @@
+#include <deque>
+#include "LoRaWan_APP.h"
+#include "EEPROM.h"
+#include "sx126x.h"
+#include "board.h"
+#include "meter_device.h"
+#include "radio.h"
+#include "uart.h"
+
+using namespace sim;
+
+/* Currents of the HTCC-AB02 [uA]: ASR6502 and SX1262 datasheets, the rest measured on the board */
+static uint32_t const MCU_ACTIVE_UA = 9000;
+static uint32_t const MCU_SLEEP_UA = 2;
+static uint32_t const FLASH_WRITE_UA = 12000;
+static uint32_t const RADIO_SLEEP_UA = 1;
+static uint32_t const RADIO_RX_UA = 4600;
+static uint32_t const RADIO_TX_0DBM_UA = 18000;
+static uint32_t const RADIO_TX_14DBM_UA = 45000;
+static uint32_t const HEAD_UA = 2700;
+static uint32_t const BOARD_UA = 1;
+
+/* The MCU wakes, processes the interrupt and the radio events and goes to sleep again */
+static Micros const WAKE_TIME = 2 * MS;
+static Micros const FLASH_COMMIT_TIME = 20 * MS;
+static Micros const BATTERY_MEASURE_TIME = 5 * MS;
+
+/* Class A receive windows after the end of the uplink */
+static Micros const RX1_DELAY = 1 * SECOND;
+static Micros const RX2_DELAY = 2 * SECOND;
+static Micros const JOIN_RX1_DELAY = 5 * SECOND;
+static Micros const JOIN_RX2_DELAY = 6 * SECOND;
+static uint8_t const RX2_DATA_RATE = 3;            /* The Things Network */
+static uint8_t const JOIN_RX2_DATA_RATE = 0;
+static Micros const REJOIN_DELAY = 30 * SECOND;     /* the library joins again on its own */
+static Micros const ACK_TIMEOUT = 2 * SECOND;       /* +-1 s until a confirmed uplink is repeated */
+
+LoRaWanClass LoRaWAN;
+enum eDeviceState_LoraWan deviceState;
+uint8_t appData[LORAWAN_APP_DATA_MAX_SIZE];
+uint8_t appDataSize = 4;
+uint32_t txDutyCycleTime;
+EEPROMClass EEPROM;
+
+static MeterDevice meter;
+
+/* What the LoRaMac of the library keeps */
+static struct {
+  bool joined;
+  uint16_t joinAttempts;
+  int8_t dataRate;
+  int8_t noAdrDataRate;
+  int8_t txPower;               /* index, 2 dB steps below 14 dBm */
+  bool busy;                    /* a confirmed uplink is still being repeated */
+  bool confirmed;
+  uint8_t trial;
+  uint8_t size;
+  uint32_t uplinks;             /* frames with a new frame counter */
+  Micros dutyCycleFree;         /* the band is free for the next frame */
+  uint32_t timer;               /* TxNextPacketTimer, a new start cancels the running one */
+  PacketStatus_t packet;
+} mac;
+
+/* Radio events the library hands to the sketch the next time it runs LoRaWAN.sleep() */
+static std::deque<std::function<void()> > indications;
+
+static uint32_t tx_current(int8_t txPower) {
+  int32_t dbm = 14 - 2 * txPower;
+  if (dbm <= 0) {
+    return RADIO_TX_0DBM_UA;
+  }
+  return RADIO_TX_0DBM_UA + (RADIO_TX_14DBM_UA - RADIO_TX_0DBM_UA) * dbm / 14;
+}
+
+static void radio_sleep() {
+  set_state(Radio, "sleep", RADIO_SLEEP_UA);
+}
+
+static void on_pin(uint8_t pin, uint8_t value) {
+  if (pin != Vext) {
+    return;
+  }
+  bool on = value == LOW;
+  set_state(Head, on ? "on" : "off", on ? HEAD_UA : 0);
+  meter.set_powered(on);
+}
+
+void board_begin() {
+  if (!meter.load(scenario().telegram)) {
+    fprintf(stderr, "cannot read the telegram %s\n", scenario().telegram);
+    exit(1);
+  }
+  meter.connect(uart(2));
+  on_pin_write(on_pin);
+  set_pin_level(USER_KEY, HIGH);
+  set_state(Mcu, "active", MCU_ACTIVE_UA);
+  radio_sleep();
+  set_state(Head, "off", 0);
+  set_state(Board, "regulator", scenario().boardSleepMicroamps > 0 ? scenario().boardSleepMicroamps : BOARD_UA);
+  mac.noAdrDataRate = 5;
+  counters().boots++;
+}
+
+uint16_t getBatteryVoltage() {
+  advance(BATTERY_MEASURE_TIME);
+  return battery_millivolts();
+}
+
+TimerTime_t TimerGetCurrentTime() {
+  return (TimerTime_t) (now() / MS);
+}
+
+int32_t randr(int32_t min, int32_t max) {
+  return min + (int32_t) sim::random(max - min + 1);
+}
+
+void printDevParam() {
+  Serial.printf("+OTAA=%d\r\n", overTheAirActivation);
+}
+
+void SX126xGetPacketStatus(PacketStatus_t *packet) {
+  *packet = mac.packet;
+}
+
+/* The window opens, catches the downlink if there is one and the radio sleeps again. Returns its end */
+static Micros receive(Micros at, uint8_t dataRate, size_t downlinkSize) {
+  Micros length = downlinkSize > 0 ? airtime(dataRate, downlinkSize) + 3 * MS : rx_window(dataRate);
+  schedule(at, []() { set_state(Radio, "rx", RADIO_RX_UA); });
+  schedule(at + length, []() { radio_sleep(); });
+  return at + length;
+}
+
+/* Starts the frame once the band is free, returns the end of the transmission */
+static Micros transmit(uint8_t dataRate, size_t phySize) {
+  Micros start = now() > mac.dutyCycleFree ? now() : mac.dutyCycleFree;
+  Micros length = airtime(dataRate, phySize);
+  char state[MAX_STATE_NAME];
+  snprintf(state, sizeof(state), "tx %d dBm", 14 - 2 * mac.txPower);
+  std::string name(state);
+  uint32_t current = tx_current(mac.txPower);
+  schedule(start, [name, current]() { set_state(Radio, name.c_str(), current); });
+  schedule(start + length, []() { radio_sleep(); });
+  mac.dutyCycleFree = start + length + length * DUTY_CYCLE_FACTOR;
+  return start + length;
+}
+
+static void start_timer(Micros delay);
+
+static void send_join_request() {
+  mac.joinAttempts++;
+  counters().joinAttempts++;
+  uint8_t dataRate = join_data_rate(mac.joinAttempts);
+  bool accepted = join_accepted(mac.joinAttempts);
+  log("sim: join request %d at DR%d%s\n", mac.joinAttempts, dataRate, accepted ? "" : ", no accept");
+  Micros end = transmit(dataRate, JOIN_REQUEST_SIZE);
+  Micros done;
+  if (accepted) {
+    done = receive(end + JOIN_RX1_DELAY, dataRate, JOIN_ACCEPT_SIZE);
+  } else {
+    receive(end + JOIN_RX1_DELAY, dataRate, 0);
+    done = receive(end + JOIN_RX2_DELAY, JOIN_RX2_DATA_RATE, 0);
+  }
+  schedule(done, [accepted]() {
+    if (accepted) {
+      mac.joined = true;
+      counters().joins++;
+      mac.dataRate = 0;
+      indications.push_back([]() {
+        Serial.printf("joined\r\n");
+        deviceState = DEVICE_STATE_SEND;
+      });
+    } else {
+      indications.push_back([]() {
+        Serial.printf("join failed, join again at 30s later\r\n");
+        start_timer(REJOIN_DELAY);
+      });
+    }
+  });
+}
+
+/* TxNextPacketTimer: the next cycle, or the next join attempt while not joined */
+static void start_timer(Micros delay) {
+  uint32_t timer = ++mac.timer;
+  schedule(now() + delay, [timer]() {
+    if (timer != mac.timer) {
+      return;
+    }
+    indications.push_back([]() {
+      if (mac.joined) {
+        deviceState = DEVICE_STATE_SEND;
+      } else {
+        send_join_request();
+        deviceState = DEVICE_STATE_SLEEP;
+      }
+    });
+  });
+}
+
+static void transmit_uplink();
+
+static void uplink_done(bool ack, bool data) {
+  McpsIndication_t indication;
+  memset(&indication, 0, sizeof(indication));
+  static uint8_t buffer[sizeof(scenario().downlink)];
+  indication.AckReceived = ack;
+  indication.RxData = data;
+  indication.Rssi = scenario().rssi;
+  indication.Snr = scenario().snr;
+  indication.RxSlot = 0;
+  if (data) {
+    memcpy(buffer, scenario().downlink, scenario().downlinkSize);
+    indication.Port = scenario().downlinkPort;
+    indication.Buffer = buffer;
+    indication.BufferSize = scenario().downlinkSize;
+    counters().downlinks++;
+  }
+  if (ack) {
+    counters().acks++;
+  }
+  mac.packet.Params.LoRa.RssiPkt = scenario().rssi;
+  mac.packet.Params.LoRa.SnrPkt = scenario().snr;
+  mac.busy = false;
+  if (ack || data) {
+    indications.push_back([indication]() mutable {
+      if (indication.AckReceived) {
+        downLinkAckHandle();
+      }
+      if (indication.RxData) {
+        downLinkDataHandle(&indication);
+      }
+    });
+  }
+}
+
+static void transmit_uplink() {
+  mac.trial++;
+  int8_t dataRate = mac.dataRate - (mac.trial - 1) / 2;
+  dataRate = dataRate < 0 ? 0 : dataRate;
+  counters().uplinks++;
+  counters().uplinkBytes += mac.size;
+  if (mac.trial > 1) {
+    counters().retransmissions++;
+  }
+  bool ack = mac.confirmed && !chance(scenario().lostAcks);
+  bool data = mac.trial == 1 && scenario().downlinkUplink == mac.uplinks;
+  Micros end = transmit(dataRate, mac.size + LORAWAN_FRAME_OVERHEAD);
+  if (ack || data) {
+    size_t size = LORAWAN_FRAME_OVERHEAD - 1 + (data ? scenario().downlinkSize + 1 : 0);
+    Micros done = receive(end + RX1_DELAY, dataRate, size);
+    schedule(done, [ack, data]() { uplink_done(ack, data); });
+    return;
+  }
+  receive(end + RX1_DELAY, dataRate, 0);
+  Micros done = receive(end + RX2_DELAY, RX2_DATA_RATE, 0);
+  if (mac.confirmed && mac.trial < confirmedNbTrials) {
+    Micros retry = done + ACK_TIMEOUT - SECOND + sim::random(2 * SECOND / MS) * MS;
+    schedule(retry, []() { transmit_uplink(); });
+  } else {
+    schedule(done, []() { uplink_done(false, false); });
+  }
+}
+
+void LoRaWanClass::init(DeviceClass_t, LoRaMacRegion_t) {
+  radio_sleep();
+}
+
+void LoRaWanClass::ifskipjoin() {
+}
+
+void LoRaWanClass::join() {
+  Serial.printf("joining...");
+  send_join_request();
+  deviceState = DEVICE_STATE_SLEEP;
+}
+
+void LoRaWanClass::send() {
+  if (!mac.joined) {
+    return;
+  }
+  if (mac.busy) {
+    log("sim: MAC busy, uplink dropped\n");
+    return;
+  }
+  if (!loraWanAdr) {
+    mac.dataRate = mac.noAdrDataRate;
+  } else if (mac.uplinks >= ADR_SETTLE_UPLINKS) {
+    mac.dataRate = scenario().adrDataRate;
+  }
+  mac.uplinks++;
+  mac.trial = 0;
+  mac.confirmed = isTxConfirmed;
+  mac.size = appDataSize;
+  if (appDataSize > max_payload(mac.dataRate)) {
+    /* the library sends an empty frame to get the MAC commands out */
+    log("sim: %d bytes don't fit DR%d\n", appDataSize, mac.dataRate);
+    mac.size = 0;
+    mac.confirmed = false;
+  }
+  mac.busy = mac.confirmed;
+  transmit_uplink();
+}
+
+void LoRaWanClass::cycle(uint32_t dutyCycle) {
+  start_timer((Micros) dutyCycle * MS);
+}
+
+/* lowPowerHandler() until an interrupt, then the radio events are processed */
+void LoRaWanClass::sleep() {
+  if (indications.empty()) {
+    set_state(Mcu, "sleep", MCU_SLEEP_UA);
+    next_event(scenario().duration);
+    set_state(Mcu, "active", MCU_ACTIVE_UA);
+    advance(WAKE_TIME);
+  }
+  while (!indications.empty()) {
+    std::function<void()> indication = indications.front();
+    indications.pop_front();
+    indication();
+  }
+}
+
+void LoRaWanClass::setDataRateForNoADR(int8_t dataRate) {
+  mac.noAdrDataRate = dataRate;
+}
+
+LoRaMacStatus_t LoRaMacMibGetRequestConfirm(MibRequestConfirm_t *mibGet) {
+  switch (mibGet->Type) {
+    case MIB_NETWORK_JOINED:
+      mibGet->Param.IsNetworkJoined = mac.joined;
+      break;
+    case MIB_CHANNELS_DATARATE:
+      mibGet->Param.ChannelsDatarate = mac.dataRate;
+      break;
+    case MIB_CHANNELS_TX_POWER:
+      mibGet->Param.ChannelsTxPower = mac.txPower;
+      break;
+  }
+  return LORAMAC_STATUS_OK;
+}
+
+LoRaMacStatus_t LoRaMacMibSetRequestConfirm(MibRequestConfirm_t *mibSet) {
+  switch (mibSet->Type) {
+    case MIB_NETWORK_JOINED:
+      mac.joined = mibSet->Param.IsNetworkJoined;
+      break;
+    case MIB_CHANNELS_DATARATE:
+      mac.dataRate = mibSet->Param.ChannelsDatarate;
+      break;
+    case MIB_CHANNELS_TX_POWER:
+      mac.txPower = mibSet->Param.ChannelsTxPower;
+      break;
+  }
+  return LORAMAC_STATUS_OK;
+}
+
+LoRaMacStatus_t LoRaMacQueryTxPossible(uint8_t size, LoRaMacTxInfo_t *txInfo) {
+  txInfo->MaxPossiblePayload = max_payload(mac.dataRate);
+  txInfo->CurrentPossiblePayloadSize = txInfo->MaxPossiblePayload;
+  return size <= txInfo->MaxPossiblePayload ? LORAMAC_STATUS_OK : LORAMAC_STATUS_LENGTH_ERROR;
+}
+
+LoRaMacStatus_t LoRaMacMlmeRequest(MlmeReq_t *) {
+  return LORAMAC_STATUS_OK;
+}
+
+void EEPROMClass::begin(size_t size) {
+  if (!erased_) {
+    memset(data_, 0xFF, sizeof(data_));
+    erased_ = true;
+  }
+  size_ = size < sizeof(data_) ? size : sizeof(data_);
+}
+
+uint8_t EEPROMClass::read(int address) const {
+  return data_[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  data_[address] = value;
+}
+
+bool EEPROMClass::commit() {
+  counters().flashCommits++;
+  set_state(Mcu, "flash write", FLASH_WRITE_UA);
+  advance(FLASH_COMMIT_TIME);
+  set_state(Mcu, "active", MCU_ACTIVE_UA);
+  return true;
+}
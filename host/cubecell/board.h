@@ -0,0 +1,14 @@
+#ifndef _BOARD_H
+#define _BOARD_H
+
+/* Puts the parts of the CubeCell into their initial states and the meter behind the head */
+void board_begin();
+
+/* The sketch, see sketch.cpp */
+void setup();
+void loop();
+
+/* What the EnergyAccount of the firmware estimates for the same time [uAh] */
+double firmware_charge();
+
+#endif
@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include "board.h"
+#include "scenario.h"
+
+/* Runs the CubeCell sketch through a scenario and reports its consumption */
+int main(int argc, char **argv) {
+  sim::Scenario scenario = sim::default_scenario();
+  scenario.capacityMah = 1200;
+  scenario.chemistry = sim::LiSOCl2;
+  if (!sim::parse_scenario(argc, argv, scenario)) {
+    return 2;
+  }
+  sim::init(scenario);
+  board_begin();
+  setup();
+  while (sim::now() < scenario.duration) {
+    loop();
+  }
+  sim::report("CubeCell", firmware_charge());
+  return 0;
+}
@@ -0,0 +1,14 @@
+/* The Arduino IDE puts prototypes of the sketch functions in front of the sketch, the
+   host build declares the ones used before their definition */
+#include "LoRaWan_APP.h"
+#include "Arduino.h"
+
+uint32_t nowSeconds();
+
+#include "heltec-cubecell.ino"
+
+#include "board.h"
+
+double firmware_charge() {
+  return energy.charge(nowSeconds());
+}
@@ -0,0 +1,19 @@
+#ifndef _SX126X_H
+#define _SX126X_H
+
+#include <stdint.h>
+
+typedef struct {
+  struct {
+    struct {
+      int8_t RssiPkt;
+      int8_t SnrPkt;
+      int8_t SignalRssiPkt;
+    } LoRa;
+  } Params;
+} PacketStatus_t;
+
+/* Of the last packet the radio received */
+void SX126xGetPacketStatus(PacketStatus_t *packet);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _ARDUINO_H
+#define _ARDUINO_H
+
+/* ESP32 (Heltec WiFi LoRa 32 V2) core of the host simulator */
+
+#include "arduino_core.h"
+#include "esp_sleep.h"
+#include "driver/gpio.h"
+
+/* Variables that survive the deep sleep, the simulator restores the section on every boot */
+#define RTC_DATA_ATTR __attribute__((section("rtc_data"), used))
+
+#define LED_BUILTIN 25
+#define KEY_BUILTIN 0
+#define Vext 21              /* LOW = the OLED and the battery divider are powered */
+
+typedef enum
+{
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_DEEPSLEEP = 8,
+} esp_reset_reason_t;
+
+esp_reset_reason_t esp_reset_reason();
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+#endif
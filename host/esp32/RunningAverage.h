@@ -0,0 +1,33 @@
+#ifndef _RUNNING_AVERAGE_H
+#define _RUNNING_AVERAGE_H
+
+#include <stdint.h>
+#include <vector>
+
+/* The part of robtillaart/RunningAverage the firmware uses */
+class RunningAverage {
+  public:
+    explicit RunningAverage(uint16_t size) : values_(size, 0) {}
+
+    void addValue(float value) {
+      sum_ -= values_[index_];
+      values_[index_] = value;
+      sum_ += value;
+      index_ = (index_ + 1) % values_.size();
+      if (count_ < values_.size()) {
+        count_++;
+      }
+    }
+
+    float getAverage() const {
+      return count_ > 0 ? sum_ / count_ : 0;
+    }
+
+  private:
+    std::vector<float> values_;
+    size_t index_ = 0;
+    size_t count_ = 0;
+    float sum_ = 0;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _TTN_ESP32_H
+#define _TTN_ESP32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The part of rgot-org/TTN_esp32 the firmware uses. LMIC runs in the background like the task
+   of the library: the radio events fire while the firmware waits in delay() or polls */
+class TTN_esp32 {
+  public:
+    bool begin();
+    void onMessage(void (*callback)(uint8_t const *payload, size_t size, int rssi));
+    bool provision(char const *devEui, char const *appEui, char const *appKey);
+    bool join();
+    bool isJoined();
+    bool sendBytes(uint8_t const *payload, size_t length, uint8_t port = 1, uint8_t confirm = 0);
+    void stop();
+    void deleteSession();
+
+    /* Waits until LMIC has nothing to send or receive, returns how long that took [ms] */
+    size_t waitForPendingTransactions();
+};
+
+#endif
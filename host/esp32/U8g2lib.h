@@ -0,0 +1,27 @@
+#ifndef _U8G2LIB_H
+#define _U8G2LIB_H
+
+#include <stdint.h>
+
+struct u8g2_cb_t;
+extern u8g2_cb_t const *U8G2_R0;
+extern uint8_t const u8g2_font_amstrad_cpc_extended_8f[];
+
+/* The SSD1306 on Vext: nothing is drawn, sendBuffer() takes the time of the bit-banged I2C
+   transfer at the current CPU clock and the panel draws its current while it is on */
+class U8G2_SSD1306_128X64_NONAME_F_SW_I2C {
+  public:
+    U8G2_SSD1306_128X64_NONAME_F_SW_I2C(u8g2_cb_t const *rotation, uint8_t clock, uint8_t data, uint8_t reset);
+
+    bool begin();
+    void enableUTF8Print() {}
+    void clearBuffer() {}
+    void setFont(uint8_t const *) {}
+    void setCursor(uint8_t, uint8_t) {}
+    size_t print(char const *text);
+    int printf(char const *fmt, ...);
+    void sendBuffer();
+    void sleepOn();
+};
+
+#endif
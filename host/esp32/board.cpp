@@ -0,0 +1,629 @@
+#include <stdarg.h>
+#include <time.h>
+#include "Arduino.h"
+#include "esp_adc_cal.h"
+#include "driver/rtc_io.h"
+#include "esp32/ulp.h"
+#include "rom/crc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "U8g2lib.h"
+#include "TTN_esp32.h"
+#include "lmic.h"
+#include "board.h"
+#include "meter_device.h"
+#include "radio.h"
+#include "uart.h"
+
+using namespace sim;
+
+/* Currents of the Heltec WiFi LoRa 32 V2 [uA]: ESP32 and SX1276 datasheets, the rest measured
+   on the board. The ESP32 doesn't sleep in delay(), it idles at the clock of the phase */
+struct CpuCurrent {
+  uint32_t mhz;
+  uint32_t microamps;
+};
+static CpuCurrent const CPU_CURRENTS[] = {
+  { 10, 10000 }, { 20, 12000 }, { 40, 15000 }, { 80, 28000 }, { 160, 40000 }, { 240, 55000 },
+};
+static uint32_t const BOOT_UA = 45000;
+static uint32_t const DEEP_SLEEP_UA = 10;
+static uint32_t const ULP_UA = 120;                 /* the ULP samples the pulse pin every 2 ms */
+static uint32_t const RADIO_SLEEP_UA = 1;
+static uint32_t const RADIO_RX_UA = 11500;
+static uint32_t const OLED_ON_UA = 12000;
+static uint32_t const OLED_STANDBY_UA = 10;
+static uint32_t const HEAD_UA = 2700;
+static uint32_t const BOARD_UA = 900;               /* LDO and CP2102 on the 3.3 V rail, awake or not */
+
+/* The second stage bootloader loads the application, then millis() starts */
+static Micros const BOOT_TIME = 300 * MS;
+/* 1 kB of the frame buffer over the bit-banged I2C */
+static Micros const OLED_TRANSFER_TIME_80MHZ = 40 * MS;
+static Micros const ADC_SAMPLE_TIME = 50;
+
+/* Class A receive windows after the end of the uplink */
+static Micros const RX1_DELAY = 1 * SECOND;
+static Micros const JOIN_RX1_DELAY = 5 * SECOND;
+static Micros const JOIN_RX2_DELAY = 6 * SECOND;
+static uint8_t const RX2_DATA_RATE = 3;            /* The Things Network, set by the Join-Accept */
+static uint8_t const JOIN_RX2_DATA_RATE = 0;
+static uint8_t const CONFIRMED_TRIALS = 8;         /* LMIC repeats a confirmed uplink this often */
+static uint8_t const LINK_ADR_REQ_SIZE = 5;
+
+/* Pins the firmware drives, see main.cpp */
+static uint8_t const HEAD_PIN = 17;                /* TRANSISTOR_PIN */
+static uint32_t const VOLTAGE_DIVIDER_PERCENT = 320;
+
+static MeterDevice meter;
+
+lmic_t LMIC;
+u8g2_cb_t const *U8G2_R0 = NULL;
+uint8_t const u8g2_font_amstrad_cpc_extended_8f[1] = {};
+/* Part of the RTC memory, thus it survives the deep sleep like on the chip */
+RTC_DATA_ATTR uint32_t RTC_SLOW_MEM[2048];
+RTC_DATA_ATTR static bool ulpRunning = false;
+
+static uint32_t cpuMhz = 240;
+static uint32_t heldPins = 0;
+static Micros sleepTime = 0;
+
+static struct {
+  bool vextOn;
+  bool begun;
+  bool sleeping;
+} oled;
+
+/* What LMIC keeps besides lmic_t */
+static struct {
+  bool provisioned;
+  bool joined;
+  uint16_t joinAttempts;        /* of this boot, the data rate steps down with every one */
+  bool confirmed;
+  uint8_t port;
+  size_t size;
+  uint8_t downlink[sizeof(Scenario::downlink)];
+  Micros dutyCycleFree;         /* LMIC forgets the duty cycle with the deep sleep */
+  uint32_t generation;          /* the events of a stopped LMIC are dropped */
+  void (*callback)(uint8_t const *payload, size_t size, int rssi);
+} lmic;
+
+static uint32_t cpu_current(uint32_t mhz) {
+  for (CpuCurrent const &entry : CPU_CURRENTS) {
+    if (entry.mhz >= mhz) {
+      return entry.microamps;
+    }
+  }
+  return CPU_CURRENTS[sizeof(CPU_CURRENTS) / sizeof(CPU_CURRENTS[0]) - 1].microamps;
+}
+
+static void mcu_active() {
+  char name[MAX_STATE_NAME];
+  snprintf(name, sizeof(name), "active %u MHz", cpuMhz);
+  set_state(Mcu, name, cpu_current(cpuMhz));
+}
+
+static void radio_sleep() {
+  set_state(Radio, "sleep", RADIO_SLEEP_UA);
+}
+
+static void oled_update() {
+  if (!oled.vextOn) {
+    set_state(Display, "off", 0);
+  } else if (!oled.begun || oled.sleeping) {
+    set_state(Display, "standby", OLED_STANDBY_UA);
+  } else {
+    set_state(Display, "on", OLED_ON_UA);
+  }
+}
+
+static void head_power(bool on) {
+  set_state(Head, on ? "on" : "off", on ? HEAD_UA : 0);
+  meter.set_powered(on);
+}
+
+static void on_pin(uint8_t pin, uint8_t value) {
+  if (pin == Vext) {
+    oled.vextOn = value == LOW;
+    oled_update();
+  } else if (pin == HEAD_PIN) {
+    head_power(value == HIGH);
+  }
+}
+
+void board_begin() {
+  if (!meter.load(scenario().telegram)) {
+    fprintf(stderr, "cannot read the telegram %s\n", scenario().telegram);
+    exit(1);
+  }
+  set_state(Board, "regulator", scenario().boardSleepMicroamps > 0 ? scenario().boardSleepMicroamps : BOARD_UA);
+  set_state(Head, "off", 0);
+  set_state(Display, "off", 0);
+  radio_sleep();
+}
+
+void board_boot() {
+  counters().boots++;
+  clear_events();
+  meter.connect(uart(3));
+  on_pin_write(on_pin);
+  set_pin_level(KEY_BUILTIN, HIGH);
+  set_state(Mcu, "boot", BOOT_UA);
+  advance(BOOT_TIME);
+  state().bootedAt = now();
+  cpuMhz = 240;
+  mcu_active();
+}
+
+/* The system time runs on the RTC timer from power-on, through the deep sleeps */
+extern "C" time_t __wrap_time(time_t *t) {
+  time_t seconds = (time_t) (now() / SECOND);
+  if (t != NULL) {
+    *t = seconds;
+  }
+  return seconds;
+}
+
+esp_reset_reason_t esp_reset_reason() {
+  return counters().boots > 1 ? ESP_RST_DEEPSLEEP : ESP_RST_POWERON;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  for (CpuCurrent const &entry : CPU_CURRENTS) {
+    if (entry.mhz == mhz) {
+      cpuMhz = mhz;
+      mcu_active();
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return cpuMhz;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return counters().boots > 1 ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t, esp_sleep_ext1_wakeup_mode_t) {
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us) {
+  sleepTime = us;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t, esp_sleep_pd_option_t) {
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start() {
+  lmic.generation++;
+  radio_sleep();
+  if (!(heldPins & 1u << HEAD_PIN)) {
+    head_power(false);
+  }
+  oled.vextOn = false;
+  oled_update();
+  set_state(Mcu, ulpRunning ? "deep sleep, ULP" : "deep sleep", DEEP_SLEEP_UA + (ulpRunning ? ULP_UA : 0));
+  state().wakeAt = now() + sleepTime;
+  power_down();
+}
+
+esp_err_t gpio_hold_en(gpio_num_t gpio) {
+  heldPins |= 1u << gpio;
+  return ESP_OK;
+}
+
+esp_err_t gpio_hold_dis(gpio_num_t gpio) {
+  heldPins &= ~(1u << gpio);
+  return ESP_OK;
+}
+
+void gpio_deep_sleep_hold_en() {
+}
+
+int rtc_io_number_get(gpio_num_t gpio) {
+  switch (gpio) {
+    case GPIO_NUM_0: return 11;
+    case GPIO_NUM_2: return 12;
+    case GPIO_NUM_4: return 10;
+    case GPIO_NUM_12: return 15;
+    case GPIO_NUM_13: return 14;
+    case GPIO_NUM_14: return 16;
+    case GPIO_NUM_15: return 13;
+    case GPIO_NUM_25: return 6;
+    case GPIO_NUM_26: return 7;
+    case GPIO_NUM_27: return 17;
+    case GPIO_NUM_32: return 9;
+    case GPIO_NUM_33: return 8;
+    case GPIO_NUM_34: return 4;
+    case GPIO_NUM_35: return 5;
+    case GPIO_NUM_36: return 0;
+    case GPIO_NUM_37: return 1;
+    case GPIO_NUM_38: return 2;
+    case GPIO_NUM_39: return 3;
+    default: return -1;
+  }
+}
+
+esp_err_t rtc_gpio_init(gpio_num_t) {
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_set_direction(gpio_num_t, rtc_gpio_mode_t) {
+  return ESP_OK;
+}
+
+int rtc_gpio_get_level(gpio_num_t gpio) {
+  return digitalRead(gpio);
+}
+
+esp_err_t rtc_gpio_deinit(gpio_num_t) {
+  return ESP_OK;
+}
+
+esp_err_t ulp_process_macros_and_load(uint32_t, ulp_insn_t const *, size_t *) {
+  return ESP_OK;
+}
+
+esp_err_t ulp_set_wakeup_period(size_t, uint32_t) {
+  return ESP_OK;
+}
+
+esp_err_t ulp_run(uint32_t) {
+  ulpRunning = true;
+  return ESP_OK;
+}
+
+void CLEAR_PERI_REG_MASK(uint32_t reg, uint32_t mask) {
+  if (reg == RTC_CNTL_STATE0_REG && (mask & RTC_CNTL_ULP_CP_SLP_TIMER_EN)) {
+    ulpRunning = false;
+  }
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t) {
+  return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t, adc_atten_t) {
+  return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t) {
+  advance(ADC_SAMPLE_TIME);
+  return battery_millivolts() * 100 / VOLTAGE_DIVIDER_PERCENT;
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t unit, adc_atten_t atten, adc_bits_width_t width,
+                                             uint32_t defaultVref, esp_adc_cal_characteristics_t *chars) {
+  chars->adc_num = unit;
+  chars->atten = atten;
+  chars->bit_width = width;
+  chars->vref = defaultVref;
+  return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t raw, esp_adc_cal_characteristics_t const *) {
+  return raw;
+}
+
+uint32_t crc32_le(uint32_t crc, uint8_t const *buffer, uint32_t length) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < length; i++) {
+    crc ^= buffer[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? crc >> 1 ^ 0xEDB88320 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+U8G2_SSD1306_128X64_NONAME_F_SW_I2C::U8G2_SSD1306_128X64_NONAME_F_SW_I2C(u8g2_cb_t const *, uint8_t, uint8_t, uint8_t) {
+}
+
+bool U8G2_SSD1306_128X64_NONAME_F_SW_I2C::begin() {
+  oled.begun = true;
+  oled.sleeping = false;
+  oled_update();
+  return true;
+}
+
+size_t U8G2_SSD1306_128X64_NONAME_F_SW_I2C::print(char const *text) {
+  return strlen(text);
+}
+
+int U8G2_SSD1306_128X64_NONAME_F_SW_I2C::printf(char const *fmt, ...) {
+  char buffer[64];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+  return len;
+}
+
+void U8G2_SSD1306_128X64_NONAME_F_SW_I2C::sendBuffer() {
+  oled.sleeping = false;
+  oled_update();
+  advance(OLED_TRANSFER_TIME_80MHZ * 80 / cpuMhz);
+}
+
+void U8G2_SSD1306_128X64_NONAME_F_SW_I2C::sleepOn() {
+  oled.sleeping = true;
+  oled_update();
+}
+
+/* SX1276 with PA_BOOST */
+static uint32_t tx_current(int8_t dbm) {
+  if (dbm <= 13) {
+    return 29000;
+  }
+  if (dbm <= 14) {
+    return 44000;
+  }
+  return dbm <= 17 ? 87000 : 120000;
+}
+
+/* The window opens, catches the downlink if there is one and the radio sleeps again. Returns its end */
+static Micros receive(Micros at, uint8_t dataRate, size_t downlinkSize) {
+  Micros length = downlinkSize > 0 ? airtime(dataRate, downlinkSize) + 3 * MS : rx_window(dataRate);
+  uint32_t generation = lmic.generation;
+  schedule(at, [generation]() {
+    if (generation == lmic.generation) {
+      set_state(Radio, "rx", RADIO_RX_UA);
+    }
+  });
+  schedule(at + length, [generation]() {
+    if (generation == lmic.generation) {
+      radio_sleep();
+    }
+  });
+  return at + length;
+}
+
+/* Starts the frame once the band is free, returns the end of the transmission */
+static Micros transmit(uint8_t dataRate, size_t phySize) {
+  Micros start = now() > lmic.dutyCycleFree ? now() : lmic.dutyCycleFree;
+  Micros length = airtime(dataRate, phySize);
+  char state[MAX_STATE_NAME];
+  snprintf(state, sizeof(state), "tx %d dBm", LMIC.adrTxPow);
+  std::string name(state);
+  uint32_t current = tx_current(LMIC.adrTxPow);
+  uint32_t generation = lmic.generation;
+  schedule(start, [name, current, generation]() {
+    if (generation == lmic.generation) {
+      set_state(Radio, name.c_str(), current);
+    }
+  });
+  schedule(start + length, [generation]() {
+    if (generation == lmic.generation) {
+      radio_sleep();
+    }
+  });
+  lmic.dutyCycleFree = start + length + length * DUTY_CYCLE_FACTOR;
+  return start + length;
+}
+
+/* LMIC starts at DR5 (SF7) and steps down with every failed attempt */
+static void send_join_request() {
+  lmic.joinAttempts++;
+  counters().joinAttempts++;
+  uint8_t dataRate = lmic.joinAttempts > 5 ? 0 : 6 - lmic.joinAttempts;
+  bool accepted = join_accepted(counters().joinAttempts);
+  log("sim: join request %d at DR%d%s\n", counters().joinAttempts, dataRate, accepted ? "" : ", no accept");
+  Micros end = transmit(dataRate, JOIN_REQUEST_SIZE);
+  Micros done;
+  if (accepted) {
+    done = receive(end + JOIN_RX1_DELAY, dataRate, JOIN_ACCEPT_SIZE);
+  } else {
+    receive(end + JOIN_RX1_DELAY, dataRate, 0);
+    done = receive(end + JOIN_RX2_DELAY, JOIN_RX2_DATA_RATE, 0);
+  }
+  uint32_t generation = lmic.generation;
+  schedule(done, [generation, accepted, dataRate]() {
+    if (generation != lmic.generation) {
+      return;
+    }
+    if (!accepted) {
+      Micros retry = now() + SECOND + sim::random(2 * SECOND / MS) * MS;
+      schedule(retry, [generation]() {
+        if (generation == lmic.generation) {
+          send_join_request();
+        }
+      });
+      return;
+    }
+    lmic.joined = true;
+    counters().joins++;
+    LMIC.opmode &= ~OP_JOINING;
+    LMIC.devaddr = 0x26000000 | sim::random(0x1000000);
+    LMIC.netid = 0x13;
+    LMIC.seqnoUp = 0;
+    LMIC.seqnoDn = 0;
+    LMIC.datarate = dataRate;
+    LMIC.rxDelay = 1;
+    LMIC.dn2Dr = RX2_DATA_RATE;
+  });
+}
+
+static void uplink_done(bool ack, bool data, bool adr) {
+  LMIC.txrxFlags = 0;
+  if (ack || data || adr) {
+    LMIC.txrxFlags |= TXRX_DNW1;
+    LMIC.rssi = scenario().rssi + RSSI_OFF;
+    LMIC.snr = scenario().snr * 4;
+  }
+  if (ack) {
+    LMIC.txrxFlags |= TXRX_ACK;
+    counters().acks++;
+  } else if (lmic.confirmed) {
+    LMIC.txrxFlags |= TXRX_NACK;
+  }
+  if (adr) {
+    LMIC.datarate = scenario().adrDataRate;
+  }
+  LMIC.dataLen = 0;
+  if (data) {
+    LMIC.txrxFlags |= TXRX_PORT;
+    LMIC.dataLen = scenario().downlinkSize;
+    memcpy(lmic.downlink, scenario().downlink, scenario().downlinkSize);
+    counters().downlinks++;
+  }
+  LMIC.opmode &= ~(OP_TXRXPEND | OP_TXDATA);
+  if (data && lmic.callback != NULL) {
+    lmic.callback(lmic.downlink, scenario().downlinkSize, scenario().rssi);
+  }
+}
+
+static void transmit_uplink() {
+  LMIC.txCnt++;
+  int dataRate = LMIC.datarate - (LMIC.txCnt - 1) / 2;
+  dataRate = dataRate < 0 ? 0 : dataRate;
+  counters().uplinks++;
+  counters().uplinkBytes += lmic.size;
+  if (LMIC.txCnt > 1) {
+    counters().retransmissions++;
+  }
+  bool ack = lmic.confirmed && !chance(scenario().lostAcks);
+  bool data = LMIC.txCnt == 1 && scenario().downlinkUplink == counters().uplinks - counters().retransmissions;
+  bool adr = LMIC.adrEnabled && LMIC.txCnt == 1 && LMIC.seqnoUp == ADR_SETTLE_UPLINKS &&
+             LMIC.datarate != scenario().adrDataRate;
+  Micros end = transmit(dataRate, lmic.size + LORAWAN_FRAME_OVERHEAD);
+  uint32_t generation = lmic.generation;
+  if (ack || data || adr) {
+    size_t size = LORAWAN_FRAME_OVERHEAD - 1 + (adr ? LINK_ADR_REQ_SIZE : 0) + (data ? scenario().downlinkSize + 1 : 0);
+    Micros done = receive(end + LMIC.rxDelay * SECOND, dataRate, size);
+    schedule(done, [generation, ack, data, adr]() {
+      if (generation == lmic.generation) {
+        uplink_done(ack, data, adr);
+      }
+    });
+    return;
+  }
+  receive(end + LMIC.rxDelay * SECOND, dataRate, 0);
+  Micros done = receive(end + (LMIC.rxDelay + 1) * SECOND, LMIC.dn2Dr, 0);
+  if (lmic.confirmed && LMIC.txCnt < CONFIRMED_TRIALS) {
+    Micros retry = done + SECOND + sim::random(2 * SECOND / MS) * MS;
+    schedule(retry, [generation]() {
+      if (generation == lmic.generation) {
+        transmit_uplink();
+      }
+    });
+  } else {
+    schedule(done, [generation]() {
+      if (generation == lmic.generation) {
+        uplink_done(false, false, false);
+      }
+    });
+  }
+}
+
+void LMIC_setSession(u4_t netid, devaddr_t devaddr, u1_t const *nwkKey, u1_t const *artKey) {
+  LMIC.netid = netid;
+  LMIC.devaddr = devaddr;
+  memcpy(LMIC.nwkKey, nwkKey, sizeof(LMIC.nwkKey));
+  memcpy(LMIC.artKey, artKey, sizeof(LMIC.artKey));
+  LMIC.seqnoUp = 0;
+  LMIC.seqnoDn = 0;
+  LMIC.rxDelay = 1;
+  LMIC.dn2Dr = JOIN_RX2_DATA_RATE;
+  LMIC.opmode &= ~OP_JOINING;
+  lmic.joined = true;
+}
+
+void LMIC_getSessionKeys(u4_t *netid, devaddr_t *devaddr, u1_t *nwkKey, u1_t *artKey) {
+  *netid = LMIC.netid;
+  *devaddr = LMIC.devaddr;
+  memcpy(nwkKey, LMIC.nwkKey, sizeof(LMIC.nwkKey));
+  memcpy(artKey, LMIC.artKey, sizeof(LMIC.artKey));
+}
+
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow) {
+  LMIC.datarate = dr;
+  if (txpow != KEEP_TXPOW) {
+    LMIC.adrTxPow = txpow;
+  }
+}
+
+void LMIC_setAdrMode(bool enabled) {
+  LMIC.adrEnabled = enabled;
+}
+
+void LMIC_setLinkCheckMode(bool) {
+}
+
+bool TTN_esp32::begin() {
+  memset(&LMIC, 0, sizeof(LMIC));
+  LMIC.datarate = 5;
+  LMIC.adrTxPow = 14;
+  LMIC.adrEnabled = 1;
+  LMIC.rxDelay = 1;
+  radio_sleep();
+  return true;
+}
+
+void TTN_esp32::onMessage(void (*callback)(uint8_t const *payload, size_t size, int rssi)) {
+  lmic.callback = callback;
+}
+
+bool TTN_esp32::provision(char const *, char const *, char const *) {
+  lmic.provisioned = true;
+  return true;
+}
+
+bool TTN_esp32::join() {
+  if (!lmic.provisioned) {
+    return false;
+  }
+  if (lmic.joined || (LMIC.opmode & OP_JOINING)) {
+    return true;
+  }
+  LMIC.opmode |= OP_JOINING;
+  lmic.joinAttempts = 0;
+  send_join_request();
+  return true;
+}
+
+bool TTN_esp32::isJoined() {
+  return lmic.joined;
+}
+
+bool TTN_esp32::sendBytes(uint8_t const *, size_t length, uint8_t port, uint8_t confirm) {
+  if (!lmic.joined || (LMIC.opmode & OP_TXRXPEND)) {
+    return false;
+  }
+  if (length > max_payload(LMIC.datarate)) {
+    log("sim: %u bytes don't fit DR%d\n", (unsigned) length, LMIC.datarate);
+    return false;
+  }
+  LMIC.seqnoUp++;
+  LMIC.txCnt = 0;
+  LMIC.txrxFlags = 0;
+  LMIC.opmode |= OP_TXRXPEND | OP_TXDATA;
+  lmic.confirmed = confirm != 0;
+  lmic.port = port;
+  lmic.size = length;
+  transmit_uplink();
+  return true;
+}
+
+void TTN_esp32::stop() {
+  lmic.generation++;
+  LMIC.opmode &= ~(OP_TXRXPEND | OP_TXDATA | OP_JOINING);
+  radio_sleep();
+}
+
+void TTN_esp32::deleteSession() {
+  lmic.joined = false;
+  LMIC.devaddr = 0;
+}
+
+size_t TTN_esp32::waitForPendingTransactions() {
+  unsigned long start = millis();
+  while (LMIC.opmode & OP_TXRXPEND) {
+    delay(100);
+  }
+  return millis() - start;
+}
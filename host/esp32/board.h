@@ -0,0 +1,17 @@
+#ifndef _BOARD_H
+#define _BOARD_H
+
+/* Puts the parts of the ESP32 board into their power-on states and the meter behind the head */
+void board_begin();
+
+/* Before setup() of every boot: the boot loader, then millis() starts from 0 */
+void board_boot();
+
+/* Ends the boot in esp_deep_sleep_start(), see main.cpp */
+void power_down() __attribute__((noreturn));
+
+/* The firmware, see src/main.cpp */
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,4 @@
+/* Keys of the simulated node, the network stand-in accepts any */
+const char *devEui = "0000000000000001";
+const char *appEui = "0000000000000000";
+const char *appKey = "00000000000000000000000000000000";
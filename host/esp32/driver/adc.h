@@ -0,0 +1,42 @@
+#ifndef _DRIVER_ADC_H
+#define _DRIVER_ADC_H
+
+#include "esp_err.h"
+
+typedef enum
+{
+  ADC_UNIT_1 = 1,
+  ADC_UNIT_2 = 2,
+} adc_unit_t;
+
+typedef enum
+{
+  ADC_ATTEN_DB_0,
+  ADC_ATTEN_DB_2_5,
+  ADC_ATTEN_DB_6,
+  ADC_ATTEN_DB_11,
+} adc_atten_t;
+
+typedef enum
+{
+  ADC_WIDTH_BIT_9,
+  ADC_WIDTH_BIT_10,
+  ADC_WIDTH_BIT_11,
+  ADC_WIDTH_BIT_12,
+} adc_bits_width_t;
+
+typedef enum
+{
+  ADC1_CHANNEL_0,
+  ADC1_CHANNEL_1,
+} adc1_channel_t;
+
+#define ADC1_GPIO37_CHANNEL ADC1_CHANNEL_1
+
+esp_err_t adc1_config_width(adc_bits_width_t width);
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten);
+
+/* The battery behind the 220k/100k divider of the V2.1 board, see esp_adc_cal.h */
+int adc1_get_raw(adc1_channel_t channel);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _DRIVER_GPIO_H
+#define _DRIVER_GPIO_H
+
+#include "esp_err.h"
+
+typedef enum
+{
+  GPIO_NUM_0 = 0,
+  GPIO_NUM_2 = 2,
+  GPIO_NUM_4 = 4,
+  GPIO_NUM_12 = 12,
+  GPIO_NUM_13 = 13,
+  GPIO_NUM_14 = 14,
+  GPIO_NUM_15 = 15,
+  GPIO_NUM_17 = 17,
+  GPIO_NUM_25 = 25,
+  GPIO_NUM_26 = 26,
+  GPIO_NUM_27 = 27,
+  GPIO_NUM_32 = 32,
+  GPIO_NUM_33 = 33,
+  GPIO_NUM_34 = 34,
+  GPIO_NUM_35 = 35,
+  GPIO_NUM_36 = 36,
+  GPIO_NUM_37 = 37,
+  GPIO_NUM_38 = 38,
+  GPIO_NUM_39 = 39,
+} gpio_num_t;
+
+/* A held pad keeps its level through the deep sleep, e.g. the power of the optical head */
+esp_err_t gpio_hold_en(gpio_num_t gpio);
+esp_err_t gpio_hold_dis(gpio_num_t gpio);
+void gpio_deep_sleep_hold_en();
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _DRIVER_RTC_IO_H
+#define _DRIVER_RTC_IO_H
+
+#include "driver/gpio.h"
+
+typedef enum
+{
+  RTC_GPIO_MODE_INPUT_ONLY,
+  RTC_GPIO_MODE_OUTPUT_ONLY,
+} rtc_gpio_mode_t;
+
+/* RTC IO of the pad, -1 if it is no RTC GPIO */
+int rtc_io_number_get(gpio_num_t gpio);
+esp_err_t rtc_gpio_init(gpio_num_t gpio);
+esp_err_t rtc_gpio_set_direction(gpio_num_t gpio, rtc_gpio_mode_t mode);
+int rtc_gpio_get_level(gpio_num_t gpio);
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _ESP32_ULP_H
+#define _ESP32_ULP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/* The ULP of the simulator isn't programmable, it draws its current during the deep sleep but
+   counts no pulses: the program assembles to nothing and the counters stay 0 */
+typedef uint32_t ulp_insn_t;
+
+#define R0 0
+#define R1 1
+#define R2 2
+#define R3 3
+
+#define I_MOVI(...) 0
+#define I_LD(...) 0
+#define I_ST(...) 0
+#define I_ADDI(...) 0
+#define I_ANDI(...) 0
+#define I_SUBR(...) 0
+#define I_RD_REG(...) 0
+#define I_HALT() 0
+#define M_LABEL(...) 0
+#define M_BGE(...) 0
+#define M_BXZ(...) 0
+#define M_BX(...) 0
+
+/* 8 kB of RTC slow memory in 32 bit words */
+extern uint32_t RTC_SLOW_MEM[2048];
+
+esp_err_t ulp_process_macros_and_load(uint32_t address, ulp_insn_t const *program, size_t *size);
+esp_err_t ulp_set_wakeup_period(size_t index, uint32_t periodUs);
+esp_err_t ulp_run(uint32_t address);
+
+#endif
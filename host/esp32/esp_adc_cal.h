@@ -0,0 +1,27 @@
+#ifndef _ESP_ADC_CAL_H
+#define _ESP_ADC_CAL_H
+
+#include <stdint.h>
+#include "driver/adc.h"
+
+typedef enum
+{
+  ESP_ADC_CAL_VAL_EFUSE_VREF,
+  ESP_ADC_CAL_VAL_EFUSE_TP,
+  ESP_ADC_CAL_VAL_DEFAULT_VREF,
+} esp_adc_cal_value_t;
+
+typedef struct {
+  adc_unit_t adc_num;
+  adc_atten_t atten;
+  adc_bits_width_t bit_width;
+  uint32_t vref;
+} esp_adc_cal_characteristics_t;
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t unit, adc_atten_t atten, adc_bits_width_t width,
+                                             uint32_t defaultVref, esp_adc_cal_characteristics_t *chars);
+
+/* The simulated ADC is calibrated already: the raw value is the voltage at the pin [mV] */
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t raw, esp_adc_cal_characteristics_t const *chars);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _ESP_ERR_H
+#define _ESP_ERR_H
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _ESP_SLEEP_H
+#define _ESP_SLEEP_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum
+{
+  ESP_SLEEP_WAKEUP_UNDEFINED,
+  ESP_SLEEP_WAKEUP_ALL,
+  ESP_SLEEP_WAKEUP_EXT0,
+  ESP_SLEEP_WAKEUP_EXT1,
+  ESP_SLEEP_WAKEUP_TIMER,
+} esp_sleep_wakeup_cause_t;
+
+typedef enum
+{
+  ESP_EXT1_WAKEUP_ALL_LOW,
+  ESP_EXT1_WAKEUP_ANY_HIGH,
+} esp_sleep_ext1_wakeup_mode_t;
+
+typedef enum
+{
+  ESP_PD_DOMAIN_RTC_PERIPH,
+} esp_sleep_pd_domain_t;
+
+typedef enum
+{
+  ESP_PD_OPTION_OFF,
+  ESP_PD_OPTION_ON,
+  ESP_PD_OPTION_AUTO,
+} esp_sleep_pd_option_t;
+
+/* The simulator only wakes the node by the timer, the button is never pressed */
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode);
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us);
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option);
+
+/* Ends the boot: the simulator charges the sleep currents and boots the firmware again */
+void esp_deep_sleep_start() __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _LMIC_H
+#define _LMIC_H
+
+#include <stdint.h>
+
+/* The part of the LMIC state and API the firmware uses, run by the TTN_esp32 stand-in */
+
+typedef uint8_t u1_t;
+typedef uint16_t u2_t;
+typedef uint32_t u4_t;
+typedef int8_t s1_t;
+typedef int16_t s2_t;
+typedef u1_t dr_t;
+typedef u4_t devaddr_t;
+
+#define MAX_CHANNELS 16
+#define RSSI_OFF 64
+#define KEEP_TXPOW -128
+
+/* txrxFlags of the last transaction */
+#define TXRX_ACK 0x80
+#define TXRX_NACK 0x40
+#define TXRX_PORT 0x10
+#define TXRX_DNW2 0x02
+#define TXRX_DNW1 0x01
+
+/* opmode */
+#define OP_JOINING 0x0004
+#define OP_TXDATA 0x0008
+#define OP_TXRXPEND 0x0080
+#define OP_LINKDEAD 0x1000
+
+struct lmic_t {
+  u2_t opmode;
+  u1_t txrxFlags;
+  u1_t dataLen;
+  s2_t rssi;                   /* of the last downlink + RSSI_OFF */
+  s1_t snr;                    /* [dB/4] */
+  u4_t netid;
+  devaddr_t devaddr;
+  u1_t nwkKey[16];
+  u1_t artKey[16];
+  u4_t seqnoUp;
+  u4_t seqnoDn;
+  dr_t datarate;
+  s1_t adrTxPow;               /* [dBm] */
+  u1_t adrEnabled;
+  u1_t rxDelay;
+  u1_t rx1DrOffset;
+  dr_t dn2Dr;
+  u4_t dn2Freq;
+  u4_t channelFreq[MAX_CHANNELS];
+  u2_t channelDrMap[MAX_CHANNELS];
+  u2_t channelMap;
+  u1_t txCnt;
+};
+
+extern lmic_t LMIC;
+
+void LMIC_setSession(u4_t netid, devaddr_t devaddr, u1_t const *nwkKey, u1_t const *artKey);
+void LMIC_getSessionKeys(u4_t *netid, devaddr_t *devaddr, u1_t *nwkKey, u1_t *artKey);
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow);
+void LMIC_setAdrMode(bool enabled);
+void LMIC_setLinkCheckMode(bool enabled);
+
+#endif
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "config.h"
+#include "board.h"
+#include "scenario.h"
+
+/* Start and end of the RTC_DATA_ATTR variables, provided by the linker */
+extern char __start_rtc_data[], __stop_rtc_data[];
+
+/* The RTC memory between the boots */
+static char *rtcMemory = NULL;
+
+static size_t rtc_size() {
+  return __stop_rtc_data - __start_rtc_data;
+}
+
+void power_down() {
+  memcpy(rtcMemory, __start_rtc_data, rtc_size());
+  fflush(stdout);
+  _exit(0);
+}
+
+/* Runs the ESP32 firmware through a scenario and reports its consumption. Every boot runs in a
+   child process, thus everything but the RTC memory and the simulator state is lost with the
+   deep sleep like on the chip */
+int main(int argc, char **argv) {
+  sim::Scenario scenario = sim::default_scenario();
+  scenario.capacityMah = 2000;
+  scenario.chemistry = sim::LiPo;
+  scenario.meterInverted = IRINVERTED;
+  if (!sim::parse_scenario(argc, argv, scenario)) {
+    return 2;
+  }
+  sim::init(scenario);
+  board_begin();
+  rtcMemory = (char *) mmap(NULL, rtc_size(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (rtcMemory == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  memcpy(rtcMemory, __start_rtc_data, rtc_size());
+  fflush(stdout);
+
+  while (sim::now() < scenario.duration) {
+    pid_t child = fork();
+    if (child < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (child == 0) {
+      memcpy(__start_rtc_data, rtcMemory, rtc_size());
+      board_boot();
+      setup();
+      while (sim::now() < scenario.duration) {
+        loop();
+      }
+      power_down();
+    }
+    int status;
+    if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "the firmware crashed at %.3f s\n", (double) sim::now() / sim::SECOND);
+      return 1;
+    }
+    if (sim::state().wakeAt == 0) {
+      break;
+    }
+    sim::advance_to(sim::state().wakeAt < scenario.duration ? sim::state().wakeAt : scenario.duration);
+    sim::state().wakeAt = 0;
+  }
+  sim::report("ESP32", -1);
+  return 0;
+}
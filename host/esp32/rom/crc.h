@@ -0,0 +1,9 @@
+#ifndef _ROM_CRC_H
+#define _ROM_CRC_H
+
+#include <stdint.h>
+
+/* CRC-32 (IEEE 802.3) of the ROM, crc is the result of the previous block or 0 */
+uint32_t crc32_le(uint32_t crc, uint8_t const *buffer, uint32_t length);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _SOC_RTC_CNTL_REG_H
+#define _SOC_RTC_CNTL_REG_H
+
+#include <stdint.h>
+
+#define RTC_CNTL_STATE0_REG 0x3ff48018
+#define RTC_CNTL_ULP_CP_SLP_TIMER_EN (1u << 24)
+
+/* Only clearing the ULP timer is simulated: the ULP isn't started again */
+void CLEAR_PERI_REG_MASK(uint32_t reg, uint32_t mask);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef _SOC_RTC_IO_REG_H
+#define _SOC_RTC_IO_REG_H
+
+#define RTC_GPIO_IN_REG 0x3ff48424
+#define RTC_GPIO_IN_NEXT_S 14
+
+#endif
@@ -0,0 +1,188 @@
+/* Standalone driver of the fuzz targets for a toolchain without libFuzzer (g++): runs the seeds,
+   then mutations of them. The mutations are deterministic for a seed, a run that fails can be
+   repeated with the same --seed and --runs, and its input is left in the --crash file.
+
+     build/fuzz-meter [--runs N] [--seed N] [--crash FILE] [FILE...]
+
+   The seeds are the telegrams of the corpus, once as answer and once as unsolicited data,
+   and the files given. */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "telegram.h"
+
+#ifndef CORPUS_DIR
+#define CORPUS_DIR "corpus"
+#endif
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size);
+
+static char const *const USAGE =
+  "usage: %s [--runs N] [--seed N] [--crash FILE] [FILE...]\n"
+  "  runs the seeds (" CORPUS_DIR " and the files) and N mutations of them (default 20000)\n";
+
+static size_t const MAX_SIZE = 4096;
+
+/* What the meters send that matters to the parsers */
+static char const INTERESTING[] = { '/', '!', '(', ')', '*', '&', ':', '-', '.', ',', ';', '\r', '\n', 0x02, 0x03, 0x06,
+                                    0x00, 0x7F, (char) 0x80, (char) 0xFF, '0', '9', 'F' };
+
+/* A load profile answer, the corpus has none */
+static char const *const PROFILE_SEED =
+  "/ELS5\\@V10.04\r\n"
+  "\x02P.01(0240101001500)(00)(15)(2)(1.5)(kW)(2.5)(kW)(0.120)(0.000)\r\n"
+  "(0.240)(0.010)\r\n"
+  "(0.300)(0.0\r\n"
+  "\x03\x21";
+
+static char const *crashPath = "fuzz-crash.bin";
+
+static uint64_t state = 88172645463325252ULL;
+
+static uint32_t next_random(uint32_t bound) {
+  /* xorshift64 */
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return bound > 0 ? state % bound : 0;
+}
+
+static std::string mutate(std::vector<std::string> const &seeds) {
+  std::string input = seeds[next_random(seeds.size())];
+  size_t count = 1 + next_random(8);
+  for (size_t i = 0; i < count; i++) {
+    size_t at = input.size() > 1 ? 1 + next_random(input.size() - 1) : 1;
+    switch (next_random(7)) {
+      case 0:
+        if (at < input.size()) {
+          input[at] ^= 1 << next_random(8);
+        }
+        break;
+      case 1:
+        if (at < input.size()) {
+          input[at] = INTERESTING[next_random(sizeof(INTERESTING))];
+        }
+        break;
+      case 2:
+        input.insert(at, 1, INTERESTING[next_random(sizeof(INTERESTING))]);
+        break;
+      case 3:
+        input.erase(at, next_random(16));
+        break;
+      case 4: {
+        /* a piece of the input once more, e.g. a line repeated */
+        size_t from = next_random(input.size()), len = next_random(128);
+        input.insert(at, input.substr(from, len));
+        break;
+      }
+      case 5:
+        /* a long run, e.g. a line without line feed */
+        input.insert(at, next_random(300), "0A(.)"[next_random(5)]);
+        break;
+      default: {
+        std::string const &other = seeds[next_random(seeds.size())];
+        size_t from = next_random(other.size());
+        input = input.substr(0, at) + other.substr(from, next_random(256));
+        break;
+      }
+    }
+  }
+  if (input.empty()) {
+    input.push_back(0);
+  }
+  if (input.size() > MAX_SIZE) {
+    input.resize(MAX_SIZE);
+  }
+  return input;
+}
+
+/* The input is written out before the run: the sanitizers and the time bound end the process
+   without returning here */
+static void run(std::string const &input) {
+  FILE *file = fopen(crashPath, "wb");
+  if (file != NULL) {
+    fwrite(input.data(), 1, input.size(), file);
+    fclose(file);
+  }
+  LLVMFuzzerTestOneInput((uint8_t const *) input.data(), input.size());
+}
+
+static bool read_file(char const *path, std::string &content) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  char buffer[4096];
+  for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+    content.append(buffer, n);
+  }
+  fclose(file);
+  return true;
+}
+
+static void corpus_seeds(std::vector<std::string> &seeds) {
+  DIR *dir = opendir(CORPUS_DIR);
+  if (dir == NULL) {
+    perror(CORPUS_DIR);
+    return;
+  }
+  std::vector<std::string> files;
+  for (struct dirent *entry; (entry = readdir(dir)) != NULL;) {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".tlg") == 0 || name.compare(name.size() - 4, 4, ".cap") == 0)) {
+      files.push_back(std::string(CORPUS_DIR) + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(files.begin(), files.end());
+  for (std::string const &file : files) {
+    std::string identification, data;
+    if (load_capture(file.c_str(), identification, data)) {
+      seeds.push_back(std::string(1, 0) + identification + data);
+      /* the meter repeats its telegram on its own */
+      seeds.push_back(std::string(1, 1) + data + data);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned long runs = 20000;
+  std::vector<std::string> seeds;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      state += strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--crash") == 0 && i + 1 < argc) {
+      crashPath = argv[++i];
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, USAGE, argv[0]);
+      return 2;
+    } else {
+      std::string content;
+      if (!read_file(argv[i], content)) {
+        perror(argv[i]);
+        return 2;
+      }
+      seeds.push_back(content);
+    }
+  }
+  corpus_seeds(seeds);
+  seeds.push_back(std::string(1, 0) + PROFILE_SEED);
+
+  for (std::string const &seed : seeds) {
+    run(seed);
+  }
+  for (unsigned long i = 0; i < runs; i++) {
+    run(mutate(seeds));
+  }
+  remove(crashPath);
+  printf("fuzz: %zu seeds and %lu mutations passed\n", seeds.size(), runs);
+  return 0;
+}
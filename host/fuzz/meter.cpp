@@ -0,0 +1,123 @@
+/* Fuzz target of the readout path of the CubeCell: the MeterReader reads what the input says the
+   meter sent (process_line(), parse_data_line(), read_unsolicited()) and LoadProfile::parse_line()
+   gets its lines the way the reader passes them. Built with the standalone driver in driver.cpp
+   (make fuzz) or with libFuzzer instead of it (clang++ -fsanitize=fuzzer,address).
+
+   Input: <mode> <bytes of the meter>
+     mode bit 0 set: the bytes are in the receive buffer before the request (unsolicited)
+     otherwise:      the meter answers the request with them, the identification up to the
+                     first line feed and the rest after the acknowledgement
+
+   Every input has to be through within the time its bytes take at the highest baud rate of the
+   meters (19200 bps), scaled to the host, otherwise the target aborts. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include "meter.h"
+#include "loadprofile.h"
+#include "logger.h"
+#include "wire.h"
+
+/* 10 bits per char at 19200 bps [us] */
+static double const BYTE_TIME_US = 10 * 1e6 / 19200;
+/* the host runs the parsers at least this much faster than the 48 MHz Cortex-M0+ of the CubeCell */
+static double const HOST_SPEEDUP = 20;
+/* the reader's setup and its waits on the virtual clock count as this many bytes */
+static size_t const FIXED_COST_BYTES = 256;
+/* longer inputs are no telegrams, the reader gives up after MAX_TELEGRAM_LINES anyway */
+static size_t const MAX_INPUT = 8192;
+
+static double wall_us() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static void on_register(void *, uint8_t, FixedPoint const &) {
+}
+
+static void on_session_end(void *, bool) {
+}
+
+static void read_meter(std::string const &bytes, bool unsolicited) {
+  if (unsolicited) {
+    wire_reset("", "", false);
+    wire_send_unsolicited(bytes);
+  } else {
+    size_t lineFeed = bytes.find('\n');
+    size_t split = lineFeed == std::string::npos ? bytes.size() : lineFeed + 1;
+    wire_reset(bytes.substr(0, split), bytes.substr(split), false);
+  }
+
+  MeterReader reader(Serial1);
+  MeterConfig config = default_meter_config();
+  config.identifier[0] = 0;
+  reader.configure(config);
+  reader.start_monitoring("1.8.*");
+  reader.start_monitoring("2.8.0");
+  reader.start_monitoring("0.9.1");
+  reader.start_monitoring("0.9.2");
+  reader.subscribe("1.7.0", 0);
+  reader.subscribe("16.7.0", 1);
+  reader.set_listener({ on_register, on_session_end, NULL });
+  reader.start_reading();
+  while (reader.status() == Busy) {
+    reader.loop();
+  }
+}
+
+/* As read_profile_line() passes them: up to the ETX, without CR and STX */
+static void parse_load_profile(std::string const &bytes) {
+  LoadProfile profile;
+  profile.clear();
+  char line[MAX_LINE_LENGTH];
+  for (size_t start = 0; start < bytes.size();) {
+    size_t end = bytes.find('\n', start);
+    if (end == std::string::npos) {
+      end = bytes.size();
+    }
+    size_t len = end - start < MAX_LINE_LENGTH - 1 ? end - start : MAX_LINE_LENGTH - 1;
+    memcpy(line, bytes.data() + start, len);
+    char *etx = (char *) memchr(line, 0x03, len);
+    if (etx != NULL) {
+      len = etx - line;
+    }
+    if (len > 0 && line[len - 1] == '\r') {
+      len--;
+    }
+    line[len] = 0;
+    /* the reader stops at the ETX and when the profile is full */
+    if (!profile.parse_line(line[0] == 0x02 ? line + 1 : line) || etx != NULL) {
+      return;
+    }
+    start = end + 1;
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size) {
+  static bool quiet = false;
+  if (!quiet) {
+    logger::set_level(logger::None);
+    quiet = true;
+  }
+  if (size == 0 || size > MAX_INPUT) {
+    return 0;
+  }
+  std::string bytes((char const *) data + 1, size - 1);
+
+  double start = wall_us();
+  read_meter(bytes, data[0] & 1);
+  parse_load_profile(bytes);
+  double elapsed = wall_us() - start;
+
+  double bound = (size + FIXED_COST_BYTES) * BYTE_TIME_US / HOST_SPEEDUP;
+  if (elapsed > bound) {
+    fprintf(stderr, "%zu bytes took %.0f us, more than the %.0f us of 19200 bps on the CubeCell\n", size, elapsed, bound);
+    abort();
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef _HARDWARE_SERIAL_H
+#define _HARDWARE_SERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "WString.h"
+
+/* The ESP32 core includes esp32-hal.h with the serial, the meter library relies on it */
+unsigned long millis();
+void delay(unsigned long ms);
+
+/* Frame formats as the ESP32 core encodes them, the CubeCell core only tells them apart */
+#define SERIAL_8N1 0x800001c
+#define SERIAL_7E1 0x8000012
+
+/* A handle to one of the simulated UARTs (see uart.h), copies refer to the same UART like
+   on the CubeCell core. 0 (NULL) is no UART at all */
+class HardwareSerial {
+  public:
+    HardwareSerial(long uart = 0) : uart_(uart) {}
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1);
+    void begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin, bool invert = false);
+    void end();
+    void updateBaudRate(unsigned long baud);
+    void setTimeout(unsigned long timeout);
+
+    int available();
+    int read();
+    int peek();
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length);
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+
+    size_t write(uint8_t c);
+    size_t write(uint8_t const *data, size_t size);
+    size_t write(char const *text);
+    void flush();
+
+    int printf(char const *fmt, ...);
+    size_t print(char const *text);
+    size_t print(String const &text);
+    size_t print(long value);
+    size_t println(char const *text = "");
+    size_t println(String const &text);
+
+    operator long() const {
+      return uart_;
+    }
+
+  private:
+    long uart_;
+};
+
+extern HardwareSerial Serial, Serial1, Serial2;
+
+#endif
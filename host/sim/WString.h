@@ -0,0 +1,36 @@
+#ifndef _WSTRING_H
+#define _WSTRING_H
+
+#include <string>
+
+/* The part of the Arduino String the firmware uses */
+class String {
+  public:
+    String(char const *text = "") : text_(text) {}
+    String(std::string const &text) : text_(text) {}
+    String(int value) : text_(std::to_string(value)) {}
+    String(unsigned value) : text_(std::to_string(value)) {}
+    String(long value) : text_(std::to_string(value)) {}
+    String(unsigned long value) : text_(std::to_string(value)) {}
+
+    char const *c_str() const {
+      return text_.c_str();
+    }
+
+    size_t length() const {
+      return text_.size();
+    }
+
+    String operator+(String const &other) const {
+      return String(text_ + other.text_);
+    }
+
+    friend String operator+(char const *text, String const &string) {
+      return String(std::string(text) + string.text_);
+    }
+
+  private:
+    std::string text_;
+};
+
+#endif
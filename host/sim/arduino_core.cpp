@@ -0,0 +1,85 @@
+#include "arduino_core.h"
+#include "sim.h"
+
+/* Every call to millis() takes a little, thus loops polling the time end */
+static sim::Micros const MILLIS_COST = 2;
+
+static uint8_t levels[64];
+static void (*pinHandler)(uint8_t pin, uint8_t value) = NULL;
+static void (*interrupts[64])() = {};
+
+unsigned long millis() {
+  sim::advance(MILLIS_COST);
+  return (sim::now() - sim::state().bootedAt) / sim::MS;
+}
+
+unsigned long micros() {
+  sim::advance(MILLIS_COST);
+  return sim::now() - sim::state().bootedAt;
+}
+
+void delay(unsigned long ms) {
+  sim::advance(ms * sim::MS);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advance(us);
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= sizeof(levels)) {
+    return;
+  }
+  levels[pin] = value;
+  if (pinHandler != NULL) {
+    pinHandler(pin, value);
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < sizeof(levels) ? levels[pin] : 0;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int) {
+  if (pin < sizeof(levels)) {
+    interrupts[pin] = handler;
+  }
+}
+
+long random(long max) {
+  return max > 0 ? sim::random(max) : 0;
+}
+
+long random(long min, long max) {
+  return max > min ? min + (long) sim::random(max - min) : min;
+}
+
+void randomSeed(unsigned long) {
+}
+
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh) {
+  return (value - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+}
+
+namespace sim {
+
+void on_pin_write(void (*handler)(uint8_t pin, uint8_t value)) {
+  pinHandler = handler;
+}
+
+void set_pin_level(uint8_t pin, uint8_t value) {
+  if (pin < sizeof(levels)) {
+    levels[pin] = value;
+  }
+}
+
+void trigger_interrupt(uint8_t pin) {
+  if (pin < sizeof(levels) && interrupts[pin] != NULL) {
+    interrupts[pin]();
+  }
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef _ARDUINO_CORE_H
+#define _ARDUINO_CORE_H
+
+/* The Arduino functions both boards share, included by their Arduino.h */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include "HardwareSerial.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define OPEN_DRAIN 3
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh);
+
+namespace sim {
+
+/* The board reacts to its pins, e.g. the head power. Called after the level changed */
+void on_pin_write(void (*handler)(uint8_t pin, uint8_t value));
+
+/* What the firmware reads from an input, e.g. the user button */
+void set_pin_level(uint8_t pin, uint8_t value);
+
+/* Calls the interrupt handler attached to the pin, as if the level changed */
+void trigger_interrupt(uint8_t pin);
+
+}
+
+#endif
@@ -0,0 +1,281 @@
+#include <math.h>
+#include <stdio.h>
+#include "HardwareSerial.h"
+#include "meter_device.h"
+
+static char const ACK = 0x06;
+
+/* The meter switches this long after the acknowledgement, and falls back to idle without one */
+static sim::Micros const BAUD_SWITCH_TIME = 250 * sim::MS;
+static sim::Micros const ACK_TIMEOUT = 1500 * sim::MS;
+
+static uint32_t const BAUD_RATES[] = { 300, 600, 1200, 2400, 4800, 9600, 19200 };
+
+/* The code without the medium/channel ("1-0:") and the billing period ("*255") */
+static std::string plain_code(std::string const &obis) {
+  size_t colon = obis.find(':');
+  std::string code = colon == std::string::npos ? obis : obis.substr(colon + 1);
+  size_t star = code.find('*');
+  return star == std::string::npos ? code : code.substr(0, star);
+}
+
+/* Puts the digits into the digit positions of the value, right aligned, separators stay */
+static void replace_digits(std::string &value, std::string const &digits) {
+  size_t next = digits.size();
+  for (size_t i = value.size(); i-- > 0;) {
+    if (isdigit((unsigned char) value[i])) {
+      value[i] = next > 0 ? digits[--next] : '0';
+    }
+  }
+}
+
+static size_t count_digits(std::string const &text) {
+  size_t count = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    count += isdigit((unsigned char) text[i]) ? 1 : 0;
+  }
+  return count;
+}
+
+static size_t count_decimals(std::string const &value) {
+  size_t separator = value.find_first_of(".,");
+  return separator == std::string::npos ? 0 : count_digits(value.substr(separator + 1));
+}
+
+/* Household load: 350 W on average, low at night, high in the evening [W] */
+static double load_watts(sim::Micros t) {
+  double day = (double) (t % sim::DAY) / sim::DAY;
+  return 350 - 250 * cos(2 * M_PI * (day - 0.1));
+}
+
+/* Integral of load_watts() [kWh] */
+static double load_kwh(sim::Micros t) {
+  double seconds = (double) t / sim::SECOND;
+  double period = 86400;
+  double swing = 250 * period / (2 * M_PI) * (sin(2 * M_PI * (seconds / period - 0.1)) + sin(2 * M_PI * 0.1));
+  return (350 * seconds - swing) / 3.6e6;
+}
+
+static void civil_from_days(long days, int &year, int &month, int &day) {
+  /* days since 2024-01-01, a leap year starts the cycle */
+  year = 2024;
+  static int const LENGTHS[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  for (;;) {
+    int length = year % 4 == 0 ? 366 : 365;
+    if (days < length) {
+      break;
+    }
+    days -= length;
+    year++;
+  }
+  for (month = 1; month <= 12; month++) {
+    int length = LENGTHS[month - 1] + (month == 2 && year % 4 == 0 ? 1 : 0);
+    if (days < length) {
+      break;
+    }
+    days -= length;
+  }
+  day = days + 1;
+}
+
+namespace sim {
+
+bool MeterDevice::load(char const *path) {
+  if (!load_telegram(path, identification_, lines_)) {
+    return false;
+  }
+  for (size_t i = 0; i < lines_.size(); i++) {
+    size_t open = lines_[i].find('(');
+    if (open != std::string::npos && plain_code(lines_[i].substr(0, open)) == "1.8.0") {
+      startEnergy_ = atof(lines_[i].c_str() + open + 1);
+    }
+  }
+  return true;
+}
+
+void MeterDevice::connect(Uart &uart) {
+  uart_ = &uart;
+  uart.device = this;
+}
+
+void MeterDevice::set_powered(bool on) {
+  if (on && !powered_) {
+    poweredAt_ = now();
+  }
+  powered_ = on;
+}
+
+/* The phototransistor and the LED of the head work once the head is powered and settled */
+bool MeterDevice::talking() const {
+  return powered_ && now() >= poweredAt_ + scenario().headWarmUp * MS;
+}
+
+void MeterDevice::send(std::string const &bytes, LineSettings const &settings, Micros start) {
+  Micros at = start;
+  uint32_t generation = generation_;
+  for (size_t i = 0; i < bytes.size(); i++) {
+    at += byte_time(settings.baud);
+    uint8_t byte = bytes[i];
+    schedule(at, [this, byte, settings, generation]() {
+      if (generation == generation_ && talking() && uart_ != NULL) {
+        uart_->deliver(byte, settings);
+      }
+    });
+  }
+  busyUntil_ = at;
+}
+
+void MeterDevice::receive(uint8_t byte, LineSettings const &sent) {
+  if (!talking()) {
+    return;
+  }
+  /* requests and acknowledgements come at the initial baud rate */
+  LineSettings listening = { scenario().meterBaud, scenario().meterConfig, scenario().meterInverted };
+  if (sent.baud != listening.baud || sent.inverted != listening.inverted) {
+    received_.clear();
+    return;
+  }
+  char c = convert(byte, sent, listening) & 0x7F;
+  if (c == '/') {
+    received_.clear();
+  }
+  if (received_.size() < 64) {
+    received_ += c;
+  }
+  if (c != '\n') {
+    return;
+  }
+  std::string message = received_;
+  received_.clear();
+  if (message.size() >= 5 && message.compare(0, 2, "/?") == 0 && message.compare(message.size() - 3, 3, "!\r\n") == 0) {
+    request_received();
+  } else if (phase_ == AwaitingAck && message.size() == 6 && message[0] == ACK) {
+    ack_received(message[2], message[3]);
+  }
+}
+
+void MeterDevice::request_received() {
+  counters().requests++;
+  generation_++;
+  if (chance(scenario().silentMeter)) {
+    log("meter: ignores the request\n");
+    phase_ = Idle;
+    return;
+  }
+  LineSettings settings = { scenario().meterBaud, scenario().meterConfig, scenario().meterInverted };
+  phase_ = Identifying;
+  send(identification_ + "\r\n", settings, now() + scenario().meterResponseDelay * MS);
+
+  char baudChar = identification_.size() > 4 ? identification_[4] : '0';
+  uint32_t generation = generation_;
+  if (baudChar >= '0' && baudChar <= '6') {
+    /* mode C: the reader picks the baud rate and mode */
+    schedule(busyUntil_, [this, generation]() {
+      if (generation == generation_) {
+        phase_ = AwaitingAck;
+      }
+    });
+    schedule(busyUntil_ + ACK_TIMEOUT, [this, generation]() {
+      if (generation == generation_ && phase_ == AwaitingAck) {
+        log("meter: no acknowledgement\n");
+        phase_ = Idle;
+      }
+    });
+  } else if (baudChar >= 'A' && baudChar <= 'F') {
+    /* mode B: switches right away */
+    settings.baud = BAUD_RATES[baudChar - 'A' + 1];
+    send_data(settings, busyUntil_ + BAUD_SWITCH_TIME);
+  } else {
+    send_data(settings, busyUntil_);
+  }
+}
+
+void MeterDevice::ack_received(char baudChar, char mode) {
+  if (mode != '0') {
+    log("meter: programming mode is not simulated\n");
+    phase_ = Idle;
+    return;
+  }
+  LineSettings settings = { scenario().meterBaud, scenario().meterConfig, scenario().meterInverted };
+  if (baudChar >= '0' && baudChar <= '6') {
+    settings.baud = BAUD_RATES[baudChar - '0'];
+  }
+  send_data(settings, now() + BAUD_SWITCH_TIME);
+}
+
+void MeterDevice::send_data(LineSettings const &settings, Micros start) {
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < lines_.size(); i++) {
+    lines.push_back(current_line(lines_[i]));
+  }
+  std::string block = data_block(lines);
+  if (chance(scenario().checksumErrors)) {
+    /* a bit flip in the data, CR and LF stay intact */
+    size_t position;
+    do {
+      position = 1 + random(block.size() - 3);
+    } while (block[position] == '\r' || block[position] == '\n');
+    block[position] ^= 0x01;
+    log("meter: flips a bit at %u\n", (unsigned) position);
+  }
+  counters().telegrams++;
+  phase_ = SendingData;
+  send(block, settings, start);
+  uint32_t generation = generation_;
+  schedule(busyUntil_, [this, generation]() {
+    if (generation == generation_) {
+      phase_ = Idle;
+    }
+  });
+}
+
+std::string MeterDevice::current_line(std::string const &line) const {
+  size_t open = line.find('(');
+  size_t close = line.find(')', open);
+  if (open == std::string::npos || close == std::string::npos) {
+    return line;
+  }
+  std::string code = plain_code(line.substr(0, open));
+  std::string value = line.substr(open + 1, close - open - 1);
+  size_t star = value.find('*');
+  std::string unit = star == std::string::npos ? "" : value.substr(star + 1);
+  std::string number = star == std::string::npos ? value : value.substr(0, star);
+  size_t digits = count_digits(number);
+  char text[32];
+  Micros t = now();
+  if (code == "1.8.0") {
+    double scale = pow(10, count_decimals(number));
+    snprintf(text, sizeof(text), "%0*llu", (int) digits, (unsigned long long) llround((startEnergy_ + load_kwh(t)) * scale));
+  } else if (code == "1.7.0") {
+    double watts = load_watts(t) * (unit == "W" ? 1 : 0.001);
+    snprintf(text, sizeof(text), "%0*llu", (int) digits, (unsigned long long) llround(watts * pow(10, count_decimals(number))));
+  } else if (code == "0.9.1") {
+    unsigned seconds = t / SECOND % 86400;
+    snprintf(text, sizeof(text), "%02u%02u%02u", seconds / 3600, seconds / 60 % 60, seconds % 60);
+    text[digits < 6 ? digits : 6] = 0;
+  } else if (code == "0.9.2") {
+    int year, month, day;
+    civil_from_days(t / DAY, year, month, day);
+    snprintf(text, sizeof(text), "%02d%02d%02d", year % 100, month, day);
+  } else {
+    return line;
+  }
+  std::string digitsText(text);
+  if (digitsText.size() > digits) {
+    digitsText = digitsText.substr(digitsText.size() - digits);
+  }
+  replace_digits(number, digitsText);
+  if (code == "0.9.2" && digits > 6) {
+    /* keep a century or weekday prefix as it is */
+    std::string original = star == std::string::npos ? value : value.substr(0, star);
+    for (size_t i = 0, seen = 0; i < number.size() && seen < digits - 6; i++) {
+      if (isdigit((unsigned char) number[i])) {
+        number[i] = original[i];
+        seen++;
+      }
+    }
+  }
+  return line.substr(0, open + 1) + number + (star == std::string::npos ? "" : "*" + unit) + line.substr(close);
+}
+
+}
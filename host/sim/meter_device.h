@@ -0,0 +1,56 @@
+#ifndef _METER_DEVICE_H
+#define _METER_DEVICE_H
+
+#include <string>
+#include <vector>
+#include "telegram.h"
+#include "uart.h"
+
+namespace sim {
+
+/* An IEC 62056-21 meter behind the optical head. Answers a request with the identification
+   of the corpus telegram, follows the acknowledgement (mode C) to the new baud rate and sends
+   the data lines. The registers 1.8.0, 1.7.0, 0.9.1 and 0.9.2 are rewritten in their original
+   format with a load that follows the time of the day and the clock of the simulation (from
+   2024-01-01 00:00). Only talks while the head is powered and warmed up. */
+class MeterDevice : public SerialDevice {
+  public:
+    bool load(char const *path);
+
+    void connect(Uart &uart);
+
+    void set_powered(bool on);
+
+    void receive(uint8_t byte, LineSettings const &sent);
+
+  private:
+    enum Phase
+    {
+      Idle,
+      Identifying,               /* sending the identification */
+      AwaitingAck,
+      SendingData,
+    };
+
+    void send(std::string const &bytes, LineSettings const &settings, Micros start);
+    void request_received();
+    void ack_received(char baudChar, char mode);
+    void send_data(LineSettings const &settings, Micros start);
+    std::string current_line(std::string const &line) const;
+    bool talking() const;
+
+    Uart *uart_ = NULL;
+    std::string identification_;
+    std::vector<std::string> lines_;
+    double startEnergy_ = 0;     /* [kWh] */
+    bool powered_ = false;
+    Micros poweredAt_ = 0;
+    Phase phase_ = Idle;
+    Micros busyUntil_ = 0;
+    std::string received_;
+    uint32_t generation_ = 0;    /* scheduled actions of an aborted exchange are dropped */
+};
+
+}
+
+#endif
@@ -0,0 +1,48 @@
+#include "radio.h"
+
+namespace sim {
+
+static uint8_t const MAX_PAYLOADS[] = { 51, 51, 51, 115, 222, 222 };
+
+uint8_t spreading_factor(uint8_t dataRate) {
+  return dataRate <= 5 ? 12 - dataRate : 7;
+}
+
+uint8_t max_payload(uint8_t dataRate) {
+  return MAX_PAYLOADS[dataRate <= 5 ? dataRate : 5];
+}
+
+Micros airtime(uint8_t dataRate, size_t phySize) {
+  int32_t sf = spreading_factor(dataRate);
+  int32_t lowDataRate = sf >= 11 ? 1 : 0;
+  Micros symbol = (1ULL << sf) * 8;        /* [us] at 125 kHz */
+  int32_t numerator = 8 * (int32_t) phySize - 4 * sf + 28 + 16;
+  int32_t denominator = 4 * (sf - 2 * lowDataRate);
+  int32_t blocks = numerator > 0 ? (numerator + denominator - 1) / denominator : 0;
+  return symbol * 49 / 4 + (8 + blocks * 5) * symbol;
+}
+
+Micros rx_window(uint8_t dataRate) {
+  return 8 * (1ULL << spreading_factor(dataRate)) * 8 + 3 * MS;
+}
+
+uint8_t join_data_rate(uint16_t attempt) {
+  if (attempt % 48 == 0) {
+    return 0;
+  } else if (attempt % 32 == 0) {
+    return 1;
+  } else if (attempt % 24 == 0) {
+    return 2;
+  } else if (attempt % 16 == 0) {
+    return 3;
+  } else if (attempt % 8 == 0) {
+    return 4;
+  }
+  return 5;
+}
+
+bool join_accepted(uint16_t attempt) {
+  return attempt > scenario().joinFailures && !chance(scenario().joinLoss);
+}
+
+}
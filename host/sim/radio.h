@@ -0,0 +1,39 @@
+#ifndef _RADIO_H
+#define _RADIO_H
+
+#include "sim.h"
+
+/* The EU868 LoRaWAN network both boards talk to: DR0 = SF12 ... DR5 = SF7 at 125 kHz */
+namespace sim {
+
+/* MHDR, FHDR without options, FPort and MIC */
+size_t const LORAWAN_FRAME_OVERHEAD = 13;
+size_t const JOIN_REQUEST_SIZE = 23;
+size_t const JOIN_ACCEPT_SIZE = 17;
+
+/* The band allows 1% time on air: the next frame waits 99 times the last one */
+uint32_t const DUTY_CYCLE_FACTOR = 99;
+
+/* The network moves a node with ADR to the data rate of the scenario after this many uplinks */
+uint32_t const ADR_SETTLE_UPLINKS = 20;
+
+uint8_t spreading_factor(uint8_t dataRate);
+
+/* Largest application payload of the data rate */
+uint8_t max_payload(uint8_t dataRate);
+
+/* Time on air of a PHY payload, explicit header, CRC, CR 4/5 (Semtech AN1200.13) */
+Micros airtime(uint8_t dataRate, size_t phySize);
+
+/* A receive window that catches no preamble closes after 8 symbols plus the wake-up of the radio */
+Micros rx_window(uint8_t dataRate);
+
+/* Data rate of the n-th join request (from 1) as LoRaMac alternates it in EU868 */
+uint8_t join_data_rate(uint16_t attempt);
+
+/* Does the n-th join request get an accept? */
+bool join_accepted(uint16_t attempt);
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "HardwareSerial.h"
+#include "scenario.h"
+
+#ifndef CORPUS_DIR
+#define CORPUS_DIR "corpus"
+#endif
+
+namespace sim {
+
+static char const USAGE[] =
+  "usage: %s [options]\n"
+  "  --name NAME            shown in the report\n"
+  "  --days N               simulated time (default 7)\n"
+  "  --meter FILE           telegram the meter answers with (default " CORPUS_DIR "/els-as1440.tlg)\n"
+  "  --meter-serial BAUD,FORMAT[,inverted]  e.g. 300,7E1 (default)\n"
+  "  --meter-delay MS       until the meter answers a request (default 200)\n"
+  "  --head-warm-up MS      until the optical head works (default 30)\n"
+  "  --silent P             requests the meter ignores [%%]\n"
+  "  --checksum-errors P    telegrams with a flipped bit [%%]\n"
+  "  --join-failures N      the first N join requests fail\n"
+  "  --join-loss P          further join requests that fail [%%]\n"
+  "  --lost-acks P          acknowledgements that don't arrive [%%]\n"
+  "  --rssi DBM --snr DB    of the downlinks (default -100, 5)\n"
+  "  --adr-dr DR            where the network's ADR settles (default 5)\n"
+  "  --downlink N:PORT:HEX  a downlink after the N-th uplink\n"
+  "  --capacity MAH         battery the life is extrapolated for\n"
+  "  --board-sleep UA       the board while the MCU sleeps\n"
+  "  --seed N               of the random failures\n"
+  "  --log                  echo the firmware console with the simulated time\n";
+
+Scenario default_scenario() {
+  Scenario scenario;
+  memset(&scenario, 0, sizeof(scenario));
+  snprintf(scenario.name, sizeof(scenario.name), "default");
+  snprintf(scenario.telegram, sizeof(scenario.telegram), "%s/els-as1440.tlg", CORPUS_DIR);
+  scenario.duration = 7 * DAY;
+  scenario.seed = 1;
+  scenario.rssi = -100;
+  scenario.snr = 5;
+  scenario.adrDataRate = 5;
+  scenario.meterResponseDelay = 200;
+  scenario.headWarmUp = 30;
+  scenario.meterBaud = 300;
+  scenario.meterConfig = SERIAL_7E1;
+  return scenario;
+}
+
+static bool parse_serial(char const *text, Scenario &scenario) {
+  char format[8] = "";
+  char inverted[16] = "";
+  unsigned baud = 0;
+  int fields = sscanf(text, "%u,%7[^,],%15s", &baud, format, inverted);
+  if (fields < 2 || baud == 0) {
+    return false;
+  }
+  if (strcmp(format, "7E1") == 0) {
+    scenario.meterConfig = SERIAL_7E1;
+  } else if (strcmp(format, "8N1") == 0) {
+    scenario.meterConfig = SERIAL_8N1;
+  } else {
+    return false;
+  }
+  scenario.meterBaud = baud;
+  scenario.meterInverted = fields == 3 && strcmp(inverted, "inverted") == 0;
+  return fields == 2 || scenario.meterInverted;
+}
+
+static bool parse_downlink(char const *text, Scenario &scenario) {
+  unsigned uplink, port;
+  char hex[2 * sizeof(scenario.downlink) + 1] = "";
+  if (sscanf(text, "%u:%u:%128[0-9a-fA-F]", &uplink, &port, hex) != 3 || strlen(hex) % 2 != 0 || uplink == 0) {
+    return false;
+  }
+  scenario.downlinkUplink = uplink;
+  scenario.downlinkPort = port;
+  scenario.downlinkSize = strlen(hex) / 2;
+  for (size_t i = 0; i < scenario.downlinkSize; i++) {
+    char byte[3] = { hex[2 * i], hex[2 * i + 1], 0 };
+    scenario.downlink[i] = strtoul(byte, NULL, 16);
+  }
+  return true;
+}
+
+static uint8_t percent(char const *text) {
+  int value = atoi(text);
+  return value < 0 ? 0 : value > 100 ? 100 : value;
+}
+
+bool parse_scenario(int argc, char **argv, Scenario &scenario) {
+  for (int i = 1; i < argc; i++) {
+    char const *option = argv[i];
+    if (strcmp(option, "--log") == 0) {
+      scenario.log = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      fprintf(stderr, USAGE, argv[0]);
+      return false;
+    }
+    char const *value = argv[++i];
+    bool valid = true;
+    if (strcmp(option, "--name") == 0) {
+      snprintf(scenario.name, sizeof(scenario.name), "%s", value);
+    } else if (strcmp(option, "--days") == 0) {
+      scenario.duration = (Micros) (atof(value) * DAY);
+      valid = scenario.duration > 0;
+    } else if (strcmp(option, "--meter") == 0) {
+      snprintf(scenario.telegram, sizeof(scenario.telegram), "%s", value);
+    } else if (strcmp(option, "--meter-serial") == 0) {
+      valid = parse_serial(value, scenario);
+    } else if (strcmp(option, "--meter-delay") == 0) {
+      scenario.meterResponseDelay = atoi(value);
+    } else if (strcmp(option, "--head-warm-up") == 0) {
+      scenario.headWarmUp = atoi(value);
+    } else if (strcmp(option, "--silent") == 0) {
+      scenario.silentMeter = percent(value);
+    } else if (strcmp(option, "--checksum-errors") == 0) {
+      scenario.checksumErrors = percent(value);
+    } else if (strcmp(option, "--join-failures") == 0) {
+      scenario.joinFailures = atoi(value);
+    } else if (strcmp(option, "--join-loss") == 0) {
+      scenario.joinLoss = percent(value);
+      valid = scenario.joinLoss < 100;
+    } else if (strcmp(option, "--lost-acks") == 0) {
+      scenario.lostAcks = percent(value);
+    } else if (strcmp(option, "--rssi") == 0) {
+      scenario.rssi = atoi(value);
+    } else if (strcmp(option, "--snr") == 0) {
+      scenario.snr = atoi(value);
+    } else if (strcmp(option, "--adr-dr") == 0) {
+      scenario.adrDataRate = atoi(value);
+      valid = scenario.adrDataRate <= 5;
+    } else if (strcmp(option, "--downlink") == 0) {
+      valid = parse_downlink(value, scenario);
+    } else if (strcmp(option, "--capacity") == 0) {
+      scenario.capacityMah = atoi(value);
+    } else if (strcmp(option, "--board-sleep") == 0) {
+      scenario.boardSleepMicroamps = atoi(value);
+    } else if (strcmp(option, "--seed") == 0) {
+      scenario.seed = strtoul(value, NULL, 10);
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      fprintf(stderr, "invalid %s %s\n", option, value);
+      fprintf(stderr, USAGE, argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,16 @@
+#ifndef _SCENARIO_H
+#define _SCENARIO_H
+
+#include "sim.h"
+
+namespace sim {
+
+/* Defaults shared by both boards, the board sets its battery afterwards */
+Scenario default_scenario();
+
+/* Command line options over the defaults, false (after printing the usage) on an error */
+bool parse_scenario(int argc, char **argv, Scenario &scenario);
+
+}
+
+#endif
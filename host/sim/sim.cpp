@@ -0,0 +1,264 @@
+#include "sim.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <queue>
+#include <vector>
+
+namespace sim {
+
+struct Event {
+  Micros at;
+  uint64_t sequence;           /* events due at the same time run in the order they were scheduled */
+  std::function<void()> action;
+};
+
+struct Later {
+  bool operator()(Event const &a, Event const &b) const {
+    return a.at != b.at ? a.at > b.at : a.sequence > b.sequence;
+  }
+};
+
+static State *shared = NULL;
+static std::priority_queue<Event, std::vector<Event>, Later> events;
+static uint64_t sequence = 0;
+static bool inEvent = false;   /* an event that calls into the firmware (e.g. an interrupt) doesn't move the clock */
+
+void init(Scenario const &scenario) {
+  if (shared == NULL) {
+    void *memory = mmap(NULL, sizeof(State), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+    }
+    shared = (State *) memory;
+  }
+  memset(shared, 0, sizeof(State));
+  shared->scenario = scenario;
+  shared->random = scenario.seed * 2654435761ULL + 1;
+  clear_events();
+}
+
+State &state() {
+  return *shared;
+}
+
+Scenario const &scenario() {
+  return shared->scenario;
+}
+
+Counters &counters() {
+  return shared->counters;
+}
+
+Micros now() {
+  return shared->now;
+}
+
+/* Charges every part for the time since the last settlement */
+static void settle(Micros time) {
+  if (time <= shared->now) {
+    return;
+  }
+  Micros elapsed = time - shared->now;
+  for (size_t i = 0; i < PART_COUNT; i++) {
+    PartTotals &part = shared->parts[i];
+    if (part.count == 0) {
+      continue;
+    }
+    PartState &current = part.states[part.current];
+    current.time += elapsed;
+    current.charge += (double) current.microamps * elapsed / HOUR;
+  }
+  shared->now = time;
+}
+
+void advance_to(Micros time) {
+  if (inEvent) {
+    return;
+  }
+  while (!events.empty() && events.top().at <= time) {
+    Event event = events.top();
+    events.pop();
+    settle(event.at);
+    inEvent = true;
+    event.action();
+    inEvent = false;
+  }
+  settle(time);
+}
+
+void advance(Micros duration) {
+  advance_to(shared->now + duration);
+}
+
+bool wait_until(std::function<bool()> const &condition, Micros deadline) {
+  while (!condition() && !inEvent) {
+    if (events.empty() || events.top().at > deadline) {
+      advance_to(deadline);
+      return condition();
+    }
+    advance_to(events.top().at);
+  }
+  return true;
+}
+
+bool next_event(Micros deadline) {
+  if (inEvent) {
+    return false;
+  }
+  if (events.empty() || events.top().at > deadline) {
+    advance_to(deadline);
+    return false;
+  }
+  advance_to(events.top().at);
+  return true;
+}
+
+void schedule(Micros at, std::function<void()> const &action) {
+  Event event = { at < shared->now ? shared->now : at, sequence++, action };
+  events.push(event);
+}
+
+void clear_events() {
+  while (!events.empty()) {
+    events.pop();
+  }
+}
+
+void set_state(Part part, char const *name, uint32_t microamps) {
+  PartTotals &totals = shared->parts[part];
+  for (size_t i = 0; i < totals.count; i++) {
+    if (strcmp(totals.states[i].name, name) == 0 && totals.states[i].microamps == microamps) {
+      totals.current = i;
+      return;
+    }
+  }
+  if (totals.count == MAX_PART_STATES) {
+    fprintf(stderr, "sim: too many states of part %d\n", part);
+    exit(1);
+  }
+  PartState &added = totals.states[totals.count];
+  snprintf(added.name, sizeof(added.name), "%s", name);
+  added.microamps = microamps;
+  totals.current = totals.count++;
+}
+
+char const *part_state(Part part) {
+  PartTotals const &totals = shared->parts[part];
+  return totals.count > 0 ? totals.states[totals.current].name : "";
+}
+
+double part_charge(Part part) {
+  double total = 0;
+  PartTotals const &totals = shared->parts[part];
+  for (size_t i = 0; i < totals.count; i++) {
+    total += totals.states[i].charge;
+  }
+  return total;
+}
+
+double charge() {
+  double total = 0;
+  for (size_t i = 0; i < PART_COUNT; i++) {
+    total += part_charge((Part) i);
+  }
+  return total;
+}
+
+struct CurvePoint {
+  uint8_t percent;             /* charge left */
+  uint16_t millivolts;
+};
+
+static CurvePoint const LIPO_CURVE[] = {
+  { 100, 4200 }, { 90, 4060 }, { 70, 3900 }, { 50, 3800 }, { 30, 3730 }, { 10, 3650 }, { 0, 3300 },
+};
+
+static CurvePoint const LISOCL2_CURVE[] = {
+  { 100, 3650 }, { 90, 3600 }, { 20, 3550 }, { 10, 3450 }, { 5, 3300 }, { 0, 3000 },
+};
+
+uint16_t battery_millivolts() {
+  CurvePoint const *curve = shared->scenario.chemistry == LiPo ? LIPO_CURVE : LISOCL2_CURVE;
+  size_t points = shared->scenario.chemistry == LiPo ? sizeof(LIPO_CURVE) / sizeof(LIPO_CURVE[0])
+                                                     : sizeof(LISOCL2_CURVE) / sizeof(LISOCL2_CURVE[0]);
+  double capacity = shared->scenario.capacityMah * 1000.0;
+  double left = capacity > 0 ? 100.0 * (1 - charge() / capacity) : 100;
+  if (left <= 0) {
+    return curve[points - 1].millivolts;
+  }
+  for (size_t i = 1; i < points; i++) {
+    if (left >= curve[i].percent) {
+      double share = (left - curve[i].percent) / (curve[i - 1].percent - curve[i].percent);
+      return curve[i].millivolts + share * (curve[i - 1].millivolts - curve[i].millivolts);
+    }
+  }
+  return curve[points - 1].millivolts;
+}
+
+/* xorshift64* */
+uint32_t random(uint32_t bound) {
+  uint64_t x = shared->random;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  shared->random = x;
+  uint32_t value = (x * 2685821657736338717ULL) >> 32;
+  return bound > 0 ? value % bound : value;
+}
+
+bool chance(uint8_t percent) {
+  return percent > 0 && random(100) < percent;
+}
+
+void log(char const *fmt, ...) {
+  if (!shared->scenario.log) {
+    return;
+  }
+  Micros t = shared->now;
+  printf("[%3u %02u:%02u:%02u.%03u] ", (unsigned) (t / DAY), (unsigned) (t / HOUR % 24), (unsigned) (t / (60 * SECOND) % 60),
+         (unsigned) (t / SECOND % 60), (unsigned) (t / MS % 1000));
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+static char const *const PART_NAMES[PART_COUNT] = { "mcu", "radio", "head", "display", "board" };
+
+void report(char const *board, double firmwareEstimateUah) {
+  State const &s = *shared;
+  double days = (double) s.now / DAY;
+  if (days <= 0) {
+    return;
+  }
+  double perDay = charge() / 1000 / days;
+  printf("%s, scenario %s: %.1f days\n", board, s.scenario.name, days);
+  printf("  consumption: %.3f mAh/day, battery life: %.0f days with %u mAh\n", perDay,
+         perDay > 0 ? s.scenario.capacityMah / perDay : 0, s.scenario.capacityMah);
+  if (firmwareEstimateUah >= 0) {
+    printf("  firmware estimate: %.3f mAh/day\n", firmwareEstimateUah / 1000 / days);
+  }
+  for (size_t i = 0; i < PART_COUNT; i++) {
+    PartTotals const &part = s.parts[i];
+    if (part.count == 0) {
+      continue;
+    }
+    printf("  %-8s %9.3f mAh/day\n", PART_NAMES[i], part_charge((Part) i) / 1000 / days);
+    for (size_t j = 0; j < part.count; j++) {
+      PartState const &st = part.states[j];
+      printf("    %-22s %8u uA %12.1f s/day %9.3f mAh/day\n", st.name, st.microamps, (double) st.time / SECOND / days,
+             st.charge / 1000 / days);
+    }
+  }
+  Counters const &c = s.counters;
+  printf("  per day: %.1f boots, %.1f requests, %.1f telegrams, %.1f join attempts (%u joined), %.1f uplinks"
+         " (%.1f retransmissions), %.1f acks, %.1f downlinks, %.1f flash commits, %.0f payload bytes\n",
+         c.boots / days, c.requests / days, c.telegrams / days, c.joinAttempts / days, c.joins, c.uplinks / days,
+         c.retransmissions / days, c.acks / days, c.downlinks / days, c.flashCommits / days, c.uplinkBytes / days);
+}
+
+}
@@ -0,0 +1,163 @@
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+/* Discrete-event clock of the host simulator. The firmware runs unchanged, the stand-ins of the
+   Arduino core, the LoRaWAN stacks and the peripherals advance a virtual clock instead of
+   waiting, and every part of the board draws the current of the state it is in. */
+namespace sim {
+
+typedef uint64_t Micros;
+
+Micros const MS = 1000;
+Micros const SECOND = 1000 * MS;
+Micros const HOUR = 3600 * SECOND;
+Micros const DAY = 24 * HOUR;
+
+/* Parts of the board whose current is integrated over time */
+enum Part
+{
+  Mcu,
+  Radio,
+  Head,
+  Display,
+  Board,       /* regulator, battery divider, USB bridge: whatever draws current regardless */
+  PART_COUNT,
+};
+
+size_t const MAX_PART_STATES = 12;
+size_t const MAX_STATE_NAME = 24;
+
+struct PartState {
+  char name[MAX_STATE_NAME];
+  uint32_t microamps;
+  Micros time;
+  double charge;               /* [uAh] */
+};
+
+struct PartTotals {
+  PartState states[MAX_PART_STATES];
+  size_t count;
+  size_t current;
+};
+
+enum Chemistry
+{
+  LiPo,        /* ESP32 boards, 4.2 V when full */
+  LiSOCl2,     /* e.g. a Saft LS14250 on the CubeCell, flat until shortly before the end */
+};
+
+/* Failures and conditions the scenario puts the node through */
+struct Scenario {
+  char name[32];
+  char telegram[256];          /* corpus file the virtual meter answers with */
+  Micros duration;
+  uint32_t seed;
+  uint32_t capacityMah;        /* battery the life is extrapolated for */
+  Chemistry chemistry;
+  uint16_t joinFailures;       /* the first join attempts that fail */
+  uint8_t joinLoss;            /* further join attempts that fail [%] */
+  uint8_t checksumErrors;      /* telegrams with a flipped bit [%] */
+  uint8_t silentMeter;         /* requests the meter doesn't answer [%] */
+  uint8_t lostAcks;            /* acknowledgements of confirmed uplinks that don't arrive [%] */
+  int16_t rssi;                /* of the downlinks [dBm] */
+  int8_t snr;                  /* [dB] */
+  uint8_t adrDataRate;         /* the network's ADR settles on this data rate */
+  uint16_t meterResponseDelay; /* until the meter answers the request [ms] */
+  uint16_t headWarmUp;         /* until the optical head passes the light on [ms] */
+  uint32_t meterBaud;          /* the meter's initial baud rate */
+  uint32_t meterConfig;        /* and its frame format (SERIAL_7E1 or SERIAL_8N1) */
+  bool meterInverted;          /* the receiver of the optical head inverts the levels */
+  uint16_t downlinkUplink;     /* the downlink below comes with this uplink, 0 = none */
+  uint8_t downlinkPort;
+  uint8_t downlink[64];
+  uint8_t downlinkSize;
+  uint32_t boardSleepMicroamps;/* the board while the MCU sleeps, e.g. the USB bridge of the ESP32 board */
+  bool log;                    /* echo the console of the firmware */
+};
+
+/* What happened, for the report */
+struct Counters {
+  uint32_t boots;
+  uint32_t requests;           /* "/?!" the meter received */
+  uint32_t telegrams;          /* data blocks the meter sent */
+  uint32_t joinAttempts;
+  uint32_t joins;
+  uint32_t uplinks;            /* frames on air, retransmissions included */
+  uint32_t retransmissions;
+  uint32_t acks;
+  uint32_t downlinks;
+  uint32_t flashCommits;
+  uint64_t uplinkBytes;        /* application payload */
+};
+
+/* Everything that has to survive a deep sleep of the ESP32, which runs every boot in a child
+   process. Lives in shared memory, see init() */
+struct State {
+  Micros now;
+  Micros bootedAt;             /* millis() starts from 0 again after a deep sleep of the ESP32 */
+  Micros wakeAt;               /* the ESP32 went to deep sleep until then, 0 while it is awake */
+  PartTotals parts[PART_COUNT];
+  Counters counters;
+  Scenario scenario;
+  uint64_t random;
+  bool ended;
+};
+
+/* Maps the shared state, clears it and takes over the scenario */
+void init(Scenario const &scenario);
+
+State &state();
+
+Scenario const &scenario();
+
+Counters &counters();
+
+Micros now();
+
+/* Runs the events due until then in order, charging every part for the time in between */
+void advance_to(Micros time);
+
+void advance(Micros duration);
+
+/* Jumps from event to event until the condition holds or the deadline passed. Returns the condition */
+bool wait_until(std::function<bool()> const &condition, Micros deadline);
+
+/* Jumps to the next event and runs it, false if there is none until the deadline */
+bool next_event(Micros deadline);
+
+void schedule(Micros at, std::function<void()> const &action);
+
+/* Drops the pending events, e.g. when the ESP32 reboots from deep sleep */
+void clear_events();
+
+/* The part draws this current from now on, states with the same name are summed up in the report */
+void set_state(Part part, char const *name, uint32_t microamps);
+
+char const *part_state(Part part);
+
+/* Charge drawn since the start of the simulation [uAh] */
+double charge();
+
+double part_charge(Part part);
+
+/* Voltage of the battery with the charge drawn so far [mV] */
+uint16_t battery_millivolts();
+
+/* Deterministic for a seed, shared by the children of the ESP32 */
+uint32_t random(uint32_t bound);
+
+bool chance(uint8_t percent);
+
+/* printf to stdout with the simulated time in front, only if the scenario logs */
+void log(char const *fmt, ...);
+
+/* Summary of the consumption, the extrapolated battery life and the counters */
+void report(char const *board, double firmwareEstimateUah);
+
+}
+
+#endif
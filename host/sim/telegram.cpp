@@ -0,0 +1,107 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "telegram.h"
+
+static char const STX = 0x02;
+static char const ETX = 0x03;
+
+bool load_telegram(char const *path, std::string &identification, std::vector<std::string> &lines) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  identification.clear();
+  lines.clear();
+  char buffer[4096];
+  bool first = true;
+  while (fgets(buffer, sizeof(buffer), file) != NULL) {
+    std::string line(buffer);
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+      line.pop_back();
+    }
+    if (first) {
+      identification = line;
+      first = false;
+    } else {
+      lines.push_back(line);
+    }
+  }
+  fclose(file);
+  return !identification.empty() && !lines.empty();
+}
+
+std::string data_block(std::vector<std::string> const &lines) {
+  std::string block(1, STX);
+  for (size_t i = 0; i < lines.size(); i++) {
+    block += lines[i] + "\r\n";
+  }
+  block += ETX;
+  char bcc = 0;
+  for (size_t i = 1; i < block.size(); i++) {
+    bcc ^= block[i];
+  }
+  return block + bcc;
+}
+
+static bool decode_capture(FILE *file, std::string &bytes) {
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    if (c == '\n' || c == '\r') {
+      continue;
+    }
+    if (c != '\\') {
+      bytes += (char) c;
+      continue;
+    }
+    c = fgetc(file);
+    if (c == 'r') {
+      bytes += '\r';
+    } else if (c == 'n') {
+      bytes += '\n';
+    } else if (c == '\\') {
+      bytes += '\\';
+    } else if (c == 'x') {
+      char hex[3] = {};
+      if (fread(hex, 1, 2, file) != 2 || !isxdigit((unsigned char) hex[0]) || !isxdigit((unsigned char) hex[1])) {
+        return false;
+      }
+      bytes += (char) strtol(hex, NULL, 16);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool ends_with(char const *text, char const *suffix) {
+  size_t length = strlen(text), suffixLength = strlen(suffix);
+  return length >= suffixLength && strcmp(text + length - suffixLength, suffix) == 0;
+}
+
+bool load_capture(char const *path, std::string &identification, std::string &data) {
+  if (!ends_with(path, ".cap")) {
+    std::vector<std::string> lines;
+    if (!load_telegram(path, identification, lines)) {
+      return false;
+    }
+    identification += "\r\n";
+    data = data_block(lines);
+    return true;
+  }
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  std::string bytes;
+  bool ok = decode_capture(file, bytes);
+  fclose(file);
+  size_t lineFeed = bytes.find('\n');
+  if (!ok || lineFeed == std::string::npos) {
+    return false;
+  }
+  identification = bytes.substr(0, lineFeed + 1);
+  data = bytes.substr(lineFeed + 1);
+  return true;
+}
@@ -0,0 +1,19 @@
+#ifndef _TELEGRAM_H
+#define _TELEGRAM_H
+
+#include <string>
+#include <vector>
+
+/* Telegram of the corpus (.tlg): the identification, then the data lines up to "!" without the
+   line ends, STX, ETX and BCC. Returns false if the file can't be read */
+bool load_telegram(char const *path, std::string &identification, std::vector<std::string> &lines);
+
+/* The bytes a meter sends for the telegram: STX, the lines with CR LF, "!", ETX and BCC */
+std::string data_block(std::vector<std::string> const &lines);
+
+/* What a meter sent for a request, either built from a .tlg or recorded byte by byte (.cap:
+   the bytes as text with the escapes \r, \n, \\ and \xNN, line breaks of the file are ignored).
+   identification: up to and including the first line feed, data: the rest */
+bool load_capture(char const *path, std::string &identification, std::string &data);
+
+#endif
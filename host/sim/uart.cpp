@@ -0,0 +1,218 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include "HardwareSerial.h"
+#include "arduino_core.h"
+#include "uart.h"
+
+HardwareSerial Serial(1), Serial1(2), Serial2(3);
+
+namespace sim {
+
+static Uart uarts[4];
+
+Uart &uart(long id) {
+  return uarts[id >= 1 && id <= 3 ? id : 0];
+}
+
+Micros byte_time(uint32_t baud) {
+  return baud > 0 ? 10 * SECOND / baud : SECOND;
+}
+
+static uint8_t even_parity(uint8_t byte) {
+  uint8_t parity = 0;
+  for (uint8_t bits = byte & 0x7F; bits != 0; bits >>= 1) {
+    parity ^= bits & 1;
+  }
+  return parity;
+}
+
+uint8_t convert(uint8_t byte, LineSettings const &sent, LineSettings const &received) {
+  if (sent.baud != received.baud || sent.inverted != received.inverted) {
+    return 0xF0;
+  }
+  if (sent.config == received.config) {
+    return sent.config == SERIAL_7E1 ? byte & 0x7F : byte;
+  }
+  if (sent.config == SERIAL_7E1) {
+    return (byte & 0x7F) | even_parity(byte) << 7;
+  }
+  /* 8N1 read as 7E1: bit 7 is taken for the parity, the parity error is ignored */
+  return byte & 0x7F;
+}
+
+void Uart::deliver(uint8_t byte, LineSettings const &sent) {
+  if (!open) {
+    return;
+  }
+  if (rx.size() >= UART_RX_BUFFER) {
+    overruns++;
+    return;
+  }
+  rx.push_back(convert(byte, sent, settings));
+}
+
+void Uart::transmit(uint8_t byte) {
+  if (console) {
+    if (byte != '\r' && lineLength_ < sizeof(line_) - 1) {
+      line_[lineLength_++] = byte;
+    }
+    if (byte == '\n') {
+      line_[lineLength_] = 0;
+      log("%s", line_);
+      lineLength_ = 0;
+    }
+  }
+  if (!open) {
+    return;
+  }
+  Micros start = txIdle > now() ? txIdle : now();
+  txIdle = start + byte_time(settings.baud);
+  if (device != NULL) {
+    SerialDevice *far = device;
+    LineSettings sent = settings;
+    schedule(txIdle, [far, byte, sent]() { far->receive(byte, sent); });
+  }
+}
+
+}
+
+using sim::uart;
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config) {
+  begin(baud, config, -1, -1, false);
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t, int8_t, bool invert) {
+  sim::Uart &u = uart(uart_);
+  u.open = true;
+  u.settings.baud = baud;
+  u.settings.config = config;
+  u.settings.inverted = invert;
+  u.rx.clear();
+  u.console = uart_ == 1;
+}
+
+void HardwareSerial::end() {
+  uart(uart_).open = false;
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud) {
+  uart(uart_).settings.baud = baud;
+}
+
+void HardwareSerial::setTimeout(unsigned long timeout) {
+  uart(uart_).timeout = timeout;
+}
+
+int HardwareSerial::available() {
+  return uart(uart_).rx.size();
+}
+
+int HardwareSerial::read() {
+  sim::Uart &u = uart(uart_);
+  if (u.rx.empty()) {
+    return -1;
+  }
+  uint8_t byte = u.rx.front();
+  u.rx.pop_front();
+  return byte;
+}
+
+int HardwareSerial::peek() {
+  sim::Uart &u = uart(uart_);
+  return u.rx.empty() ? -1 : u.rx.front();
+}
+
+/* Stream::timedRead(): polls until a byte is there or the timeout passed, the MCU stays busy */
+static int timed_read(long id) {
+  sim::Uart &u = uart(id);
+  sim::wait_until([&u]() { return !u.rx.empty(); }, sim::now() + u.timeout * sim::MS);
+  if (u.rx.empty()) {
+    return -1;
+  }
+  uint8_t byte = u.rx.front();
+  u.rx.pop_front();
+  return byte;
+}
+
+size_t HardwareSerial::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = timed_read(uart_);
+    if (c < 0) {
+      break;
+    }
+    buffer[count++] = c;
+  }
+  return count;
+}
+
+size_t HardwareSerial::readBytes(uint8_t *buffer, size_t length) {
+  return readBytes((char *) buffer, length);
+}
+
+size_t HardwareSerial::readBytesUntil(char terminator, char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = timed_read(uart_);
+    if (c < 0 || c == terminator) {
+      break;
+    }
+    buffer[count++] = c;
+  }
+  return count;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  uart(uart_).transmit(c);
+  return 1;
+}
+
+size_t HardwareSerial::write(uint8_t const *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(data[i]);
+  }
+  return size;
+}
+
+size_t HardwareSerial::write(char const *text) {
+  return write((uint8_t const *) text, strlen(text));
+}
+
+/* Blocks until the last byte is out, like the cores do */
+void HardwareSerial::flush() {
+  sim::Uart &u = uart(uart_);
+  if (u.open && u.txIdle > sim::now()) {
+    sim::advance_to(u.txIdle);
+  }
+}
+
+int HardwareSerial::printf(char const *fmt, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+  write(buffer);
+  return len;
+}
+
+size_t HardwareSerial::print(char const *text) {
+  return write(text);
+}
+
+size_t HardwareSerial::print(String const &text) {
+  return write(text.c_str());
+}
+
+size_t HardwareSerial::print(long value) {
+  return printf("%ld", value);
+}
+
+size_t HardwareSerial::println(char const *text) {
+  return write(text) + write("\r\n");
+}
+
+size_t HardwareSerial::println(String const &text) {
+  return println(text.c_str());
+}
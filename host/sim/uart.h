@@ -0,0 +1,59 @@
+#ifndef _UART_H
+#define _UART_H
+
+#include <deque>
+#include "sim.h"
+
+namespace sim {
+
+struct LineSettings {
+  uint32_t baud;
+  uint32_t config;             /* SERIAL_7E1 or SERIAL_8N1 */
+  bool inverted;
+};
+
+/* The far end of a UART, e.g. the virtual meter behind the optical head */
+class SerialDevice {
+  public:
+    virtual ~SerialDevice() {}
+
+    /* A byte sent by the node is completely received, with the settings the node sent it with */
+    virtual void receive(uint8_t byte, LineSettings const &sent) = 0;
+};
+
+/* Start, data, parity and stop bits take 10 bit times with 7E1 and 8N1 */
+Micros byte_time(uint32_t baud);
+
+/* What a receiver with other settings makes of the byte: the parity bit of 7E1 ends up
+   in bit 7 with 8N1, another baud rate or level garbles it altogether */
+uint8_t convert(uint8_t byte, LineSettings const &sent, LineSettings const &received);
+
+size_t const UART_RX_BUFFER = 256;
+
+class Uart {
+  public:
+    bool open = false;
+    LineSettings settings = {};
+    unsigned long timeout = 1000;        /* of the Stream reads [ms] */
+    SerialDevice *device = NULL;
+    bool console = false;                /* stdout of the firmware */
+    std::deque<uint8_t> rx;
+    Micros txIdle = 0;
+    uint32_t overruns = 0;
+
+    /* The far end sent a byte, the last bit is in now */
+    void deliver(uint8_t byte, LineSettings const &sent);
+
+    void transmit(uint8_t byte);
+
+  private:
+    char line_[512];
+    size_t lineLength_ = 0;
+};
+
+/* 1: console (Serial), 2: Serial1, 3: Serial2 */
+Uart &uart(long id);
+
+}
+
+#endif
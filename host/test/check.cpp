@@ -0,0 +1,12 @@
+#include "check.h"
+
+int failedChecks = 0;
+
+int check_result(char const *test) {
+  if (failedChecks > 0) {
+    printf("%s: %d checks failed\n", test, failedChecks);
+    return 1;
+  }
+  printf("%s: ok\n", test);
+  return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _CHECK_H
+#define _CHECK_H
+
+#include <stdio.h>
+
+/* Minimal checks of the host tests: every failed check is printed, the test fails at the end */
+extern int failedChecks;
+
+#define CHECK(condition)                                                          \
+  do {                                                                            \
+    if (!(condition)) {                                                           \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);        \
+      failedChecks++;                                                             \
+    }                                                                             \
+  } while (0)
+
+/* Prints the result, the exit code of the test */
+int check_result(char const *test);
+
+#endif
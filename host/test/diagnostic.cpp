@@ -0,0 +1,47 @@
+/* The capture id of the diagnostic upload, persisted across resets */
+
+#include <string.h>
+#include "diagnostic.h"
+#include "EEPROM.h"
+#include "check.h"
+#include "stubs.h"
+
+static char const TELEGRAM[] = "/ELS5\\@V10.04\r\n\x02" "1.8.0(001234.567*kWh)\r\n!\r\n\x03";
+
+/* A capture on a fresh upload as the reset left it, returns the id of its first fragment */
+static uint8_t capture_after_reset() {
+  static DiagnosticUpload upload;
+  upload = DiagnosticUpload();
+  EEPROM.begin(EEPROM_SIZE);
+  upload.begin();
+  memcpy(upload.buffer(), TELEGRAM, sizeof(TELEGRAM) - 1);
+  upload.start(sizeof(TELEGRAM) - 1);
+  uint8_t frame[51];
+  CHECK(upload.next_fragment(frame, sizeof(frame)) > DIAGNOSTIC_FIRST_HEADER_SIZE);
+  return frame[0];
+}
+
+static void test_id_survives_reset() {
+  stubs::erase_eeprom();
+  size_t commits = stubs::eepromCommits;
+  CHECK(capture_after_reset() == 1);
+  CHECK(capture_after_reset() == 2);
+  CHECK(capture_after_reset() == 3);
+  CHECK(stubs::eepromCommits == commits + 3);
+}
+
+static void test_id_wraps() {
+  stubs::erase_eeprom();
+  uint8_t id = 0;
+  for (size_t i = 0; i < 256; i++) {
+    id = capture_after_reset();
+  }
+  CHECK(id == 0);
+  CHECK(capture_after_reset() == 1);
+}
+
+int main() {
+  test_id_survives_reset();
+  test_id_wraps();
+  return check_result("diagnostic");
+}
@@ -0,0 +1,107 @@
+/* The data rate and TX power the link tracker of the ESP32 picks */
+
+#include "link.h"
+#include "check.h"
+
+static uint32_t const NOW = 100000;
+static LinkConfig const CONFIG = {10, 950, 86400, 259200, 0};
+
+static LinkChoice choice_for(int16_t rssi, int16_t snr) {
+  LinkState state = {};
+  state.delivery = 1000;
+  LinkTracker tracker(state, CONFIG);
+  tracker.add_downlink(NOW, rssi, snr);
+  return tracker.choose(NOW);
+}
+
+static void test_margins() {
+  /* margin over the floor at DR0 minus the configured one, 2.5 dB per data rate, then 2 dB per power step */
+  LinkChoice choice = choice_for(-100, 5 * 4);
+  CHECK(choice.dataRate == 5 && choice.txPower == 8);
+  choice = choice_for(-112, 5 * 4);
+  CHECK(choice.dataRate == 3 && choice.txPower == 16);
+  choice = choice_for(-115, 5 * 4);
+  CHECK(choice.dataRate == 2 && choice.txPower == 16);
+  choice = choice_for(-118, 5 * 4);
+  CHECK(choice.dataRate == 1 && choice.txPower == 16);
+  /* below the noise floor the SNR tells the margin, in steps of 0.25 dB */
+  choice = choice_for(-120, -10 * 4);
+  CHECK(choice.dataRate == 0 && choice.txPower == 16);
+  choice = choice_for(-80, -2 * 4);
+  CHECK(choice.dataRate == 0 && choice.txPower == 14);
+  choice = choice_for(-80, -7);
+  CHECK(choice.dataRate == 0 && choice.txPower == 14);
+  /* a strong link: the fastest data rate with the least power */
+  choice = choice_for(-60, 5 * 4);
+  CHECK(choice.dataRate == 5 && choice.txPower == 2);
+}
+
+static void test_boost() {
+  LinkState state = {};
+  state.delivery = 1000;
+  LinkTracker tracker(state, CONFIG);
+  tracker.add_downlink(NOW, -100, 5 * 4);
+  LinkChoice initial = tracker.choose(NOW);
+
+  /* a lost confirmed uplink: 3 dB more margin, i.e. more power */
+  tracker.add_uplink(NOW, true);
+  tracker.add_uplink(NOW + 900, true);
+  LinkChoice choice = tracker.choose(NOW);
+  CHECK(choice.dataRate == initial.dataRate && choice.txPower > initial.txPower);
+  CHECK(tracker.delivery() == 875);
+  CHECK(state.boost == 3);
+
+  /* more losses: slower data rates, up to 15 dB */
+  for (int i = 0; i < 10; i++) {
+    tracker.add_uplink(NOW + 1800 + i * 900, true);
+  }
+  CHECK(state.boost == 15);
+  choice = tracker.choose(NOW);
+  CHECK(choice.dataRate == 2 && choice.txPower == 16);
+
+  /* delivered: the boost shrinks once the delivery ratio is on target again */
+  tracker.add_ack();
+  CHECK(state.boost == 15);
+  for (int i = 0; i < 60; i++) {
+    tracker.add_uplink(NOW, true);
+    tracker.add_ack();
+  }
+  CHECK(tracker.delivery() >= CONFIG.targetDelivery);
+  CHECK(state.boost == 0);
+  choice = tracker.choose(NOW);
+  CHECK(choice.dataRate == initial.dataRate && choice.txPower == initial.txPower);
+}
+
+static void test_stale() {
+  LinkState state = {};
+  state.delivery = 1000;
+  LinkTracker tracker(state, CONFIG);
+  LinkChoice choice = tracker.choose(NOW);
+  CHECK(choice.dataRate == CONFIG.fallbackDataRate && choice.txPower == 16);
+  CHECK(tracker.probe_due(NOW));
+
+  tracker.add_downlink(NOW, -100, 5 * 4);
+  tracker.add_uplink(NOW, true);
+  tracker.add_ack();
+  CHECK(tracker.choose(NOW + CONFIG.staleTime).dataRate == 5);
+  CHECK(!tracker.probe_due(NOW + CONFIG.probeInterval - 1));
+  CHECK(tracker.probe_due(NOW + CONFIG.probeInterval));
+
+  /* no downlink for too long: the fallback, and probes more often */
+  choice = tracker.choose(NOW + CONFIG.staleTime + 1);
+  CHECK(choice.dataRate == CONFIG.fallbackDataRate && choice.txPower == 16);
+  tracker.add_uplink(NOW + CONFIG.staleTime + 1, true);
+  CHECK(!tracker.probe_due(NOW + CONFIG.staleTime + CONFIG.probeInterval / 4));
+  CHECK(tracker.probe_due(NOW + CONFIG.staleTime + 1 + CONFIG.probeInterval / 4));
+
+  /* a new measurement replaces the old margin instead of smoothing it */
+  tracker.add_downlink(NOW + CONFIG.staleTime + 1, -120, 5 * 4);
+  CHECK(tracker.choose(NOW + CONFIG.staleTime + 1).dataRate == 0);
+}
+
+int main() {
+  test_margins();
+  test_boost();
+  test_stale();
+  return check_result("esp32_link");
+}
@@ -0,0 +1,78 @@
+/* Which values of the ESP32 reader are used after a failed checksum */
+
+#include "plausibility.h"
+#include "config.h"
+#include "meter.h"
+#include "check.h"
+
+static void test_line_integrity() {
+  CHECK(line_integrity("1.8.0(001234.567*kWh)") == 100);
+  CHECK(line_integrity("16.7.0(000.512*kW)") == 100);
+  CHECK(line_integrity("C.1.0(12345678)") == 100);
+
+  /* a flipped separator */
+  CHECK(line_integrity("1x8.0(001234.567*kWh)") < MIN_SALVAGE_SCORE);
+  CHECK(line_integrity("1.8.0(001234/567*kWh)") < MIN_SALVAGE_SCORE);
+  CHECK(line_integrity("1.8.0(001234.5.7*kWh)") < MIN_SALVAGE_SCORE);
+  CHECK(line_integrity("1/8/0(001234.567*kWh)") < MIN_SALVAGE_SCORE);
+  /* a flipped letter or digit */
+  CHECK(line_integrity("1.8.0(0012A4.567*kWh)") < MIN_SALVAGE_SCORE);
+  CHECK(line_integrity("1.G.0(001234.567*kWh)") < MIN_SALVAGE_SCORE);
+  /* brackets, control chars and bytes with bit 7 set */
+  CHECK(line_integrity("1.8.0(001234.567*kWh") == 0);
+  CHECK(line_integrity("1.8.0)001234.567*kWh)") == 0);
+  CHECK(line_integrity("1.8.0(001234.567*kWh)(1)") < MIN_SALVAGE_SCORE);
+  CHECK(line_integrity("1.8.0(0012\x01" "4.567*kWh)") == 0);
+  CHECK(line_integrity("1.8.0(0012\xB4.567*kWh)") == 0);
+}
+
+static void test_energy() {
+  double const reference = 1000;
+  /* unknown reference or time */
+  CHECK(energy_plausible(5, 0, 900));
+  CHECK(energy_plausible(2000, reference, 0));
+  CHECK(!energy_plausible(-1, 0, 0));
+
+  /* the register counts down */
+  CHECK(!energy_plausible(999.99, reference, 900));
+  CHECK(energy_plausible(reference, reference, 900));
+
+  /* faster than the fuse allows within the time and the read time */
+  double maxIncrease = FUSE_LIMIT_W / 1000.0 * (900 + MAX_METER_READ_TIME) / 3600.0;
+  CHECK(energy_plausible(reference + maxIncrease, reference, 900));
+  CHECK(!energy_plausible(reference + maxIncrease + 0.1, reference, 900));
+  CHECK(!energy_plausible(reference + 100, reference, 3600));
+  CHECK(energy_plausible(reference + 100, reference, 86400));
+}
+
+static void test_power() {
+  CHECK(power_plausible(0));
+  CHECK(power_plausible(FUSE_LIMIT_W / 1000.0));
+  CHECK(!power_plausible(FUSE_LIMIT_W / 1000.0 + 0.01));
+  CHECK(!power_plausible(-0.5));
+}
+
+static void test_reference_reset() {
+  unsigned rejected = 0;
+  for (unsigned i = 1; i < MAX_REJECTED_READOUTS; i++) {
+    CHECK(!drop_energy_reference(rejected, 1));
+  }
+  CHECK(drop_energy_reference(rejected, 2));
+  CHECK(rejected == 0);
+
+  /* a plausible readout in between starts over */
+  CHECK(!drop_energy_reference(rejected, 1));
+  CHECK(!drop_energy_reference(rejected, 0));
+  for (unsigned i = 1; i < MAX_REJECTED_READOUTS; i++) {
+    CHECK(!drop_energy_reference(rejected, 1));
+  }
+  CHECK(drop_energy_reference(rejected, 1));
+}
+
+int main() {
+  test_line_integrity();
+  test_energy();
+  test_power();
+  test_reference_reset();
+  return check_result("esp32_plausibility");
+}
@@ -0,0 +1,46 @@
+/* The CPU clock of the ESP32 per phase and baud rate */
+
+#include "power.h"
+#include "check.h"
+
+static uint32_t const BAUD_RATES[] = { 300, 600, 1200, 2400, 4800, 9600 };
+
+/* Whether the UART keeps up with the baud rate at this clock */
+static bool uart_stable(uint32_t mhz, uint32_t baud) {
+  return mhz * 1000000 >= baud * CPU_CYCLES_PER_BIT;
+}
+
+static void test_readout() {
+  for (uint32_t baud : BAUD_RATES) {
+    uint32_t mhz = cpu_mhz_for(PowerPhase::MeterReadout, baud);
+    CHECK(uart_stable(mhz, baud));
+    /* the lowest such frequency */
+    for (uint32_t lower : CPU_FREQUENCIES_MHZ) {
+      if (lower < mhz) {
+        CHECK(!uart_stable(lower, baud));
+      }
+    }
+  }
+  CHECK(cpu_mhz_for(PowerPhase::MeterReadout, 300) == 10);
+  CHECK(cpu_mhz_for(PowerPhase::MeterReadout, 4800) == 10);
+  CHECK(cpu_mhz_for(PowerPhase::MeterReadout, 9600) == 20);
+  CHECK(cpu_mhz_for(PowerPhase::MeterReadout, 19200) == 40);
+  /* faster than any clock keeps up with: the fastest one */
+  CHECK(cpu_mhz_for(PowerPhase::MeterReadout, 1000000) == 240);
+}
+
+static void test_other_phases() {
+  for (uint32_t baud : BAUD_RATES) {
+    CHECK(cpu_mhz_for(PowerPhase::Radio, baud) == RADIO_CPU_MHZ);
+    CHECK(cpu_mhz_for(PowerPhase::Display, baud) == DISPLAY_CPU_MHZ);
+    CHECK(cpu_mhz_for(PowerPhase::Idle, baud) == IDLE_CPU_MHZ);
+  }
+  /* LMIC needs the PLL clock */
+  CHECK(RADIO_CPU_MHZ >= 80);
+}
+
+int main() {
+  test_readout();
+  test_other_phases();
+  return check_result("esp32_power");
+}
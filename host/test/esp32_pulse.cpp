@@ -0,0 +1,39 @@
+/* The power of an inter-pulse interval of the test LED (ESP32) */
+
+#include <math.h>
+#include "pulse.h"
+#include "check.h"
+
+static uint32_t const SAMPLE_PERIOD_US = 10000;
+static uint32_t const PULSES_PER_KWH = 1000;
+
+static bool near(float value, float expected) {
+  return fabsf(value - expected) <= expected * 1e-4f;
+}
+
+static void test_unknown_intervals() {
+  CHECK(pulse_power_w(0, SAMPLE_PERIOD_US, PULSES_PER_KWH) == 0);
+  /* the first pulse and intervals too long to be counted */
+  CHECK(pulse_power_w(UNKNOWN_PULSE_INTERVAL, SAMPLE_PERIOD_US, PULSES_PER_KWH) == 0);
+  CHECK(pulse_power_w(0xFFFF, SAMPLE_PERIOD_US, PULSES_PER_KWH) == 0);
+  /* no meter constant configured */
+  CHECK(pulse_power_w(360, SAMPLE_PERIOD_US, 0) == 0);
+}
+
+static void test_power() {
+  /* 1 Wh per pulse every 3.6 s: 1 kW */
+  CHECK(near(pulse_power_w(360, SAMPLE_PERIOD_US, PULSES_PER_KWH), 1000));
+  /* one sample period: the most the counter resolves */
+  CHECK(near(pulse_power_w(1, SAMPLE_PERIOD_US, PULSES_PER_KWH), 360000));
+  /* the longest interval still counted, about 655 s */
+  CHECK(near(pulse_power_w(0xFFFE, SAMPLE_PERIOD_US, PULSES_PER_KWH), 3.6e12f / (1000.0f * 0xFFFE * 10000)));
+  CHECK(pulse_power_w(0xFFFE, SAMPLE_PERIOD_US, PULSES_PER_KWH) > 0);
+  /* 10000 imp/kWh: a tenth of the energy per pulse */
+  CHECK(near(pulse_power_w(360, SAMPLE_PERIOD_US, 10000), 100));
+}
+
+int main() {
+  test_unknown_intervals();
+  test_power();
+  return check_result("esp32_pulse");
+}
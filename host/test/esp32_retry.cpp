@@ -0,0 +1,40 @@
+/* The retry delays of the ESP32, and the normal interval once the budget is used up */
+
+#include "retry.h"
+#include "check.h"
+
+static uint32_t const DEEP_SLEEP_TIME = 1200;
+
+static void test_budget_used_up() {
+  RetryClass const classes[] = { RetryClass::MeterNoise, RetryClass::MeterSilent, RetryClass::MeterBusy, RetryClass::RadioFailure };
+  for (RetryClass retryClass : classes) {
+    RetryState state = {};
+    RetryScheduler scheduler(state);
+    uint8_t budget = retry_policy(retryClass).budget;
+    for (uint8_t i = 0; i < budget; i++) {
+      CHECK(scheduler.next_delay(retryClass, DEEP_SLEEP_TIME) <= DEEP_SLEEP_TIME);
+    }
+    /* the deep sleep time, not maxDelay, as long as the failures go on */
+    for (uint8_t i = 0; i < 20; i++) {
+      CHECK(scheduler.next_delay(retryClass, DEEP_SLEEP_TIME) == DEEP_SLEEP_TIME);
+    }
+  }
+}
+
+static void test_delays_grow_up_to_max() {
+  RetryState state = {};
+  RetryScheduler scheduler(state);
+  uint32_t const expected[] = { 10, 15, 22, 33, 49, 73, 109, 163 };
+  for (uint32_t delay : expected) {
+    CHECK(scheduler.next_delay(RetryClass::MeterSilent, DEEP_SLEEP_TIME) == delay);
+  }
+  CHECK(scheduler.failures() == 8);
+  scheduler.succeeded();
+  CHECK(scheduler.failures() == 0);
+}
+
+int main() {
+  test_budget_used_up();
+  test_delays_grow_up_to_max();
+  return check_result("esp32_retry");
+}
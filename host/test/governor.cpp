@@ -0,0 +1,73 @@
+/* The battery budget of the wake governor, persisted across resets */
+
+#include "governor.h"
+#include "EEPROM.h"
+#include "check.h"
+#include "stubs.h"
+
+static uint32_t const DAY = 86400;
+static uint32_t const BASE = 900000;
+static uint16_t const EMPTY_VOLTAGE = 3000;
+
+/* A fresh governor on the EEPROM as the reset left it */
+static void restart(WakeGovernor &governor) {
+  governor = WakeGovernor(EMPTY_VOLTAGE);
+  EEPROM.begin(EEPROM_SIZE);
+  governor.begin();
+}
+
+/* The interval of the battery budget, the charge per wake puts it between the bounds */
+static uint32_t budget(WakeGovernor &governor, uint32_t now, uint8_t batteryPct) {
+  return governor.next_interval(BASE, now, batteryPct, 40);
+}
+
+static void test_budget_survives_reset() {
+  stubs::erase_eeprom();
+  WakeGovernor governor(EMPTY_VOLTAGE);
+  restart(governor);
+  governor.add_battery(0, 3600);
+  uint32_t fresh = budget(governor, 0, 50);
+  size_t commits = stubs::eepromCommits;
+  for (uint32_t day = 1; day <= 200; day++) {
+    governor.add_battery(day * DAY, 3600);
+  }
+  /* once a day */
+  CHECK(stubs::eepromCommits - commits == 200);
+  uint32_t later = budget(governor, 200 * DAY, 50);
+  CHECK(later < fresh);
+
+  /* after the reset the same half battery has to last the same 165 days */
+  restart(governor);
+  governor.add_battery(0, 3600);
+  CHECK(budget(governor, 0, 50) == later);
+  commits = stubs::eepromCommits;
+  governor.add_battery(3600, 3600);
+  CHECK(stubs::eepromCommits == commits);
+}
+
+static void test_new_battery() {
+  stubs::erase_eeprom();
+  WakeGovernor governor(EMPTY_VOLTAGE);
+  restart(governor);
+  governor.add_battery(0, 3500);
+  uint32_t fresh = budget(governor, 0, 50);
+  governor.add_battery(200 * DAY, 3400);
+
+  /* a few mV more after the reset are no new battery */
+  restart(governor);
+  governor.add_battery(0, 3450);
+  CHECK(budget(governor, 0, 50) < fresh);
+
+  restart(governor);
+  governor.add_battery(0, 3700);
+  CHECK(budget(governor, 0, 50) == fresh);
+  restart(governor);
+  governor.add_battery(0, 3700);
+  CHECK(budget(governor, 0, 50) == fresh);
+}
+
+int main() {
+  test_budget_survives_reset();
+  test_new_battery();
+  return check_result("governor");
+}
@@ -0,0 +1,298 @@
+/* The ingestion service: deduplication, the payload decoders and the reassembly of diagnostic captures */
+
+#include <fstream>
+#include <sstream>
+
+/* the service is a single file, its main() is renamed to link it into the test */
+#define main ingest_main
+#include "../../ingest/ingest.cpp"
+#undef main
+
+#include "check.h"
+
+static std::string const DEV_EUI = "70B3D57ED0000001";
+static char const *const SINK_FILE = "build/test-ingest.jsonl";
+
+static void test_dedup() {
+  Deduplicator dedup;
+  CHECK(!dedup.seen(DEV_EUI, 10, 0));
+  CHECK(dedup.seen(DEV_EUI, 10, 500));
+  CHECK(!dedup.seen("70B3D57ED0000002", 10, 500));
+  CHECK(!dedup.seen(DEV_EUI, 11, 60000));
+  CHECK(dedup.seen(DEV_EUI, 11, 61000));
+  CHECK(dedup.devices() == 2);
+
+  /* a rejoin after a few uplinks: the counters start over while the old ones are still in the window */
+  for (uint32_t fCnt = 12; fCnt < 15; fCnt++) {
+    CHECK(!dedup.seen(DEV_EUI, fCnt, fCnt * 60000));
+  }
+  long long rejoined = 15 * 60000;
+  for (uint32_t fCnt = 0; fCnt < 15; fCnt++) {
+    CHECK(!dedup.seen(DEV_EUI, fCnt, rejoined + fCnt * 60000));
+    CHECK(dedup.seen(DEV_EUI, fCnt, rejoined + fCnt * 60000 + 1500));
+  }
+
+  /* copies arriving out of order within the window */
+  Deduplicator order;
+  CHECK(!order.seen(DEV_EUI, 20, 0));
+  CHECK(!order.seen(DEV_EUI, 19, 0));
+  CHECK(order.seen(DEV_EUI, 20, 10));
+  CHECK(order.seen(DEV_EUI, 19, 10));
+}
+
+static std::vector<std::string> read_records() {
+  std::vector<std::string> records;
+  std::ifstream file(SINK_FILE);
+  std::string line;
+  while (std::getline(file, line)) {
+    records.push_back(line);
+  }
+  return records;
+}
+
+static bool has(std::string const &record, std::string const &field) {
+  return record.find(field) != std::string::npos;
+}
+
+/* Runs the webhooks through a fresh service, returns the records it wrote */
+static std::vector<std::string> ingest(std::vector<std::string> const &webhooks, std::string *stats = NULL) {
+  remove(SINK_FILE);
+  {
+    BatchSink sink(SINK_FILE, 1, 1000);
+    Ingest service(sink, "");
+    for (std::string const &webhook : webhooks) {
+      service.handle(webhook.data(), webhook.size());
+    }
+    if (stats != NULL) {
+      *stats = service.stats();
+    }
+  }
+  return read_records();
+}
+
+static void test_decoder() {
+  /* the CubeCell reading with derived metrics */
+  std::vector<uint8_t> reading;
+  put16(reading, 1234);
+  put32(reading, 1000050);
+  reading.push_back(80);
+  put16(reading, 3350);
+  reading.push_back(7);
+  put16(reading, 900);
+  put16(reading, 2500);
+  put16(reading, 15);
+  put32(reading, 600000);
+  put32(reading, 400050);
+  std::string stats;
+  std::vector<std::string> records = ingest({ synthetic_webhook(1, 5, 2, reading, 1), synthetic_webhook(1, 5, 2, reading, 1) }, &stats);
+  CHECK(records.size() == 1);
+  CHECK(has(records[0], "\"power_w\":1234"));
+  CHECK(has(records[0], "\"energy_kwh\":10000.50"));
+  CHECK(has(records[0], "\"battery_mv\":3350"));
+  CHECK(has(records[0], "\"peak_w\":2500"));
+  CHECK(has(records[0], "\"night_tariff_wh\":400050"));
+  CHECK(has(stats, "\"duplicates\":1"));
+
+  /* the energy unknown is left out, a truncated reading isn't decoded */
+  std::vector<uint8_t> unknown;
+  put16(unknown, 10);
+  put32(unknown, ENERGY_UNKNOWN);
+  unknown.push_back(50);
+  unknown.push_back(3);
+  std::vector<uint8_t> truncated(reading.begin(), reading.begin() + 9);
+  records = ingest({ synthetic_webhook(1, 1, 2, unknown, 1), synthetic_webhook(1, 2, 2, truncated, 1) }, &stats);
+  CHECK(records.size() == 1);
+  CHECK(has(records[0], "\"counter\":3"));
+  CHECK(!has(records[0], "energy_kwh"));
+  CHECK(has(stats, "\"undecodable\":1"));
+
+  /* the journal: a record per buffered reading, the day consumption from the register */
+  std::vector<uint8_t> journal = { 2, 79, 4 };
+  put16(journal, 30);
+  put16(journal, 100);
+  put32(journal, 500000);
+  put16(journal, 0xFFFF);
+  put16(journal, 200);
+  put32(journal, 500025);
+  records = ingest({ synthetic_webhook(1, 1, 5, journal, 1) });
+  CHECK(records.size() == 2);
+  CHECK(has(records[0], "\"age_min\":30"));
+  CHECK(!has(records[1], "age_min"));
+  CHECK(has(records[1], "\"day_kwh\":0.25"));
+
+  /* several meters, the one that failed has no reading */
+  std::vector<uint8_t> meters = { 2, 81, 9, 0, 2 };
+  put16(meters, 300);
+  put32(meters, 700000);
+  meters.insert(meters.end(), { 1, 3, 0, 0, 0, 0, 0, 0 });
+  records = ingest({ synthetic_webhook(1, 1, 6, meters, 1) });
+  CHECK(records.size() == 2);
+  CHECK(has(records[0], "\"meter\":0") && has(records[0], "\"power_w\":300"));
+  CHECK(has(records[1], "\"meter\":1") && has(records[1], "\"status\":3") && !has(records[1], "power_w"));
+
+  /* the load profile, the intervals summed up per day */
+  std::vector<uint8_t> profile;
+  put32(profile, 12700000);
+  profile.insert(profile.end(), { 15, 1, 2, 78 });
+  put16(profile, 120);
+  put16(profile, 80);
+  records = ingest({ synthetic_webhook(1, 1, 3, profile, 1) });
+  CHECK(records.size() == 2);
+  CHECK(has(records[0], "\"profile_minutes\":12700000"));
+  CHECK(has(records[1], "\"profile_minutes\":12700015"));
+  CHECK(has(records[1], "\"profile_day_wh\":200"));
+
+  /* the test LED pulses of the ESP32, an unknown interval power is left out */
+  std::vector<uint8_t> pulses;
+  put16(pulses, 480);
+  put32(pulses, 1000075);
+  pulses.insert(pulses.end(), { 70, 12 });
+  put16(pulses, 0);
+  put16(pulses, 3100);
+  put16(pulses, 600);
+  put16(pulses, 80);
+  records = ingest({ synthetic_webhook(1, 1, 8, pulses, 1), synthetic_webhook(1, 2, 8, std::vector<uint8_t>(pulses.begin(), pulses.begin() + 8), 1) }, &stats);
+  CHECK(records.size() == 1);
+  CHECK(has(records[0], "\"power_w\":480") && has(records[0], "\"energy_kwh\":10000.75"));
+  CHECK(!has(records[0], "last_w") && has(records[0], "\"peak_w\":3100"));
+  CHECK(has(records[0], "\"interval_s\":600") && has(records[0], "\"pulses\":80"));
+  CHECK(has(stats, "\"undecodable\":1"));
+
+  /* more entries announced than sent */
+  std::vector<uint8_t> short_journal(journal.begin(), journal.end() - 1);
+  records = ingest({ synthetic_webhook(1, 1, 5, short_journal, 1) }, &stats);
+  CHECK(records.empty());
+  CHECK(has(stats, "\"undecodable\":1"));
+}
+
+/* Writes the LZSS bits of the firmware: a literal or an <offset, length> match */
+class BitWriter {
+  public:
+    void write(uint8_t count, uint32_t value) {
+      for (int bit = count - 1; bit >= 0; bit--) {
+        if (position_ % 8 == 0) {
+          bytes.push_back(0);
+        }
+        bytes.back() |= ((value >> bit) & 1) << (7 - position_ % 8);
+        position_++;
+      }
+    }
+
+    void literal(uint8_t value) {
+      write(1, 1);
+      write(8, value);
+    }
+
+    void match(uint8_t offset, uint8_t length) {
+      write(1, 0);
+      write(LZSS_OFFSET_BITS, offset);
+      write(LZSS_LENGTH_BITS, length - LZSS_MIN_MATCH);
+    }
+
+    std::vector<uint8_t> bytes;
+
+  private:
+    size_t position_ = 0;
+};
+
+/* "/ABC5\r\nABABABAB!": literals, then a match that overlaps the bytes it produces */
+static std::vector<std::vector<uint8_t>> capture_fragments(uint8_t capture, bool corrupt) {
+  std::string text = "/ABC5\r\nABABABAB!";
+  std::vector<uint8_t> raw(text.begin(), text.end());
+  BitWriter bits;
+  for (size_t i = 0; i < 9; i++) {
+    bits.literal(raw[i]);
+  }
+  bits.match(1, 6);
+  bits.literal('!');
+
+  std::vector<uint8_t> first = { capture, 0 };
+  put16(first, raw.size());
+  put16(first, crc16(raw) ^ (corrupt ? 1 : 0));
+  first.insert(first.end(), bits.bytes.begin(), bits.bytes.begin() + 4);
+  std::vector<uint8_t> second = { capture, 1 };
+  second.insert(second.end(), bits.bytes.begin() + 4, bits.bytes.begin() + 8);
+  std::vector<uint8_t> last = { capture, 2 | DIAGNOSTIC_LAST_FRAGMENT };
+  last.insert(last.end(), bits.bytes.begin() + 8, bits.bytes.end());
+  return { first, second, last };
+}
+
+static void test_reassembler() {
+  std::string expected = "/ABC5\r\nABABABAB!";
+  std::vector<std::vector<uint8_t>> fragments = capture_fragments(3, false);
+  std::vector<uint8_t> telegram;
+  size_t count = 0;
+
+  /* in any order, complete with the last missing one */
+  Reassembler reassembler;
+  CHECK(reassembler.add(DEV_EUI, fragments[2], telegram, count) == Reassembler::Incomplete);
+  CHECK(reassembler.add(DEV_EUI, fragments[0], telegram, count) == Reassembler::Incomplete);
+  CHECK(reassembler.add("70B3D57ED0000002", fragments[1], telegram, count) == Reassembler::Incomplete);
+  CHECK(reassembler.add(DEV_EUI, fragments[1], telegram, count) == Reassembler::Complete);
+  CHECK(count == 3);
+  CHECK(std::string(telegram.begin(), telegram.end()) == expected);
+
+  /* the CRC doesn't match */
+  std::vector<std::vector<uint8_t>> corrupt = capture_fragments(4, true);
+  CHECK(reassembler.add(DEV_EUI, corrupt[0], telegram, count) == Reassembler::Incomplete);
+  CHECK(reassembler.add(DEV_EUI, corrupt[1], telegram, count) == Reassembler::Incomplete);
+  CHECK(reassembler.add(DEV_EUI, corrupt[2], telegram, count) == Reassembler::Corrupt);
+
+  /* bits missing at the end, a fragment without a header */
+  std::vector<uint8_t> cut = fragments[2];
+  cut.pop_back();
+  CHECK(reassembler.add(DEV_EUI, fragments[0], telegram, count) == Reassembler::Incomplete);
+  CHECK(reassembler.add(DEV_EUI, fragments[1], telegram, count) == Reassembler::Incomplete);
+  CHECK(reassembler.add(DEV_EUI, cut, telegram, count) == Reassembler::Corrupt);
+  CHECK(reassembler.add(DEV_EUI, { 3 }, telegram, count) == Reassembler::Corrupt);
+
+  /* a match pointing before the start */
+  BitWriter bits;
+  bits.literal('/');
+  bits.match(5, 2);
+  std::vector<uint8_t> behind = { 5, DIAGNOSTIC_LAST_FRAGMENT, 0, 3, 0, 0 };
+  behind.insert(behind.end(), bits.bytes.begin(), bits.bytes.end());
+  CHECK(reassembler.add(DEV_EUI, behind, telegram, count) == Reassembler::Corrupt);
+
+  /* through the service: one record once complete */
+  std::vector<std::string> webhooks;
+  for (size_t i = 0; i < fragments.size(); i++) {
+    webhooks.push_back(synthetic_webhook(1, 10 + i, 7, fragments[i], 2));
+  }
+  std::vector<std::string> records = ingest(webhooks);
+  CHECK(records.size() == 1);
+  CHECK(has(records[0], "\"status\":\"complete\""));
+  CHECK(has(records[0], "\"telegram_bytes\":16"));
+}
+
+/* The DevEUI goes into the file names of the telegrams, anything but 16 hex digits is rejected */
+static void test_dev_eui() {
+  std::vector<uint8_t> reading = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x64, 0x01, 0xF4, 0x50, 0x00 };
+  std::string webhook = synthetic_webhook(1, 1, 2, reading, 1);
+  size_t at = webhook.find(DEV_EUI);
+  CHECK(at != std::string::npos);
+
+  BatchSink sink(SINK_FILE, 1, 1000);
+  Ingest service(sink, "build");
+  char const *const invalid[] = { "../../x", "70B3D57ED000000", "70B3D57ED00000011", "70B3D57ED000000G", "../../70B3D57ED0", "" };
+  for (char const *devEui : invalid) {
+    std::string tampered = webhook;
+    tampered.replace(at, DEV_EUI.size(), devEui);
+    CHECK(service.handle(tampered.data(), tampered.size()) == 400);
+  }
+  std::string lower = webhook;
+  lower.replace(at, DEV_EUI.size(), "70b3d57ed0000001");
+  CHECK(service.handle(lower.data(), lower.size()) == 200);
+  /* the same device, thus a duplicate */
+  CHECK(service.handle(webhook.data(), webhook.size()) == 200);
+  CHECK(service.stats().find("\"duplicates\":1") != std::string::npos);
+}
+
+int main() {
+  test_dedup();
+  test_dev_eui();
+  test_decoder();
+  test_reassembler();
+  remove(SINK_FILE);
+  return check_result("ingest");
+}
@@ -0,0 +1,79 @@
+/* The flash commits of the journal while readings are held for a batch (LINK_ADAPTATION) */
+
+#include "journal.h"
+#include "EEPROM.h"
+#include "check.h"
+#include "stubs.h"
+
+static size_t const BATCH = 4;
+
+/* One wake as the firmware does it: the flush at the start of the cycle, the reading, and
+   the journal frame once the batch is complete. Returns whether an uplink went out */
+static bool cycle(Journal &journal, uint32_t now, bool confirmed) {
+  journal.flush();
+  journal.append(now, now / 60, 500, 80);
+  if (journal.pending() < BATCH) {
+    return false;
+  }
+  JournalRecord record;
+  CHECK(journal.read(journal.pending() - 1, record));
+  journal.mark_in_flight(record.sequence);
+  if (!confirmed) {
+    journal.acknowledge();
+  }
+  return true;
+}
+
+static void test_held_readings_stay_in_ram() {
+  stubs::erase_eeprom();
+  EEPROM.begin(EEPROM_SIZE);
+  Journal journal;
+  journal.begin();
+  size_t commits = stubs::eepromCommits;
+  size_t uplinks = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    if (cycle(journal, i * 900, false)) {
+      uplinks++;
+    }
+  }
+  CHECK(uplinks == 25);
+  CHECK(journal.pending() == 0);
+  CHECK(stubs::eepromCommits == commits);
+
+  /* acknowledged before the next wake */
+  for (uint32_t i = 100; i < 200; i++) {
+    if (cycle(journal, i * 900, true)) {
+      journal.acknowledge();
+    }
+  }
+  CHECK(journal.pending() == 0);
+  CHECK(stubs::eepromCommits == commits);
+}
+
+static void test_lost_batch_is_committed() {
+  stubs::erase_eeprom();
+  EEPROM.begin(EEPROM_SIZE);
+  Journal journal;
+  journal.begin();
+  size_t commits = stubs::eepromCommits;
+  for (uint32_t i = 0; i < BATCH; i++) {
+    cycle(journal, i * 900, true);
+  }
+  /* the ack doesn't come, the next wake commits the batch and sends it again with its reading */
+  CHECK(cycle(journal, BATCH * 900, true));
+  CHECK(stubs::eepromCommits == commits + 1);
+
+  /* delivered: one more commit clears the backlog in flash, the held readings don't commit */
+  journal.acknowledge();
+  for (uint32_t i = BATCH + 1; i < BATCH + 1 + BATCH - 1; i++) {
+    CHECK(!cycle(journal, i * 900, true));
+  }
+  CHECK(stubs::eepromCommits == commits + 2);
+  CHECK(journal.pending() == BATCH - 1);
+}
+
+int main() {
+  test_held_readings_stay_in_ram();
+  test_lost_batch_is_committed();
+  return check_result("journal");
+}
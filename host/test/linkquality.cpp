@@ -0,0 +1,111 @@
+/* The data rate, TX power and batch the link tracker picks (LINK_ADAPTATION) */
+
+#include "linkquality.h"
+#include "check.h"
+
+static uint32_t const NOW = 100000;
+
+static LinkChoice choice_for(int16_t rssi, int8_t snr) {
+  LinkTracker tracker;
+  tracker.add_downlink(NOW, rssi, snr);
+  return tracker.choose(NOW);
+}
+
+static void test_margins() {
+  /* margin over the floor at DR0 minus LINK_MARGIN, 2.5 dB per data rate, then 2 dB per power step */
+  LinkChoice choice = choice_for(-100, 5);
+  CHECK(choice.dataRate == 5 && choice.txPower == 4 && choice.batch == 1);
+  choice = choice_for(-112, 5);
+  CHECK(choice.dataRate == 3 && choice.txPower == 0 && choice.batch == 1);
+  /* below the noise floor the SNR tells the margin */
+  choice = choice_for(-120, -10);
+  CHECK(choice.dataRate == 0 && choice.txPower == 0);
+  choice = choice_for(-80, -2);
+  CHECK(choice.dataRate == 0 && choice.txPower == 1);
+  /* a strong link: the fastest data rate with the least power */
+  choice = choice_for(-60, 5);
+  CHECK(choice.dataRate == 5 && choice.txPower == 7);
+}
+
+static void test_batch() {
+  /* the slow data rates batch the readings */
+  LinkChoice choice = choice_for(-120, 5);
+  CHECK(choice.dataRate == 0 && choice.batch == 4);
+  choice = choice_for(-118, 5);
+  CHECK(choice.dataRate == 1 && choice.batch == 3);
+  choice = choice_for(-115, 5);
+  CHECK(choice.dataRate == 2 && choice.batch == 2);
+  choice = choice_for(-112, 5);
+  CHECK(choice.dataRate == 3 && choice.batch == 1);
+  CHECK(LINK_MAX_BATCH >= 4);
+}
+
+static void test_boost() {
+  LinkTracker tracker;
+  tracker.add_downlink(NOW, -100, 5);
+  LinkChoice initial = tracker.choose(NOW);
+
+  /* a lost confirmed uplink: 3 dB more margin, i.e. more power */
+  tracker.add_uplink(NOW, true);
+  tracker.add_uplink(NOW + 900, true);
+  LinkChoice choice = tracker.choose(NOW);
+  CHECK(choice.dataRate == initial.dataRate && choice.txPower < initial.txPower);
+  CHECK(tracker.delivery() == 875);
+
+  /* more losses: slower data rates, up to 15 dB */
+  for (int i = 0; i < 10; i++) {
+    tracker.add_uplink(NOW + 1800 + i * 900, true);
+  }
+  choice = tracker.choose(NOW);
+  CHECK(choice.dataRate == 2 && choice.txPower == 0);
+
+  /* delivered: the boost shrinks once the delivery ratio is on target again */
+  tracker.add_ack();
+  CHECK(tracker.choose(NOW).dataRate == 2);
+  for (int i = 0; i < 60; i++) {
+    tracker.add_uplink(NOW, true);
+    tracker.add_ack();
+  }
+  CHECK(tracker.delivery() >= LINK_TARGET_DELIVERY);
+  choice = tracker.choose(NOW);
+  CHECK(choice.dataRate == initial.dataRate && choice.txPower == initial.txPower);
+
+  /* an ack without a confirmed uplink doesn't count */
+  uint16_t delivery = tracker.delivery();
+  tracker.add_ack();
+  CHECK(tracker.delivery() == delivery);
+}
+
+static void test_stale() {
+  LinkTracker tracker;
+  LinkChoice choice = tracker.choose(NOW);
+  CHECK(choice.dataRate == LINK_FALLBACK_DATA_RATE && choice.txPower == 0 && choice.batch == 1);
+  CHECK(tracker.probe_due(NOW));
+
+  tracker.add_downlink(NOW, -100, 5);
+  tracker.add_uplink(NOW, true);
+  tracker.add_ack();
+  CHECK(tracker.choose(NOW + LINK_STALE_TIME).dataRate == 5);
+  CHECK(!tracker.probe_due(NOW + LINK_PROBE_INTERVAL - 1));
+  CHECK(tracker.probe_due(NOW + LINK_PROBE_INTERVAL));
+
+  /* no downlink for too long: the fallback, and probes more often */
+  choice = tracker.choose(NOW + LINK_STALE_TIME + 1);
+  CHECK(choice.dataRate == LINK_FALLBACK_DATA_RATE && choice.txPower == 0 && choice.batch == 1);
+  CHECK(tracker.probe_due(NOW + LINK_STALE_TIME + 1));
+  tracker.add_uplink(NOW + LINK_STALE_TIME + 1, true);
+  CHECK(!tracker.probe_due(NOW + LINK_STALE_TIME + LINK_PROBE_INTERVAL / 4));
+  CHECK(tracker.probe_due(NOW + LINK_STALE_TIME + 1 + LINK_PROBE_INTERVAL / 4));
+
+  /* a new measurement replaces the old margin instead of smoothing it */
+  tracker.add_downlink(NOW + LINK_STALE_TIME + 1, -120, 5);
+  CHECK(tracker.choose(NOW + LINK_STALE_TIME + 1).dataRate == 0);
+}
+
+int main() {
+  test_margins();
+  test_batch();
+  test_boost();
+  test_stale();
+  return check_result("linkquality");
+}
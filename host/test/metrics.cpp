@@ -0,0 +1,71 @@
+/* The metrics derived from consecutive readings (DERIVED_METRICS) */
+
+#include "metrics.h"
+#include "check.h"
+
+static int const NIGHT_START = NIGHT_TARIFF_START * 60;
+static int const NIGHT_END = NIGHT_TARIFF_END * 60;
+
+static void test_average_and_peak() {
+  MetricsTracker tracker;
+  CHECK(!tracker.update(1000, 50000, 300, -1));
+  CHECK(!tracker.valid());
+  /* too short for an average, the first reading stays the reference */
+  CHECK(!tracker.update(1030, 50010, 300, -1));
+  CHECK(tracker.update(1900, 50250, 700, -1));
+  CHECK(tracker.valid());
+  DerivedMetrics const &metrics = tracker.metrics();
+  CHECK(metrics.averagePower == 1000);
+  CHECK(metrics.peakPower == 1000);
+  CHECK(metrics.intervalMinutes == 15);
+  CHECK(tracker.update(2800, 50300, 2500, -1));
+  CHECK(metrics.averagePower == 200);
+  CHECK(metrics.peakPower == 2500);
+  /* without the meter clock it counts as day */
+  CHECK(metrics.dayEnergy == 300 && metrics.nightEnergy == 0);
+}
+
+static void test_tariff_split() {
+  MetricsTracker tracker;
+  tracker.update(0, 1000, 0, NIGHT_START - 30);
+  /* an hour ending 30 minutes into the night tariff */
+  CHECK(tracker.update(3600, 1600, 0, NIGHT_START + 30));
+  CHECK(tracker.metrics().dayEnergy == 300);
+  CHECK(tracker.metrics().nightEnergy == 300);
+  /* an hour within the night, across midnight */
+  CHECK(tracker.update(7200, 2200, 0, (NIGHT_START + 90) % 1440));
+  CHECK(tracker.metrics().nightEnergy == 900);
+  /* an hour ending 15 minutes after the night tariff */
+  tracker.update(10800, 2200, 0, NIGHT_END - 45);
+  CHECK(tracker.update(14400, 2600, 0, NIGHT_END + 15));
+  CHECK(tracker.metrics().dayEnergy == 300 + 100);
+  CHECK(tracker.metrics().nightEnergy == 900 + 300);
+  CHECK(is_night_tariff(NIGHT_START) && is_night_tariff(0) && !is_night_tariff(NIGHT_END) && !is_night_tariff(12 * 60));
+}
+
+static void test_energy_guard() {
+  MetricsTracker tracker;
+  uint32_t const maxDelta = 0xFFFFFFFF / 3600;
+  tracker.update(0, 1000, 0, -1);
+  /* a jump beyond what fits the Wh * 3600 product is a misread, it starts over */
+  CHECK(!tracker.update(900, 1000 + maxDelta + 1, 0, -1));
+  CHECK(!tracker.valid());
+  CHECK(tracker.update(1800, 1000 + maxDelta + 251, 0, -1));
+  CHECK(tracker.metrics().averagePower == 1000);
+  CHECK(tracker.metrics().dayEnergy == 250);
+
+  /* the largest accepted jump doesn't overflow */
+  CHECK(tracker.update(1800 + 3600000, 1000 + maxDelta + 251 + maxDelta, 0, -1));
+  CHECK(tracker.metrics().averagePower == maxDelta / 1000);
+
+  /* a meter that counts down was replaced */
+  CHECK(!tracker.update(1800 + 3600000 + 900, 500, 0, -1));
+  CHECK(!tracker.valid());
+}
+
+int main() {
+  test_average_and_peak();
+  test_tariff_split();
+  test_energy_guard();
+  return check_result("metrics");
+}
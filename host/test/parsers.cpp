@@ -0,0 +1,142 @@
+/* The parsers of the CubeCell readout path: OBIS codes, register values and the load profile */
+
+#include "obisvalues.h"
+#include "loadprofile.h"
+#include "check.h"
+
+static ObisCode code(char const *text) {
+  ObisCode parsed;
+  CHECK(parse_obis_code(text, parsed));
+  return parsed;
+}
+
+static bool matches(char const *pattern, char const *obis) {
+  return obis_matches(code(pattern), code(obis));
+}
+
+static void test_obis_codes() {
+  ObisCode parsed;
+  CHECK(parse_obis_code("1-0:1.8.0*255", parsed));
+  CHECK(parsed.value == 0x0100010800FFULL);
+  CHECK(parsed.mask == 0xFFFFFFFFFFFFULL);
+  CHECK(parse_obis_code("C.1.0", parsed));
+  CHECK((parsed.value >> 8 & 0xFFFFFF) == 0x600100);
+  CHECK(parse_obis_code("F.F", parsed));
+  CHECK(parse_obis_code("1.8.0&01", parsed));
+
+  CHECK(!parse_obis_code("", parsed));
+  CHECK(!parse_obis_code("1.8.", parsed));
+  CHECK(!parse_obis_code("1.8.256", parsed));
+  CHECK(!parse_obis_code("1.8.0.1", parsed));
+  CHECK(!parse_obis_code("1-8.0", parsed) && !parse_obis_code("x.8.0", parsed));
+  /* only the given length counts, e.g. up to the '(' of a line */
+  CHECK(parse_obis_code("1.8.0(000123.456*kWh)", 5, parsed) && parsed.value == code("1.8.0").value);
+}
+
+static void test_obis_matching() {
+  CHECK(matches("1.8.0", "1.8.0"));
+  CHECK(matches("1.8.0", "1-0:1.8.0*255"));
+  CHECK(matches("1-0:1.8.0*255", "1.8.0"));
+  CHECK(!matches("1.8.0", "1.8.1"));
+  CHECK(!matches("1.8.0", "2.8.0"));
+
+  /* a pattern without F is the current value, not a billing period */
+  CHECK(!matches("1.8.0", "1.8.0*01"));
+  CHECK(!matches("1.8.0", "1-0:1.8.0*96"));
+  CHECK(!matches("1.8.0", "1.8.0&01"));
+  CHECK(!matches("1.8.0*01", "1.8.0"));
+  CHECK(matches("1.8.0*01", "1.8.0*01"));
+  CHECK(matches("1.8.0**", "1.8.0*01"));
+  CHECK(matches("1.8.0**", "1.8.0"));
+
+  CHECK(matches("1.8.*", "1.8.2"));
+  CHECK(matches("1.8.*", "1-0:1.8.1*255"));
+  CHECK(!matches("1.8.*", "1.8.1*01"));
+  CHECK(!matches("1.8.*", "2.8.1"));
+  CHECK(matches("C.*", "C.1.0"));
+  CHECK(!matches("C.*", "F.F"));
+}
+
+static void test_fixed_point() {
+  FixedPoint value;
+  CHECK(parse_fixed_point("012345.678*kWh", value) && value.mantissa == 12345678 && value.decimals == 3);
+  CHECK(parse_fixed_point("00.350", value) && value.mantissa == 350 && value.decimals == 3);
+  CHECK(parse_fixed_point("-1,5*kW", value) && value.mantissa == -15 && value.decimals == 1);
+  CHECK(parse_fixed_point("42", value) && value.mantissa == 42 && value.decimals == 0);
+  CHECK(!parse_fixed_point("", value));
+  CHECK(!parse_fixed_point("*kWh", value));
+  CHECK(!parse_fixed_point("1.2.3", value));
+  CHECK(!parse_fixed_point("12a", value));
+  CHECK(!parse_fixed_point("99999999999", value));
+
+  FixedPoint kw = { 350, 3 };
+  CHECK(fixed_point_scaled(kw, 3) == 350);
+  CHECK(fixed_point_scaled(kw, 1) == 3);
+  CHECK(fixed_point_scaled(kw, 5) == 35000);
+  FixedPoint big = { 2000000000, 0 };
+  CHECK(fixed_point_scaled(big, 3) == INT32_MAX);
+}
+
+static void test_obis_values() {
+  ObisValues values;
+  CHECK(values.add("1.8.*"));
+  CHECK(values.add("1.7.0"));
+  CHECK(!values.add("1.8.*"));
+  CHECK(!values.add("1.8."));
+  CHECK(values.monitors(code("1.8.1")));
+  CHECK(!values.monitors(code("1.8.1*01")));
+  CHECK(!values.monitors(code("2.8.0")));
+
+  CHECK(values.store(code("1.8.0"), "1.8.0", 5, "012345.678*kWh"));
+  CHECK(values.store(code("1.7.0"), "1.7.0", 5, "00.350*kW"));
+  CHECK(values.store(code("1.8.0"), "1.8.0", 5, "012345.679*kWh"));
+  CHECK(values.size() == 2);
+  CHECK(values.value("1.8.0") != NULL && strcmp(values.value("1.8.0"), "012345.679*kWh") == 0);
+  CHECK(values.value("1.8.1") == NULL);
+
+  CHECK(values.remove("1.7.0"));
+  CHECK(!values.remove("1.7.0"));
+  CHECK(values.size() == 1 && values.value("1.7.0") == NULL);
+
+  for (size_t i = 0; i < MAX_OBIS_VALUES; i++) {
+    char obis[16];
+    snprintf(obis, sizeof(obis), "1.8.%u", (unsigned) i + 1);
+    values.store(code(obis), obis, strlen(obis), "1");
+  }
+  CHECK(values.size() == MAX_OBIS_VALUES);
+  CHECK(!values.store(code("1.8.99"), "1.8.99", 6, "1"));
+}
+
+static void test_load_profile() {
+  CHECK(parse_load_profile_timestamp("0240101001500") == load_profile_minutes(2024, 1, 1, 0, 15));
+  CHECK(parse_load_profile_timestamp("02401010015") != 0);
+  CHECK(parse_load_profile_timestamp("0241301001500") == 0);
+  CHECK(parse_load_profile_timestamp("024010") == 0);
+  char formatted[LOAD_PROFILE_TIMESTAMP_LENGTH];
+  format_load_profile_timestamp(load_profile_minutes(2024, 2, 29, 23, 45), '1', formatted);
+  CHECK(strcmp(formatted, "12402292345") == 0);
+
+  LoadProfile profile;
+  profile.clear();
+  CHECK(profile.parse_line("P.01(0240101001500)(00)(15)(2)(1.5)(kW)(2.5)(kW)(0.120)(0.000)"));
+  CHECK(profile.parse_line("(0.240)(0.010)"));
+  CHECK(profile.interval() == 15 && profile.channels() == 2 && profile.season() == '0');
+  CHECK(profile.size() == 2);
+  CHECK(profile.entry(0).timestamp == load_profile_minutes(2024, 1, 1, 0, 15));
+  CHECK(profile.entry(0).values[0] == 120 && profile.entry(0).values[1] == 0);
+  CHECK(profile.entry(1).timestamp == profile.entry(0).timestamp + 15);
+  CHECK(profile.entry(1).values[0] == 240 && profile.entry(1).values[1] == 10);
+
+  /* an unterminated field is dropped, the line doesn't end the readout */
+  CHECK(profile.parse_line("(0.300)(0.0"));
+  CHECK(profile.size() == 2);
+}
+
+int main() {
+  test_obis_codes();
+  test_obis_matching();
+  test_fixed_point();
+  test_obis_values();
+  test_load_profile();
+  return check_result("parsers");
+}
@@ -0,0 +1,106 @@
+/* The warm-up of the optical head from the first-response latency */
+
+#include "power.h"
+#include "check.h"
+#include "stubs.h"
+
+static unsigned long const REACTION = 200;
+
+static void test_in_time() {
+  PowerSequencer sequencer;
+  CHECK(sequencer.head_warm_up() == MIN_HEAD_WARM_UP_TIME);
+  for (int i = 0; i < 10; i++) {
+    sequencer.learn(REACTION + i % 3);
+  }
+  CHECK(sequencer.head_warm_up() == MIN_HEAD_WARM_UP_TIME);
+}
+
+static void test_late_answer() {
+  PowerSequencer sequencer;
+  sequencer.learn(REACTION);
+  /* the head settled 80 ms after the meter would have answered */
+  sequencer.learn(REACTION + 80);
+  uint16_t warmUp = sequencer.head_warm_up();
+  CHECK(warmUp >= MIN_HEAD_WARM_UP_TIME + 80 && warmUp <= MIN_HEAD_WARM_UP_TIME + 80 + 20);
+  /* in time with it, it stays */
+  for (int i = 0; i < 10; i++) {
+    sequencer.learn(REACTION);
+  }
+  CHECK(sequencer.head_warm_up() == warmUp);
+  /* a head that takes ever longer doesn't exceed the maximum */
+  for (int i = 0; i < 10; i++) {
+    sequencer.learn(REACTION + 200);
+  }
+  CHECK(sequencer.head_warm_up() == MAX_HEAD_WARM_UP_TIME);
+}
+
+static void test_unanswered() {
+  PowerSequencer sequencer;
+  sequencer.learn(REACTION);
+  sequencer.learn(0);
+  CHECK(sequencer.head_warm_up() == HEAD_WARM_UP_TIME);
+  sequencer.learn(0);
+  CHECK(sequencer.head_warm_up() == 2 * HEAD_WARM_UP_TIME);
+  for (int i = 0; i < 10; i++) {
+    sequencer.learn(0);
+  }
+  CHECK(sequencer.head_warm_up() == MAX_HEAD_WARM_UP_TIME);
+  /* the meter answers in time again, back to the measured warm-up */
+  for (int i = 0; i < 30; i++) {
+    sequencer.learn(REACTION);
+  }
+  CHECK(sequencer.head_warm_up() == MIN_HEAD_WARM_UP_TIME);
+}
+
+/* A head whose LED needs the warm-up before the request, the meter doesn't answer earlier */
+static void test_unanswered_head() {
+  PowerSequencer sequencer;
+  uint16_t const needed = 120;
+  size_t unanswered = 0;
+  for (int i = 0; i < 40; i++) {
+    if (sequencer.head_warm_up() < needed) {
+      unanswered++;
+      sequencer.learn(0);
+    } else {
+      sequencer.learn(REACTION);
+    }
+  }
+  CHECK(sequencer.head_warm_up() >= needed && sequencer.head_warm_up() <= 2 * needed);
+  /* once settled, no more requests go unanswered */
+  size_t settled = unanswered;
+  for (int i = 0; i < 40; i++) {
+    if (sequencer.head_warm_up() < needed) {
+      unanswered++;
+      sequencer.learn(0);
+    } else {
+      sequencer.learn(REACTION);
+    }
+  }
+  CHECK(unanswered == settled);
+}
+
+static void test_wait_for_head() {
+  PowerSequencer sequencer;
+  sequencer.begin();
+  sequencer.learn(REACTION);
+  sequencer.learn(REACTION + 100);
+  uint16_t warmUp = sequencer.head_warm_up();
+  stubs::now = 1000;
+  sequencer.head_on();
+  /* the battery measurement counts towards the warm-up */
+  stubs::now += 30;
+  sequencer.wait_for_head();
+  CHECK(stubs::now == 1000 + warmUp);
+  sequencer.head_off();
+  CHECK(sequencer.take_on_time() == warmUp);
+  CHECK(sequencer.take_on_time() == 0);
+}
+
+int main() {
+  test_in_time();
+  test_late_answer();
+  test_unanswered();
+  test_unanswered_head();
+  test_wait_for_head();
+  return check_result("power");
+}
@@ -0,0 +1,113 @@
+/* The meter profiles and the timings the ProtocolTuner narrows down from them */
+
+#include <string.h>
+#include "profiles.h"
+#include "check.h"
+
+static void test_lookup() {
+  MeterProfile const *profile = find_meter_profile("/ELS5\\@V10.04");
+  CHECK(profile != NULL && strcmp(profile->manufacturer, "ELS") == 0);
+  profile = find_meter_profile("/LGZ4ZMF100AC.M26");
+  CHECK(profile != NULL && strcmp(profile->manufacturer, "LGZ") == 0);
+  CHECK(find_meter_profile("/ISk5MT174-0001") == NULL);
+  CHECK(find_meter_profile("/XYZ5METER") == NULL);
+  CHECK(find_meter_profile("ELS5\\@V10.04") == NULL);
+  CHECK(find_meter_profile("/EL") == NULL);
+
+  /* read with the wrong parity the parity bit ends up in bit 7 */
+  char const wrongParity[] = { '/', (char) ('E' | 0x80), 'L', (char) ('S' | 0x80), '5', 0 };
+  profile = find_meter_profile(wrongParity);
+  CHECK(profile != NULL && strcmp(profile->manufacturer, "ELS") == 0);
+}
+
+static void test_narrowing() {
+  MeterProfile const *els = find_meter_profile("/ELS5");
+  ProtocolTuner tuner;
+  tuner.reset(els);
+  CHECK(tuner.identification_timeout() == 1500);
+  CHECK(tuner.reading_timeout() == 500);
+  CHECK(tuner.baudrate_change_delay() == 500);
+
+  /* twice the observed time plus the margin, smoothed */
+  tuner.observe_first_response(200);
+  tuner.observe_line_gap(50);
+  tuner.finish(true, false);
+  CHECK(tuner.identification_timeout() == (3 * 1500 + 500) / 4);
+  CHECK(tuner.reading_timeout() == (3 * 500 + 200) / 4);
+  CHECK(tuner.baudrate_change_delay() == 450);
+  for (int i = 0; i < 50; i++) {
+    tuner.observe_first_response(200);
+    tuner.observe_line_gap(50);
+    tuner.finish(true, false);
+  }
+  CHECK(tuner.identification_timeout() >= 500 && tuner.identification_timeout() < 510);
+  CHECK(tuner.reading_timeout() >= 200 && tuner.reading_timeout() < 210);
+  CHECK(tuner.baudrate_change_delay() == 0);
+
+  /* never beyond the profile, however slow the meter */
+  tuner.reset(els);
+  tuner.observe_first_response(5000);
+  tuner.observe_line_gap(5000);
+  tuner.finish(true, false);
+  CHECK(tuner.identification_timeout() == 1500);
+  CHECK(tuner.reading_timeout() == 500);
+
+  /* a failure before the baud rate switch restores the identification timeout */
+  tuner.observe_first_response(100);
+  tuner.finish(true, false);
+  CHECK(tuner.identification_timeout() < 1500);
+  tuner.finish(false, false);
+  CHECK(tuner.identification_timeout() == 1500);
+
+  /* unknown meters keep the configured timings */
+  ProtocolTuner unknown;
+  unknown.reset(NULL);
+  unknown.finish(true, false);
+  CHECK(unknown.profile() == NULL);
+}
+
+/* Shortens the delay as far as it goes, returns the number of readouts it stayed put */
+static int readouts_until_shortened(ProtocolTuner &tuner) {
+  uint16_t delay = tuner.baudrate_change_delay();
+  int readouts = 0;
+  while (tuner.baudrate_change_delay() == delay && readouts < 1000) {
+    tuner.finish(true, false);
+    readouts++;
+  }
+  return readouts;
+}
+
+static void test_backoff() {
+  ProtocolTuner tuner;
+  tuner.reset(find_meter_profile("/ELS5"));
+  for (int i = 0; i < 4; i++) {
+    tuner.finish(true, false);
+  }
+  CHECK(tuner.baudrate_change_delay() == 300);
+
+  /* failed behind the switch: two steps back, kept for 24 readouts */
+  tuner.finish(false, true);
+  CHECK(tuner.baudrate_change_delay() == 400);
+  CHECK(readouts_until_shortened(tuner) == 25);
+  CHECK(tuner.baudrate_change_delay() == 350);
+
+  /* every further failure doubles the time it is kept */
+  tuner.finish(false, true);
+  CHECK(tuner.baudrate_change_delay() == 450);
+  CHECK(readouts_until_shortened(tuner) == 49);
+  tuner.finish(false, true);
+  CHECK(tuner.baudrate_change_delay() == 500);
+  CHECK(readouts_until_shortened(tuner) == 97);
+
+  /* never beyond the profile */
+  tuner.finish(false, true);
+  tuner.finish(false, true);
+  CHECK(tuner.baudrate_change_delay() == 500);
+}
+
+int main() {
+  test_lookup();
+  test_narrowing();
+  test_backoff();
+  return check_result("profiles");
+}
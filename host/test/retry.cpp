@@ -0,0 +1,57 @@
+/* The retry delays per error class, and the normal interval once the budget is used up */
+
+#include "retry.h"
+#include "check.h"
+#include "stubs.h"
+
+static uint32_t const SLEEP_TIME = 1200000;
+
+static void test_delays_grow_up_to_max() {
+  RetryState state = {};
+  RetryScheduler scheduler(state);
+  /* MeterNoise: 30 s, then 200% per failure up to 600 s */
+  CHECK(scheduler.next_delay(MeterNoise, SLEEP_TIME) == 30000);
+  CHECK(scheduler.next_delay(MeterNoise, SLEEP_TIME) == 60000);
+  CHECK(scheduler.next_delay(MeterNoise, SLEEP_TIME) == 120000);
+  CHECK(scheduler.next_delay(MeterNoise, SLEEP_TIME) == 240000);
+  CHECK(scheduler.next_delay(MeterNoise, SLEEP_TIME) == 480000);
+  CHECK(scheduler.next_delay(MeterNoise, SLEEP_TIME) == 600000);
+  CHECK(scheduler.failures() == 6);
+
+  /* another class starts over */
+  CHECK(scheduler.next_delay(MeterSilent, SLEEP_TIME) == 10000);
+  CHECK(scheduler.failures() == 1);
+
+  /* never longer than the normal interval */
+  scheduler.succeeded();
+  CHECK(scheduler.next_delay(MeterBusy, 60000) == 60000);
+}
+
+static void test_budget_used_up() {
+  RetryClass const classes[] = { MeterNoise, MeterSilent, MeterBusy, RadioFailure };
+  for (RetryClass retryClass : classes) {
+    RetryState state = {};
+    RetryScheduler scheduler(state);
+    uint8_t budget = retry_policy(retryClass).budget;
+    for (uint8_t i = 0; i < budget; i++) {
+      CHECK(scheduler.next_delay(retryClass, SLEEP_TIME) <= SLEEP_TIME);
+    }
+    /* the sleep time, not maxDelay, as long as the failures go on */
+    for (uint8_t i = 0; i < 20; i++) {
+      CHECK(scheduler.next_delay(retryClass, SLEEP_TIME) == SLEEP_TIME);
+    }
+    /* also a sleep time set by downlink */
+    CHECK(scheduler.next_delay(retryClass, 3600000) == 3600000);
+  }
+
+  /* the wrong meter doesn't change, the normal interval right away */
+  RetryState state = {};
+  RetryScheduler scheduler(state);
+  CHECK(scheduler.next_delay(WrongMeter, SLEEP_TIME) == SLEEP_TIME);
+}
+
+int main() {
+  test_delays_grow_up_to_max();
+  test_budget_used_up();
+  return check_result("retry");
+}
@@ -0,0 +1,108 @@
+/* The settings of the CubeCell in flash: downlinks, the pending slot and the serial discovery */
+
+#include "settings.h"
+#include "EEPROM.h"
+#include "check.h"
+#include "stubs.h"
+
+static uint32_t const SLEEP_TIME = 900000;
+
+static void restart() {
+  EEPROM.begin(EEPROM_SIZE);
+  settings::begin(SLEEP_TIME);
+}
+
+static void test_defaults() {
+  stubs::erase_eeprom();
+  restart();
+  Settings const &current = settings::current();
+  CHECK(current.sleepTime == SLEEP_TIME);
+  CHECK(current.meter.parity == PARITY_SETTING);
+  CHECK(current.meter.initialBaudRate == INITIAL_BAUD_RATE);
+  CHECK(strcmp(current.obisEnergy, OBIS_VALUE_TOTAL_ENERGY) == 0);
+  CHECK(!current.serialDiscovered);
+}
+
+static void test_downlinks() {
+  stubs::erase_eeprom();
+  restart();
+  uint8_t const sleep[] = { SetSleepTime, 2, 0x02, 0x58 };
+  CHECK(settings::handle_downlink(sleep, sizeof(sleep)));
+  /* only applied with the next wake */
+  CHECK(settings::current().sleepTime == SLEEP_TIME);
+  CHECK(settings::apply_pending());
+  CHECK(settings::current().sleepTime == 600000);
+  CHECK(!settings::apply_pending());
+
+  /* nothing of a downlink with an invalid command is taken over */
+  uint8_t const invalid[] = { SetSleepTime, 2, 0x01, 0x2C, SetObisEnergy, 3, '1', '.', 'x' };
+  CHECK(!settings::handle_downlink(invalid, sizeof(invalid)));
+  uint8_t const truncated[] = { SetSleepTime, 2, 0x01 };
+  CHECK(!settings::handle_downlink(truncated, sizeof(truncated)));
+  CHECK(!settings::apply_pending());
+
+  /* the active settings survive a reset */
+  restart();
+  CHECK(settings::current().sleepTime == 600000);
+}
+
+static MeterConfig discovered() {
+  MeterConfig meter = settings::current().meter;
+  meter.parity = SERIAL_8N1;
+  meter.initialBaudRate = 9600;
+  strcpy(meter.identifier, "LGZ");
+  return meter;
+}
+
+static void test_discovery_and_pending_downlink() {
+  stubs::erase_eeprom();
+  restart();
+  /* a downlink arrives before the discovery, e.g. with the uplink of the device time request */
+  uint8_t const sleep[] = { SetSleepTime, 2, 0x02, 0x58 };
+  CHECK(settings::handle_downlink(sleep, sizeof(sleep)));
+  settings::store_discovered(discovered());
+  CHECK(settings::current().meter.parity == SERIAL_8N1);
+
+  CHECK(settings::apply_pending());
+  Settings const &current = settings::current();
+  CHECK(current.sleepTime == 600000);
+  CHECK(current.meter.parity == SERIAL_8N1);
+  CHECK(current.meter.initialBaudRate == 9600);
+  CHECK(strcmp(current.meter.identifier, "LGZ") == 0);
+  CHECK(current.serialDiscovered);
+
+  restart();
+  CHECK(settings::current().meter.parity == SERIAL_8N1 && settings::current().serialDiscovered);
+}
+
+static void test_identifier_set_by_downlink_is_kept() {
+  stubs::erase_eeprom();
+  restart();
+  uint8_t const identifier[] = { SetMeterIdentifier, 3, 'E', 'M', 'H' };
+  CHECK(settings::handle_downlink(identifier, sizeof(identifier)));
+  settings::store_discovered(discovered());
+  CHECK(settings::apply_pending());
+  CHECK(strcmp(settings::current().meter.identifier, "EMH") == 0);
+  CHECK(settings::current().meter.parity == SERIAL_8N1);
+}
+
+static void test_reset() {
+  stubs::erase_eeprom();
+  restart();
+  settings::store_discovered(discovered());
+  uint8_t const reset[] = { ResetSettings, 0 };
+  CHECK(settings::handle_downlink(reset, sizeof(reset)));
+  CHECK(settings::apply_pending());
+  /* the discovery runs again */
+  CHECK(!settings::current().serialDiscovered);
+  CHECK(settings::current().meter.parity == PARITY_SETTING);
+}
+
+int main() {
+  test_defaults();
+  test_downlinks();
+  test_discovery_and_pending_downlink();
+  test_identifier_set_by_downlink_is_kept();
+  test_reset();
+  return check_result("settings");
+}
@@ -0,0 +1,138 @@
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "stubs.h"
+
+/* The Arduino core as far as the firmware sources of the tests use it: the serials go nowhere
+   and the clock only moves with delay() or the test */
+
+namespace stubs {
+
+unsigned long now = 0;
+size_t eepromCommits = 0;
+
+void erase_eeprom() {
+  EEPROM = EEPROMClass();
+}
+
+}
+
+unsigned long millis() {
+  return stubs::now;
+}
+
+unsigned long micros() {
+  return stubs::now * 1000;
+}
+
+void delay(unsigned long ms) {
+  stubs::now += ms;
+}
+
+void delayMicroseconds(unsigned int us) {
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+}
+
+/* The middle of the range, thus the jitter of the retries is 0 */
+long random(long max) {
+  return max / 2;
+}
+
+long random(long min, long max) {
+  return min + (max - min) / 2;
+}
+
+HardwareSerial Serial(1), Serial1(2), Serial2(3);
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config) {
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin, bool invert) {
+}
+
+void HardwareSerial::end() {
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud) {
+}
+
+void HardwareSerial::setTimeout(unsigned long timeout) {
+}
+
+int HardwareSerial::available() {
+  return 0;
+}
+
+int HardwareSerial::read() {
+  return -1;
+}
+
+int HardwareSerial::peek() {
+  return -1;
+}
+
+size_t HardwareSerial::readBytes(char *buffer, size_t length) {
+  return 0;
+}
+
+size_t HardwareSerial::readBytes(uint8_t *buffer, size_t length) {
+  return 0;
+}
+
+size_t HardwareSerial::readBytesUntil(char terminator, char *buffer, size_t length) {
+  return 0;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return 1;
+}
+
+size_t HardwareSerial::write(uint8_t const *data, size_t size) {
+  return size;
+}
+
+size_t HardwareSerial::write(char const *text) {
+  return strlen(text);
+}
+
+void HardwareSerial::flush() {
+}
+
+int HardwareSerial::printf(char const *fmt, ...) {
+  return 0;
+}
+
+size_t HardwareSerial::print(char const *text) {
+  return strlen(text);
+}
+
+size_t HardwareSerial::println(char const *text) {
+  return strlen(text) + 2;
+}
+
+EEPROMClass EEPROM;
+
+void EEPROMClass::begin(size_t size) {
+  if (!erased_) {
+    memset(data_, 0xFF, sizeof(data_));
+    erased_ = true;
+  }
+  size_ = size < sizeof(data_) ? size : sizeof(data_);
+}
+
+uint8_t EEPROMClass::read(int address) const {
+  return data_[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  data_[address] = value;
+}
+
+bool EEPROMClass::commit() {
+  stubs::eepromCommits++;
+  return true;
+}
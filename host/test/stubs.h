@@ -0,0 +1,20 @@
+#ifndef _STUBS_H
+#define _STUBS_H
+
+#include <stddef.h>
+
+/* What the tests see of the stand-ins in stubs.cpp */
+namespace stubs {
+
+/* millis() of the firmware, delay() moves it on */
+extern unsigned long now;
+
+/* EEPROM.commit() calls, i.e. flash rows written */
+extern size_t eepromCommits;
+
+/* Forgets the EEPROM content, as if the flash was erased */
+void erase_eeprom();
+
+}
+
+#endif
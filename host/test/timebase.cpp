@@ -0,0 +1,150 @@
+/* The wall time between syncs, the drift of the node clock and the wakes on the interval boundaries */
+
+#include "timebase.h"
+#include "check.h"
+
+static uint32_t const HOUR = 3600;
+static uint32_t const DAY = 24 * HOUR;
+/* 2024-01-01 00:00:00 */
+static uint32_t const WALL = 757382400;
+
+/* Node time after `wall` seconds of a node clock that runs `ppm` fast */
+static uint32_t node_after(uint32_t wall, int32_t ppm) {
+  return wall + (int32_t) ((int64_t) wall * ppm / 1000000);
+}
+
+static void test_drift_learning() {
+  TimeBaseState state = {};
+  TimeBase timeBase(state);
+  CHECK(!timeBase.valid());
+  CHECK(timeBase.now(100) == 0);
+  CHECK(timeBase.sync(WALL, 1000, MeterClock));
+  CHECK(timeBase.valid());
+  CHECK(timeBase.now(1000 + HOUR) == WALL + HOUR);
+
+  /* below the baseline of 6 h nothing is learned, the anchor stays */
+  CHECK(timeBase.sync(WALL + 2 * HOUR, 1000 + node_after(2 * HOUR, 200), MeterClock));
+  CHECK(state.driftSamples == 0);
+  CHECK(state.nodeAnchor == 1000);
+
+  /* 12 h since the anchor, the meter clock has a resolution of 1 s, i.e. 23 ppm */
+  CHECK(timeBase.sync(WALL + 12 * HOUR, 1000 + node_after(12 * HOUR, 200), MeterClock));
+  CHECK(state.driftSamples == 1);
+  CHECK(timeBase.drift_ppm() > 200 - 24 && timeBase.drift_ppm() < 200 + 24);
+  int32_t learned = timeBase.drift_ppm();
+  uint32_t wall = timeBase.now(1000 + node_after(24 * HOUR, 200));
+  /* 12 h later within the resolution, without the drift it would be 8 s off */
+  CHECK(wall + 2 >= WALL + 24 * HOUR && wall <= WALL + 24 * HOUR + 2);
+
+  /* more than 48 h between two syncs: the measurement starts over */
+  uint32_t node = 1000 + node_after(12 * HOUR + 3 * DAY, 200);
+  CHECK(timeBase.sync(WALL + 12 * HOUR + 3 * DAY, node, MeterClock));
+  CHECK(state.driftSamples == 1);
+  CHECK(timeBase.drift_ppm() == learned);
+  CHECK(state.nodeAnchor == node);
+
+  /* a clock that runs slow, the estimate follows */
+  for (uint32_t i = 1; i <= 16; i++) {
+    CHECK(timeBase.sync(WALL + 12 * HOUR + 3 * DAY + i * DAY, node + node_after(i * DAY, -300), MeterClock));
+  }
+  CHECK(state.driftSamples == 17);
+  CHECK(timeBase.drift_ppm() < -290 && timeBase.drift_ppm() > -310);
+}
+
+static void test_clock_jumps() {
+  TimeBaseState state = {};
+  TimeBase timeBase(state);
+  CHECK(timeBase.sync(WALL, 0, MeterClock));
+  CHECK(timeBase.sync(WALL + 12 * HOUR, node_after(12 * HOUR, 100), MeterClock));
+  int32_t learned = timeBase.drift_ppm();
+  CHECK(learned > 0);
+
+  /* daylight saving time, the meter clock jumps an hour ahead */
+  uint32_t node = node_after(24 * HOUR, 100);
+  CHECK(timeBase.sync(WALL + 25 * HOUR, node, MeterClock));
+  CHECK(timeBase.drift_ppm() == learned);
+  CHECK(state.driftSamples == 1);
+  CHECK(state.nodeAnchor == node);
+  CHECK(timeBase.now(node) == WALL + 25 * HOUR);
+
+  /* and back */
+  node = node_after(36 * HOUR, 100);
+  CHECK(timeBase.sync(WALL + 35 * HOUR, node, MeterClock));
+  CHECK(timeBase.drift_ppm() == learned);
+  CHECK(state.driftSamples == 1);
+
+  /* the next sync within one offset is learned again */
+  CHECK(timeBase.sync(WALL + 47 * HOUR, node_after(48 * HOUR, 100), MeterClock));
+  CHECK(state.driftSamples == 2);
+}
+
+static void test_sources() {
+  TimeBaseState state = {};
+  TimeBase timeBase(state);
+  CHECK(!timeBase.sync(0, 10, MeterClock));
+  CHECK(!timeBase.sync(WALL, 10, NoTimeSource));
+  CHECK(!timeBase.valid());
+
+  CHECK(timeBase.sync(WALL + HOUR, 10, NetworkTime));
+  CHECK(timeBase.source() == NetworkTime);
+  CHECK(timeBase.sync(WALL, 20, MeterClock));
+  CHECK(timeBase.source() == MeterClock);
+  /* the meter clock is fresh, the network time is ignored */
+  CHECK(!timeBase.sync(WALL + HOUR, 20 + HOUR, NetworkTime));
+  CHECK(timeBase.source() == MeterClock);
+  /* the meter doesn't send its clock any more */
+  CHECK(timeBase.sync(WALL + HOUR + DAY, 20 + DAY, NetworkTime));
+  CHECK(timeBase.source() == NetworkTime);
+  CHECK(state.driftSamples == 0);
+}
+
+static void test_boundary() {
+  TimeBaseState state = {};
+  TimeBase timeBase(state);
+  CHECK(timeBase.seconds_until_boundary(100, 900, 2, 225) == 225);
+
+  CHECK(timeBase.sync(WALL + 100, 5000, MeterClock));
+  CHECK(timeBase.seconds_until_boundary(5000, 900, 2, 225) == 798);
+  CHECK(timeBase.seconds_until_boundary(5000, 0, 2, 225) == 225);
+  /* too close to the next boundary, the one after */
+  CHECK(timeBase.seconds_until_boundary(5000 + 700, 900, 2, 225) == 998);
+  CHECK(timeBase.seconds_until_boundary(5000, DAY, 2, HOUR) == DAY - 102);
+
+  /* a node clock that runs fast has to sleep longer, a slow one shorter */
+  uint32_t const sleepWall = DAY - 102;
+  for (int32_t ppm = -400; ppm <= 400; ppm += 400) {
+    state.driftPpm = ppm;
+    uint32_t sleep = timeBase.seconds_until_boundary(5000, DAY, 2, HOUR);
+    CHECK(sleep == sleepWall + (int32_t) ((int64_t) sleepWall * ppm / 1000000));
+    /* the wake lands on the lead before the boundary */
+    uint32_t wake = timeBase.now(5000 + sleep);
+    CHECK(wake + 1 >= WALL + DAY - 2 && wake <= WALL + DAY - 2 + 1);
+  }
+  state.driftPpm = 400;
+  CHECK(timeBase.seconds_until_boundary(5000, DAY, 2, HOUR) > sleepWall);
+  state.driftPpm = -400;
+  CHECK(timeBase.seconds_until_boundary(5000, DAY, 2, HOUR) < sleepWall);
+}
+
+static void test_meter_clock() {
+  CHECK(meter_clock_seconds("240101", "00:00:00") == WALL);
+  CHECK(meter_clock_seconds("1240101", "001500") == WALL + 900);
+  CHECK(meter_clock_seconds("241301", "00:00:00") == 0);
+  CHECK(meter_minute_of_day("22:30:15") == 22 * 60 + 30);
+  CHECK(meter_minute_of_day("063000") == 6 * 60 + 30);
+  CHECK(meter_minute_of_day("0630") == 6 * 60 + 30);
+  CHECK(meter_minute_of_day("24:00:00") == -1);
+  CHECK(meter_minute_of_day("12:6") == -1);
+  /* bytes with bit 7 set, e.g. a misread, are no digits */
+  CHECK(meter_minute_of_day("\xB2\xB3:15:00") == 15 * 60);
+  CHECK(meter_minute_of_day(NULL) == -1);
+}
+
+int main() {
+  test_drift_learning();
+  test_clock_jumps();
+  test_sources();
+  test_boundary();
+  test_meter_clock();
+  return check_result("timebase");
+}
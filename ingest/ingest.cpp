@@ -0,0 +1,1406 @@
+/* Ingestion service for the uplinks of the iec62056-lora nodes.
+
+   Accepts TTN (v3) webhooks on a local HTTP endpoint, drops the duplicates of uplinks
+   received by several gateways (DevEUI + frame counter), decodes the payload formats
+   of the firmware (ports 2, 3, 5, 6 and 8), keeps energy rollups per meter and forwards the
+   results as JSON lines in batches to a local sink (TCP, file or stdout). The fragments of
+   diagnostic captures (port 7) are reassembled into the raw telegram.
+
+     ingest --port 8080 --sink 127.0.0.1:9000 --telegrams corpus
+     ingest --bench 200000
+
+   See the readme in the root of the repository for the build command and the output format. */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+size_t const MAX_BODY_SIZE = 64 * 1024;
+size_t const DEDUP_WINDOW = 16;           /* frame counters remembered per device */
+long long const DEDUP_MAX_AGE_MS = 120000;  /* the copies of the gateways arrive within seconds, a retried webhook within a minute */
+size_t const MAX_PENDING_LINES = 100000;  /* kept while the sink is unavailable, then the oldest are dropped */
+
+size_t const MAX_OPEN_CAPTURES = 1000;             /* diagnostic captures waiting for fragments, then the oldest is dropped */
+long long const CAPTURE_TIMEOUT_MS = 2 * 86400000LL;  /* a capture that isn't complete by then never will be */
+
+/* Sent instead of the energy register when the readout didn't contain it (ESP32, ports 2 and 5) */
+uint32_t const ENERGY_UNKNOWN = 0xFFFFFFFF;
+
+/* Minutes since 2000-01-01 as used by the load profile uplinks, 2000-01-01 in days since 1970-01-01 */
+int64_t const EPOCH_2000_DAYS = 10957;
+
+long long now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**********
+ * JSON
+ **********/
+
+/* What is needed of a webhook. Besides TTN v3 (end_device_ids.dev_eui, uplink_message.f_port,
+   f_cnt, frm_payload) the flat form with payload_hex is accepted, the keys are matched by name. */
+struct Uplink {
+  std::string devEui;
+  std::string receivedAt;
+  uint32_t fCnt = 0;
+  bool hasFCnt = false;
+  int port = -1;
+  std::vector<uint8_t> payload;
+  bool hasPayload = false;
+};
+
+int base64_value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+' || c == '-') return 62;
+  if (c == '/' || c == '_') return 63;
+  return -1;
+}
+
+bool decode_base64(std::string const &text, std::vector<uint8_t> &out) {
+  out.clear();
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : text) {
+    if (c == '=') {
+      break;
+    }
+    int value = base64_value(c);
+    if (value < 0) {
+      return false;
+    }
+    bits = (bits << 6) | value;
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out.push_back((bits >> count) & 0xFF);
+    }
+  }
+  return true;
+}
+
+bool decode_hex(std::string const &text, std::vector<uint8_t> &out) {
+  out.clear();
+  if (text.size() % 2 != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < text.size(); i += 2) {
+    char pair[3] = { text[i], text[i + 1], 0 };
+    char *end;
+    unsigned long value = strtoul(pair, &end, 16);
+    if (*end != 0) {
+      return false;
+    }
+    out.push_back(value);
+  }
+  return true;
+}
+
+/* 16 hex digits, anything else is no DevEUI and must not end up in a file name */
+bool valid_dev_eui(std::string const &devEui) {
+  if (devEui.size() != 16) {
+    return false;
+  }
+  for (char c : devEui) {
+    if (!isxdigit((unsigned char) c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Recursive descent over the whole document, scalars are handed to the uplink by the name of their key */
+class JsonScanner {
+  public:
+    JsonScanner(const char *text, size_t len, Uplink &uplink): pos_(text), end_(text + len), uplink_(uplink) {
+    }
+
+    bool scan() {
+      skip_space();
+      if (!value("", 0)) {
+        return false;
+      }
+      skip_space();
+      return pos_ == end_;
+    }
+
+  private:
+    static int const MAX_DEPTH = 32;
+
+    void skip_space() {
+      while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\r' || *pos_ == '\n')) {
+        pos_++;
+      }
+    }
+
+    bool string(std::string &out) {
+      if (pos_ >= end_ || *pos_ != '"') {
+        return false;
+      }
+      pos_++;
+      out.clear();
+      while (pos_ < end_ && *pos_ != '"') {
+        char c = *pos_++;
+        if (c != '\\') {
+          out += c;
+          continue;
+        }
+        if (pos_ >= end_) {
+          return false;
+        }
+        char escaped = *pos_++;
+        switch (escaped) {
+          case 'n': out += '\n'; break;
+          case 't': out += '\t'; break;
+          case 'r': out += '\r'; break;
+          case 'b': out += '\b'; break;
+          case 'f': out += '\f'; break;
+          case 'u':
+            /* none of the fields used contains other than ASCII */
+            if (end_ - pos_ < 4) {
+              return false;
+            }
+            pos_ += 4;
+            out += '?';
+            break;
+          default: out += escaped; break;
+        }
+      }
+      if (pos_ >= end_) {
+        return false;
+      }
+      pos_++;
+      return true;
+    }
+
+    bool value(std::string const &key, int depth) {
+      if (depth > MAX_DEPTH || pos_ >= end_) {
+        return false;
+      }
+      if (*pos_ == '{') {
+        return object(depth + 1);
+      }
+      if (*pos_ == '[') {
+        return array(depth + 1);
+      }
+      if (*pos_ == '"') {
+        std::string text;
+        if (!string(text)) {
+          return false;
+        }
+        scalar(key, text, true);
+        return true;
+      }
+      const char *start = pos_;
+      while (pos_ < end_ && (isalnum(*pos_) || *pos_ == '-' || *pos_ == '+' || *pos_ == '.')) {
+        pos_++;
+      }
+      if (pos_ == start) {
+        return false;
+      }
+      scalar(key, std::string(start, pos_), false);
+      return true;
+    }
+
+    bool object(int depth) {
+      pos_++;
+      skip_space();
+      if (pos_ < end_ && *pos_ == '}') {
+        pos_++;
+        return true;
+      }
+      std::string key;
+      while (true) {
+        skip_space();
+        if (!string(key)) {
+          return false;
+        }
+        skip_space();
+        if (pos_ >= end_ || *pos_++ != ':') {
+          return false;
+        }
+        skip_space();
+        if (!value(key, depth)) {
+          return false;
+        }
+        skip_space();
+        if (pos_ >= end_) {
+          return false;
+        }
+        if (*pos_ == '}') {
+          pos_++;
+          return true;
+        }
+        if (*pos_++ != ',') {
+          return false;
+        }
+      }
+    }
+
+    bool array(int depth) {
+      pos_++;
+      skip_space();
+      if (pos_ < end_ && *pos_ == ']') {
+        pos_++;
+        return true;
+      }
+      while (true) {
+        skip_space();
+        /* the metadata of every gateway is in an array, its keys must not override the uplink's */
+        if (!value("", depth)) {
+          return false;
+        }
+        skip_space();
+        if (pos_ >= end_) {
+          return false;
+        }
+        if (*pos_ == ']') {
+          pos_++;
+          return true;
+        }
+        if (*pos_++ != ',') {
+          return false;
+        }
+      }
+    }
+
+    void scalar(std::string const &key, std::string const &text, bool quoted) {
+      if (key.empty()) {
+        return;
+      }
+      if ((key == "dev_eui" || key == "devEUI" || key == "devEui") && uplink_.devEui.empty()) {
+        uplink_.devEui = text;
+        for (char &c : uplink_.devEui) {
+          c = toupper((unsigned char) c);
+        }
+      } else if (key == "f_cnt" || key == "fCnt" || key == "fcnt") {
+        uplink_.fCnt = strtoul(text.c_str(), NULL, 10);
+        uplink_.hasFCnt = true;
+      } else if (key == "f_port" || key == "fPort" || key == "port") {
+        uplink_.port = atoi(text.c_str());
+      } else if ((key == "frm_payload" || key == "data") && quoted && !uplink_.hasPayload) {
+        uplink_.hasPayload = decode_base64(text, uplink_.payload);
+      } else if (key == "payload_hex" && quoted) {
+        uplink_.hasPayload = decode_hex(text, uplink_.payload);
+      } else if (key == "received_at" && uplink_.receivedAt.empty()) {
+        uplink_.receivedAt = text;
+      }
+    }
+
+    const char *pos_;
+    const char *end_;
+    Uplink &uplink_;
+};
+
+/**********
+ * DEDUPLICATION
+ **********/
+
+/* Every gateway that received an uplink delivers it, TTN merges them but other network
+   servers and several integrations don't. Frame counters restart after a rejoin, thus only
+   the last few are remembered and only for as long as copies still arrive. */
+class Deduplicator {
+  public:
+    /* Returns true if the uplink was already seen */
+    bool seen(std::string const &devEui, uint32_t fCnt, long long now) {
+      Window &window = devices_[devEui];
+      for (size_t i = 0; i < window.count; i++) {
+        if (window.fCnts[i] == fCnt && now - window.times[i] <= DEDUP_MAX_AGE_MS) {
+          return true;
+        }
+      }
+      window.fCnts[window.next] = fCnt;
+      window.times[window.next] = now;
+      window.next = (window.next + 1) % DEDUP_WINDOW;
+      if (window.count < DEDUP_WINDOW) {
+        window.count++;
+      }
+      return false;
+    }
+
+    size_t devices() const {
+      return devices_.size();
+    }
+
+  private:
+    struct Window {
+      uint32_t fCnts[DEDUP_WINDOW];
+      long long times[DEDUP_WINDOW];
+      size_t count = 0, next = 0;
+    };
+    std::unordered_map<std::string, Window> devices_;
+};
+
+/**********
+ * ROLLUPS
+ **********/
+
+/* Per meter: consumption of the current and the previous day from the energy register,
+   and the sum of the load profile intervals per day */
+struct MeterRollup {
+  std::string day;              /* YYYY-MM-DD of the readings below */
+  int64_t firstEnergy = -1;     /* [kWh/100] first reading ever seen */
+  int64_t dayStartEnergy = -1;  /* [kWh/100] first reading of the day */
+  int64_t lastEnergy = -1;      /* [kWh/100] */
+  int64_t previousDay = -1;     /* [kWh/100] consumption of the previous day, -1 = unknown */
+  uint32_t readings = 0;
+  uint16_t lastPower = 0, peakPower = 0;  /* [W] peak of the day */
+  std::string profileDay;
+  uint64_t profileWh = 0;       /* load profile of profileDay, channel 1 [Wh] */
+};
+
+class Rollups {
+  public:
+    MeterRollup const &add_reading(std::string const &meter, std::string const &day, int64_t energy, uint16_t power) {
+      MeterRollup &rollup = meters_[meter];
+      if (rollup.day != day) {
+        if (!rollup.day.empty() && rollup.dayStartEnergy >= 0 && rollup.lastEnergy >= rollup.dayStartEnergy) {
+          rollup.previousDay = rollup.lastEnergy - rollup.dayStartEnergy;
+        }
+        rollup.day = day;
+        rollup.dayStartEnergy = rollup.lastEnergy;
+        rollup.peakPower = 0;
+      }
+      if (energy > 0) {
+        if (rollup.lastEnergy >= 0 && energy < rollup.lastEnergy) {
+          /* register went backwards: meter replaced, start over */
+          rollup.firstEnergy = -1;
+          rollup.dayStartEnergy = -1;
+        }
+        if (rollup.firstEnergy < 0) {
+          rollup.firstEnergy = energy;
+        }
+        if (rollup.dayStartEnergy < 0) {
+          rollup.dayStartEnergy = energy;
+        }
+        rollup.lastEnergy = energy;
+      }
+      rollup.lastPower = power;
+      if (power > rollup.peakPower) {
+        rollup.peakPower = power;
+      }
+      rollup.readings++;
+      return rollup;
+    }
+
+    MeterRollup const &add_profile(std::string const &meter, std::string const &day, uint32_t wh) {
+      MeterRollup &rollup = meters_[meter];
+      if (rollup.profileDay != day) {
+        rollup.profileDay = day;
+        rollup.profileWh = 0;
+      }
+      rollup.profileWh += wh;
+      return rollup;
+    }
+
+    size_t size() const {
+      return meters_.size();
+    }
+
+  private:
+    std::unordered_map<std::string, MeterRollup> meters_;
+};
+
+/**********
+ * SINK
+ **********/
+
+/* Collects JSON lines and writes them in batches: to a TCP endpoint (host:port), a file or stdout (-) */
+class BatchSink {
+  public:
+    BatchSink(std::string const &target, size_t batchSize, long long flushMs): target_(target), batchSize_(batchSize), flushMs_(flushMs) {
+    }
+
+    ~BatchSink() {
+      flush();
+      if (fd_ > 2) {
+        close(fd_);
+      }
+    }
+
+    void add(std::string const &line) {
+      if (lines_ == 0) {
+        firstLineTime_ = now_ms();
+      }
+      if (lines_ >= MAX_PENDING_LINES) {
+        /* the sink is gone for a while, keep the newest */
+        size_t drop = buffer_.find('\n');
+        buffer_.erase(0, drop + 1);
+        lines_--;
+        dropped_++;
+      }
+      buffer_ += line;
+      buffer_ += '\n';
+      lines_++;
+      if (lines_ >= batchSize_) {
+        flush();
+      }
+    }
+
+    /* Flushes a batch that waited long enough */
+    void tick() {
+      if (lines_ > 0 && now_ms() - firstLineTime_ >= flushMs_) {
+        flush();
+      }
+    }
+
+    void flush() {
+      if (lines_ == 0 || !open_sink()) {
+        return;
+      }
+      size_t written = 0;
+      while (written < buffer_.size()) {
+        ssize_t n = write(fd_, buffer_.data() + written, buffer_.size() - written);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          fprintf(stderr, "sink: %s, retrying with the next batch\n", strerror(errno));
+          close(fd_);
+          fd_ = -1;
+          /* lines may be cut, resend the whole batch */
+          return;
+        }
+        written += n;
+      }
+      batches_++;
+      buffer_.clear();
+      lines_ = 0;
+    }
+
+    uint64_t batches() const {
+      return batches_;
+    }
+
+    uint64_t dropped() const {
+      return dropped_;
+    }
+
+  private:
+    bool open_sink() {
+      if (fd_ >= 0) {
+        return true;
+      }
+      if (target_ == "-") {
+        fd_ = STDOUT_FILENO;
+        return true;
+      }
+      size_t colon = target_.rfind(':');
+      if (colon != std::string::npos && target_.find('/') == std::string::npos) {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(target_.c_str() + colon + 1));
+        if (inet_pton(AF_INET, target_.substr(0, colon).c_str(), &addr.sin_addr) != 1) {
+          fprintf(stderr, "sink: invalid address %s\n", target_.c_str());
+          return false;
+        }
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd_ >= 0 && connect(fd_, (sockaddr *) &addr, sizeof(addr)) != 0) {
+          fprintf(stderr, "sink: cannot connect to %s: %s\n", target_.c_str(), strerror(errno));
+          close(fd_);
+          fd_ = -1;
+        }
+      } else {
+        fd_ = open(target_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd_ < 0) {
+          fprintf(stderr, "sink: cannot open %s: %s\n", target_.c_str(), strerror(errno));
+        }
+      }
+      return fd_ >= 0;
+    }
+
+    std::string target_;
+    size_t batchSize_;
+    long long flushMs_;
+    int fd_ = -1;
+    std::string buffer_;
+    size_t lines_ = 0;
+    long long firstLineTime_ = 0;
+    uint64_t batches_ = 0, dropped_ = 0;
+};
+
+/**********
+ * DECODING
+ **********/
+
+uint16_t u16(std::vector<uint8_t> const &p, size_t i) {
+  return (p[i] << 8) | p[i + 1];
+}
+
+uint32_t u32(std::vector<uint8_t> const &p, size_t i) {
+  return ((uint32_t) p[i] << 24) | ((uint32_t) p[i + 1] << 16) | ((uint32_t) p[i + 2] << 8) | p[i + 3];
+}
+
+/* Small JSON writer for the flat output records */
+class Record {
+  public:
+    Record &field(const char *key, std::string const &value) {
+      separator(key);
+      text_ += '"';
+      for (char c : value) {
+        if (c == '"' || c == '\\') {
+          text_ += '\\';
+        }
+        if ((uint8_t) c >= 0x20) {
+          text_ += c;
+        }
+      }
+      text_ += '"';
+      return *this;
+    }
+
+    Record &field(const char *key, long long value) {
+      char number[24];
+      snprintf(number, sizeof(number), "%lld", value);
+      separator(key);
+      text_ += number;
+      return *this;
+    }
+
+    /* Hundredths as decimal, e.g. kWh/100 -> kWh */
+    Record &hundredths(const char *key, long long value) {
+      char number[32];
+      snprintf(number, sizeof(number), "%s%lld.%02lld", value < 0 ? "-" : "", llabs(value) / 100, llabs(value) % 100);
+      separator(key);
+      text_ += number;
+      return *this;
+    }
+
+    std::string str() const {
+      return text_ + "}";
+    }
+
+  private:
+    void separator(const char *key) {
+      text_ += text_.empty() ? "{\"" : ",\"";
+      text_ += key;
+      text_ += "\":";
+    }
+
+    std::string text_;
+};
+
+/**********
+ * DIAGNOSTIC CAPTURES
+ **********/
+
+/* Same as the firmware, see heltec-cubecell/diagnostic.h */
+uint8_t const LZSS_OFFSET_BITS = 8;
+uint8_t const LZSS_LENGTH_BITS = 4;
+uint8_t const LZSS_MIN_MATCH = 2;
+uint8_t const DIAGNOSTIC_LAST_FRAGMENT = 0x80;
+size_t const DIAGNOSTIC_FRAGMENT_HEADER_SIZE = 2;
+size_t const DIAGNOSTIC_FIRST_HEADER_SIZE = 4;
+
+uint16_t crc16(std::vector<uint8_t> const &data) {
+  uint16_t crc = 0xFFFF;
+  for (uint8_t byte : data) {
+    crc ^= (uint16_t) byte << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+class BitReader {
+  public:
+    explicit BitReader(std::vector<uint8_t> const &data): data_(data) {
+    }
+
+    bool read(uint8_t count, uint32_t &value) {
+      value = 0;
+      for (uint8_t i = 0; i < count; i++, position_++) {
+        if (position_ / 8 >= data_.size()) {
+          return false;
+        }
+        value = (value << 1) | ((data_[position_ / 8] >> (7 - position_ % 8)) & 1);
+      }
+      return true;
+    }
+
+  private:
+    std::vector<uint8_t> const &data_;
+    size_t position_ = 0;
+};
+
+bool lzss_decode(std::vector<uint8_t> const &bits, size_t length, std::vector<uint8_t> &out) {
+  BitReader reader(bits);
+  out.clear();
+  while (out.size() < length) {
+    uint32_t literal, value, offset, count;
+    if (!reader.read(1, literal)) {
+      return false;
+    }
+    if (literal) {
+      if (!reader.read(8, value)) {
+        return false;
+      }
+      out.push_back(value);
+      continue;
+    }
+    if (!reader.read(LZSS_OFFSET_BITS, offset) || !reader.read(LZSS_LENGTH_BITS, count) || offset + 1 > out.size()) {
+      return false;
+    }
+    /* byte by byte, the match may overlap the bytes it produces */
+    for (uint32_t i = 0; i < count + LZSS_MIN_MATCH && out.size() < length; i++) {
+      out.push_back(out[out.size() - offset - 1]);
+    }
+  }
+  return true;
+}
+
+/* Collects the fragments of the captures per node until the last one and all before it arrived.
+   Fragment: <capture id> <index | 0x80 on the last> [<raw length> <crc16>] <LZSS bits>, the raw
+   length and CRC only in the first fragment. The bits run on across the fragments. */
+class Reassembler {
+  public:
+    enum Result {
+      Incomplete,
+      Complete,
+      Corrupt,
+    };
+
+    Result add(std::string const &devEui, std::vector<uint8_t> const &p, std::vector<uint8_t> &telegram, size_t &fragments) {
+      if (p.size() < DIAGNOSTIC_FRAGMENT_HEADER_SIZE) {
+        return Corrupt;
+      }
+      expire();
+      std::string key = devEui + "/" + std::to_string(p[0]);
+      Capture &capture = captures_[key];
+      if (capture.fragments.empty()) {
+        capture.started = now_ms();
+      }
+      size_t index = p[1] & ~DIAGNOSTIC_LAST_FRAGMENT;
+      if (index >= capture.fragments.size()) {
+        capture.fragments.resize(index + 1);
+        capture.received.resize(index + 1, false);
+      }
+      capture.fragments[index].assign(p.begin() + DIAGNOSTIC_FRAGMENT_HEADER_SIZE, p.end());
+      capture.received[index] = true;
+      if (p[1] & DIAGNOSTIC_LAST_FRAGMENT) {
+        capture.last = index;
+      }
+      if (capture.last < 0 || capture.fragments.size() != (size_t) capture.last + 1) {
+        return Incomplete;
+      }
+      for (bool received : capture.received) {
+        if (!received) {
+          return Incomplete;
+        }
+      }
+
+      fragments = capture.fragments.size();
+      Result result = assemble(capture, telegram) ? Complete : Corrupt;
+      captures_.erase(key);
+      return result;
+    }
+
+  private:
+    struct Capture {
+      std::vector<std::vector<uint8_t>> fragments;
+      std::vector<bool> received;
+      int last = -1;
+      long long started = 0;
+    };
+
+    bool assemble(Capture const &capture, std::vector<uint8_t> &telegram) const {
+      std::vector<uint8_t> const &first = capture.fragments[0];
+      if (first.size() < DIAGNOSTIC_FIRST_HEADER_SIZE) {
+        return false;
+      }
+      size_t length = u16(first, 0);
+      uint16_t crc = u16(first, 2);
+      std::vector<uint8_t> bits(first.begin() + DIAGNOSTIC_FIRST_HEADER_SIZE, first.end());
+      for (size_t i = 1; i < capture.fragments.size(); i++) {
+        bits.insert(bits.end(), capture.fragments[i].begin(), capture.fragments[i].end());
+      }
+      return lzss_decode(bits, length, telegram) && crc16(telegram) == crc;
+    }
+
+    void expire() {
+      long long now = now_ms();
+      auto oldest = captures_.end();
+      for (auto it = captures_.begin(); it != captures_.end();) {
+        if (now - it->second.started > CAPTURE_TIMEOUT_MS) {
+          it = captures_.erase(it);
+          continue;
+        }
+        if (oldest == captures_.end() || it->second.started < oldest->second.started) {
+          oldest = it;
+        }
+        ++it;
+      }
+      if (captures_.size() >= MAX_OPEN_CAPTURES && oldest != captures_.end()) {
+        captures_.erase(oldest);
+      }
+    }
+
+    std::unordered_map<std::string, Capture> captures_;
+};
+
+std::string utc_day(time_t seconds) {
+  struct tm tm;
+  gmtime_r(&seconds, &tm);
+  char day[16];
+  strftime(day, sizeof(day), "%Y-%m-%d", &tm);
+  return day;
+}
+
+/* Day of the load profile timestamp (minutes since 2000-01-01, meter time) */
+std::string profile_day(uint32_t minutes) {
+  return utc_day((time_t) (EPOCH_2000_DAYS * 86400 + (int64_t) minutes * 60));
+}
+
+class Ingest {
+  public:
+    Ingest(BatchSink &sink, std::string const &telegramDir): sink_(sink), telegramDir_(telegramDir) {
+    }
+
+    /* Returns the HTTP status for the webhook */
+    int handle(const char *body, size_t len) {
+      received_++;
+      Uplink uplink;
+      JsonScanner scanner(body, len, uplink);
+      if (!scanner.scan() || !valid_dev_eui(uplink.devEui)) {
+        malformed_++;
+        return 400;
+      }
+      if (!uplink.hasPayload || uplink.port <= 0) {
+        /* join accepts, MAC only uplinks and the like */
+        ignored_++;
+        return 202;
+      }
+      if (uplink.hasFCnt && dedup_.seen(uplink.devEui, uplink.fCnt, now_ms())) {
+        duplicates_++;
+        return 200;
+      }
+      day_ = day_of(uplink);
+      if (!decode(uplink)) {
+        undecodable_++;
+        return 202;
+      }
+      decoded_++;
+      return 200;
+    }
+
+    void tick() {
+      sink_.tick();
+    }
+
+    std::string stats() const {
+      Record record;
+      record.field("received", received_).field("decoded", decoded_).field("duplicates", duplicates_);
+      record.field("malformed", malformed_).field("undecodable", undecodable_).field("ignored", ignored_);
+      record.field("records", records_).field("devices", dedup_.devices()).field("meters", rollups_.size());
+      record.field("batches", sink_.batches()).field("dropped", sink_.dropped());
+      return record.str();
+    }
+
+    uint64_t received() const {
+      return received_;
+    }
+
+  private:
+    std::string day_of(Uplink const &uplink) const {
+      /* 2024-05-01T12:00:00.123Z */
+      if (uplink.receivedAt.size() >= 10 && uplink.receivedAt[4] == '-' && uplink.receivedAt[7] == '-') {
+        return uplink.receivedAt.substr(0, 10);
+      }
+      return utc_day(time(NULL));
+    }
+
+    Record header(Uplink const &uplink, int meter) const {
+      Record record;
+      record.field("dev_eui", uplink.devEui).field("meter", meter).field("port", uplink.port);
+      if (uplink.hasFCnt) {
+        record.field("f_cnt", uplink.fCnt);
+      }
+      if (!uplink.receivedAt.empty()) {
+        record.field("received_at", uplink.receivedAt);
+      }
+      return record;
+    }
+
+    std::string meter_key(Uplink const &uplink, int meter) const {
+      return uplink.devEui + "/" + std::to_string(meter);
+    }
+
+    /* Energy register and rollups of one reading */
+    void emit_reading(Record &record, Uplink const &uplink, int meter, uint16_t power, uint32_t energy) {
+      bool knownEnergy = energy != ENERGY_UNKNOWN;
+      MeterRollup const &rollup = rollups_.add_reading(meter_key(uplink, meter), day_, knownEnergy ? energy : 0, power);
+      record.field("power_w", power);
+      if (knownEnergy) {
+        record.hundredths("energy_kwh", energy);
+      }
+      record.field("day", rollup.day);
+      if (rollup.dayStartEnergy >= 0) {
+        record.hundredths("day_kwh", rollup.lastEnergy - rollup.dayStartEnergy);
+      }
+      if (rollup.previousDay >= 0) {
+        record.hundredths("previous_day_kwh", rollup.previousDay);
+      }
+      if (rollup.firstEnergy >= 0) {
+        record.hundredths("since_first_kwh", rollup.lastEnergy - rollup.firstEnergy);
+      }
+      record.field("day_peak_w", rollup.peakPower);
+      sink_.add(record.str());
+      records_++;
+    }
+
+    bool decode(Uplink const &uplink) {
+      std::vector<uint8_t> const &p = uplink.payload;
+      switch (uplink.port) {
+        case 2: return decode_reading(uplink, p);
+        case 3: return decode_load_profile(uplink, p);
+        case 5: return decode_journal(uplink, p);
+        case 6: return decode_multi_meter(uplink, p);
+        case 7: return decode_diagnostic(uplink, p);
+        case 8: return decode_pulses(uplink, p);
+        default: return false;
+      }
+    }
+
+    /* 7 bytes: compact, 8 bytes: ESP32, 10 bytes: CubeCell, 24 bytes: with derived metrics */
+    bool decode_reading(Uplink const &uplink, std::vector<uint8_t> const &p) {
+      if (p.size() != 7 && p.size() != 8 && p.size() != 10 && p.size() != 24) {
+        return false;
+      }
+      Record record = header(uplink, 0);
+      record.field("battery_pct", p[6]);
+      if (p.size() == 8) {
+        record.field("counter", p[7]);
+      } else if (p.size() >= 10) {
+        record.field("battery_mv", u16(p, 7)).field("counter", p[9]);
+      }
+      if (p.size() == 24) {
+        record.field("average_w", u16(p, 10)).field("peak_w", u16(p, 12)).field("interval_min", u16(p, 14));
+        record.field("day_tariff_wh", u32(p, 16)).field("night_tariff_wh", u32(p, 20));
+      }
+      emit_reading(record, uplink, 0, u16(p, 0), u32(p, 2));
+      return true;
+    }
+
+    /* ESP32 between readouts: the port 2 reading from the test LED pulses, then the interval powers */
+    bool decode_pulses(Uplink const &uplink, std::vector<uint8_t> const &p) {
+      if (p.size() != 16) {
+        return false;
+      }
+      Record record = header(uplink, 0);
+      record.field("battery_pct", p[6]).field("counter", p[7]);
+      if (u16(p, 8) > 0) {
+        record.field("last_w", u16(p, 8));
+      }
+      if (u16(p, 10) > 0) {
+        record.field("peak_w", u16(p, 10));
+      }
+      record.field("interval_s", u16(p, 12)).field("pulses", u16(p, 14));
+      emit_reading(record, uplink, 0, u16(p, 0), u32(p, 2));
+      return true;
+    }
+
+    bool decode_load_profile(Uplink const &uplink, std::vector<uint8_t> const &p) {
+      if (p.size() < 8) {
+        return false;
+      }
+      uint32_t timestamp = u32(p, 0);
+      uint8_t interval = p[4], channels = p[5], count = p[6];
+      if (channels == 0 || p.size() < 8 + (size_t) count * channels * 2) {
+        return false;
+      }
+      for (uint8_t i = 0; i < count; i++) {
+        uint32_t minutes = timestamp + i * interval;
+        size_t offset = 8 + (size_t) i * channels * 2;
+        MeterRollup const &rollup = rollups_.add_profile(meter_key(uplink, 0), profile_day(minutes), u16(p, offset));
+        Record record = header(uplink, 0);
+        record.field("battery_pct", p[7]).field("profile_minutes", minutes).field("interval_min", interval);
+        for (uint8_t channel = 0; channel < channels; channel++) {
+          std::string key = "channel" + std::to_string(channel + 1) + "_wh";
+          record.field(key.c_str(), u16(p, offset + channel * 2));
+        }
+        record.field("profile_day", rollup.profileDay).field("profile_day_wh", rollup.profileWh);
+        sink_.add(record.str());
+        records_++;
+      }
+      return true;
+    }
+
+    bool decode_journal(Uplink const &uplink, std::vector<uint8_t> const &p) {
+      if (p.size() < 3 || p.size() < 3 + (size_t) p[0] * 8) {
+        return false;
+      }
+      for (uint8_t i = 0; i < p[0]; i++) {
+        size_t offset = 3 + (size_t) i * 8;
+        Record record = header(uplink, 0);
+        record.field("battery_pct", p[1]).field("counter", p[2]);
+        uint16_t age = u16(p, offset);
+        if (age != 0xFFFF) {
+          record.field("age_min", age);
+        }
+        emit_reading(record, uplink, 0, u16(p, offset + 2), u32(p, offset + 4));
+      }
+      return true;
+    }
+
+    bool decode_multi_meter(Uplink const &uplink, std::vector<uint8_t> const &p) {
+      if (p.size() < 3 || p.size() < 3 + (size_t) p[0] * 8) {
+        return false;
+      }
+      for (uint8_t i = 0; i < p[0]; i++) {
+        size_t offset = 3 + (size_t) i * 8;
+        /* reader status 2 = ok */
+        Record record = header(uplink, p[offset]);
+        record.field("battery_pct", p[1]).field("counter", p[2]).field("status", p[offset + 1]);
+        if (p[offset + 1] != 2) {
+          sink_.add(record.str());
+          records_++;
+          continue;
+        }
+        emit_reading(record, uplink, p[offset], u16(p, offset + 2), u32(p, offset + 4));
+      }
+      return true;
+    }
+
+    /* One record per capture once all of its fragments arrived, the telegram goes to a file of its own */
+    bool decode_diagnostic(Uplink const &uplink, std::vector<uint8_t> const &p) {
+      std::vector<uint8_t> telegram;
+      size_t fragments = 0;
+      Reassembler::Result result = reassembler_.add(uplink.devEui, p, telegram, fragments);
+      if (result == Reassembler::Incomplete) {
+        return true;
+      }
+      Record record = header(uplink, 0);
+      record.field("capture", p[0]).field("fragments", fragments);
+      if (result == Reassembler::Corrupt) {
+        record.field("status", "corrupt");
+      } else {
+        record.field("status", "complete").field("telegram_bytes", telegram.size());
+        std::string file = write_telegram(uplink, p[0], telegram);
+        if (!file.empty()) {
+          record.field("file", file);
+        }
+      }
+      sink_.add(record.str());
+      records_++;
+      return result == Reassembler::Complete;
+    }
+
+    /* <dir>/<dev eui>-<yyyymmddThhmmss>-<capture id>.txt, the raw bytes as the meter sent them */
+    std::string write_telegram(Uplink const &uplink, uint8_t capture, std::vector<uint8_t> const &telegram) const {
+      if (telegramDir_.empty()) {
+        return "";
+      }
+      time_t now = time(NULL);
+      struct tm tm;
+      gmtime_r(&now, &tm);
+      char stamp[24];
+      strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%S", &tm);
+      std::string path = telegramDir_ + "/" + uplink.devEui + "-" + stamp + "-" + std::to_string(capture) + ".txt";
+      FILE *file = fopen(path.c_str(), "wb");
+      if (file == NULL) {
+        fprintf(stderr, "cannot write %s: %s\n", path.c_str(), strerror(errno));
+        return "";
+      }
+      bool written = fwrite(telegram.data(), 1, telegram.size(), file) == telegram.size();
+      written = fclose(file) == 0 && written;
+      return written ? path : "";
+    }
+
+    BatchSink &sink_;
+    std::string telegramDir_;
+    Reassembler reassembler_;
+    Deduplicator dedup_;
+    Rollups rollups_;
+    std::string day_;
+    uint64_t received_ = 0, decoded_ = 0, duplicates_ = 0, malformed_ = 0, undecodable_ = 0, ignored_ = 0, records_ = 0;
+};
+
+/**********
+ * HTTP
+ **********/
+
+struct Connection {
+  int fd;
+  std::string in;
+  std::string out;
+  bool closeAfterWrite = false;
+};
+
+const char *status_text(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    default: return "Error";
+  }
+}
+
+void respond(Connection &connection, int status, std::string const &body = "") {
+  char head[160];
+  snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: %zu\r\nContent-Type: application/json\r\n%s\r\n", status,
+           status_text(status), body.size(), connection.closeAfterWrite ? "Connection: close\r\n" : "");
+  connection.out += head;
+  connection.out += body;
+}
+
+/* Handles every complete request in the input buffer, returns false on a protocol error */
+bool process_requests(Connection &connection, Ingest &ingest) {
+  while (true) {
+    size_t headerEnd = connection.in.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+      return connection.in.size() <= MAX_BODY_SIZE;
+    }
+    std::string head = connection.in.substr(0, headerEnd);
+    for (char &c : head) {
+      c = tolower((unsigned char) c);
+    }
+    size_t contentLength = 0;
+    size_t field = head.find("\r\ncontent-length:");
+    if (field != std::string::npos) {
+      contentLength = strtoul(head.c_str() + field + 17, NULL, 10);
+    }
+    if (head.find("\r\nconnection: close") != std::string::npos) {
+      connection.closeAfterWrite = true;
+    }
+    if (contentLength > MAX_BODY_SIZE) {
+      connection.closeAfterWrite = true;
+      respond(connection, 413);
+      return false;
+    }
+    if (connection.in.size() < headerEnd + 4 + contentLength) {
+      return true;
+    }
+    const char *body = connection.in.data() + headerEnd + 4;
+    if (head.compare(0, 5, "post ") == 0) {
+      respond(connection, ingest.handle(body, contentLength));
+    } else if (head.compare(0, 11, "get /stats ") == 0) {
+      respond(connection, 200, ingest.stats() + "\n");
+    } else {
+      respond(connection, head.compare(0, 4, "get ") == 0 ? 404 : 405);
+    }
+    connection.in.erase(0, headerEnd + 4 + contentLength);
+  }
+}
+
+volatile sig_atomic_t running = 1;
+
+void stop(int) {
+  running = 0;
+}
+
+int run_server(int port, Ingest &ingest, BatchSink &sink) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+    fprintf(stderr, "cannot listen on port %d: %s\n", port, strerror(errno));
+    return 1;
+  }
+  fcntl(listener, F_SETFL, O_NONBLOCK);
+  fprintf(stderr, "listening on 127.0.0.1:%d\n", port);
+
+  std::vector<Connection> connections;
+  std::vector<pollfd> fds;
+  char buffer[16384];
+  while (running) {
+    fds.clear();
+    fds.push_back({ listener, POLLIN, 0 });
+    for (Connection const &connection : connections) {
+      fds.push_back({ connection.fd, (short) (connection.out.empty() ? POLLIN : POLLOUT), 0 });
+    }
+    if (poll(fds.data(), fds.size(), 200) < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+    ingest.tick();
+
+    for (size_t i = fds.size() - 1; i >= 1; i--) {
+      Connection &connection = connections[i - 1];
+      bool keep = true;
+      if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        keep = false;
+      } else if (fds[i].revents & POLLIN) {
+        ssize_t n = read(connection.fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+          keep = false;
+        } else {
+          connection.in.append(buffer, n);
+          if (!process_requests(connection, ingest)) {
+            connection.closeAfterWrite = true;
+            connection.in.clear();
+          }
+        }
+      } else if (fds[i].revents & POLLOUT) {
+        ssize_t n = write(connection.fd, connection.out.data(), connection.out.size());
+        if (n <= 0) {
+          keep = false;
+        } else {
+          connection.out.erase(0, n);
+          keep = !connection.out.empty() || !connection.closeAfterWrite;
+        }
+      }
+      if (!keep) {
+        close(connection.fd);
+        connections.erase(connections.begin() + (i - 1));
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      int fd;
+      while ((fd = accept(listener, NULL, NULL)) >= 0) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        Connection connection;
+        connection.fd = fd;
+        connections.push_back(connection);
+      }
+    }
+  }
+
+  for (Connection const &connection : connections) {
+    close(connection.fd);
+  }
+  close(listener);
+  sink.flush();
+  fprintf(stderr, "%s\n", ingest.stats().c_str());
+  return 0;
+}
+
+/**********
+ * BENCHMARK
+ **********/
+
+std::string encode_base64(std::vector<uint8_t> const &data) {
+  static const char *const ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < data.size(); i += 3) {
+    uint32_t bits = data[i] << 16;
+    if (i + 1 < data.size()) bits |= data[i + 1] << 8;
+    if (i + 2 < data.size()) bits |= data[i + 2];
+    out += ALPHABET[(bits >> 18) & 0x3F];
+    out += ALPHABET[(bits >> 12) & 0x3F];
+    out += i + 1 < data.size() ? ALPHABET[(bits >> 6) & 0x3F] : '=';
+    out += i + 2 < data.size() ? ALPHABET[bits & 0x3F] : '=';
+  }
+  return out;
+}
+
+void put16(std::vector<uint8_t> &p, uint16_t value) {
+  p.push_back(value >> 8);
+  p.push_back(value & 0xFF);
+}
+
+void put32(std::vector<uint8_t> &p, uint32_t value) {
+  put16(p, value >> 16);
+  put16(p, value & 0xFFFF);
+}
+
+/* A TTN v3 webhook with the gateway metadata trimmed to what makes the size realistic */
+std::string synthetic_webhook(unsigned device, uint32_t fCnt, int port, std::vector<uint8_t> const &payload, unsigned gateways) {
+  char devEui[17];
+  snprintf(devEui, sizeof(devEui), "70B3D57ED%07X", device);
+  std::string json = "{\"end_device_ids\":{\"device_id\":\"meter-" + std::to_string(device) + "\",\"application_ids\":{\"application_id\":\"smart-meters\"},"
+                     "\"dev_eui\":\"" + devEui + "\",\"join_eui\":\"0000000000000000\",\"dev_addr\":\"260B1234\"},"
+                     "\"correlation_ids\":[\"as:up:01H\",\"rpc:/ttn.lorawan.v3.AppAs/SimulateUplink:1234\"],"
+                     "\"received_at\":\"2024-05-01T12:00:00.123456789Z\",\"uplink_message\":{\"session_key_id\":\"AYa1b2c3\","
+                     "\"f_port\":" + std::to_string(port) + ",\"f_cnt\":" + std::to_string(fCnt) + ",\"frm_payload\":\"" + encode_base64(payload) + "\","
+                     "\"rx_metadata\":[";
+  for (unsigned g = 0; g < gateways; g++) {
+    json += std::string(g > 0 ? "," : "") + "{\"gateway_ids\":{\"gateway_id\":\"gw-" + std::to_string(g) + "\",\"eui\":\"B827EBFFFE000000\"},"
+            "\"time\":\"2024-05-01T12:00:00Z\",\"timestamp\":123456789,\"rssi\":-97,\"channel_rssi\":-97,\"snr\":7.25,\"uplink_token\":\"ChIKEAoOZ3ctMBIIuCfr//4AAAA=\","
+            "\"received_at\":\"2024-05-01T12:00:00.100Z\"}";
+  }
+  json += "],\"settings\":{\"data_rate\":{\"lora\":{\"bandwidth\":125000,\"spreading_factor\":9,\"coding_rate\":\"4/5\"}},\"frequency\":\"868100000\"},"
+          "\"received_at\":\"2024-05-01T12:00:00.110Z\",\"consumed_airtime\":\"0.205824s\",\"network_ids\":{\"net_id\":\"000013\"}}}";
+  return json;
+}
+
+/* Mix of the firmware's uplinks from `devices` nodes, every uplink delivered by 1-3 gateways */
+std::vector<std::string> synthetic_uplinks(size_t count, unsigned devices) {
+  std::vector<std::string> uplinks;
+  uplinks.reserve(count);
+  uint32_t seed = 12345;
+  auto random = [&seed](uint32_t range) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % range;
+  };
+  std::vector<uint32_t> energy(devices, 1000000), fCnt(devices, 0);
+  while (uplinks.size() < count) {
+    unsigned device = random(devices);
+    std::vector<uint8_t> payload;
+    int port = 2;
+    uint32_t kind = random(100);
+    energy[device] += random(50);
+    if (kind < 70) {
+      put16(payload, random(5000));
+      put32(payload, energy[device]);
+      payload.push_back(80);
+      put16(payload, 3350);
+      payload.push_back(fCnt[device] & 0xFF);
+      if (kind < 35) {
+        put16(payload, random(3000));
+        put16(payload, random(6000));
+        put16(payload, 15);
+        put32(payload, energy[device] * 6);
+        put32(payload, energy[device] * 4);
+      }
+    } else if (kind < 85) {
+      port = 5;
+      payload.push_back(6);
+      payload.push_back(79);
+      payload.push_back(fCnt[device] & 0xFF);
+      for (int i = 0; i < 6; i++) {
+        put16(payload, (6 - i) * 15);
+        put16(payload, random(5000));
+        put32(payload, energy[device] - (6 - i) * 10);
+      }
+    } else if (kind < 95) {
+      port = 6;
+      payload.push_back(4);
+      payload.push_back(81);
+      payload.push_back(fCnt[device] & 0xFF);
+      for (int i = 0; i < 4; i++) {
+        payload.push_back(i);
+        payload.push_back(i == 3 && random(10) == 0 ? 3 : 2);
+        put16(payload, random(5000));
+        put32(payload, energy[device] + i * 100000);
+      }
+    } else {
+      port = 3;
+      put32(payload, 12700000 + fCnt[device] * 120);
+      payload.push_back(15);
+      payload.push_back(2);
+      payload.push_back(8);
+      payload.push_back(78);
+      for (int i = 0; i < 16; i++) {
+        put16(payload, random(400));
+      }
+    }
+    unsigned gateways = 1 + random(3);
+    std::string webhook = synthetic_webhook(device, fCnt[device]++, port, payload, gateways);
+    for (unsigned g = 0; g < gateways && uplinks.size() < count; g++) {
+      uplinks.push_back(webhook);
+    }
+  }
+  return uplinks;
+}
+
+int run_bench(size_t count, unsigned devices, std::string const &sinkTarget, size_t batchSize) {
+  fprintf(stderr, "generating %zu webhooks from %u devices...\n", count, devices);
+  std::vector<std::string> uplinks = synthetic_uplinks(count, devices);
+  size_t bytes = 0;
+  for (std::string const &uplink : uplinks) {
+    bytes += uplink.size();
+  }
+
+  BatchSink sink(sinkTarget, batchSize, 1000);
+  Ingest ingest(sink, "");
+  long long start = now_ms();
+  for (std::string const &uplink : uplinks) {
+    ingest.handle(uplink.data(), uplink.size());
+  }
+  sink.flush();
+  long long elapsed = now_ms() - start;
+  if (elapsed == 0) {
+    elapsed = 1;
+  }
+
+  printf("%zu webhooks (%.1f MB) in %lld ms: %.0f webhooks/s, %.1f us each\n", count, bytes / 1e6, elapsed,
+         count * 1000.0 / elapsed, elapsed * 1000.0 / count);
+  printf("%s\n", ingest.stats().c_str());
+  return 0;
+}
+
+void usage() {
+  fprintf(stderr,
+          "usage: ingest [--port N] [--sink HOST:PORT|FILE|-] [--batch N] [--flush-ms N] [--telegrams DIR]\n"
+          "       ingest --bench N [--devices N] [--sink ...] [--batch N]\n"
+          "  --port      local port of the webhook endpoint (default 8080)\n"
+          "  --sink      where the records go: TCP endpoint, file or - for stdout (default -)\n"
+          "  --batch     records per batch (default 100)\n"
+          "  --flush-ms  longest time a record waits for its batch (default 1000)\n"
+          "  --telegrams directory for the telegrams of the diagnostic captures (default: not kept)\n"
+          "  --bench     decode N synthetic webhooks and report the throughput (sink default /dev/null)\n"
+          "  --devices   number of synthetic nodes (default 500)\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+  int port = 8080;
+  std::string sinkTarget, telegramDir;
+  size_t batchSize = 100, bench = 0;
+  long long flushMs = 1000;
+  unsigned devices = 500;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+    const char *value = argv[++i];
+    if (arg == "--port") {
+      port = atoi(value);
+    } else if (arg == "--sink") {
+      sinkTarget = value;
+    } else if (arg == "--batch") {
+      batchSize = strtoul(value, NULL, 10);
+    } else if (arg == "--flush-ms") {
+      flushMs = atoll(value);
+    } else if (arg == "--bench") {
+      bench = strtoul(value, NULL, 10);
+    } else if (arg == "--devices") {
+      devices = strtoul(value, NULL, 10);
+    } else if (arg == "--telegrams") {
+      telegramDir = value;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (batchSize == 0 || devices == 0) {
+    usage();
+    return 2;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  if (bench > 0) {
+    return run_bench(bench, devices, sinkTarget.empty() ? "/dev/null" : sinkTarget, batchSize);
+  }
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  BatchSink sink(sinkTarget.empty() ? "-" : sinkTarget, batchSize, flushMs);
+  Ingest ingest(sink, telegramDir);
+  return run_server(port, ingest, sink);
+}
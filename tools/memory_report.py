@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Static RAM and flash usage per module of a firmware build.
+
+Reads the object files of a build directory (Arduino: --build-path, PlatformIO:
+.pio/build/<env>) and prints text/data/bss per module. Flash = text + data,
+RAM = data + bss (static only, heap and stack come on top).
+
+  python3 tools/memory_report.py --prefix arm-none-eabi- build/
+  python3 tools/memory_report.py --prefix arm-none-eabi- build/ --heap-free meter loadprofile
+  python3 tools/memory_report.py --save release.csv build/
+  python3 tools/memory_report.py --compare release.csv build/
+
+--heap-free fails (exit code 1) if one of the given modules references the heap
+(malloc & co. or operator new), --compare shows the difference to a saved report.
+"""
+
+import argparse
+import csv
+import os
+import subprocess
+import sys
+
+HEAP_SYMBOLS = {
+    "malloc", "calloc", "realloc", "free", "strdup",
+    "_Znwj", "_Znaj", "_Znwm", "_Znam",  # operator new / new[]
+    "_ZdlPv", "_ZdaPv",                  # operator delete / delete[]
+}
+
+
+def module_name(path):
+    name = os.path.basename(path)
+    for suffix in (".cpp.o", ".c.o", ".ino.o", ".S.o", ".o"):
+        if name.endswith(suffix):
+            return name[: -len(suffix)]
+    return name
+
+
+def find_objects(build_dir, include_framework):
+    objects = []
+    for root, _, files in os.walk(build_dir):
+        # the framework and the libraries of the board package are the same for every release
+        if not include_framework and ("core" in root.split(os.sep) or "FrameworkArduino" in root):
+            continue
+        for name in files:
+            if name.endswith(".o"):
+                objects.append(os.path.join(root, name))
+    return sorted(objects)
+
+
+def object_sizes(tool, path):
+    output = subprocess.check_output([tool, path], universal_newlines=True).splitlines()
+    text, data, bss = (int(value) for value in output[1].split()[:3])
+    return text, data, bss
+
+
+def heap_references(tool, path):
+    output = subprocess.check_output([tool, "-u", path], universal_newlines=True)
+    symbols = {line.split()[-1] for line in output.splitlines() if line.strip()}
+    return sorted(symbols & HEAP_SYMBOLS)
+
+
+def load_report(path):
+    with open(path, newline="") as file:
+        return {row["module"]: row for row in csv.DictReader(file)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("build_dir")
+    parser.add_argument("--prefix", default="", help="toolchain prefix, e.g. arm-none-eabi- or xtensa-esp32-elf-")
+    parser.add_argument("--heap-free", nargs="*", default=[], metavar="MODULE", help="modules that must not use the heap")
+    parser.add_argument("--framework", action="store_true", help="include the framework objects")
+    parser.add_argument("--save", metavar="CSV", help="save the report, e.g. as baseline of a release")
+    parser.add_argument("--compare", metavar="CSV", help="show the difference to a saved report")
+    args = parser.parse_args()
+
+    objects = find_objects(args.build_dir, args.framework)
+    if not objects:
+        sys.exit("no object files found in %s" % args.build_dir)
+
+    rows = []
+    violations = []
+    for path in objects:
+        module = module_name(path)
+        text, data, bss = object_sizes(args.prefix + "size", path)
+        rows.append({"module": module, "flash": text + data, "ram": data + bss, "text": text, "data": data, "bss": bss})
+        if module in args.heap_free:
+            heap = heap_references(args.prefix + "nm", path)
+            if heap:
+                violations.append((module, heap))
+
+    baseline = load_report(args.compare) if args.compare else {}
+    rows.sort(key=lambda row: row["ram"], reverse=True)
+    print("%-24s %8s %8s %8s %8s %8s" % ("module", "flash", "ram", "text", "data", "bss"))
+    for row in rows:
+        line = "%-24s %8d %8d %8d %8d %8d" % (row["module"], row["flash"], row["ram"], row["text"], row["data"], row["bss"])
+        if args.compare:
+            old = baseline.get(row["module"])
+            if old is None:
+                line += "   (new)"
+            else:
+                line += "   flash %+d, ram %+d" % (row["flash"] - int(old["flash"]), row["ram"] - int(old["ram"]))
+        print(line)
+    print("%-24s %8d %8d" % ("total", sum(row["flash"] for row in rows), sum(row["ram"] for row in rows)))
+
+    if args.save:
+        with open(args.save, "w", newline="") as file:
+            writer = csv.DictWriter(file, fieldnames=["module", "flash", "ram", "text", "data", "bss"])
+            writer.writeheader()
+            writer.writerows(rows)
+
+    missing = set(args.heap_free) - {row["module"] for row in rows}
+    for module in sorted(missing):
+        violations.append((module, ["object file not found"]))
+    for module, heap in violations:
+        print("%s must not use the heap: %s" % (module, ", ".join(heap)), file=sys.stderr)
+    return 1 if violations else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())